@@ -0,0 +1,159 @@
+/*
+* Headless benchmark runner.
+*
+* Runs the renderer without a window for a fixed number of frames so results
+* are repeatable. On machines without a GPU point the loader at lavapipe, e.g.
+*   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./LearnVulkanBench
+*/
+
+#include "Benchmark.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+struct BenchSuite
+{
+	const char* Name;
+	void(*Run)(const BenchOptions& Options, std::vector<BenchResult>& Results);
+};
+
+static const BenchSuite BenchSuites[] = {
+	{ "scenes", RunSceneSuite },
+	{ "capture", RunCaptureSuite },
+	{ "permutations", RunPermutationSuite },
+	{ "draws", RunDrawSuite },
+	{ "packets", RunPacketSuite },
+	{ "transforms", RunTransformSuite },
+	{ "hierarchy", RunHierarchySuite },
+	{ "lod", RunLodSuite },
+	{ "meshlets", RunMeshletSuite },
+	{ "occlusion", RunOcclusionSuite },
+	{ "softraster", RunSoftRasterSuite },
+	{ "softraster_compare", RunSoftCompareSuite },
+	{ "jobs", RunJobSuite },
+	{ "pipeline", RunPipelineSuite },
+	{ "dispatch", RunDispatchSuite },
+	{ "dynres", RunDynResSuite },
+	{ "overdraw", RunOverdrawSuite },
+	{ "cmdcache", RunCommandCacheSuite },
+	{ "particles", RunParticleSuite },
+	{ "lights", RunLightSuite },
+	{ "shadows", RunShadowSuite },
+};
+
+static void PrintUsage()
+{
+	std::cerr <<
+		"Usage: LearnVulkanBench [options]\n"
+		"  --suite <name|all>    Suite to run (default all)\n"
+		"  --scene <name>        Only run one scene or case of a suite\n"
+		"  --frames <n>          Measured frames per scene (default 300)\n"
+		"  --warmup <n>          Frames drawn before measuring (default 30)\n"
+		"  --size <w> <h>        Render size (default 1920 1080)\n"
+		"  --format <csv|json>   Output format (default csv)\n"
+		"  --out <file>          Write results to file instead of stdout\n"
+		"  --baseline <file>     Compare against a csv written by an earlier run\n"
+		"  --tolerance <f>       Allowed relative slowdown (default 0.10)\n"
+		"  --heatmaps <dir>      Write the overdraw suite's heatmaps to dir\n";
+	std::cerr << "Suites:";
+	for (auto& Suite : BenchSuites)
+		std::cerr << " " << Suite.Name;
+	std::cerr << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions Options;
+	std::string SuiteName = "all";
+	std::string Format = "csv";
+	std::string OutPath;
+	std::string BaselinePath;
+	double Tolerance = 0.10;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool HasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--suite") && HasValue)
+			SuiteName = argv[++i];
+		else if (!strcmp(argv[i], "--scene") && HasValue)
+			Options.Scene = argv[++i];
+		else if (!strcmp(argv[i], "--frames") && HasValue)
+			Options.Frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--warmup") && HasValue)
+			Options.WarmupFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--size") && i + 2 < argc)
+		{
+			Options.Width = atoi(argv[++i]);
+			Options.Height = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--format") && HasValue)
+			Format = argv[++i];
+		else if (!strcmp(argv[i], "--out") && HasValue)
+			OutPath = argv[++i];
+		else if (!strcmp(argv[i], "--baseline") && HasValue)
+			BaselinePath = argv[++i];
+		else if (!strcmp(argv[i], "--tolerance") && HasValue)
+			Tolerance = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--heatmaps") && HasValue)
+			Options.HeatmapDir = argv[++i];
+		else
+		{
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	if (Options.Frames == 0)
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	std::vector<BenchResult> Results;
+	bool Found = false;
+	for (auto& Suite : BenchSuites)
+	{
+		if (SuiteName != "all" && SuiteName != Suite.Name)
+			continue;
+		Found = true;
+		Suite.Run(Options, Results);
+	}
+	if (!Found)
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	std::ofstream OutFile;
+	if (!OutPath.empty())
+	{
+		OutFile.open(OutPath);
+		if (!OutFile)
+		{
+			std::cerr << "Could not open " << OutPath << std::endl;
+			return 2;
+		}
+	}
+	std::ostream& Out = OutPath.empty() ? std::cout : OutFile;
+	if (Format == "json")
+		WriteBenchJson(Out, Results);
+	else
+		WriteBenchCsv(Out, Results);
+
+	if (!BaselinePath.empty())
+	{
+		std::vector<BenchResult> Baseline;
+		if (!ReadBenchCsv(BaselinePath, Baseline))
+		{
+			std::cerr << "Could not read baseline " << BaselinePath << std::endl;
+			return 2;
+		}
+		int Regressions = CompareBenchBaseline(Results, Baseline, Tolerance, std::cerr);
+		std::cerr << Regressions << " regression(s) against " << BaselinePath << std::endl;
+		if (Regressions > 0)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,2175 @@
+#include "Benchmark.h"
+#include "FramePipeline.h"
+#include "Overdraw.h"
+#include "Renderer.h"
+#include "SoftRaster.h"
+#include <gtc/matrix_transform.hpp>
+#include <gtc/quaternion.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#endif
+
+const BenchMetric* BenchResult::Find(const std::string& Key) const
+{
+	for (auto& Metric : Metrics)
+	{
+		if (Metric.Key == Key)
+			return &Metric;
+	}
+	return nullptr;
+}
+
+double BenchPercentile(std::vector<double> Samples, double P)
+{
+	if (Samples.empty())
+		return 0.0;
+	std::sort(Samples.begin(), Samples.end());
+	size_t Rank = (size_t)std::ceil(P / 100.0 * Samples.size());
+	if (Rank > 0)
+		Rank--;
+	return Samples[std::min(Rank, Samples.size() - 1)];
+}
+
+double BenchMean(const std::vector<double>& Samples)
+{
+	if (Samples.empty())
+		return 0.0;
+	double Sum = 0.0;
+	for (auto Sample : Samples)
+		Sum += Sample;
+	return Sum / Samples.size();
+}
+
+#ifdef _WIN32
+double BenchResidentMB()
+{
+	PROCESS_MEMORY_COUNTERS Counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters));
+	return Counters.WorkingSetSize / (1024.0 * 1024.0);
+}
+
+double BenchPeakResidentMB()
+{
+	PROCESS_MEMORY_COUNTERS Counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters));
+	return Counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+}
+#else
+// Reads a "Key:   1234 kB" line from /proc/self/status.
+static double ReadProcStatusMB(const char* Key)
+{
+	std::ifstream Status("/proc/self/status");
+	std::string Line;
+	while (std::getline(Status, Line))
+	{
+		if (Line.compare(0, strlen(Key), Key) == 0)
+		{
+			std::istringstream Fields(Line.substr(strlen(Key)));
+			double KiloBytes = 0.0;
+			Fields >> KiloBytes;
+			return KiloBytes / 1024.0;
+		}
+	}
+	return 0.0;
+}
+
+double BenchResidentMB()
+{
+	return ReadProcStatusMB("VmRSS:");
+}
+
+double BenchPeakResidentMB()
+{
+	return ReadProcStatusMB("VmHWM:");
+}
+#endif
+
+void BenchAddFrameTimes(BenchResult& Result, const std::vector<double>& FrameTimes)
+{
+	double Mean = BenchMean(FrameTimes);
+	Result.Add("fps", Mean > 0.0 ? 1.0 / Mean : 0.0);
+	Result.Add("frame_mean_ms", Mean * 1000.0);
+	Result.Add("frame_p50_ms", BenchPercentile(FrameTimes, 50.0) * 1000.0);
+	Result.Add("frame_p95_ms", BenchPercentile(FrameTimes, 95.0) * 1000.0);
+	Result.Add("frame_p99_ms", BenchPercentile(FrameTimes, 99.0) * 1000.0);
+}
+
+void BenchAddGpuMemory(BenchResult& Result, Renderer& Rend)
+{
+	const double MB = 1024.0 * 1024.0;
+	Result.Add("gpu_mem_mb", Rend.GpuMemory.GetTotalUsed() / MB);
+	Result.Add("gpu_mem_peak_mb", Rend.GpuMemory.GetTotalPeak() / MB);
+	for (int i = 0; i < (int)MemoryCategory::Count; i++)
+	{
+		MemoryCounter Counter = Rend.GpuMemory.GetCategoryUsage((MemoryCategory)i);
+		if (Counter.Peak > 0)
+			Result.Add(std::string("gpu_") + MemoryCategoryName((MemoryCategory)i) + "_mb", Counter.Current / MB);
+	}
+}
+
+/*
+* Scene suite. Each scene gets a fresh headless renderer so runs do not
+* influence each other.
+*/
+struct BenchScene
+{
+	const char* Name;
+	uint32_t Instances;
+	uint32_t Pipelines;
+	// Replace the vertex buffer, uniform buffer and pipeline every frame, while the
+	// previous frame is still on the GPU.
+	bool Churn;
+};
+
+static const BenchScene BenchScenes[] = {
+	{ "single_cube", 1, 0, false },
+	{ "instances_10k", 10000, 0, false },
+	{ "instances_100k", 100000, 0, false },
+	{ "many_pipelines", 1, 256, false },
+	{ "resource_churn", 1, 0, true },
+};
+
+static BenchResult RunScene(const BenchScene& Scene, const BenchOptions& Options)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InstanceCount = Scene.Instances;
+	Rend.UpdateUniformBuffer();
+	Rend.InitScenePipelines(Scene.Pipelines);
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> RecordTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		if (Scene.Churn)
+		{
+			Rend.ReplaceVertexBuffer(g_vb_solid_face_colors_Data,
+				sizeof(g_vb_solid_face_colors_Data),
+				sizeof(g_vb_solid_face_colors_Data[0]), false);
+			Rend.ReplaceGraphicsPipeline(true, true);
+			Rend.ReplaceUniformBuffer();
+		}
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		RecordTimes[i] = Rend.LastRecordTime;
+	}
+
+	BenchResult Result;
+	Result.Suite = "scenes";
+	Result.Name = Scene.Name;
+	Result.Add("frames", Options.Frames);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Result.Add("record_mean_ms", BenchMean(RecordTimes) * 1000.0);
+	Result.Add("record_p99_ms", BenchPercentile(RecordTimes, 99.0) * 1000.0);
+	// Replacing never has to wait for the GPU, the pool has room for the retired sets.
+	if (Scene.Churn)
+		Result.Add("descriptor_pool_stalls", (double)Rend.DescriptorPoolStalls);
+	Result.Add("rss_mb", BenchResidentMB());
+	Result.Add("rss_peak_mb", BenchPeakResidentMB());
+	BenchAddGpuMemory(Result, Rend);
+	return Result;
+}
+
+void RunSceneSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Scene : BenchScenes)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Scene.Name)
+			continue;
+		std::cerr << "[scenes] " << Scene.Name << std::endl;
+		Results.push_back(RunScene(Scene, Options));
+	}
+}
+
+/*
+* Capture suite. Draws the single cube with and without the readback ring. The
+* consumer checksums every byte, which stands in for handing the frame to an encoder.
+*/
+static BenchResult RunCapture(const char* Name, uint32_t Slots, const BenchOptions& Options)
+{
+	Renderer Rend(Options.Width, Options.Height);
+
+	volatile uint32_t Checksum = 0;
+	if (Slots > 0)
+	{
+		Rend.InitReadback(Slots, [&Checksum](const ReadbackFrame& Frame) {
+			uint32_t Sum = 0;
+			const uint32_t* Pixels = (const uint32_t*)Frame.Pixels;
+			for (uint32_t i = 0; i < Frame.Width * Frame.Height; i++)
+				Sum += Pixels[i];
+			Checksum = Checksum + Sum;
+		});
+	}
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+	if (Rend.Readback)
+	{
+		Rend.Readback->Flush();
+		Rend.Readback->ResetStats();
+	}
+
+	std::vector<double> FrameTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+	}
+
+	BenchResult Result;
+	Result.Suite = "capture";
+	Result.Name = Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("slots", Slots);
+	BenchAddFrameTimes(Result, FrameTimes);
+	if (Rend.Readback)
+	{
+		Rend.Readback->Flush();
+		ReadbackStats Stats = Rend.Readback->GetStats();
+		Result.Add("captured", (double)Stats.CapturedFrames);
+		Result.Add("capture_fps", Stats.CaptureFps);
+		Result.Add("latency_mean_ms", Stats.MeanLatency * 1000.0);
+		Result.Add("latency_max_ms", Stats.MaxLatency * 1000.0);
+		Result.Add("stalls", (double)Stats.Stalls);
+		Result.Add("stall_total_ms", Stats.StallTime * 1000.0);
+	}
+	return Result;
+}
+
+void RunCaptureSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	std::cerr << "[capture] off" << std::endl;
+	Results.push_back(RunCapture("capture_off", 0, Options));
+	std::cerr << "[capture] ring of 3" << std::endl;
+	Results.push_back(RunCapture("capture_ring3", 3, Options));
+}
+
+/*
+* Permutation suite. Precompiles every cube shader permutation and compares the
+* glslang compiles that took with what one compile per permutation would need, then
+* draws 10k instances switching to the next permutation every frame.
+*/
+void RunPermutationSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	std::cerr << "[permutations] precompile" << std::endl;
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	bool Succeeded = Permutations.Precompile();
+	double PrecompileTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+	BenchResult Precompile;
+	Precompile.Suite = "permutations";
+	Precompile.Name = "precompile";
+	Precompile.Add("permutations", Permutations.GetPermutationCount());
+	Precompile.Add("variants", Permutations.GetVariantCount());
+	Precompile.Add("compiles", Permutations.GetCompileCount());
+	Precompile.Add("compiles_without_specialization", Permutations.GetPermutationCount() * 2.0);
+	Precompile.Add("pipelines", Permutations.GetPipelineCount());
+	Precompile.Add("failed", Succeeded ? 0.0 : 1.0);
+	Precompile.Add("precompile_ms", PrecompileTime * 1000.0);
+	Precompile.Add("per_permutation_ms", PrecompileTime * 1000.0 / Permutations.GetPermutationCount());
+	Results.push_back(Precompile);
+
+	std::cerr << "[permutations] switching" << std::endl;
+	// The other DRAW_DATA values need their own draw path, the draw suite covers those.
+	std::vector<uint32_t> Switched;
+	uint32_t DrawDataFeature = Permutations.FindFeature("DRAW_DATA");
+	for (uint32_t i = 0; i < Permutations.GetPermutationCount(); i++)
+	{
+		if (Permutations.GetFeatureValue(i, DrawDataFeature) == (uint32_t)DrawDataPath::PushConstants)
+			Switched.push_back(i);
+	}
+
+	Rend.InstanceCount = 10000;
+	Rend.UpdateUniformBuffer();
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+	{
+		Rend.UsePermutation(Switched[i % Switched.size()]);
+		Rend.DrawCube();
+	}
+
+	std::vector<double> FrameTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+		Rend.UsePermutation(Switched[i % Switched.size()]);
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - FrameStart).count();
+	}
+
+	BenchResult Switching;
+	Switching.Suite = "permutations";
+	Switching.Name = "switching_10k";
+	Switching.Add("frames", Options.Frames);
+	Switching.Add("permutations", (double)Switched.size());
+	BenchAddFrameTimes(Switching, FrameTimes);
+	Results.push_back(Switching);
+}
+
+// Same grid the instanced scenes use, but every cell is its own object.
+static void BenchMakeGridDraws(Renderer& Rend, uint32_t Objects)
+{
+	uint32_t Side = (uint32_t)std::ceil(std::sqrt((float)Objects));
+	float Spacing = 20.0f / Side;
+	Rend.Draws.resize(Objects);
+	for (uint32_t i = 0; i < Objects; i++)
+	{
+		glm::vec3 Cell((float)(i % Side), 0.0f, (float)(i / Side));
+		Cell -= glm::vec3(Side - 1.0f, 0.0f, Side - 1.0f) * 0.5f;
+		DrawData& Draw = Rend.Draws[i];
+		Draw.Model = glm::scale(glm::translate(glm::mat4(1.0f), Cell * Spacing), glm::vec3(Spacing * 0.4f));
+		Draw.ObjectId = i;
+		Draw.MaterialIndex = i % 16;
+	}
+}
+
+/*
+* Draw suite. Many separate objects, each its own draw with its own transform,
+* fed through push constants, a dynamic uniform buffer offset or the bindless table.
+* The bindless cases are skipped on devices without descriptor indexing.
+*/
+struct BenchDrawCase
+{
+	const char* Name;
+	uint32_t Objects;
+	DrawDataPath Path;
+};
+
+static const BenchDrawCase BenchDrawCases[] = {
+	{ "push_1k", 1000, DrawDataPath::PushConstants },
+	{ "descriptor_1k", 1000, DrawDataPath::Descriptors },
+	{ "bindless_1k", 1000, DrawDataPath::Bindless },
+	{ "push_10k", 10000, DrawDataPath::PushConstants },
+	{ "descriptor_10k", 10000, DrawDataPath::Descriptors },
+	{ "bindless_10k", 10000, DrawDataPath::Bindless },
+	{ "push_100k", 100000, DrawDataPath::PushConstants },
+	{ "descriptor_100k", 100000, DrawDataPath::Descriptors },
+	{ "bindless_100k", 100000, DrawDataPath::Bindless },
+};
+
+static void RunDrawCase(const BenchDrawCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	if (Case.Path == DrawDataPath::Bindless && !Rend.Bindless.IsEnabled())
+	{
+		std::cerr << "[draws] " << Case.Name << " skipped, no descriptor indexing" << std::endl;
+		return;
+	}
+	BenchMakeGridDraws(Rend, Case.Objects);
+
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+	std::vector<uint32_t> Values(Permutations.GetFeatureCount(), 0);
+	Values[Permutations.FindFeature("INSTANCE_GRID")] = 1;
+	Values[Permutations.FindFeature("DRAW_DATA")] = (uint32_t)Case.Path;
+	Rend.UsePermutation(Permutations.MakePermutation(Values));
+
+	Rend.DrawPath = Case.Path;
+	if (Case.Path != DrawDataPath::PushConstants)
+		Rend.InitObjectBuffer(Case.Objects);
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> RecordTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		RecordTimes[i] = Rend.LastRecordTime;
+	}
+
+	BenchResult Result;
+	Result.Suite = "draws";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Case.Objects);
+	BenchAddFrameTimes(Result, FrameTimes);
+	double RecordMean = BenchMean(RecordTimes);
+	Result.Add("record_mean_ms", RecordMean * 1000.0);
+	Result.Add("record_p99_ms", BenchPercentile(RecordTimes, 99.0) * 1000.0);
+	Result.Add("draws_per_sec", RecordMean > 0.0 ? Case.Objects / RecordMean : 0.0);
+	Results.push_back(Result);
+}
+
+void RunDrawSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchDrawCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[draws] " << Case.Name << std::endl;
+		RunDrawCase(Case, Options, Results);
+	}
+}
+
+/*
+* Packet suite. 100k draws spread over 16 pipelines, 32 materials and 4 vertex
+* buffers in an order that changes state almost every draw. The tables repeat the
+* renderer's objects, the walk only compares key indices so the bind pattern is the
+* same as with distinct ones.
+*/
+struct BenchPacketCase
+{
+	const char* Name;
+	bool Sort;
+	bool SkipRedundant;
+};
+
+static const BenchPacketCase BenchPacketCases[] = {
+	{ "naive_100k", false, false },
+	{ "unsorted_skip_100k", false, true },
+	{ "sorted_100k", true, true },
+};
+
+static BenchResult RunPacketCase(const BenchPacketCase& Case, const BenchOptions& Options)
+{
+	const uint32_t Objects = 100000;
+	const uint32_t PipelineCount = 16;
+	const uint32_t MaterialCount = 32;
+	const uint32_t VertexBufferCount = 4;
+
+	Renderer Rend(Options.Width, Options.Height);
+	BenchMakeGridDraws(Rend, Objects);
+	Rend.InitScenePipelines(PipelineCount);
+	Rend.PacketTables.Pipelines = Rend.ScenePipelines;
+	Rend.PacketTables.Materials.assign(MaterialCount, Rend.DescriptorSet[0]);
+	Rend.PacketTables.VertexBuffers.assign(VertexBufferCount, Rend.VertexBuffer);
+	Rend.SkipRedundantBinds = Case.SkipRedundant;
+
+	// Fixed per object state, the depth is the distance to the camera.
+	std::vector<uint64_t> Keys(Objects);
+	glm::vec3 Eye = glm::vec3(glm::inverse(Rend.View)[3]);
+	for (uint32_t i = 0; i < Objects; i++)
+	{
+		uint32_t Hash = i * 2654435761u;
+		float Depth = glm::length(glm::vec3(Rend.Model * Rend.Draws[i].Model[3]) - Eye);
+		Keys[i] = MakeDrawKey(0, (Hash >> 8) % PipelineCount, (Hash >> 16) % MaterialCount,
+			i % VertexBufferCount, QuantizeDrawDepth(Depth, 0.1f, 100.0f));
+	}
+
+	std::vector<double> FrameTimes, SubmitTimes, SortTimes, RecordTimes;
+	for (uint32_t i = 0; i < Options.WarmupFrames + Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.Packets.Clear();
+		Rend.Packets.Reserve(Objects);
+		for (uint32_t Object = 0; Object < Objects; Object++)
+			Rend.Packets.Submit(Keys[Object], Object);
+		auto Submitted = std::chrono::high_resolution_clock::now();
+		if (Case.Sort)
+			Rend.Packets.Sort();
+		auto Sorted = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		auto End = std::chrono::high_resolution_clock::now();
+
+		if (i < Options.WarmupFrames)
+			continue;
+		FrameTimes.push_back(std::chrono::duration<double>(End - Start).count());
+		SubmitTimes.push_back(std::chrono::duration<double>(Submitted - Start).count());
+		SortTimes.push_back(std::chrono::duration<double>(Sorted - Submitted).count());
+		RecordTimes.push_back(Rend.LastRecordTime);
+	}
+
+	const DrawPacketStats& Stats = Rend.Packets.GetStats();
+	uint32_t Binds = Stats.PipelineBinds + Stats.MaterialBinds + Stats.VertexBufferBinds;
+	double Cpu = BenchMean(SubmitTimes) + BenchMean(SortTimes) + BenchMean(RecordTimes);
+
+	BenchResult Result;
+	Result.Suite = "packets";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("draws", Stats.Draws);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Result.Add("submit_mean_ms", BenchMean(SubmitTimes) * 1000.0);
+	Result.Add("sort_mean_ms", BenchMean(SortTimes) * 1000.0);
+	Result.Add("record_mean_ms", BenchMean(RecordTimes) * 1000.0);
+	Result.Add("cpu_per_100k_draws_ms", Cpu * 1000.0 * 100000.0 / Objects);
+	Result.Add("pipeline_binds", Stats.PipelineBinds);
+	Result.Add("material_binds", Stats.MaterialBinds);
+	Result.Add("vertex_buffer_binds", Stats.VertexBufferBinds);
+	Result.Add("binds", Binds);
+	Result.Add("binds_eliminated", Stats.NaiveBinds - Binds);
+	return Result;
+}
+
+void RunPacketSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchPacketCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[packets] " << Case.Name << std::endl;
+		Results.push_back(RunPacketCase(Case, Options));
+	}
+}
+
+/*
+* Transform suite. Builds 256k matrices from SoA position/rotation/scale with glm
+* and with every SIMD level the CPU has: TRS only, TRS premultiplied by the view
+* projection, and plain mat4 * mat4. The mapped cases write TRS into the renderer's
+* host visible ObjectBuffer, glm through a copy and the kernels directly.
+*/
+enum class BenchTransformKernel
+{
+	TRS,
+	MVP,
+	Mat4,
+	Mapped
+};
+
+static const char* const BenchTransformKernelNames[] = { "trs", "mvp", "mat4", "mapped" };
+
+struct BenchTransformInput
+{
+	std::vector<float> Arrays[10];
+	std::vector<glm::mat4> Matrices;
+	TransformSoA SoA;
+};
+
+static void BenchMakeTransforms(BenchTransformInput& Input, uint32_t Count)
+{
+	for (auto& Array : Input.Arrays)
+		Array.resize(Count);
+	Input.Matrices.resize(Count);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		float T = (float)i;
+		glm::quat Rotation = glm::angleAxis(T * 0.01f, glm::normalize(glm::vec3(std::sin(T), 1.0f, std::cos(T))));
+		float Values[10] = { std::sin(T) * 10.0f, T * 0.001f, std::cos(T) * 10.0f,
+			Rotation.x, Rotation.y, Rotation.z, Rotation.w, 1.0f, 1.0f + (i % 3), 0.5f };
+		for (int Array = 0; Array < 10; Array++)
+			Input.Arrays[Array][i] = Values[Array];
+		Input.Matrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3(Values[0], Values[1], Values[2]));
+	}
+	TransformSoA& SoA = Input.SoA;
+	SoA.PositionX = Input.Arrays[0].data();
+	SoA.PositionY = Input.Arrays[1].data();
+	SoA.PositionZ = Input.Arrays[2].data();
+	SoA.RotationX = Input.Arrays[3].data();
+	SoA.RotationY = Input.Arrays[4].data();
+	SoA.RotationZ = Input.Arrays[5].data();
+	SoA.RotationW = Input.Arrays[6].data();
+	SoA.ScaleX = Input.Arrays[7].data();
+	SoA.ScaleY = Input.Arrays[8].data();
+	SoA.ScaleZ = Input.Arrays[9].data();
+}
+
+static glm::mat4 BenchComposeGlm(const TransformSoA& In, uint32_t i)
+{
+	glm::quat Rotation(In.RotationW[i], In.RotationX[i], In.RotationY[i], In.RotationZ[i]);
+	return glm::translate(glm::mat4(1.0f), glm::vec3(In.PositionX[i], In.PositionY[i], In.PositionZ[i])) *
+		glm::mat4_cast(Rotation) *
+		glm::scale(glm::mat4(1.0f), glm::vec3(In.ScaleX[i], In.ScaleY[i], In.ScaleZ[i]));
+}
+
+// Level < 0 is glm.
+static BenchResult RunTransformCase(BenchTransformKernel Kernel, int Level, const std::string& Name,
+	const BenchTransformInput& Input, const BenchOptions& Options)
+{
+	const uint32_t Count = (uint32_t)Input.Matrices.size();
+	Renderer* Rend = nullptr;
+	std::vector<glm::mat4> Output(Count);
+	TransformOutput Out;
+	Out.Data = Output.data();
+	if (Kernel == BenchTransformKernel::Mapped)
+	{
+		Rend = new Renderer(Options.Width, Options.Height);
+		Rend->DrawPath = DrawDataPath::Descriptors;
+		Rend->InitObjectBuffer(Count);
+		Out.Data = Rend->ObjectData;
+		Out.Stride = Rend->ObjectStride;
+		Out.Stream = true;
+	}
+	if (Level >= 0)
+		SetSimdLevel((SimdLevel)Level);
+
+	glm::mat4 ViewProjection = Rend ? Rend->Projection * Rend->View : glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	const float* VP = &ViewProjection[0][0];
+	std::vector<double> Times;
+	for (uint32_t Iteration = 0; Iteration < Options.WarmupFrames + Options.Frames; Iteration++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		if (Level >= 0)
+		{
+			switch (Kernel)
+			{
+			case BenchTransformKernel::MVP: ComposeMVP(VP, Input.SoA, Count, Out); break;
+			case BenchTransformKernel::Mat4: MultiplyMat4(VP, 0, &Input.Matrices[0][0][0], Count, Out); break;
+			default: ComposeTRS(Input.SoA, Count, Out); break;
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				switch (Kernel)
+				{
+				case BenchTransformKernel::MVP: Output[i] = ViewProjection * BenchComposeGlm(Input.SoA, i); break;
+				case BenchTransformKernel::Mat4: Output[i] = ViewProjection * Input.Matrices[i]; break;
+				default: Output[i] = BenchComposeGlm(Input.SoA, i); break;
+				}
+			}
+			if (Rend)
+			{
+				for (uint32_t i = 0; i < Count; i++)
+					memcpy(Rend->ObjectData + (size_t)i * Rend->ObjectStride, &Output[i], sizeof(glm::mat4));
+			}
+		}
+		auto End = std::chrono::high_resolution_clock::now();
+		if (Iteration >= Options.WarmupFrames)
+			Times.push_back(std::chrono::duration<double>(End - Start).count());
+	}
+	SetSimdLevel(DetectSimdLevel());
+	delete Rend;
+
+	double Mean = BenchMean(Times);
+	double BytesIn = Kernel == BenchTransformKernel::Mat4 ? sizeof(glm::mat4) : sizeof(float) * 10;
+	double BytesOut = sizeof(glm::mat4);
+
+	BenchResult Result;
+	Result.Suite = "transforms";
+	Result.Name = Name;
+	Result.Add("iterations", Options.Frames);
+	Result.Add("matrices", Count);
+	Result.Add("batch_mean_ms", Mean * 1000.0);
+	Result.Add("batch_p99_ms", BenchPercentile(Times, 99.0) * 1000.0);
+	Result.Add("matrices_per_sec", Count / Mean);
+	Result.Add("write_gb_per_sec", Count * BytesOut / Mean / 1e9);
+	Result.Add("bandwidth_gb_per_sec", Count * (BytesIn + BytesOut) / Mean / 1e9);
+	return Result;
+}
+
+void RunTransformSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	BenchTransformInput Input;
+	BenchMakeTransforms(Input, 256 * 1024);
+
+	int Detected = (int)DetectSimdLevel();
+	for (int Kernel = 0; Kernel < 4; Kernel++)
+	{
+		for (int Level = -1; Level <= Detected; Level++)
+		{
+			// The mapped cases only compare glm against the best kernel.
+			if (Kernel == (int)BenchTransformKernel::Mapped && Level >= 0 && Level != Detected)
+				continue;
+			std::string Name = std::string(BenchTransformKernelNames[Kernel]) + "_" +
+				(Level < 0 ? "glm" : SimdLevelName((SimdLevel)Level));
+			if (!Options.Scene.empty() && Options.Scene != Name)
+				continue;
+			std::cerr << "[transforms] " << Name << std::endl;
+			Results.push_back(RunTransformCase((BenchTransformKernel)Kernel, Level, Name, Input, Options));
+		}
+	}
+}
+
+/*
+* Hierarchy suite. 1M nodes, one root with three levels of 100 children below it.
+* Every frame either nothing moves, 1000 leaves and 10 of the nodes above them move,
+* or the root moves and the whole tree has to be recomputed.
+*/
+struct BenchHierarchyCase
+{
+	const char* Name;
+	uint32_t MovedLeaves;
+	uint32_t MovedParents;
+	bool MoveRoot;
+};
+
+static const BenchHierarchyCase BenchHierarchyCases[] = {
+	{ "static_1m", 0, 0, false },
+	{ "sparse_1m", 1000, 10, false },
+	{ "full_1m", 0, 0, true },
+};
+
+static BenchResult RunHierarchyCase(const BenchHierarchyCase& Case, const BenchOptions& Options)
+{
+	const uint32_t Fanout = 100;
+	SceneHierarchy Scene;
+	Scene.Reserve(1 + Fanout + Fanout * Fanout + Fanout * Fanout * Fanout);
+	SceneNode Root = Scene.AddNode(SceneNoParent, glm::vec3(0.0f));
+	std::vector<SceneNode> Parents, Leaves;
+	for (uint32_t a = 0; a < Fanout; a++)
+	{
+		SceneNode A = Scene.AddNode(Root, glm::vec3((float)a, 0.0f, 0.0f));
+		for (uint32_t b = 0; b < Fanout; b++)
+		{
+			SceneNode B = Scene.AddNode(A, glm::vec3(0.0f, (float)b, 0.0f), glm::angleAxis(0.1f * b, glm::vec3(0.0f, 1.0f, 0.0f)));
+			Parents.push_back(B);
+			for (uint32_t c = 0; c < Fanout; c++)
+				Leaves.push_back(Scene.AddNode(B, glm::vec3(0.0f, 0.0f, (float)c), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.5f)));
+		}
+	}
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	Scene.Update();
+	double BuildTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+	std::vector<double> UpdateTimes;
+	uint32_t Seed = 1;
+	double NodesUpdated = 0.0;
+	for (uint32_t i = 0; i < Options.WarmupFrames + Options.Frames; i++)
+	{
+		float T = (float)i * 0.01f;
+		for (uint32_t Moved = 0; Moved < Case.MovedLeaves; Moved++)
+		{
+			Seed = Seed * 1664525u + 1013904223u;
+			Scene.SetPosition(Leaves[Seed % Leaves.size()], glm::vec3(std::sin(T), 0.0f, (float)Moved));
+		}
+		for (uint32_t Moved = 0; Moved < Case.MovedParents; Moved++)
+		{
+			Seed = Seed * 1664525u + 1013904223u;
+			Scene.SetRotation(Parents[Seed % Parents.size()], glm::angleAxis(T, glm::vec3(0.0f, 1.0f, 0.0f)));
+		}
+		if (Case.MoveRoot)
+			Scene.SetPosition(Root, glm::vec3(0.0f, std::sin(T), 0.0f));
+
+		auto UpdateStart = std::chrono::high_resolution_clock::now();
+		Scene.Update();
+		auto UpdateEnd = std::chrono::high_resolution_clock::now();
+		if (i < Options.WarmupFrames)
+			continue;
+		UpdateTimes.push_back(std::chrono::duration<double>(UpdateEnd - UpdateStart).count());
+		NodesUpdated += Scene.GetStats().NodesUpdated;
+	}
+
+	double Mean = BenchMean(UpdateTimes);
+	BenchResult Result;
+	Result.Suite = "hierarchy";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("nodes", Scene.GetNodeCount());
+	Result.Add("levels", Scene.GetLevelCount());
+	Result.Add("build_ms", BuildTime * 1000.0);
+	Result.Add("update_mean_ms", Mean * 1000.0);
+	Result.Add("update_p99_ms", BenchPercentile(UpdateTimes, 99.0) * 1000.0);
+	Result.Add("nodes_updated", NodesUpdated / Options.Frames);
+	Result.Add("nodes_per_sec", Mean > 0.0 ? NodesUpdated / Options.Frames / Mean : 0.0);
+	return Result;
+}
+
+void RunHierarchySuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchHierarchyCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[hierarchy] " << Case.Name << std::endl;
+		Results.push_back(RunHierarchyCase(Case, Options));
+	}
+}
+
+/*
+* LOD suite. A 10k object grid of an 80k triangle lumpy sphere, the chain built on a
+* worker with BuildMeshLodsAsync, drawn with every object at full detail and with the
+* level picked by screen-space error.
+*/
+struct BenchLodCase
+{
+	const char* Name;
+	bool UseLods;
+};
+
+static const BenchLodCase BenchLodCases[] = {
+	{ "lod_off", false },
+	{ "lod_on", true },
+};
+
+// UV sphere with bumps, rings and segments share their first and last vertex so there is a seam.
+static void BenchMakeLodMesh(uint32_t Rings, uint32_t Segments, std::vector<Vertex>& Vertices, std::vector<uint32_t>& Indices)
+{
+	const float Pi = 3.14159265f;
+	for (uint32_t r = 0; r <= Rings; r++)
+	{
+		float Theta = Pi * r / Rings;
+		for (uint32_t s = 0; s <= Segments; s++)
+		{
+			float Phi = 2.0f * Pi * s / Segments;
+			float Radius = 1.0f + 0.05f * std::sin(7.0f * Theta) * std::cos(5.0f * Phi);
+			float X = std::sin(Theta) * std::cos(Phi), Y = std::cos(Theta), Z = std::sin(Theta) * std::sin(Phi);
+			Vertices.push_back({ X * Radius, Y * Radius, Z * Radius, 1.0f, X * 0.5f + 0.5f, Y * 0.5f + 0.5f, Z * 0.5f + 0.5f, 1.0f });
+		}
+	}
+	for (uint32_t r = 0; r < Rings; r++)
+	{
+		for (uint32_t s = 0; s < Segments; s++)
+		{
+			uint32_t A = r * (Segments + 1) + s, B = A + Segments + 1;
+			if (r != 0)
+				Indices.insert(Indices.end(), { A, B, A + 1 });
+			if (r != Rings - 1)
+				Indices.insert(Indices.end(), { A + 1, B, B + 1 });
+		}
+	}
+}
+
+static BenchResult RunLodCase(const BenchLodCase& Case, const BenchOptions& Options)
+{
+	const uint32_t Objects = 10000;
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+	BenchMakeLodMesh(160, 256, Vertices, Indices);
+	std::vector<float> Positions(Vertices.size() * 3);
+	for (size_t i = 0; i < Vertices.size(); i++)
+	{
+		Positions[i * 3 + 0] = Vertices[i].posX;
+		Positions[i * 3 + 1] = Vertices[i].posY;
+		Positions[i * 3 + 2] = Vertices[i].posZ;
+	}
+
+	Renderer Rend(Options.Width, Options.Height);
+	auto Start = std::chrono::high_resolution_clock::now();
+	std::future<MeshLodChain> Build = BuildMeshLodsAsync(std::move(Positions), 3 * sizeof(float), Indices);
+	MeshLodChain Chain = Build.get();
+	double BuildTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+	Rend.InitLodMesh(Vertices.data(), (uint32_t)Vertices.size(), Chain);
+	Rend.UseLods = Case.UseLods;
+	BenchMakeGridDraws(Rend, Objects);
+
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+	std::vector<uint32_t> Values(Permutations.GetFeatureCount(), 0);
+	Values[Permutations.FindFeature("INSTANCE_GRID")] = 1;
+	Values[Permutations.FindFeature("DRAW_DATA")] = (uint32_t)DrawDataPath::PushConstants;
+	Rend.UsePermutation(Permutations.MakePermutation(Values));
+	Rend.DrawPath = DrawDataPath::PushConstants;
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	double Triangles = 0.0;
+	std::vector<uint32_t> LevelDraws(Chain.Levels.size(), 0);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - FrameStart).count();
+		Triangles += (double)Rend.LastTriangleCount;
+	}
+	for (uint32_t Level : Rend.DrawLods)
+		LevelDraws[Level]++;
+
+	BenchResult Result;
+	Result.Suite = "lod";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	Result.Add("levels", (double)Chain.Levels.size());
+	Result.Add("build_ms", BuildTime * 1000.0);
+	Result.Add("source_triangles", Indices.size() / 3.0);
+	Result.Add("triangles_per_frame", Triangles / Options.Frames);
+	for (size_t Level = 0; Level < LevelDraws.size(); Level++)
+		Result.Add("draws_lod" + std::to_string(Level), LevelDraws[Level]);
+	BenchAddFrameTimes(Result, FrameTimes);
+	return Result;
+}
+
+void RunLodSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchLodCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[lod] " << Case.Name << std::endl;
+		Results.push_back(RunLodCase(Case, Options));
+	}
+}
+
+/*
+* Meshlet suite. A 16x16 grid of objects drawn meshlet by meshlet, with the GPU cull
+* pass on and off. The CPU reference cull runs on the same view first, so its
+* rejected fraction can be checked against the one the shader counted.
+*/
+enum class BenchMeshletMesh
+{
+	Sphere,
+	Terrain
+};
+
+struct BenchMeshletCase
+{
+	const char* Name;
+	BenchMeshletMesh Mesh;
+	bool Cull;
+};
+
+static const BenchMeshletCase BenchMeshletCases[] = {
+	{ "sphere_cull", BenchMeshletMesh::Sphere, true },
+	{ "sphere_nocull", BenchMeshletMesh::Sphere, false },
+	{ "terrain_cull", BenchMeshletMesh::Terrain, true },
+	{ "terrain_nocull", BenchMeshletMesh::Terrain, false },
+};
+
+// Height field over [-1, 1] in x and z. Model flips y, so it faces -y to face the camera.
+static void BenchMakeTerrainMesh(uint32_t Side, std::vector<Vertex>& Vertices, std::vector<uint32_t>& Indices)
+{
+	for (uint32_t z = 0; z < Side; z++)
+	{
+		for (uint32_t x = 0; x < Side; x++)
+		{
+			float X = 2.0f * x / (Side - 1) - 1.0f, Z = 2.0f * z / (Side - 1) - 1.0f;
+			float Y = 0.15f * std::sin(3.0f * X) * std::cos(4.0f * Z) + 0.05f * std::sin(11.0f * X + 7.0f * Z);
+			Vertices.push_back({ X, Y, Z, 1.0f, 0.3f, 0.5f + Y, 0.2f, 1.0f });
+		}
+	}
+	for (uint32_t z = 0; z + 1 < Side; z++)
+	{
+		for (uint32_t x = 0; x + 1 < Side; x++)
+		{
+			uint32_t A = z * Side + x, B = A + Side;
+			Indices.insert(Indices.end(), { A, B, A + 1, A + 1, B, B + 1 });
+		}
+	}
+}
+
+static void RunMeshletCase(const BenchMeshletCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	const uint32_t Objects = 256;
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+	if (Case.Mesh == BenchMeshletMesh::Sphere)
+		BenchMakeLodMesh(160, 256, Vertices, Indices);
+	else
+		BenchMakeTerrainMesh(192, Vertices, Indices);
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	MeshletMesh Mesh = BuildMeshlets(&Vertices[0].posX, Vertices.size(), sizeof(Vertex), Indices.data(), Indices.size());
+	double BuildTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+	Renderer Rend(Options.Width, Options.Height);
+	if (!Rend.InitMeshlets(Vertices.data(), (uint32_t)Vertices.size(), Mesh, Objects))
+	{
+		std::cerr << "[meshlets] " << Case.Name << " skipped, no multi draw indirect" << std::endl;
+		return;
+	}
+	Rend.Meshlets->CullEnabled = Case.Cull;
+	BenchMakeGridDraws(Rend, Objects);
+
+	MeshletCullStats Reference;
+	MeshletCullView View = Rend.GetCullView();
+	for (auto& Draw : Rend.Draws)
+		CullMeshlets(Mesh, Draw.Model, View, Reference);
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - FrameStart).count();
+	}
+	Rend.FinishFrame();
+	MeshletCullStats Gpu = Rend.Meshlets->GetStats();
+
+	uint64_t Triangles = Reference.GetTriangleCount();
+	BenchResult Result;
+	Result.Suite = "meshlets";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	Result.Add("source_triangles", Indices.size() / 3.0);
+	Result.Add("meshlets", (double)Mesh.Meshlets.size());
+	Result.Add("triangles_per_meshlet", Indices.size() / 3.0 / Mesh.Meshlets.size());
+	Result.Add("build_ms", BuildTime * 1000.0);
+	Result.Add("cpu_rejected_fraction", Reference.GetRejectedFraction());
+	Result.Add("cpu_frustum_fraction", (double)Reference.Triangles[(int)MeshletCull::Frustum] / Triangles);
+	Result.Add("cpu_backface_fraction", (double)Reference.Triangles[(int)MeshletCull::Backface] / Triangles);
+	Result.Add("cpu_size_fraction", (double)Reference.Triangles[(int)MeshletCull::Size] / Triangles);
+	Result.Add("gpu_rejected_fraction", Gpu.GetRejectedFraction());
+	Result.Add("triangles_per_frame", (double)Gpu.Triangles[(int)MeshletCull::Visible]);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunMeshletSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchMeshletCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[meshlets] " << Case.Name << std::endl;
+		RunMeshletCase(Case, Options, Results);
+	}
+}
+
+/*
+* Occlusion suite. The meshlet grid with a layer of large spheres between it and the
+* camera, drawn with the two-phase HiZ cull and without it. The GPU time of the pyramid
+* build is read from timestamps, 0 when the queue has none.
+*/
+struct BenchOcclusionCase
+{
+	const char* Name;
+	bool Occlusion;
+};
+
+static const BenchOcclusionCase BenchOcclusionCases[] = {
+	{ "occlusion_off", false },
+	{ "occlusion_on", true },
+};
+
+static void RunOcclusionCase(const BenchOcclusionCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	const uint32_t GridObjects = 256;
+	const uint32_t OccluderSide = 4;
+	const uint32_t Objects = GridObjects + OccluderSide * OccluderSide;
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+	BenchMakeLodMesh(160, 256, Vertices, Indices);
+	MeshletMesh Mesh = BuildMeshlets(&Vertices[0].posX, Vertices.size(), sizeof(Vertex), Indices.data(), Indices.size());
+
+	Renderer Rend(Options.Width, Options.Height);
+	if (!Rend.InitMeshlets(Vertices.data(), (uint32_t)Vertices.size(), Mesh, Objects, Case.Occlusion))
+	{
+		std::cerr << "[occlusion] " << Case.Name << " skipped, no multi draw indirect" << std::endl;
+		return;
+	}
+	if (Case.Occlusion && !Rend.HiZ)
+	{
+		std::cerr << "[occlusion] " << Case.Name << " skipped, depth can not be sampled" << std::endl;
+		return;
+	}
+	BenchMakeGridDraws(Rend, GridObjects);
+	// Model flips y, so negative y is toward the camera.
+	for (uint32_t i = 0; i < OccluderSide * OccluderSide; i++)
+	{
+		glm::vec3 Cell((float)(i % OccluderSide), 0.0f, (float)(i / OccluderSide));
+		Cell -= glm::vec3(OccluderSide - 1.0f, 0.0f, OccluderSide - 1.0f) * 0.5f;
+		DrawData Draw = {};
+		Draw.Model = glm::scale(glm::translate(glm::mat4(1.0f), Cell * 5.0f + glm::vec3(0.0f, -6.0f, 0.0f)), glm::vec3(2.4f));
+		Draw.ObjectId = GridObjects + i;
+		Rend.Draws.push_back(Draw);
+	}
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> BuildTimes;
+	double Triangles = 0.0, Occluded = 0.0, Late = 0.0;
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto FrameStart = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		// The counters are read every frame, so frames do not overlap here.
+		Rend.FinishFrame();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - FrameStart).count();
+		MeshletCullStats Stats = Rend.Meshlets->GetStats();
+		Triangles += (double)Stats.Triangles[(int)MeshletCull::Visible];
+		Occluded += (double)Stats.OccludedObjects;
+		Late += (double)Stats.LateObjects;
+		if (Rend.HiZ)
+			BuildTimes.push_back(Rend.HiZ->GetBuildTime());
+	}
+	MeshletCullStats Last = Rend.Meshlets->GetStats();
+
+	BenchResult Result;
+	Result.Suite = "occlusion";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	Result.Add("meshlets", (double)Mesh.Meshlets.size());
+	Result.Add("triangles_per_frame", Triangles / Options.Frames);
+	Result.Add("occluded_objects", Occluded / Options.Frames);
+	Result.Add("late_objects", Late / Options.Frames);
+	Result.Add("rejected_fraction", Last.GetRejectedFraction());
+	uint64_t Total = Last.GetTriangleCount();
+	Result.Add("occluded_fraction", Total ? (double)Last.Triangles[(int)MeshletCull::Occluded] / Total : 0.0);
+	if (Rend.HiZ)
+	{
+		Result.Add("hiz_levels", Rend.HiZ->GetLevelCount());
+		Result.Add("hiz_build_ms", BenchMean(BuildTimes));
+	}
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunOcclusionSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchOcclusionCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[occlusion] " << Case.Name << std::endl;
+		RunOcclusionCase(Case, Options, Results);
+	}
+}
+
+/*
+* Software raster suites, on the scene suite's cube grids. softraster times the CPU
+* rasterizer with 1, 2, 4 ... threads up to the hardware's and needs no Vulkan device,
+* it draws a tenth of --frames since a CPU frame takes far longer. softraster_compare
+* draws one frame with the renderer, reads it back and counts the pixels where the two
+* differ by more than rounding.
+*/
+struct BenchSoftCase
+{
+	const char* Name;
+	uint32_t Instances;
+};
+
+static const BenchSoftCase BenchSoftCases[] = {
+	{ "single_cube", 1 },
+	{ "instances_10k", 10000 },
+	{ "instances_100k", 100000 },
+};
+
+// The renderer's default camera and instance grid, one draw per instance.
+static void BenchSoftDraw(SoftRasterizer& Raster, const BenchOptions& Options, uint32_t Instances)
+{
+	glm::mat4 Projection, View, Model;
+	Renderer::DefaultCamera(Options.Width, Options.Height, Projection, View, Model);
+	glm::mat4 MVP = Projection * View * Model;
+	glm::vec4 Grid = Renderer::InstanceGrid(Instances);
+	uint32_t Side = (uint32_t)Grid.x;
+	const uint32_t VertexCount = sizeof(g_vb_solid_face_colors_Data) / sizeof(g_vb_solid_face_colors_Data[0]);
+
+	Raster.Clear(glm::vec4(0.2f));
+	for (uint32_t i = 0; i < Instances; i++)
+	{
+		glm::vec3 Cell((float)(i % Side), 0.0f, (float)(i / Side));
+		Cell -= glm::vec3(Side - 1.0f, 0.0f, Side - 1.0f) * 0.5f;
+		glm::mat4 Instance = glm::scale(glm::translate(glm::mat4(1.0f), Cell * Grid.y), glm::vec3(Grid.z));
+		Raster.Draw(g_vb_solid_face_colors_Data, VertexCount, MVP * Instance);
+	}
+	Raster.Flush();
+}
+
+// SingleThreaded is the mean frame time of the 1 thread run, 0 while that is the one running.
+static BenchResult RunSoftRasterCase(const BenchSoftCase& Case, uint32_t Threads, double SingleThreaded, const BenchOptions& Options)
+{
+	SoftRasterizer Raster(Options.Width, Options.Height, Threads);
+	uint32_t Frames = std::max(3u, Options.Frames / 10);
+	for (uint32_t i = 0; i < std::min(3u, Options.WarmupFrames); i++)
+		BenchSoftDraw(Raster, Options, Case.Instances);
+
+	std::vector<double> FrameTimes(Frames), SetupTimes(Frames), RasterTimes(Frames);
+	for (uint32_t i = 0; i < Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		BenchSoftDraw(Raster, Options, Case.Instances);
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		SetupTimes[i] = Raster.GetStats().SetupTime;
+		RasterTimes[i] = Raster.GetStats().RasterTime;
+	}
+	const SoftRasterStats& Stats = Raster.GetStats();
+	double Mean = BenchMean(FrameTimes);
+
+	BenchResult Result;
+	Result.Suite = "softraster";
+	Result.Name = std::string(Case.Name) + "_t" + std::to_string(Threads);
+	Result.Add("frames", Frames);
+	Result.Add("threads", Threads);
+	Result.Add("simd_level", (double)GetSimdLevel());
+	Result.Add("triangles", (double)Stats.Triangles);
+	Result.Add("rasterized_triangles", (double)Stats.Rasterized);
+	Result.Add("pixels", (double)Stats.Pixels);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Result.Add("setup_mean_ms", BenchMean(SetupTimes) * 1000.0);
+	Result.Add("raster_mean_ms", BenchMean(RasterTimes) * 1000.0);
+	Result.Add("triangles_per_sec", Stats.Triangles / Mean);
+	Result.Add("pixels_per_sec", Stats.Pixels / Mean);
+	Result.Add("speedup", SingleThreaded > 0.0 ? SingleThreaded / Mean : 1.0);
+	return Result;
+}
+
+void RunSoftRasterSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	uint32_t Hardware = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> ThreadCounts;
+	for (uint32_t Threads = 1; Threads < Hardware; Threads *= 2)
+		ThreadCounts.push_back(Threads);
+	ThreadCounts.push_back(Hardware);
+
+	for (auto& Case : BenchSoftCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		double SingleThreaded = 0.0;
+		for (uint32_t Threads : ThreadCounts)
+		{
+			std::cerr << "[softraster] " << Case.Name << " " << Threads << " threads" << std::endl;
+			Results.push_back(RunSoftRasterCase(Case, Threads, SingleThreaded, Options));
+			if (Threads == 1)
+				SingleThreaded = Results.back().Find("frame_mean_ms")->Value / 1000.0;
+		}
+	}
+}
+
+static void RunSoftCompareCase(const BenchSoftCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InstanceCount = Case.Instances;
+	Rend.UpdateUniformBuffer();
+
+	std::vector<uint8_t> Pixels;
+	uint32_t RowPitch = 0;
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	Rend.InitReadback(1, [&](const ReadbackFrame& Frame) {
+		Pixels.assign(Frame.Pixels, Frame.Pixels + (size_t)Frame.RowPitch * Frame.Height);
+		RowPitch = Frame.RowPitch;
+		Format = Frame.Format;
+	});
+	Rend.DrawCube();
+	Rend.Readback->Flush();
+	if (Format != VK_FORMAT_B8G8R8A8_UNORM && Format != VK_FORMAT_R8G8B8A8_UNORM)
+	{
+		std::cerr << "[softraster_compare] " << Case.Name << " skipped, surface is not 8 bit UNORM" << std::endl;
+		return;
+	}
+
+	SoftRasterizer Raster(Options.Width, Options.Height);
+	BenchSoftDraw(Raster, Options, Case.Instances);
+	uint32_t MaxError = 0;
+	// Vertex colors are interpolated in float on both sides, 2 of 255 covers the rounding.
+	double Mismatch = Raster.Compare(Pixels.data(), RowPitch, Format == VK_FORMAT_B8G8R8A8_UNORM, 2, &MaxError);
+
+	BenchResult Result;
+	Result.Suite = "softraster_compare";
+	Result.Name = Case.Name;
+	Result.Add("pixels", (double)Raster.GetStats().Pixels);
+	Result.Add("mismatch_fraction", Mismatch);
+	Result.Add("max_channel_error", MaxError);
+	Results.push_back(Result);
+}
+
+void RunSoftCompareSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchSoftCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[softraster_compare] " << Case.Name << std::endl;
+		RunSoftCompareCase(Case, Options, Results);
+	}
+}
+
+/*
+* Job suite, 1, 2, 4 ... threads up to the hardware's, and the hardware's with the
+* workers pinned to cores. empty_jobs measures the scheduler alone, parallel_for splits the transform
+* suite's TRS kernel over the threads, and waves runs groups of small jobs that each
+* wait for the group before them.
+*/
+enum class BenchJobCase
+{
+	EmptyJobs,
+	ParallelFor,
+	Waves
+};
+
+static const char* const BenchJobCaseNames[] = { "empty_jobs", "parallel_for", "waves" };
+
+// Enough arithmetic that a job is not just scheduler overhead.
+static void BenchJobWork(std::atomic<uint32_t>& Sink)
+{
+	uint32_t Value = 1;
+	for (uint32_t i = 0; i < 2000; i++)
+		Value = Value * 1664525u + 1013904223u;
+	Sink.fetch_add(Value, std::memory_order_relaxed);
+}
+
+// SingleThreaded is the mean batch time of the 1 thread run, 0 while that is the one running.
+static BenchResult RunJobCase(BenchJobCase Case, uint32_t Threads, JobAffinity Affinity, double SingleThreaded,
+	const BenchTransformInput& Input, const BenchOptions& Options)
+{
+	const uint32_t EmptyJobs = 65536;
+	const uint32_t Waves = 64;
+	const uint32_t WaveJobs = 256;
+	const uint32_t Matrices = (uint32_t)Input.Matrices.size();
+	std::vector<glm::mat4> Output(Matrices);
+	std::atomic<uint32_t> Sink(0);
+	JobSystem Jobs(Threads, Affinity);
+
+	std::vector<double> Times;
+	uint32_t Items = 0;
+	for (uint32_t Iteration = 0; Iteration < Options.WarmupFrames + Options.Frames; Iteration++)
+	{
+		if (Iteration == Options.WarmupFrames)
+			Jobs.ResetStats();
+		auto Start = std::chrono::high_resolution_clock::now();
+		if (Case == BenchJobCase::EmptyJobs)
+		{
+			JobCounter Counter;
+			for (uint32_t i = 0; i < EmptyJobs; i++)
+				Jobs.Run([] {}, &Counter);
+			Jobs.Wait(Counter);
+			Items = EmptyJobs;
+		}
+		else if (Case == BenchJobCase::ParallelFor)
+		{
+			Jobs.ParallelFor(Matrices, 1024, [&](uint32_t Begin, uint32_t End)
+			{
+				const TransformSoA& T = Input.SoA;
+				TransformSoA Range = { T.PositionX + Begin, T.PositionY + Begin, T.PositionZ + Begin,
+					T.RotationX + Begin, T.RotationY + Begin, T.RotationZ + Begin, T.RotationW + Begin,
+					T.ScaleX + Begin, T.ScaleY + Begin, T.ScaleZ + Begin };
+				TransformOutput Out;
+				Out.Data = &Output[Begin];
+				ComposeTRS(Range, End - Begin, Out);
+			});
+			Items = Matrices;
+		}
+		else
+		{
+			std::vector<JobCounter> Counters(Waves);
+			for (uint32_t w = 0; w < Waves; w++)
+				for (uint32_t i = 0; i < WaveJobs; i++)
+					Jobs.Run([&Sink] { BenchJobWork(Sink); }, &Counters[w], w > 0 ? &Counters[w - 1] : nullptr);
+			Jobs.Wait(Counters[Waves - 1]);
+			Items = Waves * WaveJobs;
+		}
+		auto End = std::chrono::high_resolution_clock::now();
+		if (Iteration >= Options.WarmupFrames)
+			Times.push_back(std::chrono::duration<double>(End - Start).count());
+	}
+	JobSystemStats Stats = Jobs.GetStats();
+	double Mean = BenchMean(Times);
+
+	BenchResult Result;
+	Result.Suite = "jobs";
+	Result.Name = std::string(BenchJobCaseNames[(int)Case]) + "_t" + std::to_string(Threads) +
+		(Affinity != JobAffinity::None ? "_pinned" : "");
+	Result.Add("iterations", Options.Frames);
+	Result.Add("threads", Threads);
+	Result.Add("items", Items);
+	Result.Add("batch_mean_ms", Mean * 1000.0);
+	Result.Add("batch_p99_ms", BenchPercentile(Times, 99.0) * 1000.0);
+	Result.Add(Case == BenchJobCase::ParallelFor ? "matrices_per_sec" : "jobs_per_sec", Items / Mean);
+	Result.Add("speedup", SingleThreaded > 0.0 ? SingleThreaded / Mean : 1.0);
+	Result.Add("stolen_fraction", Stats.Executed ? (double)Stats.Stolen / Stats.Executed : 0.0);
+	Result.Add("sleeps", (double)Stats.Sleeps);
+	return Result;
+}
+
+void RunJobSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	BenchTransformInput Input;
+	BenchMakeTransforms(Input, 256 * 1024);
+
+	uint32_t Hardware = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> ThreadCounts;
+	for (uint32_t Threads = 1; Threads < Hardware; Threads *= 2)
+		ThreadCounts.push_back(Threads);
+	ThreadCounts.push_back(Hardware);
+
+	for (int Case = 0; Case < 3; Case++)
+	{
+		if (!Options.Scene.empty() && Options.Scene != BenchJobCaseNames[Case])
+			continue;
+		double SingleThreaded = 0.0;
+		for (uint32_t Threads : ThreadCounts)
+		{
+			std::cerr << "[jobs] " << BenchJobCaseNames[Case] << " " << Threads << " threads" << std::endl;
+			Results.push_back(RunJobCase((BenchJobCase)Case, Threads, JobAffinity::None, SingleThreaded, Input, Options));
+			if (Threads == 1)
+				SingleThreaded = Results.back().Find("batch_mean_ms")->Value / 1000.0;
+		}
+		std::cerr << "[jobs] " << BenchJobCaseNames[Case] << " " << Hardware << " threads pinned" << std::endl;
+		Results.push_back(RunJobCase((BenchJobCase)Case, Hardware, JobAffinity::PinWorkers, SingleThreaded, Input, Options));
+	}
+}
+
+/*
+* Pipeline suite. 4096 spinning objects drawn through a FramePipeline, with the
+* simulation taking a fixed 4 ms on top of the transforms, serial on the render
+* thread and free running on its own thread. latency is from the start of
+* simulating a frame until the GPU finished it, what pipelining adds shows up there.
+* Snapshots the renderer was too slow for are dropped, frames it drew faster than the
+* simulation are repeated.
+*/
+struct BenchPipelineCase
+{
+	const char* Name;
+	bool Threaded;
+};
+
+static const BenchPipelineCase BenchPipelineCases[] = {
+	{ "serial", false },
+	{ "pipelined", true },
+};
+
+static BenchResult RunPipelineCase(const BenchPipelineCase& Case, const BenchOptions& Options)
+{
+	const uint32_t Objects = 4096;
+	const double SimulationCost = 0.004;
+
+	Renderer Rend(Options.Width, Options.Height);
+	BenchMakeGridDraws(Rend, Objects);
+	std::vector<DrawData> Grid = Rend.Draws;
+
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+	std::vector<uint32_t> Values(Permutations.GetFeatureCount(), 0);
+	Values[Permutations.FindFeature("INSTANCE_GRID")] = 1;
+	Values[Permutations.FindFeature("DRAW_DATA")] = (uint32_t)DrawDataPath::PushConstants;
+	Rend.UsePermutation(Permutations.MakePermutation(Values));
+
+	glm::mat4 Projection, View, Model;
+	Renderer::DefaultCamera(Options.Width, Options.Height, Projection, View, Model);
+	FramePipeline Pipeline(&Rend, [&](RenderSnapshot& Out, double Time, double)
+	{
+		Out.Projection = Projection;
+		Out.View = View;
+		Out.Model = Model;
+		Out.InstanceCount = 1;
+		Out.Draws.resize(Objects);
+		for (uint32_t i = 0; i < Objects; i++)
+		{
+			Out.Draws[i] = Grid[i];
+			Out.Draws[i].Model = glm::rotate(Grid[i].Model, (float)Time + i * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		while (std::chrono::duration<double>(std::chrono::steady_clock::now() - Out.SimStart).count() < SimulationCost)
+			;
+	}, Case.Threaded);
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Pipeline.RenderFrame();
+	Pipeline.ResetStats();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> Latencies(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Pipeline.RenderFrame();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		Latencies[i] = Pipeline.GetStats().LastLatency;
+	}
+	FramePipelineStats Stats = Pipeline.GetStats();
+
+	BenchResult Result;
+	Result.Suite = "pipeline";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Result.Add("latency_mean_ms", Stats.MeanLatency * 1000.0);
+	Result.Add("latency_p99_ms", BenchPercentile(Latencies, 99.0) * 1000.0);
+	Result.Add("latency_frames", BenchMean(FrameTimes) > 0.0 ? Stats.MeanLatency / BenchMean(FrameTimes) : 0.0);
+	Result.Add("mailbox_wait_mean_ms", Stats.MeanWait * 1000.0);
+	Result.Add("dropped_snapshots", (double)Stats.Dropped);
+	Result.Add("repeated_frames", (double)Stats.Repeated);
+	return Result;
+}
+
+void RunPipelineSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchPipelineCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[pipeline] " << Case.Name << std::endl;
+		Results.push_back(RunPipelineCase(Case, Options));
+	}
+}
+
+/*
+* Dispatch suite. The draw suite's push_10k scene, recorded once with the device
+* functions from vkGetDeviceProcAddr and once with the loader's trampolines that
+* linking against the loader gives. Recording is nearly all vkCmdPushConstants and
+* vkCmdDraw, so the difference is the loader's per call dispatch.
+*/
+struct BenchDispatchCase
+{
+	const char* Name;
+	VulkanDispatchMode Mode;
+};
+
+static const BenchDispatchCase BenchDispatchCases[] = {
+	{ "loader_10k", VulkanDispatchMode::Loader },
+	{ "device_10k", VulkanDispatchMode::Device },
+};
+
+static BenchResult RunDispatchCase(const BenchDispatchCase& Case, const BenchOptions& Options)
+{
+	const uint32_t Objects = 10000;
+	Renderer Rend(Options.Width, Options.Height);
+	LoadVulkanDevice(Rend.Device, Case.Mode);
+	BenchMakeGridDraws(Rend, Objects);
+
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+	std::vector<uint32_t> Values(Permutations.GetFeatureCount(), 0);
+	Values[Permutations.FindFeature("INSTANCE_GRID")] = 1;
+	Values[Permutations.FindFeature("DRAW_DATA")] = (uint32_t)DrawDataPath::PushConstants;
+	Rend.UsePermutation(Permutations.MakePermutation(Values));
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> RecordTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		Rend.DrawCube();
+		RecordTimes[i] = Rend.LastRecordTime;
+	}
+
+	BenchResult Result;
+	Result.Suite = "dispatch";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	double RecordMean = BenchMean(RecordTimes);
+	Result.Add("record_mean_ms", RecordMean * 1000.0);
+	Result.Add("record_p50_ms", BenchPercentile(RecordTimes, 50.0) * 1000.0);
+	Result.Add("record_p99_ms", BenchPercentile(RecordTimes, 99.0) * 1000.0);
+	Result.Add("draws_per_sec", RecordMean > 0.0 ? Objects / RecordMean : 0.0);
+	return Result;
+}
+
+void RunDispatchSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchDispatchCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[dispatch] " << Case.Name << std::endl;
+		Results.push_back(RunDispatchCase(Case, Options));
+	}
+}
+
+/*
+* Dynamic resolution suite, on the scene suite's 100k instance grid. Every case first
+* draws the warmup frames at full size to measure the GPU time, then gives the
+* controller a budget of a fraction of it. full keeps the scale at 1, which is the
+* cost of the extra blit.
+*/
+struct BenchDynResCase
+{
+	const char* Name;
+	double BudgetFraction;
+};
+
+static const BenchDynResCase BenchDynResCases[] = {
+	{ "full", 1.0 },
+	{ "budget_75", 0.75 },
+	{ "budget_50", 0.5 },
+};
+
+static void RunDynResCase(const BenchDynResCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InstanceCount = 100000;
+	Rend.UpdateUniformBuffer();
+
+	DynamicResolutionSettings Settings;
+	Settings.MinScale = Settings.MaxScale = 1.0f;
+	if (!Rend.InitDynamicResolution(Settings))
+	{
+		std::cerr << "[dynres] " << Case.Name << " skipped, can not blit to the swapchain images" << std::endl;
+		return;
+	}
+
+	std::vector<double> FullTimes;
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+	{
+		Rend.DrawCube();
+		Rend.FinishFrame();
+		FullTimes.push_back(Rend.GetGpuFrameTime());
+	}
+	double FullMs = BenchMean(FullTimes);
+	if (Case.BudgetFraction < 1.0)
+	{
+		Rend.DynamicResolution->Settings.MinScale = 0.25f;
+		Rend.DynamicResolution->Settings.BudgetMs = FullMs * Case.BudgetFraction;
+	}
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> GpuTimes(Options.Frames);
+	double ScaleSum = 0.0;
+	uint32_t OverBudget = 0;
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		GpuTimes[i] = Rend.GetGpuFrameTime();
+		ScaleSum += (double)Rend.RenderExtent.width / Rend.SurfaceSizeX;
+		if (Case.BudgetFraction < 1.0 && GpuTimes[i] > Rend.DynamicResolution->Settings.BudgetMs)
+			OverBudget++;
+	}
+
+	BenchResult Result;
+	Result.Suite = "dynres";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("full_gpu_ms", FullMs);
+	// Milliseconds, named so the baseline comparison leaves it alone.
+	Result.Add("gpu_budget", Case.BudgetFraction < 1.0 ? Rend.DynamicResolution->Settings.BudgetMs : 0.0);
+	Result.Add("gpu_mean_ms", BenchMean(GpuTimes));
+	Result.Add("gpu_p99_ms", BenchPercentile(GpuTimes, 99.0));
+	Result.Add("scale_mean", ScaleSum / Options.Frames);
+	Result.Add("scale_final", Rend.DynamicResolution->GetScale());
+	Result.Add("over_budget_fraction", (double)OverBudget / Options.Frames);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunDynResSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchDynResCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[dynres] " << Case.Name << std::endl;
+		RunDynResCase(Case, Options, Results);
+	}
+}
+
+/*
+* Overdraw suite, on the scene suite's instance grids. _depth cases count the fragments
+* that pass the depth test, what the normal pipeline shades, _all cases every fragment
+* the grid rasterizes. The frames are timed with the counting pipeline, then one more
+* is read back for the counts and, with --heatmaps, written out as a PPM.
+*/
+struct BenchOverdrawCase
+{
+	const char* Name;
+	uint32_t Instances;
+	bool DepthTest;
+};
+
+static const BenchOverdrawCase BenchOverdrawCases[] = {
+	{ "instances_10k_depth", 10000, true },
+	{ "instances_10k_all", 10000, false },
+	{ "instances_100k_depth", 100000, true },
+	{ "instances_100k_all", 100000, false },
+};
+
+static void RunOverdrawCase(const BenchOverdrawCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InstanceCount = Case.Instances;
+	Rend.UpdateUniformBuffer();
+	Rend.InitOverdraw(Case.DepthTest);
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+	std::vector<double> FrameTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+	}
+
+	OverdrawStats Stats;
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	bool Written = true;
+	std::string HeatmapPath = Options.HeatmapDir.empty() ? "" : Options.HeatmapDir + "/overdraw_" + Case.Name + ".ppm";
+	Rend.InitReadback(1, [&](const ReadbackFrame& Frame) {
+		Format = Frame.Format;
+		Stats = AnalyzeOverdraw(Frame);
+		if (!HeatmapPath.empty())
+			Written = WriteOverdrawHeatmap(HeatmapPath, Frame);
+	});
+	Rend.DrawCube();
+	Rend.Readback->Flush();
+	if (Format != VK_FORMAT_B8G8R8A8_UNORM && Format != VK_FORMAT_R8G8B8A8_UNORM)
+	{
+		std::cerr << "[overdraw] " << Case.Name << " skipped, surface is not 8 bit UNORM" << std::endl;
+		return;
+	}
+	if (!Written)
+		std::cerr << "[overdraw] could not write " << HeatmapPath << std::endl;
+
+	BenchResult Result;
+	Result.Suite = "overdraw";
+	Result.Name = Case.Name;
+	Result.Add("instances", Case.Instances);
+	Result.Add("mean_overdraw", Stats.Mean);
+	Result.Add("mean_covered_overdraw", Stats.MeanCovered);
+	Result.Add("max_overdraw", Stats.Max);
+	Result.Add("fragments_per_frame", (double)Stats.Fragments);
+	Result.Add("covered_fraction", Stats.Pixels ? (double)Stats.Covered / Stats.Pixels : 0.0);
+	// Counts stop at 255, fragments_per_frame is a lower bound when this is not 0.
+	Result.Add("saturated_fraction", Stats.Pixels ? (double)Stats.Saturated / Stats.Pixels : 0.0);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunOverdrawSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchOverdrawCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[overdraw] " << Case.Name << std::endl;
+		RunOverdrawCase(Case, Options, Results);
+	}
+}
+
+/*
+* Command cache suite, on the draw suite's 10k object grid. recorded is every frame
+* recorded as usual, cached submits the buffers recorded for each image again. The
+* animated case moves every object each frame through ObjectBuffer, which leaves the
+* commands alone, so it should stay cached too.
+*/
+struct BenchCommandCacheCase
+{
+	const char* Name;
+	DrawDataPath Path;
+	bool Cache;
+	bool Animate;
+};
+
+static const BenchCommandCacheCase BenchCommandCacheCases[] = {
+	{ "recorded_10k", DrawDataPath::PushConstants, false, false },
+	{ "cached_10k", DrawDataPath::PushConstants, true, false },
+	{ "recorded_descriptor_10k_animated", DrawDataPath::Descriptors, false, true },
+	{ "cached_descriptor_10k_animated", DrawDataPath::Descriptors, true, true },
+};
+
+static void RunCommandCacheCase(const BenchCommandCacheCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	const uint32_t Objects = 10000;
+	Renderer Rend(Options.Width, Options.Height);
+	BenchMakeGridDraws(Rend, Objects);
+
+	Rend.InitShaderPermutations();
+	ShaderPermutations& Permutations = *Rend.Permutations;
+	std::vector<uint32_t> Values(Permutations.GetFeatureCount(), 0);
+	Values[Permutations.FindFeature("INSTANCE_GRID")] = 1;
+	Values[Permutations.FindFeature("DRAW_DATA")] = (uint32_t)Case.Path;
+	Rend.UsePermutation(Permutations.MakePermutation(Values));
+
+	Rend.DrawPath = Case.Path;
+	if (Case.Path != DrawDataPath::PushConstants)
+		Rend.InitObjectBuffer(Objects);
+	if (Case.Cache)
+		Rend.InitCommandCache();
+
+	std::vector<glm::mat4> BaseModels(Objects);
+	for (uint32_t i = 0; i < Objects; i++)
+		BaseModels[i] = Rend.Draws[i].Model;
+	auto Animate = [&](uint32_t Frame)
+	{
+		if (!Case.Animate)
+			return;
+		glm::mat4 Spin = glm::rotate(glm::mat4(1.0f), Frame * 0.02f, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (uint32_t i = 0; i < Objects; i++)
+			Rend.Draws[i].Model = BaseModels[i] * Spin;
+		Rend.UpdateObjectBuffer();
+	};
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+	{
+		Animate(i);
+		Rend.DrawCube();
+	}
+
+	uint64_t RecordsBefore = Rend.CommandCacheRecords;
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> RecordTimes(Options.Frames);
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Animate(Options.WarmupFrames + i);
+		Rend.DrawCube();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		RecordTimes[i] = Rend.LastRecordTime;
+	}
+
+	BenchResult Result;
+	Result.Suite = "cmdcache";
+	Result.Name = Case.Name;
+	Result.Add("frames", Options.Frames);
+	Result.Add("objects", Objects);
+	Result.Add("record_mean_ms", BenchMean(RecordTimes) * 1000.0);
+	Result.Add("record_p99_ms", BenchPercentile(RecordTimes, 99.0) * 1000.0);
+	// Cached buffers recorded again while measuring, 0 for static content.
+	Result.Add("rerecords", (double)(Rend.CommandCacheRecords - RecordsBefore));
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunCommandCacheSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchCommandCacheCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[cmdcache] " << Case.Name << std::endl;
+		RunCommandCacheCase(Case, Options, Results);
+	}
+}
+
+/*
+* Particle suite. The emitter rate keeps about Capacity particles alive, the warmup runs
+* at least one lifetime so the counts are at steady state when measuring. The _atomics
+* cases compact with one atomic per particle instead of per subgroup, their alive counts
+* should match the subgroup cases exactly, as the same particles survive in another order.
+*/
+struct BenchParticleCase
+{
+	const char* Name;
+	uint32_t Capacity;
+	bool Subgroups;
+};
+
+static const BenchParticleCase BenchParticleCases[] = {
+	{ "particles_100k", 100000, true },
+	{ "particles_1m", 1000000, true },
+	{ "particles_1m_atomics", 1000000, false },
+	{ "particles_4m", 4000000, true },
+};
+
+static void RunParticleCase(const BenchParticleCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	if (Case.Subgroups && !Rend.SubgroupBallotSupported)
+	{
+		std::cerr << "[particles] " << Case.Name << " skipped, no subgroup ballots" << std::endl;
+		return;
+	}
+	Rend.SubgroupBallotSupported = Case.Subgroups;
+	Rend.InitParticles(Case.Capacity);
+	ParticleSystem& Particles = *Rend.Particles;
+	// Particles live 0.75 lifetimes on average.
+	Particles.Emitter.Rate = Case.Capacity / (0.75f * Particles.Emitter.Lifetime);
+
+	uint32_t Warmup = std::max(Options.WarmupFrames, (uint32_t)std::ceil(Particles.Emitter.Lifetime / Particles.TimeStep));
+	for (uint32_t i = 0; i < Warmup; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> GpuTimes(Options.Frames);
+	double AliveSum = 0.0;
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		// The count is read every frame, so frames do not overlap here.
+		Rend.FinishFrame();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		GpuTimes[i] = Rend.GetGpuFrameTime();
+		AliveSum += Particles.GetAliveCount();
+	}
+	double Alive = AliveSum / Options.Frames;
+	double GpuMs = BenchMean(GpuTimes);
+
+	BenchResult Result;
+	Result.Suite = "particles";
+	Result.Name = Case.Name;
+	Result.Add("capacity", Case.Capacity);
+	Result.Add("subgroups", Particles.UsesSubgroups() ? 1.0 : 0.0);
+	Result.Add("alive", Alive);
+	Result.Add("gpu_mean_ms", GpuMs);
+	Result.Add("gpu_p99_ms", BenchPercentile(GpuTimes, 99.0));
+	// Simulated and drawn, of the whole frame's GPU time.
+	Result.Add("particles_per_sec", GpuMs > 0.0 ? Alive / (GpuMs / 1000.0) : 0.0);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunParticleSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchParticleCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[particles] " << Case.Name << std::endl;
+		RunParticleCase(Case, Options, Results);
+	}
+}
+
+/*
+* Clustered lighting suite, on 10k grid instances with point lights scattered over the grid.
+* Light count sweeps from 10 to 10k at a fixed radius, so lights per cluster grow with it.
+* The _all cases shade every fragment with every light instead, the cost binning avoids.
+*/
+struct BenchLightCase
+{
+	const char* Name;
+	uint32_t Lights;
+	bool AllLights;
+};
+
+static const BenchLightCase BenchLightCases[] = {
+	{ "lights_10", 10, false },
+	{ "lights_100", 100, false },
+	{ "lights_1000", 1000, false },
+	{ "lights_10000", 10000, false },
+	{ "lights_100_all", 100, true },
+	{ "lights_1000_all", 1000, true },
+};
+
+static void RunLightCase(const BenchLightCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	Renderer Rend(Options.Width, Options.Height);
+	Rend.InstanceCount = 10000;
+	Rend.UpdateUniformBuffer();
+	Rend.InitLighting(Case.Lights);
+	ClusteredLighting& Lighting = *Rend.Lighting;
+	Lighting.ShadeAllLights = Case.AllLights;
+
+	// Same lights every run, spread over the grid just above and below the cubes.
+	auto Unit = [](uint32_t Seed) { return (float)((Seed * 2654435761u) >> 8) / 16777216.0f; };
+	Lighting.Lights.resize(Case.Lights);
+	for (uint32_t i = 0; i < Case.Lights; i++)
+	{
+		PointLight& Light = Lighting.Lights[i];
+		Light.Position = glm::vec3(Unit(i * 4) * 20.0f - 10.0f, Unit(i * 4 + 1) * 2.0f - 1.0f, Unit(i * 4 + 2) * 20.0f - 10.0f);
+		Light.Radius = 2.0f;
+		Light.Color = glm::vec4(glm::vec3(0.5f + Unit(i * 4 + 3)), 1.0f);
+	}
+
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Rend.DrawCube();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> GpuTimes(Options.Frames);
+	double ReferenceSum = 0.0;
+	uint32_t MaxLights = 0;
+	uint32_t Overflowed = 0;
+	uint32_t Clusters = 0;
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Rend.DrawCube();
+		// The stats are read every frame, so frames do not overlap here.
+		Rend.FinishFrame();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		GpuTimes[i] = Rend.GetGpuFrameTime();
+		ClusterLightStats Stats = Lighting.GetStats();
+		ReferenceSum += Stats.References;
+		MaxLights = std::max(MaxLights, Stats.MaxLights);
+		Overflowed = std::max(Overflowed, Stats.Overflowed);
+		Clusters = Stats.Clusters;
+	}
+
+	BenchResult Result;
+	Result.Suite = "lights";
+	Result.Name = Case.Name;
+	Result.Add("lights", Case.Lights);
+	Result.Add("clusters", Clusters);
+	Result.Add("gpu_mean_ms", BenchMean(GpuTimes));
+	Result.Add("gpu_p99_ms", BenchPercentile(GpuTimes, 99.0));
+	// Binning counts, all 0 for the _all cases.
+	Result.Add("mean_lights_per_cluster", Clusters ? ReferenceSum / Options.Frames / Clusters : 0.0);
+	Result.Add("max_lights_per_cluster", MaxLights);
+	// Clusters that dropped lights, their pixels are shaded too dark.
+	Result.Add("overflowed_clusters", Overflowed);
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunLightSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchLightCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[lights] " << Case.Name << std::endl;
+		RunLightCase(Case, Options, Results);
+	}
+}
+
+/*
+* Shadow suite, 4 cascades of 2048 over a grid of 1024 objects. The cached cases render
+* their static objects once and then only copy them, the dynamic objects bob up and down
+* and are rendered every frame. _uncached renders the static objects every frame as well,
+* and _light_moving turns the light every frame, which has the same effect.
+*/
+struct BenchShadowCase
+{
+	const char* Name;
+	// Percent of the objects that never move.
+	uint32_t StaticPercent;
+	bool Uncached;
+	bool MovingLight;
+};
+
+static const BenchShadowCase BenchShadowCases[] = {
+	{ "shadows_static", 100, false, false },
+	{ "shadows_mostly_static", 90, false, false },
+	{ "shadows_half_static", 50, false, false },
+	{ "shadows_dynamic", 0, false, false },
+	{ "shadows_static_uncached", 100, true, false },
+	{ "shadows_light_moving", 100, false, true },
+};
+
+static void RunShadowCase(const BenchShadowCase& Case, const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	const uint32_t Objects = 1024;
+	Renderer Rend(Options.Width, Options.Height);
+	BenchMakeGridDraws(Rend, Objects);
+	Rend.InitShadows();
+	ShadowCascades& Shadows = *Rend.Shadows;
+	Shadows.StaticCasters = Objects * Case.StaticPercent / 100;
+	std::vector<glm::mat4> Models(Objects);
+	for (uint32_t i = 0; i < Objects; i++)
+		Models[i] = Rend.Draws[i].Model;
+
+	uint32_t Frame = 0;
+	auto Step = [&]()
+	{
+		for (uint32_t i = Shadows.StaticCasters; i < Objects; i++)
+			Rend.Draws[i].Model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, std::sin(Frame * 0.1f + i), 0.0f)) * Models[i];
+		if (Case.MovingLight)
+			Shadows.LightDirection = glm::vec3(std::cos(Frame * 0.01f), -2.0f, std::sin(Frame * 0.01f));
+		if (Case.Uncached)
+			Shadows.Invalidate();
+		Rend.DrawCube();
+		Frame++;
+	};
+	for (uint32_t i = 0; i < Options.WarmupFrames; i++)
+		Step();
+
+	std::vector<double> FrameTimes(Options.Frames);
+	std::vector<double> ShadowTimes(Options.Frames);
+	std::vector<double> GpuTimes(Options.Frames);
+	uint32_t CacheRenders = Shadows.GetCacheRenders();
+	for (uint32_t i = 0; i < Options.Frames; i++)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		Step();
+		// The shadow pass time is read every frame, so frames do not overlap here.
+		Rend.FinishFrame();
+		FrameTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		ShadowTimes[i] = Shadows.GetShadowTime();
+		GpuTimes[i] = Rend.GetGpuFrameTime();
+	}
+	CacheRenders = Shadows.GetCacheRenders() - CacheRenders;
+
+	BenchResult Result;
+	Result.Suite = "shadows";
+	Result.Name = Case.Name;
+	Result.Add("objects", Objects);
+	Result.Add("static_objects", Shadows.StaticCasters);
+	Result.Add("cascades", Shadows.GetCascadeCount());
+	Result.Add("shadow_mean_ms", BenchMean(ShadowTimes));
+	Result.Add("shadow_p99_ms", BenchPercentile(ShadowTimes, 99.0));
+	// Measured frames that rendered the static objects again, all of them when uncached.
+	Result.Add("cache_render_fraction", (double)CacheRenders / Options.Frames);
+	Result.Add("gpu_mean_ms", BenchMean(GpuTimes));
+	BenchAddFrameTimes(Result, FrameTimes);
+	Results.push_back(Result);
+}
+
+void RunShadowSuite(const BenchOptions& Options, std::vector<BenchResult>& Results)
+{
+	for (auto& Case : BenchShadowCases)
+	{
+		if (!Options.Scene.empty() && Options.Scene != Case.Name)
+			continue;
+		std::cerr << "[shadows] " << Case.Name << std::endl;
+		RunShadowCase(Case, Options, Results);
+	}
+}
+
+void WriteBenchCsv(std::ostream& Out, const std::vector<BenchResult>& Results)
+{
+	Out << "suite,name,metric,value\n";
+	for (auto& Result : Results)
+	{
+		for (auto& Metric : Result.Metrics)
+			Out << Result.Suite << "," << Result.Name << "," << Metric.Key << "," << Metric.Value << "\n";
+	}
+}
+
+void WriteBenchJson(std::ostream& Out, const std::vector<BenchResult>& Results)
+{
+	Out << "[\n";
+	for (size_t i = 0; i < Results.size(); i++)
+	{
+		auto& Result = Results[i];
+		Out << "  { \"suite\": \"" << Result.Suite << "\", \"name\": \"" << Result.Name << "\", \"metrics\": {";
+		for (size_t m = 0; m < Result.Metrics.size(); m++)
+		{
+			Out << (m ? ", " : " ") << "\"" << Result.Metrics[m].Key << "\": " << Result.Metrics[m].Value;
+		}
+		Out << " } }" << (i + 1 < Results.size() ? "," : "") << "\n";
+	}
+	Out << "]\n";
+}
+
+bool ReadBenchCsv(const std::string& Path, std::vector<BenchResult>& Results)
+{
+	std::ifstream In(Path);
+	if (!In)
+		return false;
+
+	std::string Line;
+	std::getline(In, Line); // Header.
+	while (std::getline(In, Line))
+	{
+		std::istringstream Fields(Line);
+		std::string Suite, Name, Key, Value;
+		if (!std::getline(Fields, Suite, ',') || !std::getline(Fields, Name, ',') ||
+			!std::getline(Fields, Key, ',') || !std::getline(Fields, Value))
+			continue;
+
+		if (Results.empty() || Results.back().Suite != Suite || Results.back().Name != Name)
+		{
+			Results.push_back(BenchResult());
+			Results.back().Suite = Suite;
+			Results.back().Name = Name;
+		}
+		Results.back().Add(Key, std::stod(Value));
+	}
+	return true;
+}
+
+static bool EndsWith(const std::string& String, const std::string& Suffix)
+{
+	return String.size() >= Suffix.size() &&
+		String.compare(String.size() - Suffix.size(), Suffix.size(), Suffix) == 0;
+}
+
+int CompareBenchBaseline(const std::vector<BenchResult>& Current, const std::vector<BenchResult>& Baseline, double Tolerance, std::ostream& Log)
+{
+	int Regressions = 0;
+	for (auto& Result : Current)
+	{
+		const BenchResult* Base = nullptr;
+		for (auto& Candidate : Baseline)
+		{
+			if (Candidate.Suite == Result.Suite && Candidate.Name == Result.Name)
+				Base = &Candidate;
+		}
+		if (Base == nullptr)
+			continue;
+
+		for (auto& Metric : Result.Metrics)
+		{
+			bool LowerIsBetter = EndsWith(Metric.Key, "_ms");
+			bool HigherIsBetter = Metric.Key == "fps" || EndsWith(Metric.Key, "_per_sec");
+			auto BaseMetric = Base->Find(Metric.Key);
+			if (BaseMetric == nullptr || BaseMetric->Value <= 0.0 || !(LowerIsBetter || HigherIsBetter))
+				continue;
+
+			double Change = (Metric.Value - BaseMetric->Value) / BaseMetric->Value;
+			bool Regressed = LowerIsBetter ? Change > Tolerance : -Change > Tolerance;
+			if (Regressed)
+			{
+				Regressions++;
+				Log << "REGRESSION " << Result.Suite << "/" << Result.Name << " " << Metric.Key << ": "
+					<< BaseMetric->Value << " -> " << Metric.Value << " (" << Change * 100.0 << "%)" << std::endl;
+			}
+		}
+	}
+	return Regressions;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+* Headless benchmark helpers. Every suite produces BenchResults, which are
+* written as CSV/JSON and can be compared against a stored baseline.
+*/
+
+struct BenchMetric
+{
+	std::string Key;
+	double Value;
+};
+
+struct BenchResult
+{
+	std::string Suite;
+	std::string Name;
+	std::vector<BenchMetric> Metrics;
+
+	void Add(const std::string& Key, double Value) { Metrics.push_back({ Key, Value }); }
+	// Returns nullptr if the metric does not exist.
+	const BenchMetric* Find(const std::string& Key) const;
+};
+
+struct BenchOptions
+{
+	uint32_t Frames = 300;
+	uint32_t WarmupFrames = 30;
+	int Width = 1920;
+	int Height = 1080;
+	// Only run the scene or case with this name, empty runs all of them.
+	std::string Scene;
+	// Directory suites write images to, empty writes none.
+	std::string HeatmapDir;
+};
+
+// Nearest rank percentile, P in [0, 100].
+double BenchPercentile(std::vector<double> Samples, double P);
+double BenchMean(const std::vector<double>& Samples);
+
+// Resident and peak resident memory of this process, in megabytes.
+double BenchResidentMB();
+double BenchPeakResidentMB();
+
+// Adds fps, mean/p50/p95/p99 frame time metrics from per frame times in seconds.
+void BenchAddFrameTimes(BenchResult& Result, const std::vector<double>& FrameTimes);
+
+class Renderer;
+// Adds total and per category device memory usage of Rend.
+void BenchAddGpuMemory(BenchResult& Result, Renderer& Rend);
+
+// Suites
+void RunSceneSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunCaptureSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunPermutationSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunDrawSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunPacketSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunTransformSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunHierarchySuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunLodSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunMeshletSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunOcclusionSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunSoftRasterSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunSoftCompareSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunJobSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunPipelineSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunDispatchSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunDynResSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunOverdrawSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunCommandCacheSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunParticleSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunLightSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+void RunShadowSuite(const BenchOptions& Options, std::vector<BenchResult>& Results);
+
+// Output is in long form, one metric per row, so every suite fits in the same file.
+void WriteBenchCsv(std::ostream& Out, const std::vector<BenchResult>& Results);
+void WriteBenchJson(std::ostream& Out, const std::vector<BenchResult>& Results);
+bool ReadBenchCsv(const std::string& Path, std::vector<BenchResult>& Results);
+
+/*
+* Compares every timing metric that exists in both runs. Metrics ending in "_ms"
+* are lower-is-better, "fps" and metrics ending in "_per_sec" are higher-is-better.
+* Everything else is informational. Returns the number of regressions beyond Tolerance.
+*/
+int CompareBenchBaseline(const std::vector<BenchResult>& Current, const std::vector<BenchResult>& Baseline, double Tolerance, std::ostream& Log);
@@ -0,0 +1,223 @@
+#include "BindlessTable.h"
+#include "Renderer.h"
+#include <iostream>
+
+void SlotAllocator::Init(uint32_t Capacity)
+{
+	this->Capacity = Capacity;
+	Next = 0;
+	FreeSlots.clear();
+}
+
+uint32_t SlotAllocator::Allocate()
+{
+	if (!FreeSlots.empty())
+	{
+		uint32_t Slot = FreeSlots.back();
+		FreeSlots.pop_back();
+		return Slot;
+	}
+	if (Next == Capacity)
+		return InvalidSlot;
+	return Next++;
+}
+
+void SlotAllocator::Free(uint32_t Slot)
+{
+	FreeSlots.push_back(Slot);
+}
+
+bool BindlessTable::Init(Renderer* Rend, const BindlessCapacity& Capacity)
+{
+#ifdef VK_EXT_descriptor_indexing
+	this->Rend = Rend;
+	VkDevice Device = Rend->Device;
+
+	VkDescriptorSetLayoutBinding Bindings[3] = {};
+	const VkDescriptorType Types[3] = {
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_SAMPLER };
+	const uint32_t Counts[3] = { Capacity.Buffers, Capacity.Images, Capacity.Samplers };
+	VkDescriptorBindingFlagsEXT BindingFlags[3];
+	VkDescriptorPoolSize PoolSizes[3];
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		Bindings[i].binding = i;
+		Bindings[i].descriptorType = Types[i];
+		Bindings[i].descriptorCount = Counts[i];
+		Bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		// Unused entries may stay unwritten, and entries the GPU does not use may change while bound.
+		BindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+		PoolSizes[i].type = Types[i];
+		PoolSizes[i].descriptorCount = Counts[i];
+		Slots[i].Init(Counts[i]);
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT FlagsInfo = {};
+	FlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	FlagsInfo.bindingCount = 3;
+	FlagsInfo.pBindingFlags = BindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.pNext = &FlagsInfo;
+	LayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	LayoutInfo.bindingCount = 3;
+	LayoutInfo.pBindings = Bindings;
+	if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, NULL, &Layout) != VK_SUCCESS)
+	{
+		std::cout << "Could not create the bindless set layout, using bound descriptor sets.\n";
+		Layout = VK_NULL_HANDLE;
+		return false;
+	}
+
+	VkDescriptorPoolCreateInfo PoolInfo = {};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	PoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	PoolInfo.maxSets = 1;
+	PoolInfo.poolSizeCount = 3;
+	PoolInfo.pPoolSizes = PoolSizes;
+	VkDescriptorSet NewSet = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(Device, &PoolInfo, NULL, &Pool) == VK_SUCCESS)
+	{
+		VkDescriptorSetAllocateInfo AllocInfo = {};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		AllocInfo.descriptorPool = Pool;
+		AllocInfo.descriptorSetCount = 1;
+		AllocInfo.pSetLayouts = &Layout;
+		if (vkAllocateDescriptorSets(Device, &AllocInfo, &NewSet) != VK_SUCCESS)
+			NewSet = VK_NULL_HANDLE;
+	}
+	if (NewSet == VK_NULL_HANDLE)
+	{
+		std::cout << "Could not allocate the bindless table, using bound descriptor sets.\n";
+		Destroy();
+		return false;
+	}
+	Set = NewSet;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void BindlessTable::Destroy()
+{
+	if (Rend == nullptr)
+		return;
+	VkDevice Device = Rend->Device;
+	// Frees Set as well.
+	if (Pool)
+		vkDestroyDescriptorPool(Device, Pool, NULL);
+	if (Layout)
+		vkDestroyDescriptorSetLayout(Device, Layout, NULL);
+	Pool = VK_NULL_HANDLE;
+	Layout = VK_NULL_HANDLE;
+	Set = VK_NULL_HANDLE;
+	Pending.clear();
+}
+
+uint32_t BindlessTable::Allocate(BindlessKind Kind)
+{
+	uint32_t Slot = Slots[(int)Kind].Allocate();
+	if (Slot == SlotAllocator::InvalidSlot)
+		std::cout << "Bindless table is full.\n";
+	return Slot;
+}
+
+uint32_t BindlessTable::RegisterBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkDeviceSize Range)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	uint32_t Slot = Allocate(BindlessKind::Buffer);
+	if (Slot == SlotAllocator::InvalidSlot)
+		return Slot;
+
+	VkDescriptorBufferInfo BufferInfo = { Buffer, Offset, Range };
+	VkWriteDescriptorSet Write = {};
+	Write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	Write.dstSet = Set;
+	Write.dstBinding = 0;
+	Write.dstArrayElement = Slot;
+	Write.descriptorCount = 1;
+	Write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	Write.pBufferInfo = &BufferInfo;
+	vkUpdateDescriptorSets(Rend->Device, 1, &Write, 0, NULL);
+	return Slot;
+}
+
+uint32_t BindlessTable::RegisterImage(VkImageView View, VkImageLayout ImageLayout)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	uint32_t Slot = Allocate(BindlessKind::Image);
+	if (Slot == SlotAllocator::InvalidSlot)
+		return Slot;
+
+	VkDescriptorImageInfo ImageInfo = { VK_NULL_HANDLE, View, ImageLayout };
+	VkWriteDescriptorSet Write = {};
+	Write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	Write.dstSet = Set;
+	Write.dstBinding = 1;
+	Write.dstArrayElement = Slot;
+	Write.descriptorCount = 1;
+	Write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	Write.pImageInfo = &ImageInfo;
+	vkUpdateDescriptorSets(Rend->Device, 1, &Write, 0, NULL);
+	return Slot;
+}
+
+uint32_t BindlessTable::RegisterSampler(VkSampler Sampler)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	uint32_t Slot = Allocate(BindlessKind::Sampler);
+	if (Slot == SlotAllocator::InvalidSlot)
+		return Slot;
+
+	VkDescriptorImageInfo ImageInfo = { Sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+	VkWriteDescriptorSet Write = {};
+	Write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	Write.dstSet = Set;
+	Write.dstBinding = 2;
+	Write.dstArrayElement = Slot;
+	Write.descriptorCount = 1;
+	Write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	Write.pImageInfo = &ImageInfo;
+	vkUpdateDescriptorSets(Rend->Device, 1, &Write, 0, NULL);
+	return Slot;
+}
+
+void BindlessTable::Release(BindlessKind Kind, uint32_t Slot, uint64_t Value)
+{
+	if (Slot == SlotAllocator::InvalidSlot)
+		return;
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Pending.push_back({ Value, Kind, Slot });
+}
+
+void BindlessTable::Collect(uint64_t CompletedValue)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	while (!Pending.empty() && Pending.front().Value <= CompletedValue)
+	{
+		// The stale descriptor stays in the table, partially bound allows that as long as no shader reads it.
+		Slots[(int)Pending.front().Kind].Free(Pending.front().Slot);
+		Pending.pop_front();
+	}
+}
+
+void BindlessTable::Bind(VkCommandBuffer Cmd, VkPipelineLayout PipelineLayout, uint32_t SetIndex)
+{
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, SetIndex, 1, &Set, 0, NULL);
+}
+
+uint32_t BindlessTable::GetUsedCount(BindlessKind Kind)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Slots[(int)Kind].GetUsedCount();
+}
+
+uint32_t BindlessTable::GetCapacity(BindlessKind Kind)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Slots[(int)Kind].GetCapacity();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class Renderer;
+
+enum class BindlessKind
+{
+	Buffer,
+	Image,
+	Sampler,
+	Count
+};
+
+// Table sizes, InitDevice clamps them to the device limits.
+struct BindlessCapacity
+{
+	uint32_t Buffers = 4096;
+	uint32_t Images = 16384;
+	uint32_t Samplers = 128;
+};
+
+// Hands out indices below Capacity, freed ones are reused first.
+class SlotAllocator
+{
+public:
+	static const uint32_t InvalidSlot = UINT32_MAX;
+
+	void Init(uint32_t Capacity);
+	// InvalidSlot when every slot is taken.
+	uint32_t Allocate();
+	void Free(uint32_t Slot);
+	uint32_t GetUsedCount() const { return Next - (uint32_t)FreeSlots.size(); }
+	uint32_t GetCapacity() const { return Capacity; }
+
+private:
+	uint32_t Capacity = 0;
+	// Slots at and above Next were never handed out.
+	uint32_t Next = 0;
+	std::vector<uint32_t> FreeSlots;
+};
+
+/*
+* One big descriptor set for every buffer, image and sampler, built on
+* VK_EXT_descriptor_indexing. It is created update-after-bind and partially bound,
+* so it is bound once per frame and entries can be written while it is bound.
+* Shaders pick entries by the slot numbers Register* returns.
+*
+* A released slot is handed out again only once the GPU passed the value it was
+* released with, same rule as DeletionQueue.
+*/
+class BindlessTable
+{
+public:
+	// Returns false if the set can not be created, the table stays disabled then.
+	bool Init(Renderer* Rend, const BindlessCapacity& Capacity);
+	void Destroy();
+	bool IsEnabled() const { return Set != VK_NULL_HANDLE; }
+
+	// Binding 0, storage buffers.
+	uint32_t RegisterBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkDeviceSize Range);
+	// Binding 1, sampled images.
+	uint32_t RegisterImage(VkImageView View, VkImageLayout Layout);
+	// Binding 2, samplers.
+	uint32_t RegisterSampler(VkSampler Sampler);
+
+	void Release(BindlessKind Kind, uint32_t Slot, uint64_t Value);
+	// Makes the slots released with a value <= CompletedValue available again.
+	void Collect(uint64_t CompletedValue);
+
+	void Bind(VkCommandBuffer Cmd, VkPipelineLayout Layout, uint32_t SetIndex);
+
+	VkDescriptorSetLayout GetLayout() const { return Layout; }
+	uint32_t GetUsedCount(BindlessKind Kind);
+	uint32_t GetCapacity(BindlessKind Kind);
+
+private:
+	struct Released
+	{
+		uint64_t Value;
+		BindlessKind Kind;
+		uint32_t Slot;
+	};
+
+	// Must hold Mutex.
+	uint32_t Allocate(BindlessKind Kind);
+
+	Renderer* Rend = nullptr;
+	VkDescriptorSetLayout Layout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+
+	std::mutex Mutex;
+	SlotAllocator Slots[(int)BindlessKind::Count];
+	std::deque<Released> Pending;
+};
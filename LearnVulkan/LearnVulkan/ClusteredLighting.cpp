@@ -0,0 +1,415 @@
+#include "ClusteredLighting.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Same uniform as the CLUSTERED_LIGHTING block of the cube's fragment shader.
+static const char* binShaderText =
+"#version 450\n"
+"layout (local_size_x = 64) in;\n"
+"struct Light {\n"
+"    // xyz = position, w = radius.\n"
+"    vec4 position;\n"
+"    // rgb = color times intensity.\n"
+"    vec4 color;\n"
+"};\n"
+"layout (std140, binding = 0) uniform clusterVals {\n"
+"    mat4 view;\n"
+"    mat4 inverseProjection;\n"
+"    // x, y, z = clusters along each axis, w = all of them.\n"
+"    uvec4 clusterCount;\n"
+"    // x = lights, y = room per cluster, z = tile size in pixels, w = 1 to shade with every light.\n"
+"    uvec4 config;\n"
+"    // xy = render size, z = near plane, w = depth slices per unit of log depth.\n"
+"    vec4 screen;\n"
+"    vec4 ambient;\n"
+"} cluster;\n"
+"layout (std430, binding = 1) readonly buffer lightBuffer { Light lights[]; };\n"
+"layout (std430, binding = 2) writeonly buffer countBuffer { uint clusterLightCounts[]; };\n"
+"layout (std430, binding = 3) writeonly buffer indexBuffer { uint clusterLights[]; };\n"
+"layout (std430, binding = 4) buffer statsBuffer {\n"
+"    uint references;\n"
+"    uint overflowed;\n"
+"    uint maxLights;\n"
+"};\n"
+"// View space spheres of a batch of lights, shared by the workgroup's clusters.\n"
+"shared vec4 batchLights[64];\n"
+"// View space point at depth along the ray through ndc.\n"
+"vec3 pointAtDepth(vec2 ndc, float depth) {\n"
+"    vec4 p = cluster.inverseProjection * vec4(ndc, 1.0, 1.0);\n"
+"    vec3 ray = p.xyz / p.w;\n"
+"    return ray * (depth / -ray.z);\n"
+"}\n"
+"void main() {\n"
+"    uint index = gl_GlobalInvocationID.x;\n"
+"    // Past the last cluster threads still load lights and meet the barriers.\n"
+"    bool valid = index < cluster.clusterCount.w;\n"
+"    uvec3 size = cluster.clusterCount.xyz;\n"
+"    uvec3 id = uvec3(index % size.x, (index / size.x) % size.y, index / (size.x * size.y));\n"
+"    // Box around the cluster: its tile's corners at the near and far depth of its slice.\n"
+"    vec2 tileSize = vec2(cluster.config.z) / cluster.screen.xy * 2.0;\n"
+"    vec2 lo = vec2(id.xy) * tileSize - 1.0;\n"
+"    vec2 hi = min(lo + tileSize, vec2(1.0));\n"
+"    float near = cluster.screen.z * exp(float(id.z) / cluster.screen.w);\n"
+"    float far = cluster.screen.z * exp(float(id.z + 1u) / cluster.screen.w);\n"
+"    vec3 boxLo = vec3(1e30);\n"
+"    vec3 boxHi = vec3(-1e30);\n"
+"    for (int i = 0; i < 8; i++) {\n"
+"        vec2 ndc = vec2((i & 1) != 0 ? hi.x : lo.x, (i & 2) != 0 ? hi.y : lo.y);\n"
+"        vec3 p = pointAtDepth(ndc, (i & 4) != 0 ? far : near);\n"
+"        boxLo = min(boxLo, p);\n"
+"        boxHi = max(boxHi, p);\n"
+"    }\n"
+"    uint room = cluster.config.y;\n"
+"    uint count = 0u;\n"
+"    // Nothing to bin when every fragment shades with every light.\n"
+"    uint lightCount = cluster.config.w != 0u ? 0u : cluster.config.x;\n"
+"    for (uint first = 0u; first < lightCount; first += 64u) {\n"
+"        uint light = first + gl_LocalInvocationIndex;\n"
+"        if (light < lightCount) {\n"
+"            Light l = lights[light];\n"
+"            batchLights[gl_LocalInvocationIndex] = vec4((cluster.view * vec4(l.position.xyz, 1.0)).xyz, l.position.w);\n"
+"        }\n"
+"        barrier();\n"
+"        uint batch = min(64u, lightCount - first);\n"
+"        for (uint i = 0u; valid && i < batch; i++) {\n"
+"            vec4 sphere = batchLights[i];\n"
+"            vec3 offset = clamp(sphere.xyz, boxLo, boxHi) - sphere.xyz;\n"
+"            if (dot(offset, offset) <= sphere.w * sphere.w) {\n"
+"                if (count < room)\n"
+"                    clusterLights[index * room + count] = first + i;\n"
+"                count++;\n"
+"            }\n"
+"        }\n"
+"        barrier();\n"
+"    }\n"
+"    if (valid) {\n"
+"        clusterLightCounts[index] = count;\n"
+"        atomicAdd(references, min(count, room));\n"
+"        if (count > room)\n"
+"            atomicAdd(overflowed, 1u);\n"
+"        atomicMax(maxLights, count);\n"
+"    }\n"
+"}\n";
+
+// Layout of the uniform buffer.
+struct ClusterUniform
+{
+	glm::mat4 View;
+	glm::mat4 InverseProjection;
+	uint32_t ClusterCount[4];
+	uint32_t Config[4];
+	glm::vec4 Screen;
+	glm::vec4 Ambient;
+};
+
+static void CreateBuffer(Renderer* Rend, VkDeviceSize Size, VkBufferUsageFlags Usage, VkFlags Properties,
+	MemoryCategory Category, VkBuffer* Buffer, VkDeviceMemory* Memory)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.usage = Usage;
+	buf_info.size = Size;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto res = vkCreateBuffer(Rend->Device, &buf_info, NULL, Buffer);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(Rend->Device, *Buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits, Properties, &alloc_info.memoryTypeIndex))
+		std::exit(-1);
+
+	res = Rend->AllocateMemory(&alloc_info, Category, Memory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	res = vkBindBufferMemory(Rend->Device, *Buffer, *Memory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+ClusteredLighting::ClusteredLighting(Renderer* Rend, uint32_t MaxLights, const std::string& VertSource, const std::string& FragSource,
+	uint32_t TileSize, uint32_t Slices, uint32_t LightsPerCluster)
+	: Rend(Rend), MaxLights(std::max(MaxLights, 1u)), TileSize(std::max(TileSize, 1u)), Slices(std::max(Slices, 1u)),
+	LightsPerCluster(std::max(LightsPerCluster, 1u))
+{
+	MaxClusters = ((Rend->SurfaceSizeX + this->TileSize - 1) / this->TileSize) *
+		((Rend->SurfaceSizeY + this->TileSize - 1) / this->TileSize) * this->Slices;
+	// The renderer's sets, then the bindless table when it has one.
+	SetIndex = (uint32_t)Rend->DescriptorSetLayouts.size() + (Rend->Bindless.IsEnabled() ? 1 : 0);
+
+	InitBuffers();
+	InitDescriptors();
+	InitPipelines(VertSource, FragSource);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	if (Rend->ShaderReload)
+		Rend->ShaderReload->RemoveTarget(ReloadTarget);
+	VkDevice Device = Rend->Device;
+	// Frames already submitted may still use them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	Retired.RetirePipeline(Value, Pipeline);
+	Retired.RetirePipeline(Value, BinPipeline);
+	for (auto Module : Modules)
+		Retired.RetireShaderModule(Value, Module);
+	Retired.RetirePipelineLayout(Value, DrawLayout);
+	Retired.RetirePipelineLayout(Value, BinLayout);
+	Retired.RetireDescriptorPool(Value, DescriptorPool);
+	Retired.RetireDescriptorSetLayout(Value, SetLayout);
+
+	vkUnmapMemory(Device, UniformMemory);
+	vkUnmapMemory(Device, LightMemory);
+	vkUnmapMemory(Device, StatsMemory);
+	const VkBuffer Buffers[] = { UniformBuffer, LightBuffer, CountBuffer, IndexBuffer, StatsBuffer };
+	const VkDeviceMemory Memories[] = { UniformMemory, LightMemory, CountMemory, IndexMemory, StatsMemory };
+	for (int i = 0; i < 5; i++)
+	{
+		Retired.RetireBuffer(Value, Buffers[i]);
+		Retired.RetireMemory(Value, Memories[i]);
+	}
+}
+
+void ClusteredLighting::InitBuffers()
+{
+	const VkFlags HostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	CreateBuffer(Rend, sizeof(ClusterUniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, HostMemory,
+		MemoryCategory::Uniform, &UniformBuffer, &UniformMemory);
+	auto res = vkMapMemory(Rend->Device, UniformMemory, 0, VK_WHOLE_SIZE, 0, &Uniform);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	memset(Uniform, 0, sizeof(ClusterUniform));
+
+	CreateBuffer(Rend, sizeof(PointLight) * MaxLights, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HostMemory,
+		MemoryCategory::Uniform, &LightBuffer, &LightMemory);
+	res = vkMapMemory(Rend->Device, LightMemory, 0, VK_WHOLE_SIZE, 0, (void**)&MappedLights);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	CreateBuffer(Rend, sizeof(uint32_t) * MaxClusters, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, &CountBuffer, &CountMemory);
+	CreateBuffer(Rend, sizeof(uint32_t) * MaxClusters * LightsPerCluster, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, &IndexBuffer, &IndexMemory);
+
+	CreateBuffer(Rend, sizeof(uint32_t) * 3, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		HostMemory, MemoryCategory::Other, &StatsBuffer, &StatsMemory);
+	res = vkMapMemory(Rend->Device, StatsMemory, 0, VK_WHOLE_SIZE, 0, (void**)&Stats);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	memset((void*)Stats, 0, sizeof(uint32_t) * 3);
+}
+
+void ClusteredLighting::InitDescriptors()
+{
+	// The uniform, the lights, the counts and indices, then the stats only the binning writes.
+	VkDescriptorSetLayoutBinding Bindings[5] = {};
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		Bindings[i].binding = i;
+		Bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		Bindings[i].descriptorCount = 1;
+		Bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | (i < 4 ? VK_SHADER_STAGE_FRAGMENT_BIT : 0);
+	}
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.bindingCount = 5;
+	LayoutInfo.pBindings = Bindings;
+	auto res = vkCreateDescriptorSetLayout(Rend->Device, &LayoutInfo, NULL, &SetLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorPoolSize PoolSizes[2] = {};
+	PoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	PoolSizes[0].descriptorCount = 1;
+	PoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	PoolSizes[1].descriptorCount = 4;
+	VkDescriptorPoolCreateInfo PoolInfo = {};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	PoolInfo.maxSets = 1;
+	PoolInfo.poolSizeCount = 2;
+	PoolInfo.pPoolSizes = PoolSizes;
+	res = vkCreateDescriptorPool(Rend->Device, &PoolInfo, NULL, &DescriptorPool);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorSetAllocateInfo AllocInfo = {};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	AllocInfo.descriptorPool = DescriptorPool;
+	AllocInfo.descriptorSetCount = 1;
+	AllocInfo.pSetLayouts = &SetLayout;
+	res = vkAllocateDescriptorSets(Rend->Device, &AllocInfo, &Set);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorBufferInfo BufferInfos[5] = {
+		{ UniformBuffer, 0, VK_WHOLE_SIZE },
+		{ LightBuffer, 0, VK_WHOLE_SIZE },
+		{ CountBuffer, 0, VK_WHOLE_SIZE },
+		{ IndexBuffer, 0, VK_WHOLE_SIZE },
+		{ StatsBuffer, 0, VK_WHOLE_SIZE },
+	};
+	VkWriteDescriptorSet Writes[5] = {};
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		Writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		Writes[i].dstSet = Set;
+		Writes[i].dstBinding = i;
+		Writes[i].descriptorCount = 1;
+		Writes[i].descriptorType = Bindings[i].descriptorType;
+		Writes[i].pBufferInfo = &BufferInfos[i];
+	}
+	vkUpdateDescriptorSets(Rend->Device, 5, Writes, 0, NULL);
+}
+
+void ClusteredLighting::InitPipelines(const std::string& VertSource, const std::string& FragSource)
+{
+	const VkShaderStageFlagBits Stages[3] = { VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	const std::string Sources[3] = { binShaderText, VertSource, FragSource };
+	const std::string DrawData = "#define DRAW_DATA " + std::to_string((int)Rend->DrawPath) + "\n";
+	const std::string Preambles[3] = { "", DrawData,
+		DrawData + "#define CLUSTERED_LIGHTING 1\n#define LIGHT_SET " + std::to_string(SetIndex) + "\n" };
+	for (int i = 0; i < 3; i++)
+	{
+		std::vector<unsigned int> Spirv;
+		if (!Rend->GLSLtoSPV(Stages[i], Sources[i].c_str(), Spirv, Preambles[i].empty() ? nullptr : Preambles[i].c_str()))
+			std::exit(-1);
+		Modules[i] = Rend->CreateShaderModule(Spirv);
+		if (Modules[i] == VK_NULL_HANDLE)
+			std::exit(-1);
+	}
+
+	VkPipelineLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	LayoutInfo.setLayoutCount = 1;
+	LayoutInfo.pSetLayouts = &SetLayout;
+	auto res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &BinLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// Same sets and push constants as the renderer's PipelineLayout up to the light set, so
+	// what RecordFrame binds and pushes with that layout stays valid for this pipeline.
+	std::vector<VkDescriptorSetLayout> DrawSets = Rend->DescriptorSetLayouts;
+	if (Rend->Bindless.IsEnabled())
+		DrawSets.push_back(Rend->Bindless.GetLayout());
+	DrawSets.push_back(SetLayout);
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	PushRange.size = sizeof(::DrawData);
+	LayoutInfo.setLayoutCount = (uint32_t)DrawSets.size();
+	LayoutInfo.pSetLayouts = DrawSets.data();
+	LayoutInfo.pushConstantRangeCount = 1;
+	LayoutInfo.pPushConstantRanges = &PushRange;
+	res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &DrawLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkComputePipelineCreateInfo ComputeInfo = {};
+	ComputeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	ComputeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ComputeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	ComputeInfo.stage.module = Modules[0];
+	ComputeInfo.stage.pName = "main";
+	ComputeInfo.layout = BinLayout;
+	res = vkCreateComputePipelines(Rend->Device, Rend->PipelineCache, 1, &ComputeInfo, NULL, &BinPipeline);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkPipelineShaderStageCreateInfo DrawStages[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		DrawStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		DrawStages[i].stage = Stages[i + 1];
+		DrawStages[i].module = Modules[i + 1];
+		DrawStages[i].pName = "main";
+	}
+	Pipeline = Rend->CreateGraphicsPipeline(VK_TRUE, VK_TRUE, DrawStages, DrawLayout);
+
+	// The bin shader is our own, only the draw pipeline comes from the cube's files.
+	if (Rend->ShaderReload)
+	{
+		ShaderReloadTarget Target;
+		Target.Preambles[0] = Preambles[1];
+		Target.Preambles[1] = Preambles[2];
+		Target.Layout = DrawLayout;
+		Target.Pipeline = &Pipeline;
+		Target.Modules[0] = &Modules[1];
+		Target.Modules[1] = &Modules[2];
+		ReloadTarget = Rend->ShaderReload->AddTarget(Target);
+	}
+}
+
+void ClusteredLighting::Update()
+{
+	uint32_t Width = Rend->RenderExtent.width;
+	uint32_t Height = Rend->RenderExtent.height;
+	uint32_t TilesX = (Width + TileSize - 1) / TileSize;
+	uint32_t TilesY = (Height + TileSize - 1) / TileSize;
+	ClusterCount = TilesX * TilesY * Slices;
+	uint32_t LightCount = std::min((uint32_t)Lights.size(), MaxLights);
+	memcpy(MappedLights, Lights.data(), sizeof(PointLight) * LightCount);
+
+	// Planes of glm::perspective: [2][2] = -(f + n) / (f - n), [3][2] = -2fn / (f - n).
+	const glm::mat4& Projection = Rend->Projection;
+	float Near = Projection[3][2] / (Projection[2][2] - 1.0f);
+	float Far = Projection[3][2] / (Projection[2][2] + 1.0f);
+
+	ClusterUniform Data;
+	Data.View = Rend->View * Rend->Model;
+	Data.InverseProjection = glm::inverse(Projection);
+	Data.ClusterCount[0] = TilesX;
+	Data.ClusterCount[1] = TilesY;
+	Data.ClusterCount[2] = Slices;
+	Data.ClusterCount[3] = ClusterCount;
+	Data.Config[0] = LightCount;
+	Data.Config[1] = LightsPerCluster;
+	Data.Config[2] = TileSize;
+	Data.Config[3] = ShadeAllLights ? 1 : 0;
+	Data.Screen = glm::vec4((float)Width, (float)Height, Near, Slices / std::log(Far / Near));
+	Data.Ambient = glm::vec4(Ambient, 0.0f);
+	memcpy(Uniform, &Data, sizeof(Data));
+}
+
+void ClusteredLighting::RecordBinning(VkCommandBuffer Cmd)
+{
+	vkCmdFillBuffer(Cmd, StatsBuffer, 0, VK_WHOLE_SIZE, 0);
+	VkMemoryBarrier Barrier = {};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+
+	// One thread per cluster, the light count comes from the uniform.
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, BinPipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, BinLayout, 0, 1, &Set, 0, NULL);
+	vkCmdDispatch(Cmd, (ClusterCount + 63) / 64, 1, 1);
+
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+}
+
+void ClusteredLighting::BindSet(VkCommandBuffer Cmd)
+{
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawLayout, SetIndex, 1, &Set, 0, NULL);
+}
+
+ClusterLightStats ClusteredLighting::GetStats() const
+{
+	ClusterLightStats Result;
+	Result.Clusters = ClusterCount;
+	Result.References = Stats[0];
+	Result.Overflowed = Stats[1];
+	Result.MaxLights = Stats[2];
+	return Result;
+}
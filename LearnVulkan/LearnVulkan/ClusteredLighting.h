@@ -0,0 +1,119 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+// In the space Draws' models map to, like the cube.
+struct PointLight
+{
+	glm::vec3 Position = glm::vec3(0.0f);
+	// Light falls off to nothing at this distance.
+	float Radius = 1.0f;
+	// Color times intensity, alpha is unused.
+	glm::vec4 Color = glm::vec4(1.0f);
+};
+
+// Light lists of the last binned frame, once it finished on the GPU.
+struct ClusterLightStats
+{
+	uint32_t Clusters = 0;
+	// Light indices written, over all clusters.
+	uint32_t References = 0;
+	// Clusters with more lights than LightsPerCluster, the rest are dropped.
+	uint32_t Overflowed = 0;
+	uint32_t MaxLights = 0;
+};
+
+/*
+* Clustered forward lighting. The view frustum, taken from Renderer::Projection, is cut
+* into TileSize pixel tiles on screen and Slices exponential slices in depth. Every frame
+* a compute pass tests each light's sphere against each cluster's view space box and
+* writes the indices of the ones touching it, up to LightsPerCluster. The cube's fragment
+* shader, built with CLUSTERED_LIGHTING, then only shades with the lights of its cluster.
+*
+* The lights, the camera and the render size go through a uniform buffer Update writes,
+* so the recorded commands stay the same from frame to frame and can be cached.
+* Buffers are written by the CPU every frame, so the previous frame must be finished,
+* which DrawCube ensures.
+*/
+class ClusteredLighting
+{
+public:
+	// The sources are the cube's shaders, compiled for the renderer's current DrawPath.
+	// The clusters are sized for the full surface.
+	ClusteredLighting(Renderer* Rend, uint32_t MaxLights, const std::string& VertSource, const std::string& FragSource,
+		uint32_t TileSize = 64, uint32_t Slices = 24, uint32_t LightsPerCluster = 128);
+	~ClusteredLighting();
+
+	// Copies Lights and the renderer's camera and RenderExtent into the uniform buffer.
+	void Update();
+	// Records the binning dispatch, outside a render pass.
+	void RecordBinning(VkCommandBuffer Cmd);
+	// Binds the light set for GetPipeline, inside the render pass after the renderer's sets.
+	void BindSet(VkCommandBuffer Cmd);
+	// Draws with the renderer's DrawData and sets, so it replaces its pipelines.
+	VkPipeline GetPipeline() const { return Pipeline; }
+	// Starts like the renderer's PipelineLayout. Draws bind their sets with it, so the light set stays bound.
+	VkPipelineLayout GetLayout() const { return DrawLayout; }
+
+	ClusterLightStats GetStats() const;
+	uint32_t GetMaxLights() const { return MaxLights; }
+
+	// At most GetMaxLights are used.
+	std::vector<PointLight> Lights;
+	glm::vec3 Ambient = glm::vec3(0.1f);
+	// Bins nothing and shades every fragment with every light, to compare against.
+	bool ShadeAllLights = false;
+
+private:
+	void InitBuffers();
+	void InitDescriptors();
+	void InitPipelines(const std::string& VertSource, const std::string& FragSource);
+
+	Renderer* Rend;
+	uint32_t MaxLights;
+	uint32_t TileSize;
+	uint32_t Slices;
+	uint32_t LightsPerCluster;
+	// For the full surface, RenderExtent may use fewer.
+	uint32_t MaxClusters;
+	// Of the last Update.
+	uint32_t ClusterCount = 0;
+	// Where the light set goes, after the renderer's sets.
+	uint32_t SetIndex;
+
+	// The uniform, persistently mapped.
+	VkBuffer UniformBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory UniformMemory = VK_NULL_HANDLE;
+	void* Uniform = nullptr;
+	// Persistently mapped.
+	VkBuffer LightBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory LightMemory = VK_NULL_HANDLE;
+	PointLight* MappedLights = nullptr;
+	// Light count per cluster, then LightsPerCluster indices per cluster. Only the GPU touches them.
+	VkBuffer CountBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory CountMemory = VK_NULL_HANDLE;
+	VkBuffer IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory IndexMemory = VK_NULL_HANDLE;
+	// References, overflowed clusters and the largest count. Persistently mapped.
+	VkBuffer StatsBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory StatsMemory = VK_NULL_HANDLE;
+	const uint32_t* Stats = nullptr;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+	VkPipelineLayout BinLayout = VK_NULL_HANDLE;
+	VkPipeline BinPipeline = VK_NULL_HANDLE;
+	// The renderer's sets and push constants with the light set after them.
+	VkPipelineLayout DrawLayout = VK_NULL_HANDLE;
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	VkShaderModule Modules[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+	// Pipeline at the renderer's ShaderReload, when it has one.
+	uint32_t ReloadTarget = UINT32_MAX;
+};
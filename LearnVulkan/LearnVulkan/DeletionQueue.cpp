@@ -0,0 +1,190 @@
+#include "DeletionQueue.h"
+#include "Renderer.h"
+#include <vector>
+
+void DeletionQueue::Init(Renderer* Rend)
+{
+	this->Rend = Rend;
+}
+
+void DeletionQueue::RetireBuffer(uint64_t Value, VkBuffer Buffer)
+{
+	Retire(Value, ObjectType::Buffer, (uint64_t)Buffer);
+}
+
+void DeletionQueue::RetireImage(uint64_t Value, VkImage Image)
+{
+	Retire(Value, ObjectType::Image, (uint64_t)Image);
+}
+
+void DeletionQueue::RetireImageView(uint64_t Value, VkImageView View)
+{
+	Retire(Value, ObjectType::ImageView, (uint64_t)View);
+}
+
+void DeletionQueue::RetireMemory(uint64_t Value, VkDeviceMemory Memory)
+{
+	Retire(Value, ObjectType::Memory, (uint64_t)Memory);
+}
+
+void DeletionQueue::RetirePipeline(uint64_t Value, VkPipeline Pipeline)
+{
+	Retire(Value, ObjectType::Pipeline, (uint64_t)Pipeline);
+}
+
+void DeletionQueue::RetirePipelineLayout(uint64_t Value, VkPipelineLayout Layout)
+{
+	Retire(Value, ObjectType::PipelineLayout, (uint64_t)Layout);
+}
+
+void DeletionQueue::RetireShaderModule(uint64_t Value, VkShaderModule Module)
+{
+	Retire(Value, ObjectType::ShaderModule, (uint64_t)Module);
+}
+
+void DeletionQueue::RetireFramebuffer(uint64_t Value, VkFramebuffer Framebuffer)
+{
+	Retire(Value, ObjectType::Framebuffer, (uint64_t)Framebuffer);
+}
+
+void DeletionQueue::RetireDescriptorSet(uint64_t Value, VkDescriptorPool Pool, VkDescriptorSet Set)
+{
+	Retire(Value, ObjectType::DescriptorSet, (uint64_t)Set, (uint64_t)Pool);
+}
+
+void DeletionQueue::RetireDescriptorPool(uint64_t Value, VkDescriptorPool Pool)
+{
+	Retire(Value, ObjectType::DescriptorPool, (uint64_t)Pool);
+}
+
+void DeletionQueue::RetireDescriptorSetLayout(uint64_t Value, VkDescriptorSetLayout Layout)
+{
+	Retire(Value, ObjectType::DescriptorSetLayout, (uint64_t)Layout);
+}
+
+void DeletionQueue::RetireSampler(uint64_t Value, VkSampler Sampler)
+{
+	Retire(Value, ObjectType::Sampler, (uint64_t)Sampler);
+}
+
+void DeletionQueue::RetireRenderPass(uint64_t Value, VkRenderPass RenderPass)
+{
+	Retire(Value, ObjectType::RenderPass, (uint64_t)RenderPass);
+}
+
+void DeletionQueue::RetireQueryPool(uint64_t Value, VkQueryPool Pool)
+{
+	Retire(Value, ObjectType::QueryPool, (uint64_t)Pool);
+}
+
+void DeletionQueue::Retire(uint64_t Value, ObjectType Type, uint64_t Handle, uint64_t Owner)
+{
+	if (Handle == 0)
+		return;
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Entries.push_back({ Value, Type, Handle, Owner });
+}
+
+void DeletionQueue::Collect(uint64_t CompletedValue)
+{
+	// Destroy outside the lock, freeing memory can call back into code that retires more.
+	std::vector<Entry> Ready;
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		while (!Entries.empty() && Entries.front().Value <= CompletedValue)
+		{
+			Ready.push_back(Entries.front());
+			Entries.pop_front();
+		}
+	}
+	for (auto& E : Ready)
+		Destroy(E);
+}
+
+void DeletionQueue::Flush()
+{
+	Collect(UINT64_MAX);
+}
+
+size_t DeletionQueue::GetPendingCount()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Entries.size();
+}
+
+size_t DeletionQueue::GetPendingDescriptorSets(VkDescriptorPool Pool)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	size_t Count = 0;
+	for (auto& E : Entries)
+	{
+		if (E.Type == ObjectType::DescriptorSet && E.Owner == (uint64_t)Pool)
+			Count++;
+	}
+	return Count;
+}
+
+uint64_t DeletionQueue::GetOldestDescriptorSetValue(VkDescriptorPool Pool)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	for (auto& E : Entries)
+	{
+		if (E.Type == ObjectType::DescriptorSet && E.Owner == (uint64_t)Pool)
+			return E.Value;
+	}
+	return 0;
+}
+
+void DeletionQueue::Destroy(const Entry& E)
+{
+	VkDevice Device = Rend->Device;
+	switch (E.Type)
+	{
+	case ObjectType::Buffer:
+		vkDestroyBuffer(Device, (VkBuffer)E.Handle, NULL);
+		break;
+	case ObjectType::Image:
+		vkDestroyImage(Device, (VkImage)E.Handle, NULL);
+		break;
+	case ObjectType::ImageView:
+		vkDestroyImageView(Device, (VkImageView)E.Handle, NULL);
+		break;
+	case ObjectType::Memory:
+		// Through the renderer so the memory tracker sees it.
+		Rend->FreeMemory((VkDeviceMemory)E.Handle);
+		break;
+	case ObjectType::Pipeline:
+		vkDestroyPipeline(Device, (VkPipeline)E.Handle, NULL);
+		break;
+	case ObjectType::PipelineLayout:
+		vkDestroyPipelineLayout(Device, (VkPipelineLayout)E.Handle, NULL);
+		break;
+	case ObjectType::ShaderModule:
+		vkDestroyShaderModule(Device, (VkShaderModule)E.Handle, NULL);
+		break;
+	case ObjectType::Framebuffer:
+		vkDestroyFramebuffer(Device, (VkFramebuffer)E.Handle, NULL);
+		break;
+	case ObjectType::DescriptorSet:
+	{
+		VkDescriptorSet Set = (VkDescriptorSet)E.Handle;
+		vkFreeDescriptorSets(Device, (VkDescriptorPool)E.Owner, 1, &Set);
+		break;
+	}
+	case ObjectType::DescriptorPool:
+		vkDestroyDescriptorPool(Device, (VkDescriptorPool)E.Handle, NULL);
+		break;
+	case ObjectType::DescriptorSetLayout:
+		vkDestroyDescriptorSetLayout(Device, (VkDescriptorSetLayout)E.Handle, NULL);
+		break;
+	case ObjectType::Sampler:
+		vkDestroySampler(Device, (VkSampler)E.Handle, NULL);
+		break;
+	case ObjectType::RenderPass:
+		vkDestroyRenderPass(Device, (VkRenderPass)E.Handle, NULL);
+		break;
+	case ObjectType::QueryPool:
+		vkDestroyQueryPool(Device, (VkQueryPool)E.Handle, NULL);
+		break;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <deque>
+#include <mutex>
+
+class Renderer;
+
+/*
+* Holds on to Vulkan objects that were replaced while the GPU may still use them.
+* Each object is retired with the value the GPU has to reach before it is unused,
+* a frame count or a timeline semaphore value, and destroyed by Collect once the
+* completed value passes it. Values must never go down.
+*/
+class DeletionQueue
+{
+public:
+	void Init(Renderer* Rend);
+
+	void RetireBuffer(uint64_t Value, VkBuffer Buffer);
+	void RetireImage(uint64_t Value, VkImage Image);
+	void RetireImageView(uint64_t Value, VkImageView View);
+	void RetireMemory(uint64_t Value, VkDeviceMemory Memory);
+	void RetirePipeline(uint64_t Value, VkPipeline Pipeline);
+	void RetirePipelineLayout(uint64_t Value, VkPipelineLayout Layout);
+	void RetireShaderModule(uint64_t Value, VkShaderModule Module);
+	void RetireFramebuffer(uint64_t Value, VkFramebuffer Framebuffer);
+	void RetireDescriptorSet(uint64_t Value, VkDescriptorPool Pool, VkDescriptorSet Set);
+	// Frees every set still allocated from it.
+	void RetireDescriptorPool(uint64_t Value, VkDescriptorPool Pool);
+	void RetireDescriptorSetLayout(uint64_t Value, VkDescriptorSetLayout Layout);
+	void RetireSampler(uint64_t Value, VkSampler Sampler);
+	void RetireRenderPass(uint64_t Value, VkRenderPass RenderPass);
+	void RetireQueryPool(uint64_t Value, VkQueryPool Pool);
+
+	// Destroys everything retired with a value <= CompletedValue.
+	void Collect(uint64_t CompletedValue);
+	// Destroys everything, the device has to be idle.
+	void Flush();
+
+	size_t GetPendingCount();
+	// Retired sets from Pool not freed yet.
+	size_t GetPendingDescriptorSets(VkDescriptorPool Pool);
+	// Value of the oldest retired set from Pool, 0 if there is none.
+	uint64_t GetOldestDescriptorSetValue(VkDescriptorPool Pool);
+
+private:
+	enum class ObjectType
+	{
+		Buffer,
+		Image,
+		ImageView,
+		Memory,
+		Pipeline,
+		PipelineLayout,
+		ShaderModule,
+		Framebuffer,
+		DescriptorSet,
+		DescriptorPool,
+		DescriptorSetLayout,
+		Sampler,
+		RenderPass,
+		QueryPool
+	};
+
+	struct Entry
+	{
+		uint64_t Value;
+		ObjectType Type;
+		uint64_t Handle;
+		// Pool the descriptor set came from.
+		uint64_t Owner;
+	};
+
+	void Retire(uint64_t Value, ObjectType Type, uint64_t Handle, uint64_t Owner = 0);
+	void Destroy(const Entry& E);
+
+	Renderer* Rend = nullptr;
+	std::mutex Mutex;
+	// In retire order, so also in value order.
+	std::deque<Entry> Entries;
+};
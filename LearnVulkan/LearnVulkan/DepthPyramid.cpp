@@ -0,0 +1,350 @@
+#include "DepthPyramid.h"
+#include "Renderer.h"
+#include <algorithm>
+
+static const char* reduceShaderText =
+"#version 450\n"
+"layout (local_size_x = 8, local_size_y = 8) in;\n"
+"// The depth buffer or the level below.\n"
+"layout (binding = 0) uniform sampler2D source;\n"
+"layout (binding = 1, r32f) uniform writeonly image2D target;\n"
+"layout (push_constant) uniform reduceVals {\n"
+"    ivec2 sourceSize;\n"
+"    ivec2 targetSize;\n"
+"};\n"
+"void main() {\n"
+"    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);\n"
+"    if (any(greaterThanEqual(texel, targetSize)))\n"
+"        return;\n"
+"    // Every source texel this one overlaps, 2x2 between levels and up to 3x3 from\n"
+"    // a depth buffer that is not a power of two.\n"
+"    ivec2 first = texel * sourceSize / targetSize;\n"
+"    ivec2 last = min(((texel + 1) * sourceSize + targetSize - 1) / targetSize, sourceSize) - 1;\n"
+"    float depth = 0.0;\n"
+"    for (int y = first.y; y <= last.y; y++) {\n"
+"        for (int x = first.x; x <= last.x; x++)\n"
+"            depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);\n"
+"    }\n"
+"    imageStore(target, texel, vec4(depth));\n"
+"}\n";
+
+// Layout of the reduce shader's push constants.
+struct ReduceConstants
+{
+	int32_t SourceSize[2];
+	int32_t TargetSize[2];
+};
+
+static uint32_t PreviousPowerOfTwo(uint32_t Value)
+{
+	uint32_t Power = 1;
+	while (Power * 2 <= Value)
+		Power *= 2;
+	return Power;
+}
+
+bool DepthPyramid::IsSupported(const Renderer* Rend)
+{
+	return Rend->DepthSampled;
+}
+
+DepthPyramid::DepthPyramid(Renderer* Rend)
+	: Rend(Rend)
+{
+	Width = PreviousPowerOfTwo((uint32_t)Rend->SurfaceSizeX);
+	Height = PreviousPowerOfTwo((uint32_t)Rend->SurfaceSizeY);
+	LevelCount = 1;
+	while ((std::max(Width, Height) >> LevelCount) != 0)
+		LevelCount++;
+
+	InitImage();
+	InitDescriptors();
+	InitPipeline();
+
+	if (Rend->DeviceProperties.limits.timestampComputeAndGraphics)
+	{
+		VkQueryPoolCreateInfo QueryInfo = {};
+		QueryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		QueryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		QueryInfo.queryCount = 2;
+		auto res = vkCreateQueryPool(Rend->Device, &QueryInfo, NULL, &Timestamps);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	// Frames already submitted may still use them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	Retired.RetireQueryPool(Value, Timestamps);
+	Retired.RetirePipeline(Value, Pipeline);
+	Retired.RetireShaderModule(Value, Module);
+	Retired.RetirePipelineLayout(Value, Layout);
+	Retired.RetireDescriptorPool(Value, DescriptorPool);
+	Retired.RetireDescriptorSetLayout(Value, SetLayout);
+	Retired.RetireSampler(Value, Sampler);
+	for (auto LevelView : LevelViews)
+		Retired.RetireImageView(Value, LevelView);
+	Retired.RetireImageView(Value, View);
+	Retired.RetireImage(Value, Image);
+	Retired.RetireMemory(Value, Memory);
+}
+
+void DepthPyramid::InitImage()
+{
+	VkImageCreateInfo ImageInfo = {};
+	ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+	ImageInfo.format = VK_FORMAT_R32_SFLOAT;
+	ImageInfo.extent.width = Width;
+	ImageInfo.extent.height = Height;
+	ImageInfo.extent.depth = 1;
+	ImageInfo.mipLevels = LevelCount;
+	ImageInfo.arrayLayers = 1;
+	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ImageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	auto res = vkCreateImage(Rend->Device, &ImageInfo, NULL, &Image);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(Rend->Device, Image, &mem_reqs);
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &alloc_info.memoryTypeIndex))
+		std::exit(-1);
+	res = Rend->AllocateMemory(&alloc_info, MemoryCategory::Depth, &Memory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	res = vkBindImageMemory(Rend->Device, Image, Memory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkImageViewCreateInfo ViewInfo = {};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = Image;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	ViewInfo.format = VK_FORMAT_R32_SFLOAT;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ViewInfo.subresourceRange.levelCount = LevelCount;
+	ViewInfo.subresourceRange.layerCount = 1;
+	res = vkCreateImageView(Rend->Device, &ViewInfo, NULL, &View);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	LevelViews.resize(LevelCount);
+	ViewInfo.subresourceRange.levelCount = 1;
+	for (uint32_t i = 0; i < LevelCount; i++)
+	{
+		ViewInfo.subresourceRange.baseMipLevel = i;
+		res = vkCreateImageView(Rend->Device, &ViewInfo, NULL, &LevelViews[i]);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+
+	VkSamplerCreateInfo SamplerInfo = {};
+	SamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	SamplerInfo.magFilter = VK_FILTER_NEAREST;
+	SamplerInfo.minFilter = VK_FILTER_NEAREST;
+	SamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	SamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.maxLod = (float)LevelCount;
+	res = vkCreateSampler(Rend->Device, &SamplerInfo, NULL, &Sampler);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+void DepthPyramid::InitDescriptors()
+{
+	VkDescriptorSetLayoutBinding Bindings[2] = {};
+	Bindings[0].binding = 0;
+	Bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	Bindings[0].descriptorCount = 1;
+	Bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	Bindings[1].binding = 1;
+	Bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	Bindings[1].descriptorCount = 1;
+	Bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.bindingCount = 2;
+	LayoutInfo.pBindings = Bindings;
+	auto res = vkCreateDescriptorSetLayout(Rend->Device, &LayoutInfo, NULL, &SetLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorPoolSize PoolSizes[2] = {};
+	PoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	PoolSizes[0].descriptorCount = LevelCount;
+	PoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	PoolSizes[1].descriptorCount = LevelCount;
+	VkDescriptorPoolCreateInfo PoolInfo = {};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	PoolInfo.maxSets = LevelCount;
+	PoolInfo.poolSizeCount = 2;
+	PoolInfo.pPoolSizes = PoolSizes;
+	res = vkCreateDescriptorPool(Rend->Device, &PoolInfo, NULL, &DescriptorPool);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	std::vector<VkDescriptorSetLayout> Layouts(LevelCount, SetLayout);
+	Sets.resize(LevelCount);
+	VkDescriptorSetAllocateInfo AllocInfo = {};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	AllocInfo.descriptorPool = DescriptorPool;
+	AllocInfo.descriptorSetCount = LevelCount;
+	AllocInfo.pSetLayouts = Layouts.data();
+	res = vkAllocateDescriptorSets(Rend->Device, &AllocInfo, Sets.data());
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	for (uint32_t i = 0; i < LevelCount; i++)
+	{
+		VkDescriptorImageInfo Source = {};
+		Source.sampler = Sampler;
+		Source.imageView = i == 0 ? Rend->DepthImageView : LevelViews[i - 1];
+		Source.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		VkDescriptorImageInfo Target = {};
+		Target.imageView = LevelViews[i];
+		Target.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet Writes[2] = {};
+		for (uint32_t b = 0; b < 2; b++)
+		{
+			Writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			Writes[b].dstSet = Sets[i];
+			Writes[b].dstBinding = b;
+			Writes[b].descriptorCount = 1;
+			Writes[b].descriptorType = Bindings[b].descriptorType;
+		}
+		Writes[0].pImageInfo = &Source;
+		Writes[1].pImageInfo = &Target;
+		vkUpdateDescriptorSets(Rend->Device, 2, Writes, 0, NULL);
+	}
+}
+
+void DepthPyramid::InitPipeline()
+{
+	std::vector<unsigned int> Spirv;
+	bool Compiled = Rend->GLSLtoSPV(VK_SHADER_STAGE_COMPUTE_BIT, reduceShaderText, Spirv);
+	if (!Compiled)
+		std::exit(-1);
+	Module = Rend->CreateShaderModule(Spirv);
+	if (Module == VK_NULL_HANDLE)
+		std::exit(-1);
+
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	PushRange.size = sizeof(ReduceConstants);
+	VkPipelineLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	LayoutInfo.setLayoutCount = 1;
+	LayoutInfo.pSetLayouts = &SetLayout;
+	LayoutInfo.pushConstantRangeCount = 1;
+	LayoutInfo.pPushConstantRanges = &PushRange;
+	auto res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &Layout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkComputePipelineCreateInfo ComputeInfo = {};
+	ComputeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	ComputeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ComputeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	ComputeInfo.stage.module = Module;
+	ComputeInfo.stage.pName = "main";
+	ComputeInfo.layout = Layout;
+	res = vkCreateComputePipelines(Rend->Device, Rend->PipelineCache, 1, &ComputeInfo, NULL, &Pipeline);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+void DepthPyramid::RecordBuild(VkCommandBuffer Cmd)
+{
+	if (Timestamps != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(Cmd, Timestamps, 0, 2);
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 0);
+	}
+
+	// The depth goes from attachment to sampled. Last frame's pyramid is not needed,
+	// every level is rewritten, but the culling that read it has to be done.
+	VkImageMemoryBarrier Barriers[2] = {};
+	Barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	Barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	Barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	Barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	Barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	Barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barriers[0].image = Rend->DepthImage;
+	Barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	Barriers[0].subresourceRange.levelCount = 1;
+	Barriers[0].subresourceRange.layerCount = 1;
+	Barriers[1] = Barriers[0];
+	Barriers[1].srcAccessMask = 0;
+	Barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	Barriers[1].image = Image;
+	Barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	Barriers[1].subresourceRange.levelCount = LevelCount;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 2, Barriers);
+
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+	VkImageMemoryBarrier LevelBarrier = Barriers[1];
+	LevelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	LevelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	LevelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	LevelBarrier.subresourceRange.levelCount = 1;
+	for (uint32_t i = 0; i < LevelCount; i++)
+	{
+		ReduceConstants Constants;
+		Constants.SourceSize[0] = i == 0 ? Rend->SurfaceSizeX : (int32_t)std::max(Width >> (i - 1), 1u);
+		Constants.SourceSize[1] = i == 0 ? Rend->SurfaceSizeY : (int32_t)std::max(Height >> (i - 1), 1u);
+		Constants.TargetSize[0] = (int32_t)std::max(Width >> i, 1u);
+		Constants.TargetSize[1] = (int32_t)std::max(Height >> i, 1u);
+		vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Layout, 0, 1, &Sets[i], 0, NULL);
+		vkCmdPushConstants(Cmd, Layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants), &Constants);
+		vkCmdDispatch(Cmd, (Constants.TargetSize[0] + 7) / 8, (Constants.TargetSize[1] + 7) / 8, 1);
+
+		// The next level and the culling read this one.
+		LevelBarrier.subresourceRange.baseMipLevel = i;
+		vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, NULL, 0, NULL, 1, &LevelBarrier);
+	}
+
+	// Back to an attachment for the rest of the frame.
+	Barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	Barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	Barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	Barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, NULL, 0, NULL, 1, Barriers);
+
+	if (Timestamps != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 1);
+	Built = true;
+}
+
+double DepthPyramid::GetBuildTime() const
+{
+	if (Timestamps == VK_NULL_HANDLE || !Built)
+		return 0.0;
+	uint64_t Ticks[2];
+	auto res = vkGetQueryPoolResults(Rend->Device, Timestamps, 0, 2, sizeof(Ticks), Ticks, sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS)
+		return 0.0;
+	return (Ticks[1] - Ticks[0]) * Rend->DeviceProperties.limits.timestampPeriod * 1e-6;
+}
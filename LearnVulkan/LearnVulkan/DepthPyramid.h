@@ -0,0 +1,70 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <cstdint>
+#include <vector>
+
+class Renderer;
+
+/*
+* Hierarchical Z of the renderer's depth buffer. Level 0 is the largest power of two
+* that fits in the surface, every texel of it and of each level above holds the farthest
+* depth under it, so a rectangle whose nearest depth is beyond the texels covering it
+* is hidden. Built by one compute dispatch per level, reading the level below.
+*
+* Needs a depth buffer that can be sampled, see IsSupported. Sized once, a new surface
+* size needs a new pyramid.
+*/
+class DepthPyramid
+{
+public:
+	static bool IsSupported(const Renderer* Rend);
+
+	DepthPyramid(Renderer* Rend);
+	~DepthPyramid();
+
+	// Outside a render pass, once the depth buffer holds the frame's depth. Moves the
+	// depth buffer to DEPTH_STENCIL_READ_ONLY_OPTIMAL and back, and leaves every level
+	// in GENERAL, visible to compute shader reads.
+	void RecordBuild(VkCommandBuffer Cmd);
+
+	// All levels, GENERAL layout. Read with texelFetch, the sampler is nearest and clamps.
+	VkImageView GetView() const { return View; }
+	VkSampler GetSampler() const { return Sampler; }
+	uint32_t GetWidth() const { return Width; }
+	uint32_t GetHeight() const { return Height; }
+	uint32_t GetLevelCount() const { return LevelCount; }
+
+	// GPU time of the last build in milliseconds, once its frame finished.
+	// 0 when the queue has no timestamps.
+	double GetBuildTime() const;
+
+private:
+	void InitImage();
+	void InitDescriptors();
+	void InitPipeline();
+
+	Renderer* Rend;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t LevelCount;
+
+	VkImage Image = VK_NULL_HANDLE;
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	VkImageView View = VK_NULL_HANDLE;
+	// One per level, the target of its reduction and the source of the next.
+	std::vector<VkImageView> LevelViews;
+	VkSampler Sampler = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+	// Set i reads the depth buffer or level i - 1 and writes level i.
+	std::vector<VkDescriptorSet> Sets;
+	VkPipelineLayout Layout = VK_NULL_HANDLE;
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	VkShaderModule Module = VK_NULL_HANDLE;
+
+	// Before and after the build.
+	VkQueryPool Timestamps = VK_NULL_HANDLE;
+	bool Built = false;
+};
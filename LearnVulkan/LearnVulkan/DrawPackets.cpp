@@ -0,0 +1,147 @@
+#include "DrawPackets.h"
+#include "Renderer.h"
+#include <cassert>
+
+static const uint32_t DrawKeyDepthShift = 0;
+static const uint32_t DrawKeyVertexBufferShift = DrawKeyDepthShift + DrawKeyDepthBits;
+static const uint32_t DrawKeyMaterialShift = DrawKeyVertexBufferShift + DrawKeyVertexBufferBits;
+static const uint32_t DrawKeyPipelineShift = DrawKeyMaterialShift + DrawKeyMaterialBits;
+static const uint32_t DrawKeyPassShift = DrawKeyPipelineShift + DrawKeyPipelineBits;
+
+static uint64_t KeyField(uint32_t Value, uint32_t Bits, uint32_t Shift)
+{
+	assert(Value < (1u << Bits));
+	return (uint64_t)(Value & ((1u << Bits) - 1)) << Shift;
+}
+
+static uint32_t KeyValue(uint64_t Key, uint32_t Bits, uint32_t Shift)
+{
+	return (uint32_t)(Key >> Shift) & ((1u << Bits) - 1);
+}
+
+uint64_t MakeDrawKey(uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t VertexBuffer, uint32_t Depth)
+{
+	return KeyField(Pass, DrawKeyPassBits, DrawKeyPassShift) |
+		KeyField(Pipeline, DrawKeyPipelineBits, DrawKeyPipelineShift) |
+		KeyField(Material, DrawKeyMaterialBits, DrawKeyMaterialShift) |
+		KeyField(VertexBuffer, DrawKeyVertexBufferBits, DrawKeyVertexBufferShift) |
+		KeyField(Depth, DrawKeyDepthBits, DrawKeyDepthShift);
+}
+
+uint32_t DrawKeyPipeline(uint64_t Key)
+{
+	return KeyValue(Key, DrawKeyPipelineBits, DrawKeyPipelineShift);
+}
+
+uint32_t DrawKeyMaterial(uint64_t Key)
+{
+	return KeyValue(Key, DrawKeyMaterialBits, DrawKeyMaterialShift);
+}
+
+uint32_t DrawKeyVertexBuffer(uint64_t Key)
+{
+	return KeyValue(Key, DrawKeyVertexBufferBits, DrawKeyVertexBufferShift);
+}
+
+uint32_t QuantizeDrawDepth(float Depth, float Near, float Far)
+{
+	const uint32_t MaxDepth = (1u << DrawKeyDepthBits) - 1;
+	float T = (Depth - Near) / (Far - Near);
+	if (!(T > 0.0f))
+		return 0;
+	if (T >= 1.0f)
+		return MaxDepth;
+	return (uint32_t)(T * MaxDepth);
+}
+
+void DrawPacketQueue::Sort()
+{
+	size_t Count = Packets.size();
+	if (Count < 2)
+		return;
+	Scratch.resize(Count);
+
+	// One read over the packets builds the histograms of all 8 bytes.
+	static_assert(sizeof(DrawPacket) == 16, "Every pass moves whole packets, keep them small");
+	uint32_t Histograms[8][256] = {};
+	for (auto& Packet : Packets)
+	{
+		uint64_t Key = Packet.Key;
+		for (int Byte = 0; Byte < 8; Byte++)
+			Histograms[Byte][(Key >> (Byte * 8)) & 0xFF]++;
+	}
+
+	DrawPacket* Source = Packets.data();
+	DrawPacket* Destination = Scratch.data();
+	for (int Byte = 0; Byte < 8; Byte++)
+	{
+		const uint32_t* Histogram = Histograms[Byte];
+		uint32_t Shift = Byte * 8;
+		// Every key has the same byte here, the pass would only copy.
+		if (Histogram[(Source[0].Key >> Shift) & 0xFF] == Count)
+			continue;
+
+		uint32_t Offsets[256];
+		uint32_t Sum = 0;
+		for (int i = 0; i < 256; i++)
+		{
+			Offsets[i] = Sum;
+			Sum += Histogram[i];
+		}
+		for (size_t i = 0; i < Count; i++)
+			Destination[Offsets[(Source[i].Key >> Shift) & 0xFF]++] = Source[i];
+
+		DrawPacket* Swap = Source;
+		Source = Destination;
+		Destination = Swap;
+	}
+
+	if (Source != Packets.data())
+		Packets.swap(Scratch);
+}
+
+void DrawPacketQueue::Record(VkCommandBuffer Cmd, VkPipelineLayout Layout, const DrawPacketTables& Tables,
+	const DrawData* Payloads, uint32_t VertexCount, uint32_t InstanceCount, bool SkipRedundant)
+{
+	Stats = DrawPacketStats();
+	const uint32_t None = UINT32_MAX;
+	uint32_t BoundPipeline = None;
+	uint32_t BoundMaterial = None;
+	uint32_t BoundVertexBuffer = None;
+	const VkDeviceSize Offset = 0;
+
+	for (auto& Packet : Packets)
+	{
+		uint32_t Pipeline = DrawKeyPipeline(Packet.Key);
+		uint32_t Material = DrawKeyMaterial(Packet.Key);
+		uint32_t VertexBuffer = DrawKeyVertexBuffer(Packet.Key);
+		assert(Pipeline < Tables.Pipelines.size() && Material < Tables.Materials.size() &&
+			VertexBuffer < Tables.VertexBuffers.size());
+
+		if (!SkipRedundant || Pipeline != BoundPipeline)
+		{
+			vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Tables.Pipelines[Pipeline]);
+			BoundPipeline = Pipeline;
+			Stats.PipelineBinds++;
+		}
+		if (!SkipRedundant || Material != BoundMaterial)
+		{
+			vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 0, 1,
+				&Tables.Materials[Material], 0, NULL);
+			BoundMaterial = Material;
+			Stats.MaterialBinds++;
+		}
+		if (!SkipRedundant || VertexBuffer != BoundVertexBuffer)
+		{
+			vkCmdBindVertexBuffers(Cmd, 0, 1, &Tables.VertexBuffers[VertexBuffer], &Offset);
+			BoundVertexBuffer = VertexBuffer;
+			Stats.VertexBufferBinds++;
+		}
+
+		vkCmdPushConstants(Cmd, Layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0, sizeof(DrawData), &Payloads[Packet.Payload]);
+		vkCmdDraw(Cmd, VertexCount, InstanceCount, 0, 0);
+		Stats.Draws++;
+	}
+	Stats.NaiveBinds = Stats.Draws * 3;
+}
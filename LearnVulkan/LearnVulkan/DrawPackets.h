@@ -0,0 +1,83 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <vector>
+
+struct DrawData;
+
+/*
+* Draw sort keys, most significant field first so sorting groups draws by pass,
+* then pipeline, then material, then vertex buffer, and orders each group by depth.
+*
+*   63..60 pass | 59..48 pipeline | 47..32 material | 31..24 vertex buffer | 23..0 depth
+*
+* Pipeline, material and vertex buffer are indices into DrawPacketTables.
+*/
+const uint32_t DrawKeyPassBits = 4;
+const uint32_t DrawKeyPipelineBits = 12;
+const uint32_t DrawKeyMaterialBits = 16;
+const uint32_t DrawKeyVertexBufferBits = 8;
+const uint32_t DrawKeyDepthBits = 24;
+
+uint64_t MakeDrawKey(uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t VertexBuffer, uint32_t Depth);
+uint32_t DrawKeyPipeline(uint64_t Key);
+uint32_t DrawKeyMaterial(uint64_t Key);
+uint32_t DrawKeyVertexBuffer(uint64_t Key);
+// Maps view depth in [Near, Far] onto the depth field, near first. Flip it for back to front.
+uint32_t QuantizeDrawDepth(float Depth, float Near, float Far);
+
+struct DrawPacket
+{
+	uint64_t Key;
+	// Index of the draw's DrawData.
+	uint32_t Payload;
+};
+
+// What the key indices refer to. Materials are bound as descriptor set 0.
+struct DrawPacketTables
+{
+	std::vector<VkPipeline> Pipelines;
+	std::vector<VkDescriptorSet> Materials;
+	std::vector<VkBuffer> VertexBuffers;
+};
+
+struct DrawPacketStats
+{
+	uint32_t Draws = 0;
+	uint32_t PipelineBinds = 0;
+	uint32_t MaterialBinds = 0;
+	uint32_t VertexBufferBinds = 0;
+	// Binds a loop that binds everything for every draw would have made.
+	uint32_t NaiveBinds = 0;
+};
+
+/*
+* Collects the draws of a frame as sort key plus payload, radix sorts them and
+* records them, only binding state that differs from the previous draw.
+*/
+class DrawPacketQueue
+{
+public:
+	void Clear() { Packets.clear(); }
+	void Reserve(size_t Count) { Packets.reserve(Count); }
+	void Submit(uint64_t Key, uint32_t Payload) { Packets.push_back({ Key, Payload }); }
+	bool IsEmpty() const { return Packets.empty(); }
+	size_t GetCount() const { return Packets.size(); }
+
+	// Stable LSD radix sort on the key, a byte per pass. Passes where every key has the same byte are skipped.
+	void Sort();
+
+	// Draws every packet with VertexCount vertices and InstanceCount instances, the payload's
+	// DrawData goes through push constants. SkipRedundant = false binds everything every draw.
+	void Record(VkCommandBuffer Cmd, VkPipelineLayout Layout, const DrawPacketTables& Tables,
+		const DrawData* Payloads, uint32_t VertexCount, uint32_t InstanceCount, bool SkipRedundant = true);
+
+	const std::vector<DrawPacket>& GetPackets() const { return Packets; }
+	// Of the last Record.
+	const DrawPacketStats& GetStats() const { return Stats; }
+
+private:
+	std::vector<DrawPacket> Packets;
+	std::vector<DrawPacket> Scratch;
+	DrawPacketStats Stats;
+};
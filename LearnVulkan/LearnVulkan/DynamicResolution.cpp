@@ -0,0 +1,36 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& Settings)
+	: Settings(Settings), Scale(Settings.MaxScale)
+{
+}
+
+float DynamicResolutionController::Update(double GpuMs)
+{
+	if (GpuMs <= 0.0 || Settings.BudgetMs <= 0.0)
+		return Scale;
+	Smoothed = HasSample ? Smoothed + (GpuMs - Smoothed) * Settings.Smoothing : GpuMs;
+	HasSample = true;
+
+	double Ratio = Settings.BudgetMs / Smoothed;
+	if (std::abs(Ratio - 1.0) <= Settings.Deadband)
+		return Scale;
+	double Ideal = Scale * std::sqrt(Ratio);
+	float Next = (float)(Scale + (Ideal - Scale) * Settings.Gain);
+	Next = std::min(std::max(Next, Settings.MinScale), Settings.MaxScale);
+
+	// The smoothed time was measured at the old scale, carry it over to the new one
+	// so the next frames are not judged against stale pixel counts.
+	Smoothed *= (double)(Next * Next) / (Scale * Scale);
+	Scale = Next;
+	return Scale;
+}
+
+void DynamicResolutionController::SetScale(float NewScale)
+{
+	Scale = std::min(std::max(NewScale, Settings.MinScale), Settings.MaxScale);
+	HasSample = false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+struct DynamicResolutionSettings
+{
+	// GPU milliseconds a frame may take.
+	double BudgetMs = 16.0;
+	// Fractions of the surface size along each axis.
+	float MinScale = 0.5f;
+	float MaxScale = 1.0f;
+	// Weight of the newest frame in the smoothed GPU time.
+	double Smoothing = 0.3;
+	// How much of the way to the scale that would meet the budget is taken per frame.
+	double Gain = 0.5;
+	// Relative distance from the budget within which the scale is left alone.
+	double Deadband = 0.05;
+};
+
+/*
+* Picks the render scale from measured GPU frame times. The GPU time is taken to grow
+* with the pixel count, so the scale that would have met the budget is
+* Scale * sqrt(Budget / Time). The time is smoothed and the scale only moves part of
+* the way there each frame, so a single slow frame does not make it jump.
+*/
+class DynamicResolutionController
+{
+public:
+	explicit DynamicResolutionController(const DynamicResolutionSettings& Settings = DynamicResolutionSettings());
+
+	// GPU time of a frame drawn at the current scale, returns the scale for the next one.
+	float Update(double GpuMs);
+	float GetScale() const { return Scale; }
+	// Clamped to the settings. Also forgets the smoothed time, it was for another scale.
+	void SetScale(float NewScale);
+	double GetSmoothedMs() const { return Smoothed; }
+
+	DynamicResolutionSettings Settings;
+
+private:
+	float Scale;
+	double Smoothed = 0.0;
+	bool HasSample = false;
+};
@@ -0,0 +1,175 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+
+SnapshotMailbox::SnapshotMailbox() : Middle(2), Published(0), Dropped(0)
+{
+}
+
+void SnapshotMailbox::Publish()
+{
+	// Release makes the slot's contents visible to the consumer that takes it, acquire
+	// makes sure the consumer is done with the slot that comes back.
+	uint32_t Old = Middle.exchange(WriteIndex | FreshBit, std::memory_order_acq_rel);
+	if (Old & FreshBit)
+		Dropped.fetch_add(1, std::memory_order_relaxed);
+	WriteIndex = Old & ~FreshBit;
+	Published.fetch_add(1, std::memory_order_relaxed);
+}
+
+const RenderSnapshot* SnapshotMailbox::Acquire(bool* Fresh)
+{
+	// Only the consumer clears FreshBit, so once it is seen set it stays set until the
+	// exchange below, which then takes whatever was published last.
+	bool New = (Middle.load(std::memory_order_relaxed) & FreshBit) != 0;
+	if (New)
+	{
+		ReadIndex = Middle.exchange(ReadIndex, std::memory_order_acq_rel) & ~FreshBit;
+		HasRead = true;
+	}
+	if (Fresh)
+		*Fresh = New;
+	return HasRead ? &Slots[ReadIndex] : nullptr;
+}
+
+FramePipeline::FramePipeline(Renderer* Rend, SimulateFunction Simulate, bool Threaded, double SimulationRate)
+	: Rend(Rend), Simulate(Simulate), Threaded(Threaded), SimulationRate(SimulationRate)
+{
+	StartTime = std::chrono::steady_clock::now();
+	if (Threaded)
+		SimThread = std::thread(&FramePipeline::SimulationLoop, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+	if (SimThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> Lock(SignalMutex);
+			Quit = true;
+		}
+		Signal.notify_all();
+		SimThread.join();
+	}
+}
+
+void FramePipeline::SimulateNext()
+{
+	RenderSnapshot& Out = Mailbox.GetWriteSlot();
+	Out.SimStart = std::chrono::steady_clock::now();
+	double Time = std::chrono::duration<double>(Out.SimStart - StartTime).count();
+	Out.Frame = NextFrame++;
+	Out.Time = Time;
+	Simulate(Out, Time, NextFrame == 1 ? 0.0 : Time - LastTime);
+	LastTime = Time;
+	Out.SimEnd = std::chrono::steady_clock::now();
+	Mailbox.Publish();
+}
+
+void FramePipeline::SimulationLoop()
+{
+	auto Interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(SimulationRate > 0.0 ? 1.0 / SimulationRate : 0.0));
+	auto NextStart = std::chrono::steady_clock::now();
+	while (true)
+	{
+		SimulateNext();
+		// Never waits for the render thread, a snapshot it did not take is overwritten.
+		std::unique_lock<std::mutex> Lock(SignalMutex);
+		Signal.notify_all();
+		// Behind schedule the next one starts right away, without catching up.
+		NextStart = std::max(NextStart + Interval, std::chrono::steady_clock::now());
+		if (Interval.count() > 0)
+			Signal.wait_until(Lock, NextStart, [&]() { return Quit; });
+		if (Quit)
+			return;
+	}
+}
+
+void FramePipeline::Apply(const RenderSnapshot& Snapshot)
+{
+	Rend->Projection = Snapshot.Projection;
+	Rend->View = Snapshot.View;
+	Rend->Model = Snapshot.Model;
+	Rend->InstanceCount = Snapshot.InstanceCount;
+	// Copy assignment keeps Draws' capacity, so this does not allocate once it is warm.
+	Rend->Draws = Snapshot.Draws;
+	Rend->UpdateUniformBuffer();
+	if (Rend->ObjectData)
+		Rend->UpdateObjectBuffer();
+}
+
+void FramePipeline::RenderFrame()
+{
+	if (!Threaded)
+		SimulateNext();
+	else if (!HasSnapshot)
+	{
+		// Nothing to draw again yet.
+		std::unique_lock<std::mutex> Lock(SignalMutex);
+		Signal.wait(Lock, [&]() { return Mailbox.HasFresh(); });
+	}
+	HasSnapshot = true;
+
+	bool IsFresh = false;
+	const RenderSnapshot* Snapshot = Mailbox.Acquire(&IsFresh);
+	auto TakenTime = std::chrono::steady_clock::now();
+
+	// DrawCube does not wait for its frame, the previous one is done once this returns.
+	Rend->FinishFrame();
+	if (HasInFlight)
+	{
+		double Latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - InFlightStart).count();
+		Finished++;
+		LatencySum += Latency;
+		LatencyMax = std::max(LatencyMax, Latency);
+		LastLatency = Latency;
+	}
+
+	// The renderer still holds a snapshot drawn again.
+	if (IsFresh)
+		Apply(*Snapshot);
+	Rend->DrawCube();
+	HasInFlight = true;
+	InFlightStart = Snapshot->SimStart;
+
+	Rendered++;
+	if (!IsFresh)
+	{
+		Repeated++;
+		return;
+	}
+	double Wait = std::chrono::duration<double>(TakenTime - Snapshot->SimEnd).count();
+	Fresh++;
+	WaitSum += Wait;
+	WaitMax = std::max(WaitMax, Wait);
+}
+
+FramePipelineStats FramePipeline::GetStats() const
+{
+	FramePipelineStats Result;
+	Result.Rendered = Rendered;
+	Result.Repeated = Repeated;
+	Result.Simulated = Mailbox.GetPublished();
+	Result.Dropped = Mailbox.GetDropped() - DroppedBefore;
+	if (Fresh)
+		Result.MeanWait = WaitSum / Fresh;
+	if (Finished)
+		Result.MeanLatency = LatencySum / Finished;
+	Result.MaxWait = WaitMax;
+	Result.MaxLatency = LatencyMax;
+	Result.LastLatency = LastLatency;
+	return Result;
+}
+
+void FramePipeline::ResetStats()
+{
+	Rendered = 0;
+	Repeated = 0;
+	Fresh = 0;
+	Finished = 0;
+	DroppedBefore = Mailbox.GetDropped();
+	WaitSum = WaitMax = 0.0;
+	LatencySum = LatencyMax = 0.0;
+	LastLatency = 0.0;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Renderer.h"
+
+// Everything the render thread needs to draw one frame, made by the simulation.
+struct RenderSnapshot
+{
+	uint64_t Frame = 0;
+	// Simulated time in seconds.
+	double Time = 0.0;
+	glm::mat4 Projection;
+	glm::mat4 View;
+	glm::mat4 Model;
+	uint32_t InstanceCount = 1;
+	// Replaces Renderer::Draws, empty draws the single default cube.
+	std::vector<DrawData> Draws;
+	// When the simulation started and finished this snapshot.
+	std::chrono::steady_clock::time_point SimStart;
+	std::chrono::steady_clock::time_point SimEnd;
+};
+
+/*
+* Triple buffer between one producer and one consumer. The producer always has a
+* slot of its own to write and the consumer one to read, the third holds the newest
+* published snapshot. Handing over is a single atomic exchange on either side, so
+* neither ever waits for the other. A snapshot the consumer did not take in time is
+* overwritten by the next. Slots are reused, their vectors keep their capacity.
+*/
+class SnapshotMailbox
+{
+public:
+	SnapshotMailbox();
+
+	// Producer: fill the write slot, then publish it.
+	RenderSnapshot& GetWriteSlot() { return Slots[WriteIndex]; }
+	void Publish();
+
+	// Consumer: the newest published snapshot, nullptr before the first. Stays valid
+	// and unchanged until the next Acquire. Fresh is false when it was returned before.
+	const RenderSnapshot* Acquire(bool* Fresh = nullptr);
+	bool HasFresh() const { return (Middle.load(std::memory_order_acquire) & FreshBit) != 0; }
+
+	uint64_t GetPublished() const { return Published.load(std::memory_order_relaxed); }
+	uint64_t GetDropped() const { return Dropped.load(std::memory_order_relaxed); }
+
+private:
+	static const uint32_t FreshBit = 4;
+
+	RenderSnapshot Slots[3];
+	// Slot in the middle, with FreshBit until the consumer takes it.
+	std::atomic<uint32_t> Middle;
+	uint32_t WriteIndex = 0;
+	uint32_t ReadIndex = 1;
+	bool HasRead = false;
+	std::atomic<uint64_t> Published;
+	std::atomic<uint64_t> Dropped;
+};
+
+struct FramePipelineStats
+{
+	uint64_t Rendered = 0;
+	// Frames drawn with the snapshot of the frame before, nothing newer was published.
+	uint64_t Repeated = 0;
+	// Snapshots the simulation published since the pipeline started, and how many
+	// of them were overwritten before the render thread took them.
+	uint64_t Simulated = 0;
+	uint64_t Dropped = 0;
+	// Seconds a fresh snapshot sat in the mailbox before the render thread took it.
+	double MeanWait = 0.0;
+	double MaxWait = 0.0;
+	// Seconds from the simulation starting a snapshot until the GPU finished drawing it,
+	// seen when the next frame starts. The last frame drawn is not counted yet.
+	double MeanLatency = 0.0;
+	double MaxLatency = 0.0;
+	double LastLatency = 0.0;
+};
+
+/*
+* Runs the simulation on its own thread, decoupled from the renderer: it publishes
+* snapshots at its own rate and each frame draws the newest one. A slower renderer
+* drops snapshots, a slower simulation draws one again, neither waits for the other.
+* The render thread stays the one that owns the Renderer and polls GLFW, it only calls
+* RenderFrame. The snapshot in flight is the latency this adds, see the stats.
+*/
+class FramePipeline
+{
+public:
+	// Fills Out for Time, Delta seconds after the previous snapshot. Out is a reused slot
+	// that still holds an older snapshot, everything in it has to be written.
+	typedef std::function<void(RenderSnapshot& Out, double Time, double Delta)> SimulateFunction;
+
+	// Threaded false simulates on the render thread right before drawing, as a baseline.
+	// SimulationRate is the snapshots per second the simulation thread aims for, 0 runs
+	// it back to back.
+	FramePipeline(Renderer* Rend, SimulateFunction Simulate, bool Threaded = true, double SimulationRate = 0.0);
+	~FramePipeline();
+
+	// On the render thread. Hands the newest snapshot to the renderer and draws it. Only
+	// waits before the first one, after that the last snapshot is drawn again when there
+	// is no newer one.
+	void RenderFrame();
+
+	FramePipelineStats GetStats() const;
+	void ResetStats();
+
+private:
+	void SimulateNext();
+	void SimulationLoop();
+	void Apply(const RenderSnapshot& Snapshot);
+
+	Renderer* Rend;
+	SimulateFunction Simulate;
+	bool Threaded;
+	double SimulationRate;
+	SnapshotMailbox Mailbox;
+
+	// Simulation thread only.
+	uint64_t NextFrame = 0;
+	std::chrono::steady_clock::time_point StartTime;
+	double LastTime = 0.0;
+
+	// Only wakes the two threads, snapshots go through the mailbox.
+	std::thread SimThread;
+	std::mutex SignalMutex;
+	std::condition_variable Signal;
+	bool Quit = false;
+
+	// Render thread only.
+	bool HasSnapshot = false;
+	uint64_t Rendered = 0;
+	uint64_t Repeated = 0;
+	uint64_t Fresh = 0;
+	// Frames the GPU finished, and when the simulation started the one still in flight.
+	uint64_t Finished = 0;
+	bool HasInFlight = false;
+	std::chrono::steady_clock::time_point InFlightStart;
+	uint64_t DroppedBefore = 0;
+	double WaitSum = 0.0;
+	double WaitMax = 0.0;
+	double LatencySum = 0.0;
+	double LatencyMax = 0.0;
+	double LastLatency = 0.0;
+};
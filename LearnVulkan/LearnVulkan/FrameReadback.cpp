@@ -0,0 +1,258 @@
+#include "FrameReadback.h"
+#include "Renderer.h"
+
+FrameReadback::FrameReadback(Renderer* Rend, uint32_t SlotCount, ReadbackCallback Callback)
+	: Rend(Rend), Callback(Callback)
+{
+	Width = Rend->SurfaceSizeX;
+	Height = Rend->SurfaceSizeY;
+	// SurfaceFormat is always a 4 byte per pixel format.
+	FrameSize = (VkDeviceSize)Width * Height * 4;
+
+	InitSlots(SlotCount);
+	Worker = std::thread(&FrameReadback::WorkerLoop, this);
+}
+
+FrameReadback::~FrameReadback()
+{
+	Flush();
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Quit = true;
+	}
+	WorkReady.notify_all();
+	Worker.join();
+	DeleteSlots();
+}
+
+void FrameReadback::InitSlots(uint32_t SlotCount)
+{
+	VkDevice Device = Rend->Device;
+	Slots.resize(SlotCount);
+
+	for (auto& S : Slots)
+	{
+		VkBufferCreateInfo buf_info = {};
+		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buf_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		buf_info.size = FrameSize;
+		buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		auto res = vkCreateBuffer(Device, &buf_info, NULL, &S.Buffer);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+
+		VkMemoryRequirements mem_reqs;
+		vkGetBufferMemoryRequirements(Device, S.Buffer, &mem_reqs);
+
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = mem_reqs.size;
+
+		// The CPU reads every byte, so prefer cached memory and invalidate by hand if it is not coherent.
+		if (Rend->memory_type_from_properties(mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			&alloc_info.memoryTypeIndex))
+		{
+			NeedsInvalidate = !(Rend->MemoryProperties.memoryTypes[alloc_info.memoryTypeIndex].propertyFlags &
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		}
+		else if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&alloc_info.memoryTypeIndex))
+		{
+			std::exit(-1);
+		}
+
+		res = Rend->AllocateMemory(&alloc_info, MemoryCategory::Staging, &S.Memory);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+
+		res = vkBindBufferMemory(Device, S.Buffer, S.Memory, 0);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+
+		// Stays mapped for the lifetime of the slot.
+		res = vkMapMemory(Device, S.Memory, 0, VK_WHOLE_SIZE, 0, (void **)&S.Mapped);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+void FrameReadback::DeleteSlots()
+{
+	VkDevice Device = Rend->Device;
+	for (auto& S : Slots)
+	{
+		vkUnmapMemory(Device, S.Memory);
+		vkDestroyBuffer(Device, S.Buffer, NULL);
+		Rend->FreeMemory(S.Memory);
+	}
+	Slots.clear();
+}
+
+void FrameReadback::RecordCopy(VkCommandBuffer Cmd, VkImage Image)
+{
+	auto FindFree = [this]() -> int32_t {
+		for (uint32_t i = 0; i < Slots.size(); i++)
+		{
+			if (Slots[i].State == SlotState::Free)
+				return i;
+		}
+		return -1;
+	};
+
+	std::unique_lock<std::mutex> Lock(Mutex);
+	int32_t Index = FindFree();
+	if (Index < 0)
+	{
+		// Ring is full, this is the only place the render thread waits.
+		auto StallStart = std::chrono::high_resolution_clock::now();
+		SlotFreed.wait(Lock, [&]() { return (Index = FindFree()) >= 0; });
+		Stats.Stalls++;
+		Stats.StallTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - StallStart).count();
+	}
+	Slots[Index].State = SlotState::Recorded;
+	PendingSlot = Index;
+	Lock.unlock();
+
+	VkImageMemoryBarrier ToTransfer = {};
+	ToTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	ToTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	ToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	ToTransfer.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	ToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	ToTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	ToTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	ToTransfer.image = Image;
+	ToTransfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ToTransfer.subresourceRange.baseMipLevel = 0;
+	ToTransfer.subresourceRange.levelCount = 1;
+	ToTransfer.subresourceRange.baseArrayLayer = 0;
+	ToTransfer.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &ToTransfer);
+
+	VkBufferImageCopy Region = {};
+	Region.bufferOffset = 0;
+	Region.bufferRowLength = 0; // Tightly packed.
+	Region.bufferImageHeight = 0;
+	Region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	Region.imageSubresource.mipLevel = 0;
+	Region.imageSubresource.baseArrayLayer = 0;
+	Region.imageSubresource.layerCount = 1;
+	Region.imageOffset = { 0, 0, 0 };
+	Region.imageExtent = { Width, Height, 1 };
+	vkCmdCopyImageToBuffer(Cmd, Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Slots[Index].Buffer, 1, &Region);
+
+	// Make the copy visible to the host once the frame's value is reached.
+	VkBufferMemoryBarrier ToHost = {};
+	ToHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	ToHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	ToHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	ToHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	ToHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	ToHost.buffer = Slots[Index].Buffer;
+	ToHost.offset = 0;
+	ToHost.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &ToHost, 0, NULL);
+}
+
+void FrameReadback::Submitted(uint64_t Value)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		if (PendingSlot < 0)
+			return;
+		Slot& S = Slots[PendingSlot];
+		S.State = SlotState::InFlight;
+		S.Value = Value;
+		S.FrameIndex = NextFrameIndex++;
+		S.SubmitTime = std::chrono::high_resolution_clock::now();
+		InFlight.push_back(PendingSlot);
+		PendingSlot = -1;
+	}
+	WorkReady.notify_one();
+}
+
+void FrameReadback::Flush()
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+	SlotFreed.wait(Lock, [this]() { return InFlight.empty(); });
+}
+
+ReadbackStats FrameReadback::GetStats()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	ReadbackStats Result = Stats;
+	if (Result.CapturedFrames > 0)
+		Result.MeanLatency = LatencySum / Result.CapturedFrames;
+	double Elapsed = std::chrono::duration<double>(LastCapture - FirstCapture).count();
+	if (Result.CapturedFrames > 1 && Elapsed > 0.0)
+		Result.CaptureFps = (Result.CapturedFrames - 1) / Elapsed;
+	return Result;
+}
+
+void FrameReadback::ResetStats()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Stats = ReadbackStats();
+	LatencySum = 0.0;
+}
+
+void FrameReadback::WorkerLoop()
+{
+	VkDevice Device = Rend->Device;
+	while (true)
+	{
+		uint32_t Index;
+		{
+			std::unique_lock<std::mutex> Lock(Mutex);
+			WorkReady.wait(Lock, [this]() { return Quit || !InFlight.empty(); });
+			// Quit only once everything submitted has been consumed.
+			if (InFlight.empty())
+				return;
+			Index = InFlight.front();
+		}
+
+		// The render thread does not touch a slot while it is in flight.
+		Slot& S = Slots[Index];
+		Rend->GraphicsTimeline.Wait(S.Value);
+
+		if (NeedsInvalidate)
+		{
+			VkMappedMemoryRange Range = {};
+			Range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			Range.memory = S.Memory;
+			Range.offset = 0;
+			Range.size = VK_WHOLE_SIZE;
+			vkInvalidateMappedMemoryRanges(Device, 1, &Range);
+		}
+
+		auto Now = std::chrono::high_resolution_clock::now();
+		double Latency = std::chrono::duration<double>(Now - S.SubmitTime).count();
+
+		ReadbackFrame Frame;
+		Frame.Pixels = S.Mapped;
+		Frame.Width = Width;
+		Frame.Height = Height;
+		Frame.RowPitch = Width * 4;
+		Frame.Format = Rend->SurfaceFormat.format;
+		Frame.FrameIndex = S.FrameIndex;
+		Callback(Frame);
+
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			if (Stats.CapturedFrames == 0)
+				FirstCapture = Now;
+			LastCapture = Now;
+			Stats.CapturedFrames++;
+			LatencySum += Latency;
+			if (Latency > Stats.MaxLatency)
+				Stats.MaxLatency = Latency;
+			InFlight.pop_front();
+			S.State = SlotState::Free;
+		}
+		SlotFreed.notify_all();
+	}
+}
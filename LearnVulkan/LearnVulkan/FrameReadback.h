@@ -0,0 +1,108 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Renderer;
+
+// A finished frame handed to the consumer. Pixels are only valid during the callback.
+struct ReadbackFrame
+{
+	const uint8_t* Pixels;
+	uint32_t Width;
+	uint32_t Height;
+	// Bytes per row, rows are tightly packed.
+	uint32_t RowPitch;
+	VkFormat Format;
+	uint64_t FrameIndex;
+};
+
+typedef std::function<void(const ReadbackFrame& Frame)> ReadbackCallback;
+
+struct ReadbackStats
+{
+	uint64_t CapturedFrames = 0;
+	// Frames that had to wait because every slot was busy.
+	uint64_t Stalls = 0;
+	double StallTime = 0.0;
+	// Captured frames per second between the first and last callback.
+	double CaptureFps = 0.0;
+	// Time from submit to the consumer getting the frame, in seconds.
+	double MeanLatency = 0.0;
+	double MaxLatency = 0.0;
+};
+
+/*
+* Copies the final color image of each frame into a ring of host visible buffers.
+* The copy is recorded into the frame's command buffer and the slot remembers the
+* frame's GraphicsTimeline value. A worker thread waits for the values and hands the
+* pixels to the consumer, so the render thread only waits when every slot is still in use.
+*/
+class FrameReadback
+{
+public:
+	FrameReadback(Renderer* Rend, uint32_t SlotCount, ReadbackCallback Callback);
+	~FrameReadback();
+
+	// Records the copy of Image (in COLOR_ATTACHMENT_OPTIMAL) into Cmd and leaves
+	// Image in TRANSFER_SRC_OPTIMAL.
+	void RecordCopy(VkCommandBuffer Cmd, VkImage Image);
+	// Call right after submitting Cmd, with the timeline value of the submit.
+	void Submitted(uint64_t Value);
+
+	// Blocks until every submitted frame went through the consumer.
+	void Flush();
+
+	ReadbackStats GetStats();
+	void ResetStats();
+
+private:
+	enum class SlotState { Free, Recorded, InFlight };
+
+	struct Slot
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		uint8_t* Mapped = nullptr;
+		uint64_t Value = 0;
+		SlotState State = SlotState::Free;
+		uint64_t FrameIndex = 0;
+		std::chrono::high_resolution_clock::time_point SubmitTime;
+	};
+
+	void InitSlots(uint32_t SlotCount);
+	void DeleteSlots();
+	void WorkerLoop();
+
+	Renderer* Rend;
+	ReadbackCallback Callback;
+	std::vector<Slot> Slots;
+	uint32_t Width;
+	uint32_t Height;
+	VkDeviceSize FrameSize;
+	// Memory is not coherent, so mapped ranges have to be invalidated before reading.
+	bool NeedsInvalidate = false;
+
+	// Slot handed out by RecordCopy and not yet submitted.
+	int32_t PendingSlot = -1;
+	uint64_t NextFrameIndex = 0;
+
+	std::mutex Mutex;
+	std::condition_variable SlotFreed;
+	std::condition_variable WorkReady;
+	// Slots in submit order, waiting for the worker.
+	std::deque<uint32_t> InFlight;
+	std::thread Worker;
+	bool Quit = false;
+
+	ReadbackStats Stats;
+	std::chrono::high_resolution_clock::time_point FirstCapture;
+	std::chrono::high_resolution_clock::time_point LastCapture;
+	double LatencySum = 0.0;
+};
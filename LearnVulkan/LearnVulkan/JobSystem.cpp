@@ -0,0 +1,391 @@
+#include "JobSystem.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct Job
+{
+	std::function<void()> Fn;
+	JobCounter* Counter;
+};
+
+// Deque slots a thread starts with, doubled when they run out.
+static const int64_t JobDequeCapacity = 1024;
+
+static thread_local const JobSystem* CurrentSystem = nullptr;
+static thread_local int CurrentIndex = -1;
+
+/*
+* Chase-Lev deque, with the memory orders of Le et al., "Correct and Efficient
+* Work-Stealing for Weak Memory Models". Only the owning thread calls Push and Pop.
+*/
+class JobSystem::Deque
+{
+public:
+	Deque() : Top(0), Bottom(0)
+	{
+		Rings.emplace_back(new Ring(JobDequeCapacity));
+		Buffer.store(Rings.back().get(), std::memory_order_relaxed);
+	}
+
+	void Push(Job* J)
+	{
+		int64_t B = Bottom.load(std::memory_order_relaxed);
+		int64_t T = Top.load(std::memory_order_acquire);
+		Ring* R = Buffer.load(std::memory_order_relaxed);
+		if (B - T > R->Mask)
+			R = Grow(R, T, B);
+		R->Put(B, J);
+		std::atomic_thread_fence(std::memory_order_release);
+		Bottom.store(B + 1, std::memory_order_relaxed);
+	}
+
+	Job* Pop()
+	{
+		int64_t B = Bottom.load(std::memory_order_relaxed) - 1;
+		Ring* R = Buffer.load(std::memory_order_relaxed);
+		Bottom.store(B, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t T = Top.load(std::memory_order_relaxed);
+		if (T > B)
+		{
+			Bottom.store(B + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Job* J = R->Get(B);
+		if (T == B)
+		{
+			// The last job, a thief may be taking it at the same time.
+			if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				J = nullptr;
+			Bottom.store(B + 1, std::memory_order_relaxed);
+		}
+		return J;
+	}
+
+	// nullptr when empty or when another thread got there first.
+	Job* Steal()
+	{
+		int64_t T = Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t B = Bottom.load(std::memory_order_acquire);
+		if (T >= B)
+			return nullptr;
+		Ring* R = Buffer.load(std::memory_order_acquire);
+		Job* J = R->Get(T);
+		if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return J;
+	}
+
+	// A hint, exact only on the owning thread.
+	bool IsEmpty() const
+	{
+		return Bottom.load(std::memory_order_relaxed) <= Top.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Ring
+	{
+		explicit Ring(int64_t Capacity) : Mask(Capacity - 1), Items(new std::atomic<Job*>[Capacity]) {}
+		Job* Get(int64_t i) const { return Items[i & Mask].load(std::memory_order_relaxed); }
+		void Put(int64_t i, Job* J) { Items[i & Mask].store(J, std::memory_order_relaxed); }
+
+		int64_t Mask;
+		std::unique_ptr<std::atomic<Job*>[]> Items;
+	};
+
+	Ring* Grow(Ring* Old, int64_t T, int64_t B)
+	{
+		Rings.emplace_back(new Ring((Old->Mask + 1) * 2));
+		Ring* New = Rings.back().get();
+		for (int64_t i = T; i < B; i++)
+			New->Put(i, Old->Get(i));
+		Buffer.store(New, std::memory_order_release);
+		return New;
+	}
+
+	// Apart, the owner writes Bottom and thieves write Top.
+	std::atomic<int64_t> Top;
+	char Padding[64 - sizeof(int64_t)];
+	std::atomic<int64_t> Bottom;
+	std::atomic<Ring*> Buffer;
+	// Outgrown rings stay until the deque goes, a thief may still be reading one.
+	std::vector<std::unique_ptr<Ring>> Rings;
+};
+
+static void PinCurrentThread(uint32_t Core)
+{
+	uint32_t Cores = std::max(1u, std::thread::hardware_concurrency());
+	Core %= Cores;
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (Core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+	cpu_set_t Set;
+	CPU_ZERO(&Set);
+	CPU_SET(Core, &Set);
+	pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set);
+#else
+	(void)Core;
+#endif
+}
+
+static uint32_t NextRandom(uint32_t& Seed)
+{
+	Seed ^= Seed << 13;
+	Seed ^= Seed >> 17;
+	Seed ^= Seed << 5;
+	return Seed;
+}
+
+JobSystem::JobSystem(uint32_t ThreadCount, JobAffinity Affinity)
+	: SharedCount(0), Sleeping(0)
+{
+	if (ThreadCount == 0)
+		ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t WorkerCount = ThreadCount - 1;
+	for (uint32_t i = 0; i < ThreadCount; i++)
+		Deques.emplace_back(new Deque());
+	Stats.reset(new ThreadStats[Deques.size() + 1]);
+	ResetStats();
+
+	CurrentSystem = this;
+	CurrentIndex = 0;
+	if (Affinity == JobAffinity::PinAll)
+		PinCurrentThread(0);
+	for (uint32_t i = 1; i <= WorkerCount; i++)
+		Workers.emplace_back(&JobSystem::WorkerLoop, this, i, Affinity == JobAffinity::None ? -1 : (int)i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> Lock(SleepMutex);
+		Quit = true;
+	}
+	WakeUp.notify_all();
+	for (auto& Worker : Workers)
+		Worker.join();
+	if (CurrentSystem == this)
+		CurrentSystem = nullptr;
+}
+
+void JobSystem::Run(std::function<void()> Fn, JobCounter* Counter, JobCounter* After)
+{
+	Job* J = new Job{ std::move(Fn), Counter };
+	if (Counter)
+		Counter->Pending.fetch_add(1, std::memory_order_relaxed);
+	if (After)
+	{
+		std::lock_guard<std::mutex> Lock(After->Mutex);
+		if (After->Pending.load(std::memory_order_acquire) != 0)
+		{
+			After->Waiters.push_back(J);
+			return;
+		}
+	}
+	Submit(J);
+}
+
+void JobSystem::Wait(JobCounter& Counter)
+{
+	int Index = ThreadIndex();
+	uint32_t Seed = (uint32_t)(uintptr_t)&Counter | 1;
+	while (!Counter.IsDone())
+	{
+		if (Job* J = FindJob(Index, Seed))
+			Execute(J, Index);
+		else
+			std::this_thread::yield();
+	}
+	// The thread that finished the last job may still be inside the counter's lock.
+	std::lock_guard<std::mutex> Lock(Counter.Mutex);
+}
+
+void JobSystem::ParallelFor(uint32_t Count, uint32_t MinChunk, const std::function<void(uint32_t Begin, uint32_t End)>& Fn)
+{
+	if (Count == 0)
+		return;
+	uint32_t Threads = GetThreadCount();
+	uint32_t Chunk = std::max(std::max(MinChunk, 1u), (Count + Threads * 4 - 1) / (Threads * 4));
+	if (Threads == 1 || Chunk >= Count)
+	{
+		Fn(0, Count);
+		return;
+	}
+
+	// The caller takes the first chunk itself and then helps with the rest.
+	JobCounter Counter;
+	for (uint32_t Begin = Chunk; Begin < Count; Begin += Chunk)
+	{
+		uint32_t End = std::min(Begin + Chunk, Count);
+		Run([&Fn, Begin, End] { Fn(Begin, End); }, &Counter);
+	}
+	Fn(0, Chunk);
+	Wait(Counter);
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+	JobSystemStats Total;
+	for (size_t i = 0; i <= Deques.size(); i++)
+	{
+		Total.Executed += Stats[i].Executed.load(std::memory_order_relaxed);
+		Total.Stolen += Stats[i].Stolen.load(std::memory_order_relaxed);
+		Total.Sleeps += Stats[i].Sleeps.load(std::memory_order_relaxed);
+	}
+	return Total;
+}
+
+void JobSystem::ResetStats()
+{
+	for (size_t i = 0; i <= Deques.size(); i++)
+	{
+		Stats[i].Executed.store(0, std::memory_order_relaxed);
+		Stats[i].Stolen.store(0, std::memory_order_relaxed);
+		Stats[i].Sleeps.store(0, std::memory_order_relaxed);
+	}
+}
+
+int JobSystem::ThreadIndex() const
+{
+	return CurrentSystem == this ? CurrentIndex : -1;
+}
+
+void JobSystem::Submit(Job* J)
+{
+	int Index = ThreadIndex();
+	if (Index >= 0)
+		Deques[Index]->Push(J);
+	else
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		Shared.push_back(J);
+		SharedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Pairs with the fence in WorkerLoop: either the worker sees the job, or this sees it asleep.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (Sleeping.load(std::memory_order_relaxed) > 0)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(SleepMutex);
+			WakeGeneration++;
+		}
+		WakeUp.notify_one();
+	}
+}
+
+Job* JobSystem::FindJob(int Index, uint32_t& Seed)
+{
+	if (Index >= 0)
+	{
+		if (Job* J = Deques[Index]->Pop())
+			return J;
+	}
+	if (SharedCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		if (!Shared.empty())
+		{
+			Job* J = Shared.front();
+			Shared.pop_front();
+			SharedCount.fetch_sub(1, std::memory_order_relaxed);
+			return J;
+		}
+	}
+
+	uint32_t Count = (uint32_t)Deques.size();
+	uint32_t Start = NextRandom(Seed) % Count;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		uint32_t Victim = (Start + i) % Count;
+		if ((int)Victim == Index)
+			continue;
+		if (Job* J = Deques[Victim]->Steal())
+		{
+			Stats[Index >= 0 ? Index : Count].Stolen.fetch_add(1, std::memory_order_relaxed);
+			return J;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* J, int Index)
+{
+	J->Fn();
+	JobCounter* Counter = J->Counter;
+	delete J;
+	Stats[Index >= 0 ? Index : Deques.size()].Executed.fetch_add(1, std::memory_order_relaxed);
+	if (Counter)
+		Finish(Counter);
+}
+
+void JobSystem::Finish(JobCounter* Counter)
+{
+	std::vector<Job*> Ready;
+	{
+		std::lock_guard<std::mutex> Lock(Counter->Mutex);
+		if (Counter->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Ready.swap(Counter->Waiters);
+	}
+	// Counter may be gone from here on.
+	for (Job* J : Ready)
+		Submit(J);
+}
+
+bool JobSystem::HasWork() const
+{
+	if (SharedCount.load(std::memory_order_relaxed) > 0)
+		return true;
+	for (auto& Queue : Deques)
+		if (!Queue->IsEmpty())
+			return true;
+	return false;
+}
+
+void JobSystem::WorkerLoop(uint32_t Index, int Core)
+{
+	if (Core >= 0)
+		PinCurrentThread(Core);
+	CurrentSystem = this;
+	CurrentIndex = (int)Index;
+	uint32_t Seed = Index * 0x9E3779B9u | 1;
+
+	for (;;)
+	{
+		if (Job* J = FindJob(Index, Seed))
+		{
+			Execute(J, Index);
+			continue;
+		}
+		// Jobs tend to come in bursts, look again for a while before sleeping.
+		bool Found = false;
+		for (int Spin = 0; Spin < 64 && !Found; Spin++)
+		{
+			std::this_thread::yield();
+			Found = HasWork();
+		}
+		if (Found)
+			continue;
+
+		std::unique_lock<std::mutex> Lock(SleepMutex);
+		if (Quit)
+			return;
+		Sleeping.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!HasWork())
+		{
+			uint64_t Seen = WakeGeneration;
+			Stats[Index].Sleeps.fetch_add(1, std::memory_order_relaxed);
+			WakeUp.wait(Lock, [&] { return Quit || WakeGeneration != Seen; });
+		}
+		Sleeping.fetch_sub(1, std::memory_order_relaxed);
+		if (Quit)
+			return;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+/*
+* Counts the unfinished jobs that were started with it. A job started with a counter
+* to wait on only becomes runnable once that counter reaches zero, which is how jobs
+* depend on each other. Has to outlive the jobs it counts and anything waiting on it.
+*/
+class JobCounter
+{
+public:
+	JobCounter() : Pending(0) {}
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return Pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<uint32_t> Pending;
+	// Guards the last decrement and Waiters, so waking dependents and parking new
+	// ones can not miss each other.
+	std::mutex Mutex;
+	std::vector<Job*> Waiters;
+};
+
+enum class JobAffinity
+{
+	// Threads go wherever the OS puts them.
+	None,
+	// Worker i runs on logical core i + 1, wrapping around, the calling thread is left alone.
+	PinWorkers,
+	// PinWorkers, and the thread that created the system on core 0. It stays there
+	// after the system is gone.
+	PinAll,
+};
+
+struct JobSystemStats
+{
+	uint64_t Executed = 0;
+	// Jobs a thread took from another thread's deque.
+	uint64_t Stolen = 0;
+	// Times a worker found nothing to do and went to sleep.
+	uint64_t Sleeps = 0;
+};
+
+/*
+* Worker threads with one Chase-Lev work-stealing deque each. A thread pushes and
+* pops the bottom of its own deque, so recently started jobs run hot in its cache,
+* and idle threads steal from the top of the others. The thread that created the
+* system owns a deque too and runs jobs while it waits. Jobs started from any other
+* thread go through a locked queue instead.
+*/
+class JobSystem
+{
+public:
+	// ThreadCount counts the calling thread, so 1 starts no workers. 0 is one thread per core.
+	explicit JobSystem(uint32_t ThreadCount = 0, JobAffinity Affinity = JobAffinity::None);
+	~JobSystem();
+
+	// Counter, when given, counts Fn until it has run. After is waited for first.
+	void Run(std::function<void()> Fn, JobCounter* Counter = nullptr, JobCounter* After = nullptr);
+	// Runs other jobs until Counter reaches zero.
+	void Wait(JobCounter& Counter);
+	// Calls Fn on chunks of [0, Count) of at least MinChunk, a few per thread so
+	// uneven chunks even out, and returns once all of them ran.
+	void ParallelFor(uint32_t Count, uint32_t MinChunk, const std::function<void(uint32_t Begin, uint32_t End)>& Fn);
+
+	// Workers plus the creating thread.
+	uint32_t GetThreadCount() const { return (uint32_t)Deques.size(); }
+	JobSystemStats GetStats() const;
+	void ResetStats();
+
+private:
+	class Deque;
+	// A cache line each, threads only write their own.
+	struct ThreadStats
+	{
+		std::atomic<uint64_t> Executed;
+		std::atomic<uint64_t> Stolen;
+		std::atomic<uint64_t> Sleeps;
+		char Padding[64 - 3 * sizeof(uint64_t)];
+	};
+
+	// Deque of the calling thread, -1 for threads that are not part of this system.
+	int ThreadIndex() const;
+	void Submit(Job* J);
+	// Own deque first, then the shared queue, then the other deques from a random one.
+	Job* FindJob(int Index, uint32_t& Seed);
+	void Execute(Job* J, int Index);
+	void Finish(JobCounter* Counter);
+	bool HasWork() const;
+	void WorkerLoop(uint32_t Index, int Core);
+
+	std::vector<std::unique_ptr<Deque>> Deques;
+	// One per deque, and a last one shared by threads outside the system.
+	std::unique_ptr<ThreadStats[]> Stats;
+	std::vector<std::thread> Workers;
+
+	std::mutex SharedMutex;
+	std::deque<Job*> Shared;
+	std::atomic<uint32_t> SharedCount;
+
+	// Idle workers sleep here, Run wakes one when any are asleep.
+	std::mutex SleepMutex;
+	std::condition_variable WakeUp;
+	std::atomic<uint32_t> Sleeping;
+	uint64_t WakeGeneration = 0;
+	bool Quit = false;
+};
@@ -1,9 +1,28 @@
 #include <iostream>
 #include "Renderer.h"
+#include "FramePipeline.h"
+#include <gtc/matrix_transform.hpp>
 
 using namespace std;
 
-void main()
+int main()
 {
 	Renderer rend;
-}
\ No newline at end of file
+
+	// The cube spins on the simulation thread, the main thread only draws. The callback
+	// must not touch rend, the render thread owns it.
+	glm::mat4 Projection, View, Model;
+	Renderer::DefaultCamera(rend.SurfaceSizeX, rend.SurfaceSizeY, Projection, View, Model);
+	FramePipeline Pipeline(&rend, [&](RenderSnapshot& Out, double Time, double)
+	{
+		Out.Projection = Projection;
+		Out.View = View;
+		Out.Model = glm::rotate(Model, (float)Time, glm::vec3(0.0f, 1.0f, 0.0f));
+		Out.InstanceCount = 1;
+		Out.Draws.clear();
+	}, true, 120.0);
+
+	// DrawCube polls the window's events.
+	while (!glfwWindowShouldClose(rend.window))
+		Pipeline.RenderFrame();
+}
@@ -0,0 +1,198 @@
+#include "MemoryTracker.h"
+#include <vector>
+
+const char* MemoryCategoryName(MemoryCategory Category)
+{
+	switch (Category)
+	{
+	case MemoryCategory::Vertex: return "vertex";
+	case MemoryCategory::Uniform: return "uniform";
+	case MemoryCategory::Depth: return "depth";
+	case MemoryCategory::Texture: return "texture";
+	case MemoryCategory::RenderTarget: return "render_target";
+	case MemoryCategory::Staging: return "staging";
+	default: return "other";
+	}
+}
+
+void MemoryTracker::Init(VkInstance Instance, VkPhysicalDevice PhysicalDevice, bool UseBudgetExtension)
+{
+	this->PhysicalDevice = PhysicalDevice;
+	vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &Properties);
+
+	for (uint32_t i = 0; i < Properties.memoryHeapCount; i++)
+		Heaps[i].Budget = Properties.memoryHeaps[i].size;
+
+	if (UseBudgetExtension)
+	{
+		fvkGetPhysicalDeviceMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)
+			vkGetInstanceProcAddr(Instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+	}
+	UpdateBudget();
+}
+
+void MemoryTracker::TrackAllocation(VkDeviceMemory Memory, VkDeviceSize Size, uint32_t MemoryTypeIndex, MemoryCategory Category)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		uint32_t Heap = Properties.memoryTypes[MemoryTypeIndex].heapIndex;
+		Allocations[Memory] = { Size, Heap, Category };
+
+		MemoryCounter& Counter = Categories[(int)Category];
+		Counter.Current += Size;
+		Counter.Allocations++;
+		if (Counter.Current > Counter.Peak)
+			Counter.Peak = Counter.Current;
+
+		Heaps[Heap].Used += Size;
+		if (Heaps[Heap].Used > Heaps[Heap].Peak)
+			Heaps[Heap].Peak = Heaps[Heap].Used;
+
+		TotalUsed += Size;
+		if (TotalUsed > TotalPeak)
+			TotalPeak = TotalUsed;
+	}
+	CheckThresholds();
+}
+
+void MemoryTracker::TrackFree(VkDeviceMemory Memory)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		auto Found = Allocations.find(Memory);
+		if (Found == Allocations.end())
+			return;
+
+		const Allocation& Alloc = Found->second;
+		Categories[(int)Alloc.Category].Current -= Alloc.Size;
+		Categories[(int)Alloc.Category].Allocations--;
+		Heaps[Alloc.Heap].Used -= Alloc.Size;
+		TotalUsed -= Alloc.Size;
+		Allocations.erase(Found);
+	}
+	CheckThresholds();
+}
+
+void MemoryTracker::UpdateBudget()
+{
+#ifdef VK_EXT_memory_budget
+	if (fvkGetPhysicalDeviceMemoryProperties2)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT Budget = {};
+		Budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2KHR Properties2 = {};
+		Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		Properties2.pNext = &Budget;
+		fvkGetPhysicalDeviceMemoryProperties2(PhysicalDevice, &Properties2);
+
+		std::lock_guard<std::mutex> Lock(Mutex);
+		for (uint32_t i = 0; i < Properties.memoryHeapCount; i++)
+		{
+			Heaps[i].Budget = Budget.heapBudget[i];
+			Heaps[i].DriverUsage = Budget.heapUsage[i];
+			// Allocations made after this query are added on top in EvaluateHeap.
+			UsedAtBudgetQuery[i] = Heaps[i].Used;
+		}
+	}
+#endif
+	CheckThresholds();
+}
+
+void MemoryTracker::SetThresholds(float Warning, float Critical)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	WarningThreshold = Warning;
+	CriticalThreshold = Critical;
+}
+
+void MemoryTracker::SetPressureCallback(MemoryPressureCallback Callback)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	PressureCallback = Callback;
+}
+
+VkDeviceSize MemoryTracker::EstimatedUsage(uint32_t Heap)
+{
+	// Without the extension DriverUsage and UsedAtBudgetQuery stay 0 and this is just our own usage.
+	const HeapUsage& Usage = Heaps[Heap];
+	VkDeviceSize Since = Usage.Used > UsedAtBudgetQuery[Heap] ? Usage.Used - UsedAtBudgetQuery[Heap] : 0;
+	VkDeviceSize Estimate = Usage.DriverUsage + Since;
+	return Estimate > Usage.Used ? Estimate : Usage.Used;
+}
+
+MemoryPressure MemoryTracker::EvaluateHeap(uint32_t Heap)
+{
+	const HeapUsage& Usage = Heaps[Heap];
+	if (Usage.Budget == 0)
+		return MemoryPressure::None;
+
+	double Fraction = (double)EstimatedUsage(Heap) / (double)Usage.Budget;
+	if (Fraction >= CriticalThreshold)
+		return MemoryPressure::Critical;
+	if (Fraction >= WarningThreshold)
+		return MemoryPressure::Warning;
+	return MemoryPressure::None;
+}
+
+void MemoryTracker::CheckThresholds()
+{
+	struct Event
+	{
+		uint32_t Heap;
+		MemoryPressure Level;
+		HeapUsage Usage;
+	};
+	std::vector<Event> Events;
+	MemoryPressureCallback Callback;
+
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		for (uint32_t i = 0; i < Properties.memoryHeapCount; i++)
+		{
+			MemoryPressure Level = EvaluateHeap(i);
+			// Only report going up, dropping back re-arms the threshold.
+			if (Level > HeapPressure[i])
+			{
+				HeapUsage Usage = Heaps[i];
+				Usage.DriverUsage = EstimatedUsage(i);
+				Events.push_back({ i, Level, Usage });
+			}
+			HeapPressure[i] = Level;
+		}
+		Callback = PressureCallback;
+	}
+
+	// Called without the lock so the callback can free memory.
+	if (Callback)
+	{
+		for (auto& E : Events)
+			Callback(E.Heap, E.Level, E.Usage);
+	}
+}
+
+MemoryCounter MemoryTracker::GetCategoryUsage(MemoryCategory Category)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Categories[(int)Category];
+}
+
+HeapUsage MemoryTracker::GetHeapUsage(uint32_t Heap)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	HeapUsage Usage = Heaps[Heap];
+	Usage.DriverUsage = EstimatedUsage(Heap);
+	return Usage;
+}
+
+VkDeviceSize MemoryTracker::GetTotalUsed()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return TotalUsed;
+}
+
+VkDeviceSize MemoryTracker::GetTotalPeak()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return TotalPeak;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+enum class MemoryCategory
+{
+	Vertex,
+	Uniform,
+	Depth,
+	Texture,
+	RenderTarget,
+	Staging,
+	Other,
+	Count
+};
+
+const char* MemoryCategoryName(MemoryCategory Category);
+
+struct MemoryCounter
+{
+	VkDeviceSize Current = 0;
+	VkDeviceSize Peak = 0;
+	uint32_t Allocations = 0;
+};
+
+struct HeapUsage
+{
+	// What we allocated ourselves.
+	VkDeviceSize Used = 0;
+	VkDeviceSize Peak = 0;
+	// From VK_EXT_memory_budget, or the heap size and our own usage without it.
+	VkDeviceSize Budget = 0;
+	VkDeviceSize DriverUsage = 0;
+};
+
+enum class MemoryPressure
+{
+	None,
+	// Time to stream down, e.g. drop texture mips.
+	Warning,
+	// Time to evict.
+	Critical
+};
+
+typedef std::function<void(uint32_t Heap, MemoryPressure Level, const HeapUsage& Usage)> MemoryPressureCallback;
+
+/*
+* Tags every device memory allocation with a category and keeps current and peak
+* usage per category and per heap. When VK_EXT_memory_budget is available the heap
+* budgets come from the driver, so memory used by other processes counts as well.
+* The pressure callback fires once each time a heap crosses a threshold upwards.
+*/
+class MemoryTracker
+{
+public:
+	void Init(VkInstance Instance, VkPhysicalDevice PhysicalDevice, bool UseBudgetExtension);
+
+	void TrackAllocation(VkDeviceMemory Memory, VkDeviceSize Size, uint32_t MemoryTypeIndex, MemoryCategory Category);
+	void TrackFree(VkDeviceMemory Memory);
+
+	// Queries the driver budget (if available) and checks the thresholds.
+	void UpdateBudget();
+
+	// Fractions of a heap's budget.
+	void SetThresholds(float Warning, float Critical);
+	void SetPressureCallback(MemoryPressureCallback Callback);
+
+	MemoryCounter GetCategoryUsage(MemoryCategory Category);
+	HeapUsage GetHeapUsage(uint32_t Heap);
+	uint32_t GetHeapCount() const { return Properties.memoryHeapCount; }
+	VkDeviceSize GetTotalUsed();
+	VkDeviceSize GetTotalPeak();
+	bool HasBudgetExtension() const { return fvkGetPhysicalDeviceMemoryProperties2 != nullptr; }
+
+private:
+	struct Allocation
+	{
+		VkDeviceSize Size;
+		uint32_t Heap;
+		MemoryCategory Category;
+	};
+
+	// Must hold Mutex. Driver usage at the last budget query plus what we allocated since.
+	VkDeviceSize EstimatedUsage(uint32_t Heap);
+	// Must hold Mutex. Returns the pressure level of Heap right now.
+	MemoryPressure EvaluateHeap(uint32_t Heap);
+	void CheckThresholds();
+
+	VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties Properties = {};
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR fvkGetPhysicalDeviceMemoryProperties2 = nullptr;
+
+	std::mutex Mutex;
+	std::unordered_map<VkDeviceMemory, Allocation> Allocations;
+	MemoryCounter Categories[(int)MemoryCategory::Count];
+	HeapUsage Heaps[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize UsedAtBudgetQuery[VK_MAX_MEMORY_HEAPS] = {};
+	MemoryPressure HeapPressure[VK_MAX_MEMORY_HEAPS] = {};
+	VkDeviceSize TotalUsed = 0;
+	VkDeviceSize TotalPeak = 0;
+
+	float WarningThreshold = 0.8f;
+	float CriticalThreshold = 0.95f;
+	MemoryPressureCallback PressureCallback;
+};
@@ -0,0 +1,412 @@
+#include "MeshLod.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace
+{
+	// Symmetric 4x4 matrix, the upper triangle row by row.
+	struct Quadric
+	{
+		double A[10] = {};
+
+		void AddPlane(double a, double b, double c, double d, double Weight)
+		{
+			const double P[4] = { a, b, c, d };
+			int k = 0;
+			for (int i = 0; i < 4; i++)
+				for (int j = i; j < 4; j++)
+					A[k++] += P[i] * P[j] * Weight;
+		}
+
+		void Add(const Quadric& Other)
+		{
+			for (int i = 0; i < 10; i++)
+				A[i] += Other.A[i];
+		}
+
+		// v^T Q v for v = (x, y, z, 1).
+		double Evaluate(const float* V) const
+		{
+			double x = V[0], y = V[1], z = V[2];
+			return A[0] * x * x + 2.0 * A[1] * x * y + 2.0 * A[2] * x * z + 2.0 * A[3] * x +
+				A[4] * y * y + 2.0 * A[5] * y * z + 2.0 * A[6] * y +
+				A[7] * z * z + 2.0 * A[8] * z +
+				A[9];
+		}
+	};
+
+	struct Collapse
+	{
+		double Cost;
+		uint32_t From;
+		uint32_t To;
+		uint32_t FromVersion;
+		uint32_t ToVersion;
+
+		bool operator>(const Collapse& Other) const { return Cost > Other.Cost; }
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(const float* Positions, size_t VertexCount, size_t PositionStride, const uint32_t* Indices, size_t IndexCount);
+		// Collapses until at most Target triangles are left or nothing can be collapsed. Returns false in the latter case.
+		bool Reduce(size_t Target);
+		size_t GetTriangleCount() const { return ActiveTriangles; }
+		double GetError() const { return std::sqrt(MaxError); }
+		void AppendIndices(std::vector<uint32_t>& Out) const;
+
+	private:
+		const float* Position(uint32_t V) const { return (const float*)((const char*)Positions + V * Stride); }
+		void TriangleNormal(const uint32_t* T, uint32_t Moved, uint32_t Target, double* Normal) const;
+		void PushEdge(uint32_t A, uint32_t B);
+		bool CanCollapse(uint32_t From, uint32_t To);
+		void Apply(uint32_t From, uint32_t To);
+
+		const float* Positions;
+		size_t Stride;
+		std::vector<uint32_t> Triangles;
+		std::vector<uint8_t> Removed;
+		std::vector<std::vector<uint32_t>> VertexTriangles;
+		std::vector<Quadric> Quadrics;
+		// Sum of the triangle areas in each quadric, turns the cost into a distance.
+		std::vector<double> Weights;
+		std::vector<uint8_t> Locked;
+		std::vector<uint32_t> Versions;
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> Heap;
+		std::vector<uint32_t> Scratch;
+		size_t ActiveTriangles;
+		double MaxError = 0.0;
+	};
+}
+
+Simplifier::Simplifier(const float* Positions, size_t VertexCount, size_t PositionStride, const uint32_t* Indices, size_t IndexCount)
+	: Positions(Positions), Stride(PositionStride), Triangles(Indices, Indices + IndexCount)
+{
+	size_t TriangleCount = IndexCount / 3;
+	ActiveTriangles = TriangleCount;
+	Removed.assign(TriangleCount, 0);
+	VertexTriangles.resize(VertexCount);
+	Quadrics.resize(VertexCount);
+	Weights.assign(VertexCount, 0.0);
+	Locked.assign(VertexCount, 0);
+	Versions.assign(VertexCount, 0);
+
+	for (uint32_t t = 0; t < TriangleCount; t++)
+	{
+		const uint32_t* T = &Triangles[t * 3];
+		const float* P0 = Position(T[0]);
+		const float* P1 = Position(T[1]);
+		const float* P2 = Position(T[2]);
+		double E1[3] = { P1[0] - P0[0], P1[1] - P0[1], P1[2] - P0[2] };
+		double E2[3] = { P2[0] - P0[0], P2[1] - P0[1], P2[2] - P0[2] };
+		double N[3] = { E1[1] * E2[2] - E1[2] * E2[1], E1[2] * E2[0] - E1[0] * E2[2], E1[0] * E2[1] - E1[1] * E2[0] };
+		double Length = std::sqrt(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+		// Area weighted, so many small triangles do not outvote a large one.
+		double Area = Length * 0.5;
+		if (Length > 0.0)
+		{
+			N[0] /= Length;
+			N[1] /= Length;
+			N[2] /= Length;
+		}
+		double D = -(N[0] * P0[0] + N[1] * P0[1] + N[2] * P0[2]);
+		for (int k = 0; k < 3; k++)
+		{
+			Quadrics[T[k]].AddPlane(N[0], N[1], N[2], D, Area);
+			Weights[T[k]] += Area;
+			VertexTriangles[T[k]].push_back(t);
+		}
+	}
+
+	// Edges used by one triangle are on the border.
+	std::vector<uint64_t> Edges;
+	Edges.reserve(IndexCount);
+	for (size_t t = 0; t < TriangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t A = Triangles[t * 3 + k];
+			uint32_t B = Triangles[t * 3 + (k + 1) % 3];
+			Edges.push_back(((uint64_t)std::min(A, B) << 32) | std::max(A, B));
+		}
+	}
+	std::sort(Edges.begin(), Edges.end());
+	for (size_t i = 0; i < Edges.size();)
+	{
+		size_t Next = i + 1;
+		while (Next < Edges.size() && Edges[Next] == Edges[i])
+			Next++;
+		if (Next - i == 1)
+		{
+			Locked[(uint32_t)(Edges[i] >> 32)] = 1;
+			Locked[(uint32_t)Edges[i]] = 1;
+		}
+		i = Next;
+	}
+
+	// Vertices sharing a position differ in attributes, moving one would tear the seam open.
+	std::vector<uint32_t> ByPosition(VertexCount);
+	for (uint32_t v = 0; v < VertexCount; v++)
+		ByPosition[v] = v;
+	std::sort(ByPosition.begin(), ByPosition.end(), [this](uint32_t A, uint32_t B)
+	{
+		return std::lexicographical_compare(Position(A), Position(A) + 3, Position(B), Position(B) + 3);
+	});
+	for (size_t i = 1; i < ByPosition.size(); i++)
+	{
+		const float* A = Position(ByPosition[i - 1]);
+		const float* B = Position(ByPosition[i]);
+		if (A[0] == B[0] && A[1] == B[1] && A[2] == B[2])
+		{
+			Locked[ByPosition[i - 1]] = 1;
+			Locked[ByPosition[i]] = 1;
+		}
+	}
+
+	Edges.erase(std::unique(Edges.begin(), Edges.end()), Edges.end());
+	for (uint64_t Edge : Edges)
+		PushEdge((uint32_t)(Edge >> 32), (uint32_t)Edge);
+}
+
+void Simplifier::PushEdge(uint32_t A, uint32_t B)
+{
+	if (Locked[A] && Locked[B])
+		return;
+	Quadric Q = Quadrics[A];
+	Q.Add(Quadrics[B]);
+	// Move the unlocked end, or the one that moves more cheaply.
+	double CostAB = Locked[A] ? HUGE_VAL : Q.Evaluate(Position(B));
+	double CostBA = Locked[B] ? HUGE_VAL : Q.Evaluate(Position(A));
+	if (CostAB <= CostBA)
+		Heap.push({ std::max(CostAB, 0.0), A, B, Versions[A], Versions[B] });
+	else
+		Heap.push({ std::max(CostBA, 0.0), B, A, Versions[B], Versions[A] });
+}
+
+void Simplifier::TriangleNormal(const uint32_t* T, uint32_t Moved, uint32_t Target, double* Normal) const
+{
+	const float* P[3];
+	for (int k = 0; k < 3; k++)
+		P[k] = Position(T[k] == Moved ? Target : T[k]);
+	double E1[3] = { P[1][0] - P[0][0], P[1][1] - P[0][1], P[1][2] - P[0][2] };
+	double E2[3] = { P[2][0] - P[0][0], P[2][1] - P[0][1], P[2][2] - P[0][2] };
+	Normal[0] = E1[1] * E2[2] - E1[2] * E2[1];
+	Normal[1] = E1[2] * E2[0] - E1[0] * E2[2];
+	Normal[2] = E1[0] * E2[1] - E1[1] * E2[0];
+}
+
+bool Simplifier::CanCollapse(uint32_t From, uint32_t To)
+{
+	// Vertices next to both ends have to be the ones across the shared triangles, or the
+	// collapse pinches the surface into a non-manifold edge.
+	Scratch.clear();
+	uint32_t Shared = 0;
+	for (uint32_t t : VertexTriangles[From])
+	{
+		if (Removed[t])
+			continue;
+		const uint32_t* T = &Triangles[t * 3];
+		bool HasTo = T[0] == To || T[1] == To || T[2] == To;
+		if (HasTo)
+			Shared++;
+		for (int k = 0; k < 3; k++)
+		{
+			if (T[k] != From && T[k] != To)
+				Scratch.push_back(T[k]);
+		}
+	}
+	std::sort(Scratch.begin(), Scratch.end());
+	Scratch.erase(std::unique(Scratch.begin(), Scratch.end()), Scratch.end());
+	uint32_t Common = 0;
+	for (uint32_t t : VertexTriangles[To])
+	{
+		if (Removed[t])
+			continue;
+		const uint32_t* T = &Triangles[t * 3];
+		for (int k = 0; k < 3; k++)
+		{
+			if (T[k] != From && T[k] != To && std::binary_search(Scratch.begin(), Scratch.end(), T[k]))
+			{
+				Common++;
+				// Counted once per vertex.
+				Scratch.erase(std::lower_bound(Scratch.begin(), Scratch.end(), T[k]));
+			}
+		}
+	}
+	if (Common != Shared)
+		return false;
+
+	// No triangle that stays may flip over.
+	for (uint32_t t : VertexTriangles[From])
+	{
+		if (Removed[t])
+			continue;
+		const uint32_t* T = &Triangles[t * 3];
+		if (T[0] == To || T[1] == To || T[2] == To)
+			continue;
+		double Before[3], After[3];
+		TriangleNormal(T, From, From, Before);
+		TriangleNormal(T, From, To, After);
+		double Dot = Before[0] * After[0] + Before[1] * After[1] + Before[2] * After[2];
+		double Lengths = std::sqrt((Before[0] * Before[0] + Before[1] * Before[1] + Before[2] * Before[2]) *
+			(After[0] * After[0] + After[1] * After[1] + After[2] * After[2]));
+		if (Dot <= 0.2 * Lengths)
+			return false;
+	}
+	return true;
+}
+
+void Simplifier::Apply(uint32_t From, uint32_t To)
+{
+	for (uint32_t t : VertexTriangles[From])
+	{
+		if (Removed[t])
+			continue;
+		uint32_t* T = &Triangles[t * 3];
+		if (T[0] == To || T[1] == To || T[2] == To)
+		{
+			Removed[t] = 1;
+			ActiveTriangles--;
+			continue;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			if (T[k] == From)
+				T[k] = To;
+		}
+		VertexTriangles[To].push_back(t);
+	}
+	VertexTriangles[From].clear();
+	Quadrics[To].Add(Quadrics[From]);
+	Weights[To] += Weights[From];
+	Versions[From]++;
+	Versions[To]++;
+
+	// Costs of every edge around To changed.
+	Scratch.clear();
+	for (uint32_t t : VertexTriangles[To])
+	{
+		if (Removed[t])
+			continue;
+		for (int k = 0; k < 3; k++)
+		{
+			if (Triangles[t * 3 + k] != To)
+				Scratch.push_back(Triangles[t * 3 + k]);
+		}
+	}
+	std::sort(Scratch.begin(), Scratch.end());
+	Scratch.erase(std::unique(Scratch.begin(), Scratch.end()), Scratch.end());
+	for (uint32_t Neighbor : Scratch)
+		PushEdge(To, Neighbor);
+}
+
+bool Simplifier::Reduce(size_t Target)
+{
+	while (ActiveTriangles > Target)
+	{
+		if (Heap.empty())
+			return false;
+		Collapse Top = Heap.top();
+		Heap.pop();
+		if (Top.FromVersion != Versions[Top.From] || Top.ToVersion != Versions[Top.To])
+			continue;
+		if (!CanCollapse(Top.From, Top.To))
+			continue;
+		Apply(Top.From, Top.To);
+		double Weight = Weights[Top.To];
+		if (Weight > 0.0)
+			MaxError = std::max(MaxError, Top.Cost / Weight);
+	}
+	return true;
+}
+
+void Simplifier::AppendIndices(std::vector<uint32_t>& Out) const
+{
+	for (size_t t = 0; t < Removed.size(); t++)
+	{
+		if (!Removed[t])
+			Out.insert(Out.end(), &Triangles[t * 3], &Triangles[t * 3] + 3);
+	}
+}
+
+MeshLodChain BuildMeshLods(const float* Positions, size_t VertexCount, size_t PositionStride,
+	const uint32_t* Indices, size_t IndexCount, const MeshLodSettings& Settings)
+{
+	MeshLodChain Chain;
+	if (VertexCount == 0 || IndexCount < 3)
+		return Chain;
+
+	float Min[3], Max[3];
+	const float* First = Positions;
+	for (int k = 0; k < 3; k++)
+		Min[k] = Max[k] = First[k];
+	for (size_t v = 1; v < VertexCount; v++)
+	{
+		const float* P = (const float*)((const char*)Positions + v * PositionStride);
+		for (int k = 0; k < 3; k++)
+		{
+			Min[k] = std::min(Min[k], P[k]);
+			Max[k] = std::max(Max[k], P[k]);
+		}
+	}
+	for (int k = 0; k < 3; k++)
+		Chain.Center[k] = (Min[k] + Max[k]) * 0.5f;
+	for (size_t v = 0; v < VertexCount; v++)
+	{
+		const float* P = (const float*)((const char*)Positions + v * PositionStride);
+		float D[3] = { P[0] - Chain.Center[0], P[1] - Chain.Center[1], P[2] - Chain.Center[2] };
+		Chain.Radius = std::max(Chain.Radius, std::sqrt(D[0] * D[0] + D[1] * D[1] + D[2] * D[2]));
+	}
+
+	Chain.Indices.assign(Indices, Indices + IndexCount / 3 * 3);
+	Chain.Levels.push_back({ 0, (uint32_t)Chain.Indices.size(), 0.0f });
+
+	// One simplification run, each level is a snapshot on the way down.
+	Simplifier Simplify(Positions, VertexCount, PositionStride, Indices, IndexCount / 3 * 3);
+	while (Chain.Levels.size() < Settings.MaxLevels)
+	{
+		size_t Previous = Chain.Levels.back().IndexCount / 3;
+		size_t Target = std::max((size_t)(Previous * Settings.Reduction), (size_t)Settings.MinTriangles);
+		if (Target >= Previous)
+			break;
+		bool Reached = Simplify.Reduce(Target);
+		// Stuck well above the target, keep it if it still saves a good share.
+		if (Simplify.GetTriangleCount() * 10 > Previous * 9)
+			break;
+		MeshLodLevel Level;
+		Level.FirstIndex = (uint32_t)Chain.Indices.size();
+		Simplify.AppendIndices(Chain.Indices);
+		Level.IndexCount = (uint32_t)Chain.Indices.size() - Level.FirstIndex;
+		Level.Error = (float)Simplify.GetError();
+		Chain.Levels.push_back(Level);
+		if (!Reached)
+			break;
+	}
+	return Chain;
+}
+
+std::future<MeshLodChain> BuildMeshLodsAsync(std::vector<float> Positions, size_t PositionStride,
+	std::vector<uint32_t> Indices, const MeshLodSettings& Settings)
+{
+	return std::async(std::launch::async, [Positions = std::move(Positions), PositionStride, Indices = std::move(Indices), Settings]()
+	{
+		return BuildMeshLods(Positions.data(), Positions.size() * sizeof(float) / PositionStride, PositionStride,
+			Indices.data(), Indices.size(), Settings);
+	});
+}
+
+uint32_t SelectMeshLod(const MeshLodChain& Chain, float Scale, float Distance, float PixelsPerUnit, float ErrorPixels)
+{
+	if (Chain.Levels.empty())
+		return 0;
+	// Inside the bounding sphere everything is close.
+	if (Distance <= 0.0f)
+		return 0;
+	float MaxError = ErrorPixels * Distance / (PixelsPerUnit * Scale);
+	uint32_t Level = 0;
+	while (Level + 1 < Chain.Levels.size() && Chain.Levels[Level + 1].Error <= MaxError)
+		Level++;
+	return Level;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+struct MeshLodSettings
+{
+	// Including level 0, the source mesh.
+	uint32_t MaxLevels = 8;
+	// Triangle target of each level relative to the one before.
+	float Reduction = 0.5f;
+	uint32_t MinTriangles = 32;
+};
+
+struct MeshLodLevel
+{
+	uint32_t FirstIndex;
+	uint32_t IndexCount;
+	// Object space distance the level may be off from the source by, roughly.
+	float Error;
+};
+
+/*
+* Every level indexes the same vertices, so one vertex buffer serves the whole chain
+* and the levels are ranges of one index buffer, finest first.
+*/
+struct MeshLodChain
+{
+	std::vector<uint32_t> Indices;
+	std::vector<MeshLodLevel> Levels;
+	// Bounding sphere of the vertices.
+	float Center[3] = {};
+	float Radius = 0.0f;
+};
+
+/*
+* Simplifies a triangle list by quadric error edge collapse (Garland and Heckbert),
+* always moving a vertex onto a neighbor so no vertices are added. Border vertices
+* and vertices that share their position with another vertex (attribute seams) are
+* never moved. Positions are three floats every PositionStride bytes.
+* Only reads its arguments, so it can run on any thread.
+*/
+MeshLodChain BuildMeshLods(const float* Positions, size_t VertexCount, size_t PositionStride,
+	const uint32_t* Indices, size_t IndexCount, const MeshLodSettings& Settings = MeshLodSettings());
+
+// Same on a worker thread, on copies of the arrays.
+std::future<MeshLodChain> BuildMeshLodsAsync(std::vector<float> Positions, size_t PositionStride,
+	std::vector<uint32_t> Indices, const MeshLodSettings& Settings = MeshLodSettings());
+
+/*
+* Coarsest level whose error stays within ErrorPixels on screen. Distance is from the
+* camera to the nearest point of the scaled bounding sphere, PixelsPerUnit is what one
+* unit at distance one covers on screen, Projection[1][1] * Height / 2.
+*/
+uint32_t SelectMeshLod(const MeshLodChain& Chain, float Scale, float Distance, float PixelsPerUnit, float ErrorPixels);
@@ -0,0 +1,633 @@
+#include "MeshletCuller.h"
+#include "Renderer.h"
+#include "DepthPyramid.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <string>
+
+// Shared by the cull and occlusion shaders.
+static const char* cullCommonText =
+"#version 450\n"
+"layout (local_size_x = 64) in;\n"
+"// Survivors packed at the front and counted, otherwise one command per meshlet.\n"
+"layout (constant_id = 0) const bool COMPACT = false;\n"
+"const uint SKIPPED = 0xffffffffu;\n"
+"struct Meshlet {\n"
+"    vec4 sphere;\n"
+"    vec4 apex;\n"
+"    vec3 axis;\n"
+"    uint vertexCount;\n"
+"    uint firstIndex;\n"
+"    uint triangleCount;\n"
+"    uint pad0;\n"
+"    uint pad1;\n"
+"};\n"
+"struct DrawCommand {\n"
+"    uint indexCount;\n"
+"    uint instanceCount;\n"
+"    uint firstIndex;\n"
+"    int vertexOffset;\n"
+"    uint firstInstance;\n"
+"};\n"
+"layout (std430, binding = 0) readonly buffer meshletBuffer { Meshlet meshlets[]; };\n"
+"layout (std430, binding = 1) readonly buffer objectBuffer { mat4 models[]; };\n"
+"layout (std430, binding = 2) writeonly buffer commandBuffer { DrawCommand commands[]; };\n"
+"layout (std430, binding = 3) buffer counterBuffer {\n"
+"    // Of the single or first phase, then of the second.\n"
+"    uint drawCount[2];\n"
+"    uint resultMeshlets[5];\n"
+"    uint resultTriangles[5];\n"
+"    uint occludedObjects;\n"
+"    uint lateObjects;\n"
+"};\n"
+"// Bit 0 = visible after this frame's occlusion test, bit 1 = the frame before, bits 2+ = why not.\n"
+"layout (std430, binding = 4) buffer visibilityBuffer { uint visibility[]; };\n"
+"layout (push_constant) uniform cullVals {\n"
+"    mat4 viewProj;\n"
+"    // xyz = camera position, w = pixels per unit at distance one.\n"
+"    vec4 camera;\n"
+"    uint meshletCount;\n"
+"    uint objectCount;\n"
+"    float minPixels;\n"
+"    // 1 = cull, 2 = count results, bits 2+ = phase, 0 without occlusion.\n"
+"    uint flags;\n"
+"    // Sphere around every meshlet.\n"
+"    vec4 bounds;\n"
+"    // Where the second phase's commands start.\n"
+"    uint commandBase;\n"
+"};\n"
+"float objectScale(mat4 model) {\n"
+"    return sqrt(max(dot(model[0].xyz, model[0].xyz), max(dot(model[1].xyz, model[1].xyz), dot(model[2].xyz, model[2].xyz))));\n"
+"}\n"
+"bool outsideFrustum(vec3 center, float radius) {\n"
+"    mat4 rows = transpose(viewProj);\n"
+"    vec4 planes[6] = vec4[6](rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],\n"
+"        rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]);\n"
+"    for (int i = 0; i < 6; i++) {\n"
+"        if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))\n"
+"            return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n";
+
+static const char* cullShaderText =
+"// Same tests and order as CullMeshlet in Meshlets.cpp.\n"
+"uint cullMeshlet(Meshlet m, mat4 model) {\n"
+"    vec3 center = (model * vec4(m.sphere.xyz, 1.0)).xyz;\n"
+"    float radius = m.sphere.w * objectScale(model);\n"
+"    if (outsideFrustum(center, radius))\n"
+"        return 1u;\n"
+"    if (m.apex.w < 1.0) {\n"
+"        vec3 apex = (model * vec4(m.apex.xyz, 1.0)).xyz;\n"
+"        vec3 axis = normalize(mat3(model) * m.axis);\n"
+"        vec3 toApex = apex - camera.xyz;\n"
+"        float d = length(toApex);\n"
+"        if (d > 0.0 && dot(toApex / d, axis) >= m.apex.w)\n"
+"            return 2u;\n"
+"    }\n"
+"    float distance = length(center - camera.xyz);\n"
+"    if (distance > radius && 2.0 * radius * camera.w / distance < minPixels)\n"
+"        return 3u;\n"
+"    return 0u;\n"
+"}\n"
+"void main() {\n"
+"    uint id = gl_GlobalInvocationID.x;\n"
+"    if (id >= meshletCount * objectCount)\n"
+"        return;\n"
+"    uint object = id / meshletCount;\n"
+"    Meshlet m = meshlets[id % meshletCount];\n"
+"    uint phase = flags >> 2;\n"
+"    uint visible = phase != 0u ? visibility[object] : 1u;\n"
+"    // The first phase only takes objects visible last frame, the second the others,\n"
+"    // so every meshlet is counted once.\n"
+"    bool skipped = phase == 1u ? (visible & 1u) == 0u : phase == 2u && (visible & 2u) != 0u;\n"
+"    uint result = SKIPPED;\n"
+"    if (!skipped) {\n"
+"        if ((visible & 1u) == 0u)\n"
+"            result = visible >> 2;\n"
+"        else\n"
+"            result = (flags & 1u) != 0u ? cullMeshlet(m, models[object]) : 0u;\n"
+"    }\n"
+"    if ((flags & 2u) != 0u && !skipped) {\n"
+"        atomicAdd(resultMeshlets[result], 1u);\n"
+"        atomicAdd(resultTriangles[result], m.triangleCount);\n"
+"    }\n"
+"    DrawCommand command = DrawCommand(m.triangleCount * 3u, 1u, m.firstIndex, 0, object);\n"
+"    if (COMPACT) {\n"
+"        if (result == 0u)\n"
+"            commands[commandBase + atomicAdd(drawCount[phase == 2u ? 1 : 0], 1u)] = command;\n"
+"    } else {\n"
+"        if (result != 0u)\n"
+"            command.instanceCount = 0u;\n"
+"        commands[commandBase + id] = command;\n"
+"    }\n"
+"}\n";
+
+static const char* occlusionShaderText =
+"layout (binding = 5) uniform sampler2D depthPyramid;\n"
+"// Farthest depth the pyramid has under the rectangle from lo to hi, in [0, 1] across the screen.\n"
+"float farthestDepth(vec2 lo, vec2 hi) {\n"
+"    vec2 extent = (hi - lo) * vec2(textureSize(depthPyramid, 0));\n"
+"    // The level where the rectangle spans two texels at most each way.\n"
+"    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(depthPyramid) - 1);\n"
+"    ivec2 size = textureSize(depthPyramid, level);\n"
+"    ivec2 a = clamp(ivec2(lo * vec2(size)), ivec2(0), size - 1);\n"
+"    ivec2 b = clamp(ivec2(hi * vec2(size)), ivec2(0), size - 1);\n"
+"    return max(max(texelFetch(depthPyramid, a, level).r, texelFetch(depthPyramid, ivec2(b.x, a.y), level).r),\n"
+"        max(texelFetch(depthPyramid, ivec2(a.x, b.y), level).r, texelFetch(depthPyramid, b, level).r));\n"
+"}\n"
+"// Tests the box around the sphere, its nearest corner against the farthest depth\n"
+"// under its screen rectangle.\n"
+"bool occluded(vec3 center, float radius) {\n"
+"    vec2 lo = vec2(1.0);\n"
+"    vec2 hi = vec2(-1.0);\n"
+"    float nearest = 1.0;\n"
+"    for (int i = 0; i < 8; i++) {\n"
+"        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);\n"
+"        vec4 clip = viewProj * vec4(corner, 1.0);\n"
+"        // Reaches behind the camera, nothing to test.\n"
+"        if (clip.w <= 1e-5)\n"
+"            return false;\n"
+"        vec3 ndc = clip.xyz / clip.w;\n"
+"        lo = min(lo, ndc.xy);\n"
+"        hi = max(hi, ndc.xy);\n"
+"        nearest = min(nearest, ndc.z);\n"
+"    }\n"
+"    lo = clamp(lo * 0.5 + 0.5, 0.0, 1.0);\n"
+"    hi = clamp(hi * 0.5 + 0.5, 0.0, 1.0);\n"
+"    return nearest > farthestDepth(lo, hi);\n"
+"}\n"
+"void main() {\n"
+"    uint object = gl_GlobalInvocationID.x;\n"
+"    if (object >= objectCount)\n"
+"        return;\n"
+"    mat4 model = models[object];\n"
+"    vec3 center = (model * vec4(bounds.xyz, 1.0)).xyz;\n"
+"    float radius = bounds.w * objectScale(model);\n"
+"    uint result = 0u;\n"
+"    if ((flags & 1u) != 0u) {\n"
+"        if (outsideFrustum(center, radius))\n"
+"            result = 1u;\n"
+"        else if (occluded(center, radius))\n"
+"            result = 4u;\n"
+"    }\n"
+"    uint previous = visibility[object] & 1u;\n"
+"    visibility[object] = (result == 0u ? 1u : 0u) | (previous << 1) | (result << 2);\n"
+"    if ((flags & 2u) != 0u) {\n"
+"        if (result == 4u)\n"
+"            atomicAdd(occludedObjects, 1u);\n"
+"        if (result == 0u && previous == 0u)\n"
+"            atomicAdd(lateObjects, 1u);\n"
+"    }\n"
+"}\n";
+
+static const char* vertShaderText =
+"#version 450\n"
+"layout (std140, set = 0, binding = 0) uniform bufferVals {\n"
+"    mat4 mvp;\n"
+"    vec4 grid;\n"
+"} myBufferVals;\n"
+"layout (std430, set = 1, binding = 1) readonly buffer objectBuffer { mat4 models[]; };\n"
+"layout (location = 0) in vec4 pos;\n"
+"layout (location = 1) in vec4 inColor;\n"
+"layout (location = 0) out vec4 outColor;\n"
+"void main() {\n"
+"   outColor = inColor;\n"
+"   // The cull pass put the object in firstInstance.\n"
+"   gl_Position = myBufferVals.mvp * models[gl_InstanceIndex] * vec4(pos.xyz, 1.0);\n"
+"}\n";
+
+static const char* fragShaderText =
+"#version 450\n"
+"layout (location = 0) in vec4 color;\n"
+"layout (location = 0) out vec4 outColor;\n"
+"void main() {\n"
+"   outColor = color;\n"
+"}\n";
+
+// Layout of the cull shader's push constants.
+struct MeshletCullConstants
+{
+	glm::mat4 ViewProjection;
+	glm::vec4 Camera;
+	uint32_t MeshletCount;
+	uint32_t ObjectCount;
+	float MinPixels;
+	uint32_t Flags;
+	glm::vec4 Bounds;
+	uint32_t CommandBase;
+};
+
+// Two draw counts, two per result, occluded and late objects.
+static const uint32_t CounterCount = 2 + 2 * (uint32_t)MeshletCull::Count + 2;
+
+static void CreateBuffer(Renderer* Rend, VkDeviceSize Size, VkBufferUsageFlags Usage, VkFlags Properties,
+	MemoryCategory Category, VkBuffer* Buffer, VkDeviceMemory* Memory)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.usage = Usage;
+	buf_info.size = Size;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto res = vkCreateBuffer(Rend->Device, &buf_info, NULL, Buffer);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(Rend->Device, *Buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits, Properties, &alloc_info.memoryTypeIndex))
+		std::exit(-1);
+
+	res = Rend->AllocateMemory(&alloc_info, Category, Memory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	res = vkBindBufferMemory(Rend->Device, *Buffer, *Memory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+bool MeshletCuller::IsSupported(const Renderer* Rend)
+{
+	return Rend->EnabledFeatures.multiDrawIndirect && Rend->EnabledFeatures.drawIndirectFirstInstance;
+}
+
+MeshletCuller::MeshletCuller(Renderer* Rend, const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh, uint32_t MaxObjects,
+	DepthPyramid* Pyramid)
+	: Rend(Rend), Pyramid(Pyramid), MeshletCount((uint32_t)Mesh.Meshlets.size())
+{
+	uint32_t MaxDraws = Rend->DeviceProperties.limits.maxDrawIndirectCount;
+	this->MaxObjects = std::max(1u, std::min(MaxObjects, MaxDraws / std::max(MeshletCount, 1u)));
+	Compact = Rend->DrawIndirectCountSupported;
+#ifdef VK_KHR_draw_indirect_count
+	if (Compact)
+	{
+		DrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+			vkGetDeviceProcAddr(Rend->Device, "vkCmdDrawIndexedIndirectCountKHR");
+		Compact = DrawIndexedIndirectCount != nullptr;
+	}
+#else
+	Compact = false;
+#endif
+
+	// Sphere around the meshlets' spheres, centered on their box.
+	glm::vec3 Lo(FLT_MAX), Hi(-FLT_MAX);
+	for (auto& Cluster : Mesh.Meshlets)
+	{
+		glm::vec3 Center(Cluster.Center[0], Cluster.Center[1], Cluster.Center[2]);
+		Lo = glm::min(Lo, Center - Cluster.Radius);
+		Hi = glm::max(Hi, Center + Cluster.Radius);
+	}
+	glm::vec3 Center = MeshletCount ? (Lo + Hi) * 0.5f : glm::vec3(0.0f);
+	float Radius = 0.0f;
+	for (auto& Cluster : Mesh.Meshlets)
+	{
+		glm::vec3 Offset = glm::vec3(Cluster.Center[0], Cluster.Center[1], Cluster.Center[2]) - Center;
+		Radius = std::max(Radius, glm::length(Offset) + Cluster.Radius);
+	}
+	Bounds = glm::vec4(Center, Radius);
+
+	InitBuffers(Vertices, VertexCount, Mesh);
+	InitDescriptors();
+	InitPipelines();
+}
+
+MeshletCuller::~MeshletCuller()
+{
+	VkDevice Device = Rend->Device;
+	// Frames already submitted may still use them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	Retired.RetirePipeline(Value, DrawPipeline);
+	Retired.RetirePipeline(Value, CullPipeline);
+	Retired.RetirePipeline(Value, OcclusionPipeline);
+	for (auto Module : Modules)
+		Retired.RetireShaderModule(Value, Module);
+	Retired.RetirePipelineLayout(Value, DrawLayout);
+	Retired.RetirePipelineLayout(Value, CullLayout);
+	Retired.RetireDescriptorPool(Value, DescriptorPool);
+	Retired.RetireDescriptorSetLayout(Value, SetLayout);
+
+	vkUnmapMemory(Device, ObjectMemory);
+	vkUnmapMemory(Device, CounterMemory);
+	const VkBuffer Buffers[] = { VertexBuffer, IndexBuffer, MeshletBuffer, ObjectBuffer, CommandBuffer, VisibilityBuffer, CounterBuffer };
+	const VkDeviceMemory Memories[] = { VertexMemory, IndexMemory, MeshletMemory, ObjectMemory, CommandMemory, VisibilityMemory, CounterMemory };
+	for (int i = 0; i < 7; i++)
+	{
+		Retired.RetireBuffer(Value, Buffers[i]);
+		Retired.RetireMemory(Value, Memories[i]);
+	}
+}
+
+void MeshletCuller::InitBuffers(const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh)
+{
+	Rend->InitHostBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, Vertices, sizeof(Vertex) * VertexCount,
+		MemoryCategory::Vertex, &VertexBuffer, &VertexMemory);
+	Rend->InitHostBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, Mesh.Indices.data(), sizeof(uint32_t) * Mesh.Indices.size(),
+		MemoryCategory::Vertex, &IndexBuffer, &IndexMemory);
+	Rend->InitHostBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, Mesh.Meshlets.data(), sizeof(Meshlet) * Mesh.Meshlets.size(),
+		MemoryCategory::Vertex, &MeshletBuffer, &MeshletMemory);
+
+	const VkFlags HostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	CreateBuffer(Rend, sizeof(glm::mat4) * MaxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HostMemory,
+		MemoryCategory::Uniform, &ObjectBuffer, &ObjectMemory);
+	auto res = vkMapMemory(Rend->Device, ObjectMemory, 0, VK_WHOLE_SIZE, 0, (void**)&Objects);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// Only the GPU touches the commands and the visibility. The second phase has its own commands.
+	CreateBuffer(Rend, sizeof(VkDrawIndexedIndirectCommand) * MeshletCount * MaxObjects * (Pyramid ? 2 : 1),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, &CommandBuffer, &CommandMemory);
+	CreateBuffer(Rend, sizeof(uint32_t) * MaxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, &VisibilityBuffer, &VisibilityMemory);
+
+	CreateBuffer(Rend, sizeof(uint32_t) * CounterCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		HostMemory, MemoryCategory::Other, &CounterBuffer, &CounterMemory);
+	res = vkMapMemory(Rend->Device, CounterMemory, 0, VK_WHOLE_SIZE, 0, (void**)&Counters);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	memset((void*)Counters, 0, sizeof(uint32_t) * CounterCount);
+}
+
+void MeshletCuller::InitDescriptors()
+{
+	// Five storage buffers, then the pyramid when occluding.
+	const uint32_t BindingCount = Pyramid ? 6 : 5;
+	VkDescriptorSetLayoutBinding Bindings[6] = {};
+	for (uint32_t i = 0; i < BindingCount; i++)
+	{
+		Bindings[i].binding = i;
+		Bindings[i].descriptorType = i < 5 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		Bindings[i].descriptorCount = 1;
+		Bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	// The vertex shader reads the object transforms too.
+	Bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.bindingCount = BindingCount;
+	LayoutInfo.pBindings = Bindings;
+	auto res = vkCreateDescriptorSetLayout(Rend->Device, &LayoutInfo, NULL, &SetLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorPoolSize PoolSizes[2] = {};
+	PoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	PoolSizes[0].descriptorCount = 5;
+	PoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	PoolSizes[1].descriptorCount = 1;
+	VkDescriptorPoolCreateInfo PoolInfo = {};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	PoolInfo.maxSets = 1;
+	PoolInfo.poolSizeCount = Pyramid ? 2 : 1;
+	PoolInfo.pPoolSizes = PoolSizes;
+	res = vkCreateDescriptorPool(Rend->Device, &PoolInfo, NULL, &DescriptorPool);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorSetAllocateInfo AllocInfo = {};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	AllocInfo.descriptorPool = DescriptorPool;
+	AllocInfo.descriptorSetCount = 1;
+	AllocInfo.pSetLayouts = &SetLayout;
+	res = vkAllocateDescriptorSets(Rend->Device, &AllocInfo, &Set);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorBufferInfo BufferInfos[5] = {
+		{ MeshletBuffer, 0, VK_WHOLE_SIZE },
+		{ ObjectBuffer, 0, VK_WHOLE_SIZE },
+		{ CommandBuffer, 0, VK_WHOLE_SIZE },
+		{ CounterBuffer, 0, VK_WHOLE_SIZE },
+		{ VisibilityBuffer, 0, VK_WHOLE_SIZE },
+	};
+	VkDescriptorImageInfo PyramidInfo = {};
+	if (Pyramid)
+	{
+		PyramidInfo.sampler = Pyramid->GetSampler();
+		PyramidInfo.imageView = Pyramid->GetView();
+		PyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	}
+	VkWriteDescriptorSet Writes[6] = {};
+	for (uint32_t i = 0; i < BindingCount; i++)
+	{
+		Writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		Writes[i].dstSet = Set;
+		Writes[i].dstBinding = i;
+		Writes[i].descriptorCount = 1;
+		Writes[i].descriptorType = Bindings[i].descriptorType;
+		if (i < 5)
+			Writes[i].pBufferInfo = &BufferInfos[i];
+		else
+			Writes[i].pImageInfo = &PyramidInfo;
+	}
+	vkUpdateDescriptorSets(Rend->Device, BindingCount, Writes, 0, NULL);
+}
+
+void MeshletCuller::InitPipelines()
+{
+	const VkShaderStageFlagBits Stages[4] = { VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT,
+		VK_SHADER_STAGE_COMPUTE_BIT };
+	const std::string Sources[4] = { std::string(cullCommonText) + cullShaderText, vertShaderText, fragShaderText,
+		std::string(cullCommonText) + occlusionShaderText };
+	for (int i = 0; i < (Pyramid ? 4 : 3); i++)
+	{
+		std::vector<unsigned int> Spirv;
+		if (!Rend->GLSLtoSPV(Stages[i], Sources[i].c_str(), Spirv))
+			std::exit(-1);
+		Modules[i] = Rend->CreateShaderModule(Spirv);
+		if (Modules[i] == VK_NULL_HANDLE)
+			std::exit(-1);
+	}
+
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	PushRange.size = sizeof(MeshletCullConstants);
+	VkPipelineLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	LayoutInfo.setLayoutCount = 1;
+	LayoutInfo.pSetLayouts = &SetLayout;
+	LayoutInfo.pushConstantRangeCount = 1;
+	LayoutInfo.pPushConstantRanges = &PushRange;
+	auto res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &CullLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// Set 0 is the renderer's uniform buffer, for the MVP.
+	const VkDescriptorSetLayout DrawSets[2] = { Rend->DescriptorSetLayouts[0], SetLayout };
+	LayoutInfo.setLayoutCount = 2;
+	LayoutInfo.pSetLayouts = DrawSets;
+	LayoutInfo.pushConstantRangeCount = 0;
+	LayoutInfo.pPushConstantRanges = NULL;
+	res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &DrawLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkBool32 CompactValue = Compact;
+	VkSpecializationMapEntry Entry = { 0, 0, sizeof(VkBool32) };
+	VkSpecializationInfo Specialization = {};
+	Specialization.mapEntryCount = 1;
+	Specialization.pMapEntries = &Entry;
+	Specialization.dataSize = sizeof(CompactValue);
+	Specialization.pData = &CompactValue;
+
+	VkComputePipelineCreateInfo ComputeInfo = {};
+	ComputeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	ComputeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ComputeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	ComputeInfo.stage.module = Modules[0];
+	ComputeInfo.stage.pName = "main";
+	ComputeInfo.stage.pSpecializationInfo = &Specialization;
+	ComputeInfo.layout = CullLayout;
+	res = vkCreateComputePipelines(Rend->Device, Rend->PipelineCache, 1, &ComputeInfo, NULL, &CullPipeline);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	if (Pyramid)
+	{
+		ComputeInfo.stage.module = Modules[3];
+		res = vkCreateComputePipelines(Rend->Device, Rend->PipelineCache, 1, &ComputeInfo, NULL, &OcclusionPipeline);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+
+	VkPipelineShaderStageCreateInfo DrawStages[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		DrawStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		DrawStages[i].stage = Stages[i + 1];
+		DrawStages[i].module = Modules[i + 1];
+		DrawStages[i].pName = "main";
+	}
+	DrawPipeline = Rend->CreateGraphicsPipeline(VK_TRUE, VK_TRUE, DrawStages, DrawLayout);
+}
+
+void MeshletCuller::RecordCull(VkCommandBuffer Cmd, const DrawData* Draws, uint32_t DrawCount, const MeshletCullView& View)
+{
+	ObjectCount = std::min(DrawCount, MaxObjects);
+	for (uint32_t i = 0; i < ObjectCount; i++)
+		Objects[i] = Draws[i].Model;
+	CullView = View;
+
+	// Counters start at zero every frame, the commands are all rewritten or skipped by the count.
+	vkCmdFillBuffer(Cmd, CounterBuffer, 0, VK_WHOLE_SIZE, 0);
+	// Nothing was visible before, the second phase tests everything.
+	if (Pyramid && VisibilityReset)
+	{
+		vkCmdFillBuffer(Cmd, VisibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+		VisibilityReset = false;
+	}
+	VkMemoryBarrier Barrier = {};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+
+	RecordDispatch(Cmd, CullPipeline, Pyramid ? 1 : 0, MeshletCount * ObjectCount);
+
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+}
+
+void MeshletCuller::RecordLateCull(VkCommandBuffer Cmd)
+{
+	if (!Pyramid)
+		return;
+	// The first phase's counters and visibility reads come before, the pyramid reads
+	// are covered by the build's own barriers.
+	VkMemoryBarrier Barrier = {};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+
+	// One thread per object updates the visibility, then the meshlets of the objects that
+	// turned visible get their draws.
+	RecordDispatch(Cmd, OcclusionPipeline, 2, ObjectCount);
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+	RecordDispatch(Cmd, CullPipeline, 2, MeshletCount * ObjectCount);
+
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+}
+
+void MeshletCuller::RecordDispatch(VkCommandBuffer Cmd, VkPipeline Pipeline, uint32_t Phase, uint32_t Threads)
+{
+	MeshletCullConstants Constants;
+	Constants.ViewProjection = CullView.ViewProjection;
+	Constants.Camera = glm::vec4(CullView.Camera, CullView.PixelsPerUnit);
+	Constants.MeshletCount = MeshletCount;
+	Constants.ObjectCount = ObjectCount;
+	Constants.MinPixels = CullView.MinPixels;
+	Constants.Flags = (CullEnabled ? 1u : 0u) | (CountStats ? 2u : 0u) | (Phase << 2);
+	Constants.Bounds = Bounds;
+	Constants.CommandBase = Phase == 2 ? MeshletCount * MaxObjects : 0;
+
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, CullLayout, 0, 1, &Set, 0, NULL);
+	vkCmdPushConstants(Cmd, CullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants), &Constants);
+	vkCmdDispatch(Cmd, (Threads + 63) / 64, 1, 1);
+}
+
+void MeshletCuller::RecordDraw(VkCommandBuffer Cmd)
+{
+	RecordIndirect(Cmd, 0);
+}
+
+void MeshletCuller::RecordLateDraw(VkCommandBuffer Cmd)
+{
+	if (Pyramid)
+		RecordIndirect(Cmd, 1);
+}
+
+void MeshletCuller::RecordIndirect(VkCommandBuffer Cmd, uint32_t Phase)
+{
+	if (ObjectCount == 0)
+		return;
+	const VkDescriptorSet Sets[2] = { Rend->DescriptorSet[0], Set };
+	const VkDeviceSize Offset = 0;
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawPipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawLayout, 0, 2, Sets, 0, NULL);
+	vkCmdBindVertexBuffers(Cmd, 0, 1, &VertexBuffer, &Offset);
+	vkCmdBindIndexBuffer(Cmd, IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	uint32_t MaxDraws = MeshletCount * ObjectCount;
+	VkDeviceSize CommandOffset = sizeof(VkDrawIndexedIndirectCommand) * MeshletCount * MaxObjects * Phase;
+#ifdef VK_KHR_draw_indirect_count
+	if (Compact)
+	{
+		DrawIndexedIndirectCount(Cmd, CommandBuffer, CommandOffset, CounterBuffer, sizeof(uint32_t) * Phase,
+			MaxDraws, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
+#endif
+	vkCmdDrawIndexedIndirect(Cmd, CommandBuffer, CommandOffset, MaxDraws, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+MeshletCullStats MeshletCuller::GetStats() const
+{
+	const uint32_t Results = (uint32_t)MeshletCull::Count;
+	MeshletCullStats Stats;
+	for (uint32_t i = 0; i < Results; i++)
+	{
+		Stats.Meshlets[i] = Counters[2 + i];
+		Stats.Triangles[i] = Counters[2 + Results + i];
+	}
+	Stats.OccludedObjects = Counters[2 + 2 * Results];
+	Stats.LateObjects = Counters[3 + 2 * Results];
+	return Stats;
+}
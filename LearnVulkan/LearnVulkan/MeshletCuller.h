@@ -0,0 +1,116 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include "Meshlets.h"
+
+class DepthPyramid;
+class Renderer;
+struct DrawData;
+struct Vertex;
+
+/*
+* Draws an indexed mesh meshlet by meshlet. A compute pass tests every meshlet of
+* every object against the frustum, its normal cone and a minimum screen size, and
+* writes an indexed indirect draw for each survivor, with the object in firstInstance.
+* With VK_KHR_draw_indirect_count the survivors are compacted and the GPU count is
+* drawn, otherwise every meshlet keeps its command and culled ones get 0 instances.
+*
+* With a depth pyramid the cull runs in two phases. RecordCull and RecordDraw only
+* draw the objects that were visible last frame, then the caller builds the pyramid
+* from their depth and RecordLateCull tests every object's bounds against it.
+* RecordLateDraw draws the objects that turned visible, occluded ones get no draws.
+*
+* Needs the multiDrawIndirect and drawIndirectFirstInstance features, see IsSupported.
+* Buffers are written by the CPU every frame, so the previous frame must be finished,
+* which DrawCube ensures.
+*/
+class MeshletCuller
+{
+public:
+	static bool IsSupported(const Renderer* Rend);
+
+	// Vertices are in the cube's format. Room for MaxObjects objects a frame, fewer if
+	// the device's maxDrawIndirectCount does not allow that many meshlets.
+	// Pyramid turns on occlusion culling, it is the caller's and has to outlive this.
+	MeshletCuller(Renderer* Rend, const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh, uint32_t MaxObjects,
+		DepthPyramid* Pyramid = nullptr);
+	~MeshletCuller();
+
+	// Writes the object transforms and records the cull dispatch, outside a render pass.
+	void RecordCull(VkCommandBuffer Cmd, const DrawData* Draws, uint32_t DrawCount, const MeshletCullView& View);
+	// Records the indirect draws of what RecordCull kept, inside the render pass.
+	// Viewport and scissor are the caller's.
+	void RecordDraw(VkCommandBuffer Cmd);
+	// Second phase, with occlusion only. After the pyramid was built from what RecordDraw drew,
+	// outside a render pass, then inside one that loads the attachments.
+	void RecordLateCull(VkCommandBuffer Cmd);
+	void RecordLateDraw(VkCommandBuffer Cmd);
+	bool IsOccluding() const { return Pyramid != nullptr; }
+
+	// Of the last culled frame, once it finished on the GPU. Only counted with CountStats.
+	MeshletCullStats GetStats() const;
+	uint32_t GetMeshletCount() const { return MeshletCount; }
+	uint32_t GetMaxObjects() const { return MaxObjects; }
+	// The next frame draws everything in the second phase, for when Draws changed meaning.
+	void ResetVisibility() { VisibilityReset = true; }
+
+	// Off draws every meshlet, for comparing against the unculled cost.
+	bool CullEnabled = true;
+	// Per result atomics in the cull shader, cheap but not free.
+	bool CountStats = true;
+
+private:
+	void InitBuffers(const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh);
+	void InitDescriptors();
+	void InitPipelines();
+	void RecordDispatch(VkCommandBuffer Cmd, VkPipeline Pipeline, uint32_t Phase, uint32_t Threads);
+	void RecordIndirect(VkCommandBuffer Cmd, uint32_t Phase);
+
+	Renderer* Rend;
+	DepthPyramid* Pyramid;
+	uint32_t MeshletCount;
+	uint32_t MaxObjects;
+	uint32_t ObjectCount = 0;
+	// Sphere around every meshlet, object space.
+	glm::vec4 Bounds;
+	// Of the last RecordCull, the late cull reuses it.
+	MeshletCullView CullView;
+	bool Compact;
+	bool VisibilityReset = true;
+#ifdef VK_KHR_draw_indirect_count
+	PFN_vkCmdDrawIndexedIndirectCountKHR DrawIndexedIndirectCount = nullptr;
+#endif
+
+	VkBuffer VertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory VertexMemory = VK_NULL_HANDLE;
+	VkBuffer IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory IndexMemory = VK_NULL_HANDLE;
+	VkBuffer MeshletBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory MeshletMemory = VK_NULL_HANDLE;
+	// One mat4 per object, persistently mapped.
+	VkBuffer ObjectBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory ObjectMemory = VK_NULL_HANDLE;
+	glm::mat4* Objects = nullptr;
+	VkBuffer CommandBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory CommandMemory = VK_NULL_HANDLE;
+	// Per object, bit 0 visible after this frame's cull, bit 1 visible the frame before,
+	// the bits above the MeshletCull result that hid it.
+	VkBuffer VisibilityBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory VisibilityMemory = VK_NULL_HANDLE;
+	// Draw count of each phase, meshlets and triangles per MeshletCull result, then
+	// occluded and late objects. Persistently mapped.
+	VkBuffer CounterBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory CounterMemory = VK_NULL_HANDLE;
+	const uint32_t* Counters = nullptr;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+	VkPipelineLayout CullLayout = VK_NULL_HANDLE;
+	VkPipeline CullPipeline = VK_NULL_HANDLE;
+	// Object bounds against the pyramid, only with occlusion.
+	VkPipeline OcclusionPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout DrawLayout = VK_NULL_HANDLE;
+	VkPipeline DrawPipeline = VK_NULL_HANDLE;
+	VkShaderModule Modules[4] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+};
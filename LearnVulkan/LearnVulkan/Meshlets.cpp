@@ -0,0 +1,361 @@
+#include "Meshlets.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	glm::vec3 LoadPosition(const float* Positions, size_t PositionStride, uint32_t Vertex)
+	{
+		const float* P = (const float*)((const uint8_t*)Positions + Vertex * PositionStride);
+		return glm::vec3(P[0], P[1], P[2]);
+	}
+
+	// Ritter's sphere, within a few percent of the smallest.
+	void BoundingSphere(const std::vector<glm::vec3>& Points, glm::vec3& Center, float& Radius)
+	{
+		glm::vec3 A = Points[0];
+		glm::vec3 B = A;
+		for (auto& P : Points)
+		{
+			if (glm::dot(P - A, P - A) > glm::dot(B - A, B - A))
+				B = P;
+		}
+		glm::vec3 C = B;
+		for (auto& P : Points)
+		{
+			if (glm::dot(P - B, P - B) > glm::dot(C - B, C - B))
+				C = P;
+		}
+		Center = (B + C) * 0.5f;
+		Radius = glm::length(C - B) * 0.5f;
+		for (auto& P : Points)
+		{
+			float Distance = glm::length(P - Center);
+			if (Distance > Radius)
+			{
+				float Grown = (Radius + Distance) * 0.5f;
+				Center += (P - Center) * ((Grown - Radius) / Distance);
+				Radius = Grown;
+			}
+		}
+	}
+
+	class MeshletBuilder
+	{
+	public:
+		MeshletBuilder(const float* Positions, size_t VertexCount, size_t PositionStride,
+			const uint32_t* Indices, size_t IndexCount, uint32_t MaxVertices, uint32_t MaxTriangles);
+		MeshletMesh Build();
+
+	private:
+		// Unemitted triangle next to the current meshlet that fits and costs the fewest new vertices, or UINT32_MAX.
+		uint32_t FindNeighbour() const;
+		// Unemitted triangle to start the next meshlet with, near the last one if possible.
+		uint32_t FindSeed();
+		bool Fits(uint32_t Triangle) const;
+		void Add(uint32_t Triangle);
+		void Flush(MeshletMesh& Mesh);
+
+		const float* Positions;
+		size_t PositionStride;
+		const uint32_t* Indices;
+		uint32_t MaxVertices;
+		uint32_t MaxTriangles;
+
+		std::vector<glm::vec3> Normals;
+		// Triangles around each vertex, TrianglesStart[v] to TrianglesStart[v + 1].
+		std::vector<uint32_t> TrianglesStart;
+		std::vector<uint32_t> VertexTriangles;
+		// Unemitted triangles around each vertex.
+		std::vector<uint32_t> LiveTriangles;
+		std::vector<uint8_t> Emitted;
+		// Meshlet + 1 a vertex was last added to.
+		std::vector<uint32_t> VertexStamp;
+		uint32_t Stamp = 0;
+		size_t Cursor = 0;
+
+		std::vector<uint32_t> CurrentVertices;
+		std::vector<uint32_t> CurrentTriangles;
+		glm::vec3 NormalSum;
+		// Vertices of the last flushed meshlet, where FindSeed looks first.
+		std::vector<uint32_t> LastVertices;
+	};
+}
+
+MeshletBuilder::MeshletBuilder(const float* Positions, size_t VertexCount, size_t PositionStride,
+	const uint32_t* Indices, size_t IndexCount, uint32_t MaxVertices, uint32_t MaxTriangles)
+	: Positions(Positions), PositionStride(PositionStride), Indices(Indices), MaxVertices(MaxVertices), MaxTriangles(MaxTriangles)
+{
+	size_t TriangleCount = IndexCount / 3;
+	Normals.resize(TriangleCount);
+	TrianglesStart.assign(VertexCount + 1, 0);
+	for (size_t t = 0; t < TriangleCount; t++)
+	{
+		glm::vec3 A = LoadPosition(Positions, PositionStride, Indices[t * 3 + 0]);
+		glm::vec3 B = LoadPosition(Positions, PositionStride, Indices[t * 3 + 1]);
+		glm::vec3 C = LoadPosition(Positions, PositionStride, Indices[t * 3 + 2]);
+		// Clockwise front faces, so this points out of the front.
+		glm::vec3 N = glm::cross(C - A, B - A);
+		float Length = glm::length(N);
+		Normals[t] = Length > 0.0f ? N / Length : glm::vec3(0.0f);
+		for (int k = 0; k < 3; k++)
+			TrianglesStart[Indices[t * 3 + k] + 1]++;
+	}
+	for (size_t v = 0; v < VertexCount; v++)
+		TrianglesStart[v + 1] += TrianglesStart[v];
+	LiveTriangles.resize(VertexCount);
+	for (size_t v = 0; v < VertexCount; v++)
+		LiveTriangles[v] = TrianglesStart[v + 1] - TrianglesStart[v];
+	VertexTriangles.resize(TrianglesStart[VertexCount]);
+	std::vector<uint32_t> Fill(TrianglesStart.begin(), TrianglesStart.end() - 1);
+	for (uint32_t t = 0; t < TriangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+			VertexTriangles[Fill[Indices[t * 3 + k]]++] = t;
+	}
+	Emitted.assign(TriangleCount, 0);
+	VertexStamp.assign(VertexCount, 0);
+}
+
+bool MeshletBuilder::Fits(uint32_t Triangle) const
+{
+	if (CurrentTriangles.size() >= MaxTriangles)
+		return false;
+	uint32_t Extra = 0;
+	for (int k = 0; k < 3; k++)
+		Extra += VertexStamp[Indices[Triangle * 3 + k]] != Stamp;
+	return CurrentVertices.size() + Extra <= MaxVertices;
+}
+
+void MeshletBuilder::Add(uint32_t Triangle)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		uint32_t Vertex = Indices[Triangle * 3 + k];
+		if (VertexStamp[Vertex] != Stamp)
+		{
+			VertexStamp[Vertex] = Stamp;
+			CurrentVertices.push_back(Vertex);
+		}
+		LiveTriangles[Vertex]--;
+	}
+	Emitted[Triangle] = 1;
+	CurrentTriangles.push_back(Triangle);
+	NormalSum += Normals[Triangle];
+}
+
+uint32_t MeshletBuilder::FindNeighbour() const
+{
+	float SumLength = glm::length(NormalSum);
+	glm::vec3 Axis = SumLength > 0.0f ? NormalSum / SumLength : glm::vec3(0.0f);
+	uint32_t Best = UINT32_MAX;
+	float BestScore = 0.0f;
+	for (uint32_t Vertex : CurrentVertices)
+	{
+		if (LiveTriangles[Vertex] == 0)
+			continue;
+		for (uint32_t i = TrianglesStart[Vertex]; i < TrianglesStart[Vertex + 1]; i++)
+		{
+			uint32_t Triangle = VertexTriangles[i];
+			if (Emitted[Triangle] || !Fits(Triangle))
+				continue;
+			uint32_t Extra = 0;
+			uint32_t Finished = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t Corner = Indices[Triangle * 3 + k];
+				Extra += VertexStamp[Corner] != Stamp;
+				Finished += LiveTriangles[Corner] == 1;
+			}
+			// New vertices first. Among equal counts take triangles that use a vertex up, so
+			// no stragglers are left behind for tiny meshlets, then the ones facing along the cone.
+			float Score = (float)Extra - 0.25f * (float)Finished + 0.5f * (1.0f - glm::dot(Normals[Triangle], Axis));
+			if (Best == UINT32_MAX || Score < BestScore)
+			{
+				Best = Triangle;
+				BestScore = Score;
+			}
+		}
+	}
+	return Best;
+}
+
+uint32_t MeshletBuilder::FindSeed()
+{
+	// The vertex with the fewest triangles left is on the rim of what was emitted,
+	// starting there keeps the next meshlet from leaving holes behind.
+	uint32_t BestVertex = UINT32_MAX;
+	for (uint32_t Vertex : LastVertices)
+	{
+		if (LiveTriangles[Vertex] != 0 && (BestVertex == UINT32_MAX || LiveTriangles[Vertex] < LiveTriangles[BestVertex]))
+			BestVertex = Vertex;
+	}
+	if (BestVertex != UINT32_MAX)
+	{
+		for (uint32_t i = TrianglesStart[BestVertex]; i < TrianglesStart[BestVertex + 1]; i++)
+		{
+			if (!Emitted[VertexTriangles[i]])
+				return VertexTriangles[i];
+		}
+	}
+	while (Cursor < Emitted.size() && Emitted[Cursor])
+		Cursor++;
+	return Cursor < Emitted.size() ? (uint32_t)Cursor : UINT32_MAX;
+}
+
+void MeshletBuilder::Flush(MeshletMesh& Mesh)
+{
+	if (CurrentTriangles.empty())
+		return;
+
+	Meshlet Cluster = {};
+	Cluster.FirstIndex = (uint32_t)Mesh.Indices.size();
+	Cluster.TriangleCount = (uint32_t)CurrentTriangles.size();
+	Cluster.VertexCount = (uint32_t)CurrentVertices.size();
+	for (uint32_t Triangle : CurrentTriangles)
+		Mesh.Indices.insert(Mesh.Indices.end(), Indices + Triangle * 3, Indices + Triangle * 3 + 3);
+
+	std::vector<glm::vec3> Points(CurrentVertices.size());
+	for (size_t i = 0; i < CurrentVertices.size(); i++)
+		Points[i] = LoadPosition(Positions, PositionStride, CurrentVertices[i]);
+	glm::vec3 Center;
+	BoundingSphere(Points, Center, Cluster.Radius);
+
+	// The axis is the mean normal, the cone opens as far as the normal furthest from it.
+	glm::vec3 Axis(0.0f);
+	float MinDot = 1.0f;
+	float SumLength = glm::length(NormalSum);
+	if (SumLength > 0.0f)
+	{
+		Axis = NormalSum / SumLength;
+		for (uint32_t Triangle : CurrentTriangles)
+		{
+			if (Normals[Triangle] != glm::vec3(0.0f))
+				MinDot = std::min(MinDot, glm::dot(Normals[Triangle], Axis));
+		}
+	}
+	glm::vec3 Apex = Center;
+	Cluster.ConeCutoff = MeshletNoCone;
+	if (SumLength > 0.0f && MinDot > 0.1f)
+	{
+		// Move the apex back along the axis until it is behind every triangle's plane,
+		// then looking at the apex along the axis sees the back of all of them.
+		float MaxT = 0.0f;
+		for (uint32_t Triangle : CurrentTriangles)
+		{
+			const glm::vec3& N = Normals[Triangle];
+			if (N == glm::vec3(0.0f))
+				continue;
+			glm::vec3 Corner = LoadPosition(Positions, PositionStride, Indices[Triangle * 3]);
+			MaxT = std::max(MaxT, glm::dot(Center - Corner, N) / glm::dot(Axis, N));
+		}
+		Apex = Center - Axis * MaxT;
+		Cluster.ConeCutoff = std::sqrt(1.0f - MinDot * MinDot);
+	}
+	for (int k = 0; k < 3; k++)
+	{
+		Cluster.Center[k] = Center[k];
+		Cluster.ConeApex[k] = Apex[k];
+		Cluster.ConeAxis[k] = Axis[k];
+	}
+	Mesh.Meshlets.push_back(Cluster);
+
+	LastVertices.swap(CurrentVertices);
+	CurrentVertices.clear();
+	CurrentTriangles.clear();
+	Stamp++;
+}
+
+MeshletMesh MeshletBuilder::Build()
+{
+	MeshletMesh Mesh;
+	Mesh.Indices.reserve(Emitted.size() * 3);
+	Stamp = 1;
+	NormalSum = glm::vec3(0.0f);
+	for (;;)
+	{
+		uint32_t Next = CurrentTriangles.empty() ? FindSeed() : FindNeighbour();
+		if (Next == UINT32_MAX)
+		{
+			if (CurrentTriangles.empty())
+				break;
+			// Nothing adjacent fits any more.
+			Flush(Mesh);
+			NormalSum = glm::vec3(0.0f);
+			continue;
+		}
+		Add(Next);
+		if (CurrentTriangles.size() == MaxTriangles)
+		{
+			Flush(Mesh);
+			NormalSum = glm::vec3(0.0f);
+		}
+	}
+	return Mesh;
+}
+
+MeshletMesh BuildMeshlets(const float* Positions, size_t VertexCount, size_t PositionStride,
+	const uint32_t* Indices, size_t IndexCount, uint32_t MaxVertices, uint32_t MaxTriangles)
+{
+	assert(MaxVertices >= 3 && MaxTriangles >= 1);
+	MeshletBuilder Builder(Positions, VertexCount, PositionStride, Indices, IndexCount, MaxVertices, MaxTriangles);
+	return Builder.Build();
+}
+
+uint64_t MeshletCullStats::GetTriangleCount() const
+{
+	uint64_t Count = 0;
+	for (uint64_t Triangles : Triangles)
+		Count += Triangles;
+	return Count;
+}
+
+double MeshletCullStats::GetRejectedFraction() const
+{
+	uint64_t Count = GetTriangleCount();
+	return Count ? 1.0 - (double)Triangles[(int)MeshletCull::Visible] / Count : 0.0;
+}
+
+MeshletCull CullMeshlet(const Meshlet& Cluster, const glm::mat4& Model, const MeshletCullView& View)
+{
+	float Scale = std::sqrt(std::max(glm::dot(glm::vec3(Model[0]), glm::vec3(Model[0])),
+		std::max(glm::dot(glm::vec3(Model[1]), glm::vec3(Model[1])), glm::dot(glm::vec3(Model[2]), glm::vec3(Model[2])))));
+	glm::vec3 Center = glm::vec3(Model * glm::vec4(Cluster.Center[0], Cluster.Center[1], Cluster.Center[2], 1.0f));
+	float Radius = Cluster.Radius * Scale;
+
+	// Planes from the rows of the matrix, the near one as z > -w so both depth ranges are covered.
+	glm::mat4 Rows = glm::transpose(View.ViewProjection);
+	const glm::vec4 Planes[6] = { Rows[3] + Rows[0], Rows[3] - Rows[0], Rows[3] + Rows[1],
+		Rows[3] - Rows[1], Rows[3] + Rows[2], Rows[3] - Rows[2] };
+	for (auto& Plane : Planes)
+	{
+		if (glm::dot(glm::vec3(Plane), Center) + Plane.w < -Radius * glm::length(glm::vec3(Plane)))
+			return MeshletCull::Frustum;
+	}
+
+	if (Cluster.ConeCutoff < 1.0f)
+	{
+		glm::vec3 Apex = glm::vec3(Model * glm::vec4(Cluster.ConeApex[0], Cluster.ConeApex[1], Cluster.ConeApex[2], 1.0f));
+		glm::vec3 Axis = glm::normalize(glm::mat3(Model) * glm::vec3(Cluster.ConeAxis[0], Cluster.ConeAxis[1], Cluster.ConeAxis[2]));
+		glm::vec3 ToApex = Apex - View.Camera;
+		float Distance = glm::length(ToApex);
+		if (Distance > 0.0f && glm::dot(ToApex / Distance, Axis) >= Cluster.ConeCutoff)
+			return MeshletCull::Backface;
+	}
+
+	float Distance = glm::length(Center - View.Camera);
+	if (Distance > Radius && 2.0f * Radius * View.PixelsPerUnit / Distance < View.MinPixels)
+		return MeshletCull::Size;
+	return MeshletCull::Visible;
+}
+
+void CullMeshlets(const MeshletMesh& Mesh, const glm::mat4& Model, const MeshletCullView& View, MeshletCullStats& Stats)
+{
+	for (auto& Cluster : Mesh.Meshlets)
+	{
+		int Result = (int)CullMeshlet(Cluster, Model, View);
+		Stats.Meshlets[Result]++;
+		Stats.Triangles[Result] += Cluster.TriangleCount;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const uint32_t MeshletMaxVertices = 64;
+const uint32_t MeshletMaxTriangles = 124;
+// ConeCutoff of meshlets whose triangles face too many ways to ever be back facing together.
+const float MeshletNoCone = 2.0f;
+
+/*
+* A cluster of neighbouring triangles with its bounds, matches Meshlet in the cull
+* shader (std430, 64 bytes). Positions and directions are in object space.
+*/
+struct Meshlet
+{
+	float Center[3];
+	float Radius;
+	// Every triangle faces away from a camera at P when
+	// dot(normalize(ConeApex - P), ConeAxis) >= ConeCutoff.
+	float ConeApex[3];
+	float ConeCutoff;
+	float ConeAxis[3];
+	uint32_t VertexCount;
+	uint32_t FirstIndex;
+	uint32_t TriangleCount;
+	uint32_t Pad[2];
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> Meshlets;
+	// The source triangles regrouped by meshlet, still indexing the source vertices.
+	std::vector<uint32_t> Indices;
+};
+
+/*
+* Splits a triangle list into meshlets of at most MaxVertices distinct vertices and
+* MaxTriangles triangles. Meshlets grow over shared edges, preferring triangles that
+* add no vertices and that face the way the meshlet already does, so the normal cones
+* stay narrow. Front faces wind clockwise, like the cube. Positions are three floats
+* every PositionStride bytes.
+*/
+MeshletMesh BuildMeshlets(const float* Positions, size_t VertexCount, size_t PositionStride,
+	const uint32_t* Indices, size_t IndexCount,
+	uint32_t MaxVertices = MeshletMaxVertices, uint32_t MaxTriangles = MeshletMaxTriangles);
+
+// Same tests and order as the cull shader, a meshlet is rejected by the first that fails.
+enum class MeshletCull
+{
+	Visible,
+	Frustum,
+	Backface,
+	// Covers less than MinPixels across.
+	Size,
+	// Whole object behind the depth pyramid, only the GPU two-phase cull tests this.
+	Occluded,
+	Count
+};
+
+struct MeshletCullView
+{
+	// World to clip space.
+	glm::mat4 ViewProjection;
+	glm::vec3 Camera;
+	// Pixels one unit at distance one covers, Projection[1][1] * Height / 2.
+	float PixelsPerUnit;
+	float MinPixels = 1.0f;
+};
+
+struct MeshletCullStats
+{
+	uint64_t Meshlets[(int)MeshletCull::Count] = {};
+	uint64_t Triangles[(int)MeshletCull::Count] = {};
+	// Objects the two-phase cull found occluded, and ones it drew only in the second phase.
+	uint64_t OccludedObjects = 0;
+	uint64_t LateObjects = 0;
+
+	uint64_t GetTriangleCount() const;
+	// Share of the triangles rejected before rasterization.
+	double GetRejectedFraction() const;
+};
+
+// Model is object to world, any scale is taken as its largest axis.
+MeshletCull CullMeshlet(const Meshlet& Cluster, const glm::mat4& Model, const MeshletCullView& View);
+// Adds every meshlet of Mesh drawn with Model to Stats.
+void CullMeshlets(const MeshletMesh& Mesh, const glm::mat4& Model, const MeshletCullView& View, MeshletCullStats& Stats);
@@ -0,0 +1,75 @@
+#include "Overdraw.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+OverdrawStats AnalyzeOverdraw(const ReadbackFrame& Frame)
+{
+	assert(Frame.RowPitch >= Frame.Width * 4);
+	OverdrawStats Stats;
+	Stats.Histogram.assign(256, 0);
+	for (uint32_t y = 0; y < Frame.Height; y++)
+	{
+		const uint8_t* Row = Frame.Pixels + (size_t)y * Frame.RowPitch;
+		for (uint32_t x = 0; x < Frame.Width; x++)
+			Stats.Histogram[Row[x * 4]]++;
+	}
+
+	Stats.Pixels = Frame.Width * Frame.Height;
+	for (uint32_t Count = 0; Count < 256; Count++)
+	{
+		uint32_t Pixels = Stats.Histogram[Count];
+		if (!Pixels)
+			continue;
+		Stats.Fragments += (uint64_t)Count * Pixels;
+		Stats.Max = Count;
+	}
+	Stats.Covered = Stats.Pixels - Stats.Histogram[0];
+	Stats.Saturated = Stats.Histogram[255];
+	if (Stats.Pixels)
+		Stats.Mean = (double)Stats.Fragments / Stats.Pixels;
+	if (Stats.Covered)
+		Stats.MeanCovered = (double)Stats.Fragments / Stats.Covered;
+	return Stats;
+}
+
+// Black, blue, green, yellow, red, evenly spaced over [0, 1].
+static void HeatColor(float t, uint8_t* Rgb)
+{
+	static const float Stops[5][3] = { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } };
+	if (t > 1.0f)
+	{
+		Rgb[0] = Rgb[1] = Rgb[2] = 255;
+		return;
+	}
+	float Position = t * 4.0f;
+	int Stop = std::min((int)Position, 3);
+	float f = Position - Stop;
+	for (int c = 0; c < 3; c++)
+		Rgb[c] = (uint8_t)((Stops[Stop][c] + (Stops[Stop + 1][c] - Stops[Stop][c]) * f) * 255.0f + 0.5f);
+}
+
+bool WriteOverdrawHeatmap(const std::string& Path, const ReadbackFrame& Frame, uint32_t MaxCount)
+{
+	if (!MaxCount)
+		MaxCount = std::max(AnalyzeOverdraw(Frame).Max, 1u);
+
+	uint8_t Palette[256][3];
+	for (uint32_t Count = 0; Count < 256; Count++)
+		HeatColor((float)Count / MaxCount, Palette[Count]);
+
+	std::ofstream File(Path, std::ios::binary);
+	if (!File)
+		return false;
+	File << "P6\n" << Frame.Width << " " << Frame.Height << "\n255\n";
+	std::vector<uint8_t> Row(Frame.Width * 3);
+	for (uint32_t y = 0; y < Frame.Height; y++)
+	{
+		const uint8_t* Source = Frame.Pixels + (size_t)y * Frame.RowPitch;
+		for (uint32_t x = 0; x < Frame.Width; x++)
+			std::copy(Palette[Source[x * 4]], Palette[Source[x * 4]] + 3, &Row[x * 3]);
+		File.write((const char*)Row.data(), Row.size());
+	}
+	return (bool)File;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "FrameReadback.h"
+#include <string>
+#include <vector>
+
+// Fragment counts of a frame drawn with Renderer::InitOverdraw.
+struct OverdrawStats
+{
+	uint32_t Pixels = 0;
+	// Pixels with at least one fragment.
+	uint32_t Covered = 0;
+	uint64_t Fragments = 0;
+	uint32_t Max = 0;
+	// Pixels stuck at 255, their real count is at least that.
+	uint32_t Saturated = 0;
+	// Fragments per pixel, over the whole frame and over the covered pixels only.
+	double Mean = 0.0;
+	double MeanCovered = 0.0;
+	// Number of pixels with each count from 0 to 255.
+	std::vector<uint32_t> Histogram;
+};
+
+// Frame has to be 8 bits per channel with 4 channels, every channel holds the count.
+OverdrawStats AnalyzeOverdraw(const ReadbackFrame& Frame);
+
+// Writes the counts as a binary PPM heatmap, from black at 0 over blue, green and yellow
+// to red at MaxCount and white above it. MaxCount 0 uses the frame's maximum.
+bool WriteOverdrawHeatmap(const std::string& Path, const ReadbackFrame& Frame, uint32_t MaxCount = 0);
@@ -0,0 +1,422 @@
+#include "ParticleSystem.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SUBGROUPS comes from the preamble, the ballot needs SPIR-V 1.3.
+static const char* simulateShaderText =
+"#if SUBGROUPS\n"
+"#extension GL_KHR_shader_subgroup_ballot : require\n"
+"#endif\n"
+"layout (local_size_x = 64) in;\n"
+"struct Particle {\n"
+"    // xyz = position, w = remaining life.\n"
+"    vec4 position;\n"
+"    // xyz = velocity, w = size.\n"
+"    vec4 velocity;\n"
+"};\n"
+"layout (std430, binding = 0) readonly buffer sourceBuffer { Particle source[]; };\n"
+"layout (std430, binding = 1) writeonly buffer targetBuffer { Particle target[]; };\n"
+"struct DrawCommand {\n"
+"    uint vertexCount;\n"
+"    // Alive particles of the half.\n"
+"    uint instanceCount;\n"
+"    uint firstVertex;\n"
+"    uint firstInstance;\n"
+"};\n"
+"layout (std430, binding = 2) buffer drawBuffer { DrawCommand draws[2]; };\n"
+"layout (push_constant) uniform simulateVals {\n"
+"    // xyz = position, w = radius.\n"
+"    vec4 emitter;\n"
+"    // xyz = velocity, w = spread.\n"
+"    vec4 launch;\n"
+"    // xyz = gravity, w = time step.\n"
+"    vec4 gravity;\n"
+"    float lifetime;\n"
+"    float size;\n"
+"    uint emitCount;\n"
+"    uint capacity;\n"
+"    uint seed;\n"
+"    uint sourceHalf;\n"
+"};\n"
+"uint hash(uint x) {\n"
+"    x ^= x >> 16;\n"
+"    x *= 0x7feb352du;\n"
+"    x ^= x >> 15;\n"
+"    x *= 0x846ca68bu;\n"
+"    x ^= x >> 16;\n"
+"    return x;\n"
+"}\n"
+"float random(inout uint state) {\n"
+"    state = hash(state);\n"
+"    return float(state >> 8) * (1.0 / 16777216.0);\n"
+"}\n"
+"// Uniform in the unit ball.\n"
+"vec3 randomInSphere(inout uint state) {\n"
+"    float z = random(state) * 2.0 - 1.0;\n"
+"    float angle = random(state) * 6.2831853;\n"
+"    float r = sqrt(1.0 - z * z);\n"
+"    return vec3(r * cos(angle), r * sin(angle), z) * pow(random(state), 1.0 / 3.0);\n"
+"}\n"
+"void main() {\n"
+"    uint id = gl_GlobalInvocationID.x;\n"
+"    uint targetHalf = 1u - sourceHalf;\n"
+"    uint alive = draws[sourceHalf].instanceCount;\n"
+"    Particle p;\n"
+"    bool keep = false;\n"
+"    if (id < alive) {\n"
+"        p = source[id];\n"
+"        p.velocity.xyz += gravity.xyz * gravity.w;\n"
+"        p.position.xyz += p.velocity.xyz * gravity.w;\n"
+"        p.position.w -= gravity.w;\n"
+"        keep = p.position.w > 0.0;\n"
+"    } else if (id < min(alive + emitCount, capacity)) {\n"
+"        // New ones take the free room after the alive ones.\n"
+"        uint state = hash(id ^ hash(seed));\n"
+"        p.position = vec4(emitter.xyz + randomInSphere(state) * emitter.w, lifetime * (0.5 + 0.5 * random(state)));\n"
+"        p.velocity = vec4(launch.xyz + randomInSphere(state) * launch.w, size);\n"
+"        keep = true;\n"
+"    }\n"
+"    // Every invocation gets here, the ballot needs the whole subgroup.\n"
+"    uint slot;\n"
+"#if SUBGROUPS\n"
+"    uvec4 ballot = subgroupBallot(keep);\n"
+"    uint base = 0u;\n"
+"    if (subgroupElect())\n"
+"        base = atomicAdd(draws[targetHalf].instanceCount, subgroupBallotBitCount(ballot));\n"
+"    slot = subgroupBroadcastFirst(base) + subgroupBallotExclusiveBitCount(ballot);\n"
+"#else\n"
+"    if (keep)\n"
+"        slot = atomicAdd(draws[targetHalf].instanceCount, 1u);\n"
+"#endif\n"
+"    if (keep)\n"
+"        target[slot] = p;\n"
+"}\n";
+
+static const char* vertShaderText =
+"#version 450\n"
+"layout (std140, set = 0, binding = 0) uniform bufferVals {\n"
+"    mat4 mvp;\n"
+"    vec4 grid;\n"
+"} myBufferVals;\n"
+"struct Particle {\n"
+"    vec4 position;\n"
+"    vec4 velocity;\n"
+"};\n"
+"layout (std430, set = 1, binding = 1) readonly buffer particleBuffer { Particle particles[]; };\n"
+"layout (push_constant) uniform drawVals {\n"
+"    float lifetime;\n"
+"};\n"
+"layout (location = 0) out vec4 outColor;\n"
+"// Two clockwise triangles.\n"
+"const vec2 corners[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0),\n"
+"    vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));\n"
+"void main() {\n"
+"   Particle p = particles[gl_InstanceIndex];\n"
+"   // Hot when born, darker as it runs out of life.\n"
+"   float life = clamp(p.position.w / lifetime, 0.0, 1.0);\n"
+"   outColor = mix(vec4(0.3, 0.05, 0.0, 1.0), vec4(1.0, 0.8, 0.3, 1.0), life);\n"
+"   // Offset in clip space, so the quad faces the camera and shrinks with distance.\n"
+"   gl_Position = myBufferVals.mvp * vec4(p.position.xyz, 1.0);\n"
+"   gl_Position.xy += corners[gl_VertexIndex] * p.velocity.w;\n"
+"}\n";
+
+static const char* fragShaderText =
+"#version 450\n"
+"layout (location = 0) in vec4 color;\n"
+"layout (location = 0) out vec4 outColor;\n"
+"void main() {\n"
+"   outColor = color;\n"
+"}\n";
+
+// Layout of the simulate shader's push constants.
+struct ParticleConstants
+{
+	glm::vec4 Emitter;
+	glm::vec4 Launch;
+	glm::vec4 Gravity;
+	float Lifetime;
+	float Size;
+	uint32_t EmitCount;
+	uint32_t Capacity;
+	uint32_t Seed;
+	uint32_t SourceHalf;
+};
+
+static void CreateBuffer(Renderer* Rend, VkDeviceSize Size, VkBufferUsageFlags Usage, VkFlags Properties,
+	MemoryCategory Category, VkBuffer* Buffer, VkDeviceMemory* Memory)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.usage = Usage;
+	buf_info.size = Size;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto res = vkCreateBuffer(Rend->Device, &buf_info, NULL, Buffer);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(Rend->Device, *Buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits, Properties, &alloc_info.memoryTypeIndex))
+		std::exit(-1);
+
+	res = Rend->AllocateMemory(&alloc_info, Category, Memory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	res = vkBindBufferMemory(Rend->Device, *Buffer, *Memory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+ParticleSystem::ParticleSystem(Renderer* Rend, uint32_t Capacity)
+	: Rend(Rend), Subgroups(Rend->SubgroupBallotSupported)
+{
+	// One thread per particle in a single dispatch.
+	uint64_t MaxThreads = (uint64_t)Rend->DeviceProperties.limits.maxComputeWorkGroupCount[0] * 64;
+	this->Capacity = (uint32_t)std::min<uint64_t>(std::max(Capacity, 1u), std::min<uint64_t>(MaxThreads, UINT32_MAX - 63));
+	InitBuffers();
+	InitDescriptors();
+	InitPipelines();
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	VkDevice Device = Rend->Device;
+	// Frames already submitted may still use them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	Retired.RetirePipeline(Value, DrawPipeline);
+	Retired.RetirePipeline(Value, SimulatePipeline);
+	for (auto Module : Modules)
+		Retired.RetireShaderModule(Value, Module);
+	Retired.RetirePipelineLayout(Value, DrawLayout);
+	Retired.RetirePipelineLayout(Value, SimulateLayout);
+	Retired.RetireDescriptorPool(Value, DescriptorPool);
+	Retired.RetireDescriptorSetLayout(Value, SetLayout);
+
+	vkUnmapMemory(Device, DrawMemory);
+	const VkBuffer Buffers[] = { ParticleBuffers[0], ParticleBuffers[1], DrawBuffer };
+	const VkDeviceMemory Memories[] = { ParticleMemory[0], ParticleMemory[1], DrawMemory };
+	for (int i = 0; i < 3; i++)
+	{
+		Retired.RetireBuffer(Value, Buffers[i]);
+		Retired.RetireMemory(Value, Memories[i]);
+	}
+}
+
+void ParticleSystem::InitBuffers()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		CreateBuffer(Rend, sizeof(glm::vec4) * 2 * Capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, &ParticleBuffers[i], &ParticleMemory[i]);
+	}
+
+	CreateBuffer(Rend, sizeof(VkDrawIndirectCommand) * 2,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Other, &DrawBuffer, &DrawMemory);
+	auto res = vkMapMemory(Rend->Device, DrawMemory, 0, VK_WHOLE_SIZE, 0, (void**)&DrawCommands);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	Reset();
+}
+
+void ParticleSystem::InitDescriptors()
+{
+	// Source and target particles, then the draws. The vertex shader reads the target.
+	VkDescriptorSetLayoutBinding Bindings[3] = {};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		Bindings[i].binding = i;
+		Bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		Bindings[i].descriptorCount = 1;
+		Bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	Bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.bindingCount = 3;
+	LayoutInfo.pBindings = Bindings;
+	auto res = vkCreateDescriptorSetLayout(Rend->Device, &LayoutInfo, NULL, &SetLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkDescriptorPoolSize PoolSize = {};
+	PoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	PoolSize.descriptorCount = 6;
+	VkDescriptorPoolCreateInfo PoolInfo = {};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	PoolInfo.maxSets = 2;
+	PoolInfo.poolSizeCount = 1;
+	PoolInfo.pPoolSizes = &PoolSize;
+	res = vkCreateDescriptorPool(Rend->Device, &PoolInfo, NULL, &DescriptorPool);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	const VkDescriptorSetLayout Layouts[2] = { SetLayout, SetLayout };
+	VkDescriptorSetAllocateInfo AllocInfo = {};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	AllocInfo.descriptorPool = DescriptorPool;
+	AllocInfo.descriptorSetCount = 2;
+	AllocInfo.pSetLayouts = Layouts;
+	res = vkAllocateDescriptorSets(Rend->Device, &AllocInfo, Sets);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	for (uint32_t Half = 0; Half < 2; Half++)
+	{
+		VkDescriptorBufferInfo BufferInfos[3] = {
+			{ ParticleBuffers[1 - Half], 0, VK_WHOLE_SIZE },
+			{ ParticleBuffers[Half], 0, VK_WHOLE_SIZE },
+			{ DrawBuffer, 0, VK_WHOLE_SIZE },
+		};
+		VkWriteDescriptorSet Writes[3] = {};
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			Writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			Writes[i].dstSet = Sets[Half];
+			Writes[i].dstBinding = i;
+			Writes[i].descriptorCount = 1;
+			Writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			Writes[i].pBufferInfo = &BufferInfos[i];
+		}
+		vkUpdateDescriptorSets(Rend->Device, 3, Writes, 0, NULL);
+	}
+}
+
+void ParticleSystem::InitPipelines()
+{
+	const VkShaderStageFlagBits Stages[3] = { VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	const std::string Sources[3] = { std::string("#version 450\n") + simulateShaderText, vertShaderText, fragShaderText };
+	for (int i = 0; i < 3; i++)
+	{
+		std::vector<unsigned int> Spirv;
+		bool Compiled = i == 0 ?
+			Rend->GLSLtoSPV(Stages[i], Sources[i].c_str(), Spirv, Subgroups ? "#define SUBGROUPS 1\n" : "#define SUBGROUPS 0\n", Subgroups) :
+			Rend->GLSLtoSPV(Stages[i], Sources[i].c_str(), Spirv);
+		if (!Compiled)
+			std::exit(-1);
+		Modules[i] = Rend->CreateShaderModule(Spirv);
+		if (Modules[i] == VK_NULL_HANDLE)
+			std::exit(-1);
+	}
+
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	PushRange.size = sizeof(ParticleConstants);
+	VkPipelineLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	LayoutInfo.setLayoutCount = 1;
+	LayoutInfo.pSetLayouts = &SetLayout;
+	LayoutInfo.pushConstantRangeCount = 1;
+	LayoutInfo.pPushConstantRanges = &PushRange;
+	auto res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &SimulateLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// Set 0 is the renderer's uniform buffer, for the MVP. The lifetime is pushed for the colors.
+	const VkDescriptorSetLayout DrawSets[2] = { Rend->DescriptorSetLayouts[0], SetLayout };
+	PushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	PushRange.size = sizeof(float);
+	LayoutInfo.setLayoutCount = 2;
+	LayoutInfo.pSetLayouts = DrawSets;
+	res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &DrawLayout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkComputePipelineCreateInfo ComputeInfo = {};
+	ComputeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	ComputeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ComputeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	ComputeInfo.stage.module = Modules[0];
+	ComputeInfo.stage.pName = "main";
+	ComputeInfo.layout = SimulateLayout;
+	res = vkCreateComputePipelines(Rend->Device, Rend->PipelineCache, 1, &ComputeInfo, NULL, &SimulatePipeline);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkPipelineShaderStageCreateInfo DrawStages[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		DrawStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		DrawStages[i].stage = Stages[i + 1];
+		DrawStages[i].module = Modules[i + 1];
+		DrawStages[i].pName = "main";
+	}
+	// No vertex buffers, the quads come from gl_VertexIndex.
+	DrawPipeline = Rend->CreateGraphicsPipeline(VK_TRUE, VK_FALSE, DrawStages, DrawLayout);
+}
+
+void ParticleSystem::Reset()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		DrawCommands[i].vertexCount = 6;
+		DrawCommands[i].instanceCount = 0;
+		DrawCommands[i].firstVertex = 0;
+		DrawCommands[i].firstInstance = 0;
+	}
+	EmitDebt = 0.0f;
+}
+
+void ParticleSystem::RecordUpdate(VkCommandBuffer Cmd)
+{
+	Target = 1 - Target;
+	EmitDebt += Emitter.Rate * TimeStep;
+	uint32_t EmitCount = (uint32_t)std::min(EmitDebt, (float)Capacity);
+	EmitDebt = std::min(EmitDebt - EmitCount, 1.0f);
+
+	ParticleConstants Constants;
+	Constants.Emitter = glm::vec4(Emitter.Position, Emitter.Radius);
+	Constants.Launch = glm::vec4(Emitter.Velocity, Emitter.Spread);
+	Constants.Gravity = glm::vec4(Emitter.Gravity, TimeStep);
+	Constants.Lifetime = Emitter.Lifetime;
+	Constants.Size = Emitter.Size;
+	Constants.EmitCount = EmitCount;
+	Constants.Capacity = Capacity;
+	Constants.Seed = Step++;
+	Constants.SourceHalf = 1 - Target;
+
+	// The target's count starts at zero, the shader adds the survivors.
+	vkCmdFillBuffer(Cmd, DrawBuffer, sizeof(VkDrawIndirectCommand) * Target + offsetof(VkDrawIndirectCommand, instanceCount),
+		sizeof(uint32_t), 0);
+	VkMemoryBarrier Barrier = {};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &Barrier, 0, NULL, 0, NULL);
+
+	// One thread per slot, those past the alive and new particles only join the ballot.
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, SimulatePipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, SimulateLayout, 0, 1, &Sets[Target], 0, NULL);
+	vkCmdPushConstants(Cmd, SimulateLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants), &Constants);
+	vkCmdDispatch(Cmd, (Capacity + 63) / 64, 1, 1);
+
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &Barrier, 0, NULL, 0, NULL);
+}
+
+void ParticleSystem::RecordDraw(VkCommandBuffer Cmd)
+{
+	const VkDescriptorSet DrawSets[2] = { Rend->DescriptorSet[0], Sets[Target] };
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawPipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, DrawLayout, 0, 2, DrawSets, 0, NULL);
+	vkCmdPushConstants(Cmd, DrawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float), &Emitter.Lifetime);
+	vkCmdDrawIndirect(Cmd, DrawBuffer, sizeof(VkDrawIndirectCommand) * Target, 1, sizeof(VkDrawIndirectCommand));
+}
+
+uint32_t ParticleSystem::GetAliveCount() const
+{
+	return DrawCommands[Target].instanceCount;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <glm.hpp>
+
+class Renderer;
+
+// Where and how particles start, in the space of Model like the cube. Read every RecordUpdate.
+struct ParticleEmitter
+{
+	glm::vec3 Position = glm::vec3(0.0f);
+	// Particles start anywhere in a sphere this big around Position.
+	float Radius = 0.5f;
+	glm::vec3 Velocity = glm::vec3(0.0f, 6.0f, 0.0f);
+	// Random part of the start velocity, up to this long in any direction.
+	float Spread = 2.0f;
+	glm::vec3 Gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	// Seconds, every particle lives between half of it and all of it.
+	float Lifetime = 2.0f;
+	// Half the side of a particle's quad, in clip space at distance one.
+	float Size = 0.01f;
+	// Particles per second, as many as there is room for.
+	float Rate = 100000.0f;
+};
+
+/*
+* Particles that live on the GPU only. One compute dispatch a frame ages and moves the
+* alive particles, emits new ones into the free room and writes the survivors packed
+* into the other half of a ping-pong pair, counting them in the instanceCount of that
+* half's indirect draw. RecordDraw then draws one camera facing quad per survivor with
+* vkCmdDrawIndirect, so the CPU never touches a particle, or even knows how many there are.
+*
+* With subgroup ballots (Renderer::SubgroupBallotSupported) a subgroup reserves the room
+* for all its survivors with one atomic, otherwise every survivor takes its own.
+* The draw count buffer is written by the GPU every frame and read by GetAliveCount,
+* so the previous frame must be finished, which DrawCube ensures.
+*/
+class ParticleSystem
+{
+public:
+	// At most 64 times maxComputeWorkGroupCount[0] particles, fewer if Capacity is.
+	ParticleSystem(Renderer* Rend, uint32_t Capacity);
+	~ParticleSystem();
+
+	// Steps by TimeStep, outside a render pass.
+	void RecordUpdate(VkCommandBuffer Cmd);
+	// Records the survivors of the last RecordUpdate, inside the render pass.
+	// Viewport and scissor are the caller's.
+	void RecordDraw(VkCommandBuffer Cmd);
+	// Kills every particle, the GPU must be idle.
+	void Reset();
+
+	// Of the last update, once it finished on the GPU.
+	uint32_t GetAliveCount() const;
+	uint32_t GetCapacity() const { return Capacity; }
+	bool UsesSubgroups() const { return Subgroups; }
+
+	ParticleEmitter Emitter;
+	// Seconds every RecordUpdate advances, fixed so runs are repeatable.
+	float TimeStep = 1.0f / 60.0f;
+
+private:
+	void InitBuffers();
+	void InitDescriptors();
+	void InitPipelines();
+
+	Renderer* Rend;
+	uint32_t Capacity;
+	bool Subgroups;
+	// Half RecordUpdate writes next, the other one holds the alive particles.
+	uint32_t Target = 1;
+	// Emissions owed from fractions of a particle in earlier steps.
+	float EmitDebt = 0.0f;
+	uint32_t Step = 0;
+
+	// Position and remaining life, velocity and size. Only the GPU touches them.
+	VkBuffer ParticleBuffers[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkDeviceMemory ParticleMemory[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	// One VkDrawIndirectCommand per half, persistently mapped.
+	VkBuffer DrawBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory DrawMemory = VK_NULL_HANDLE;
+	VkDrawIndirectCommand* DrawCommands = nullptr;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+	// Indexed by the target half: reads the other one, writes that one.
+	VkDescriptorSet Sets[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkPipelineLayout SimulateLayout = VK_NULL_HANDLE;
+	VkPipeline SimulatePipeline = VK_NULL_HANDLE;
+	VkPipelineLayout DrawLayout = VK_NULL_HANDLE;
+	VkPipeline DrawPipeline = VK_NULL_HANDLE;
+	VkShaderModule Modules[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+};
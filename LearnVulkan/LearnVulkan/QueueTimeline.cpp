@@ -0,0 +1,208 @@
+#include "QueueTimeline.h"
+
+#include <cstdlib>
+
+void QueueTimeline::Init(VkDevice Device, VkQueue Queue, bool UseSemaphore)
+{
+	this->Device = Device;
+	this->Queue = Queue;
+	Submitted = 0;
+	Completed = 0;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (UseSemaphore)
+	{
+		GetCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(Device, "vkGetSemaphoreCounterValueKHR");
+		WaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(Device, "vkWaitSemaphoresKHR");
+		UseSemaphore = GetCounterValue && WaitSemaphores;
+	}
+	if (UseSemaphore)
+	{
+		VkSemaphoreTypeCreateInfoKHR TypeInfo = {};
+		TypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		TypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		TypeInfo.initialValue = 0;
+		VkSemaphoreCreateInfo SemaphoreInfo = {};
+		SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		SemaphoreInfo.pNext = &TypeInfo;
+		if (vkCreateSemaphore(Device, &SemaphoreInfo, nullptr, &Semaphore) != VK_SUCCESS)
+			std::exit(-1);
+	}
+#endif
+}
+
+void QueueTimeline::Destroy()
+{
+	if (Semaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(Device, Semaphore, nullptr);
+	Semaphore = VK_NULL_HANDLE;
+	for (auto& P : Pending)
+		vkDestroyFence(Device, P.Fence, nullptr);
+	for (auto Fence : FreeFences)
+		vkDestroyFence(Device, Fence, nullptr);
+	Pending.clear();
+	FreeFences.clear();
+}
+
+uint64_t QueueTimeline::Submit(const VkCommandBuffer* Buffers, uint32_t BufferCount,
+	const TimelineWait* Waits, uint32_t WaitCount, VkSemaphore SignalBinary)
+{
+	uint64_t Value = Submitted + 1;
+
+	std::vector<VkSemaphore> WaitSemaphoreList;
+	std::vector<uint64_t> WaitValues;
+	std::vector<VkPipelineStageFlags> WaitStages;
+	for (uint32_t i = 0; i < WaitCount; i++)
+	{
+		const TimelineWait& W = Waits[i];
+		if (W.Binary != VK_NULL_HANDLE)
+		{
+			WaitSemaphoreList.push_back(W.Binary);
+			// Ignored for binary semaphores.
+			WaitValues.push_back(0);
+			WaitStages.push_back(W.Stages);
+		}
+		else if (W.Timeline == this)
+		{
+			// Submits on one queue already start in order, and a value of ours
+			// that is not submitted yet could never be waited for.
+			continue;
+		}
+		else if (W.Timeline->UsesSemaphore() && UsesSemaphore())
+		{
+			WaitSemaphoreList.push_back(W.Timeline->GetSemaphore());
+			WaitValues.push_back(W.Value);
+			WaitStages.push_back(W.Stages);
+		}
+		else
+		{
+			W.Timeline->Wait(W.Value);
+		}
+	}
+
+	VkSemaphore SignalSemaphores[2];
+	uint64_t SignalValues[2] = { Value, 0 };
+	uint32_t SignalCount = 0;
+	if (UsesSemaphore())
+		SignalSemaphores[SignalCount++] = Semaphore;
+	if (SignalBinary != VK_NULL_HANDLE)
+		SignalSemaphores[SignalCount++] = SignalBinary;
+
+	VkSubmitInfo SubmitInfo = {};
+	SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	SubmitInfo.waitSemaphoreCount = (uint32_t)WaitSemaphoreList.size();
+	SubmitInfo.pWaitSemaphores = WaitSemaphoreList.data();
+	SubmitInfo.pWaitDstStageMask = WaitStages.data();
+	SubmitInfo.commandBufferCount = BufferCount;
+	SubmitInfo.pCommandBuffers = Buffers;
+	SubmitInfo.signalSemaphoreCount = SignalCount;
+	SubmitInfo.pSignalSemaphores = SignalSemaphores;
+
+	VkResult res;
+#ifdef VK_KHR_timeline_semaphore
+	if (UsesSemaphore())
+	{
+		VkTimelineSemaphoreSubmitInfoKHR TimelineInfo = {};
+		TimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		TimelineInfo.waitSemaphoreValueCount = (uint32_t)WaitValues.size();
+		TimelineInfo.pWaitSemaphoreValues = WaitValues.data();
+		TimelineInfo.signalSemaphoreValueCount = SignalCount;
+		TimelineInfo.pSignalSemaphoreValues = SignalValues;
+		SubmitInfo.pNext = &TimelineInfo;
+		res = vkQueueSubmit(Queue, 1, &SubmitInfo, VK_NULL_HANDLE);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+		Submitted = Value;
+		return Value;
+	}
+#endif
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	VkFence Fence = TakeFence();
+	res = vkQueueSubmit(Queue, 1, &SubmitInfo, Fence);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	Pending.push_back({ Value, Fence });
+	Submitted = Value;
+	return Value;
+}
+
+uint64_t QueueTimeline::GetCompleted()
+{
+#ifdef VK_KHR_timeline_semaphore
+	if (UsesSemaphore())
+	{
+		uint64_t Value = 0;
+		GetCounterValue(Device, Semaphore, &Value);
+		return Value;
+	}
+#endif
+	std::lock_guard<std::mutex> Lock(Mutex);
+	RetireFences(false, 0);
+	return Completed;
+}
+
+void QueueTimeline::Wait(uint64_t Value)
+{
+#ifdef VK_KHR_timeline_semaphore
+	if (UsesSemaphore())
+	{
+		VkSemaphoreWaitInfoKHR WaitInfo = {};
+		WaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		WaitInfo.semaphoreCount = 1;
+		WaitInfo.pSemaphores = &Semaphore;
+		WaitInfo.pValues = &Value;
+		VkResult res;
+		do
+		{
+			res = WaitSemaphores(Device, &WaitInfo, UINT64_MAX);
+		} while (res == VK_TIMEOUT);
+		return;
+	}
+#endif
+	std::lock_guard<std::mutex> Lock(Mutex);
+	RetireFences(true, Value);
+}
+
+VkFence QueueTimeline::TakeFence()
+{
+	// Recycle what already finished before making a new one.
+	RetireFences(false, 0);
+	if (!FreeFences.empty())
+	{
+		VkFence Fence = FreeFences.back();
+		FreeFences.pop_back();
+		return Fence;
+	}
+	VkFenceCreateInfo FenceInfo = {};
+	FenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence Fence;
+	if (vkCreateFence(Device, &FenceInfo, nullptr, &Fence) != VK_SUCCESS)
+		std::exit(-1);
+	return Fence;
+}
+
+void QueueTimeline::RetireFences(bool Block, uint64_t Value)
+{
+	// Fences signal in submit order, so only the oldest ones need looking at.
+	while (!Pending.empty())
+	{
+		PendingFence& Front = Pending.front();
+		if (Block && Front.Value <= Value)
+		{
+			VkResult res;
+			do
+			{
+				res = vkWaitForFences(Device, 1, &Front.Fence, VK_TRUE, UINT64_MAX);
+			} while (res == VK_TIMEOUT);
+		}
+		else if (vkGetFenceStatus(Device, Front.Fence) != VK_SUCCESS)
+		{
+			break;
+		}
+		vkResetFences(Device, 1, &Front.Fence);
+		FreeFences.push_back(Front.Fence);
+		Completed = Front.Value;
+		Pending.pop_front();
+	}
+}
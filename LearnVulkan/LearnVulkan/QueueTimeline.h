@@ -0,0 +1,76 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class QueueTimeline;
+
+// Something a submit waits for before Stages run: a value of a queue's timeline,
+// or a binary semaphore, which only the swapchain still needs.
+struct TimelineWait
+{
+	QueueTimeline* Timeline = nullptr;
+	uint64_t Value = 0;
+	VkSemaphore Binary = VK_NULL_HANDLE;
+	VkPipelineStageFlags Stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+/*
+* One counter per queue that only goes up. Every Submit signals the next value and
+* returns it, so waiting for work is waiting for its value: CPU waits, waits of other
+* queues and the retirement in DeletionQueue and BindlessTable all take values.
+* On VK_KHR_timeline_semaphore the counter is a timeline semaphore. Without it every
+* submit gets a fence from a pool, and waits for other queues' values happen on the
+* CPU before the submit.
+*/
+class QueueTimeline
+{
+public:
+	void Init(VkDevice Device, VkQueue Queue, bool UseSemaphore);
+	// The queue has to be idle.
+	void Destroy();
+
+	// Submits Buffers after Waits and returns the value that signals when they are done.
+	// SignalBinary is signalled too, for the present to wait on. Not thread safe, like the queue.
+	uint64_t Submit(const VkCommandBuffer* Buffers, uint32_t BufferCount,
+		const TimelineWait* Waits = nullptr, uint32_t WaitCount = 0, VkSemaphore SignalBinary = VK_NULL_HANDLE);
+	// Value of the last Submit.
+	uint64_t GetSubmitted() const { return Submitted; }
+	// Highest value the GPU finished, does not block. Thread safe.
+	uint64_t GetCompleted();
+	// Blocks until the GPU finished Value. Thread safe.
+	void Wait(uint64_t Value);
+	void WaitIdle() { Wait(Submitted); }
+
+	bool UsesSemaphore() const { return Semaphore != VK_NULL_HANDLE; }
+	VkSemaphore GetSemaphore() const { return Semaphore; }
+
+private:
+	struct PendingFence
+	{
+		uint64_t Value;
+		VkFence Fence;
+	};
+
+	// Fence path, Mutex held.
+	VkFence TakeFence();
+	void RetireFences(bool Block, uint64_t Value);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkQueue Queue = VK_NULL_HANDLE;
+	VkSemaphore Semaphore = VK_NULL_HANDLE;
+	uint64_t Submitted = 0;
+#ifdef VK_KHR_timeline_semaphore
+	PFN_vkGetSemaphoreCounterValueKHR GetCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR WaitSemaphores = nullptr;
+#endif
+
+	// Fence path. Waits hold Mutex, so a thread waiting for one value makes the
+	// others wait with it, fine for a fallback.
+	std::mutex Mutex;
+	std::deque<PendingFence> Pending;
+	std::vector<VkFence> FreeFences;
+	uint64_t Completed = 0;
+};
@@ -6,39 +6,40 @@
 #include "Renderer.h"
 #include <iostream>
 #include <sstream>
-#include <glm.hpp>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <gtc/matrix_transform.hpp>
 #ifdef _WIN32
 #include <Windows.h>
 #endif
 
 
-static const char *vertShaderText =
-"#version 400\n"
-"#extension GL_ARB_separate_shader_objects : enable\n"
-"#extension GL_ARB_shading_language_420pack : enable\n"
-"layout (std140, binding = 0) uniform bufferVals {\n"
-"    mat4 mvp;\n"
-"} myBufferVals;\n"
-"layout (location = 0) in vec4 pos;\n"
-"layout (location = 1) in vec4 inColor;\n"
-"layout (location = 0) out vec4 outColor;\n"
-"out gl_PerVertex { \n"
-"    vec4 gl_Position;\n"
-"};\n"
-"void main() {\n"
-"   outColor = inColor;\n"
-"   gl_Position = myBufferVals.mvp * pos;\n"
-"}\n";
+// The cube's shaders, the only copy of them. Watched for changes when reloading is on.
+static const char *vertShaderPath = "Shaders/cube.vert";
+static const char *fragShaderPath = "Shaders/cube.frag";
+
+// Must match the constant_ids and #ifdefs in the shaders.
+static const std::vector<ShaderFeature> CubeShaderFeatures = {
+	{ "INSTANCE_GRID", ShaderFeatureTier::Specialization, 2, 0 },
+	{ "COLOR_MODE", ShaderFeatureTier::Specialization, 4, 1 },
+	{ "GAMMA", ShaderFeatureTier::Specialization, 2, 2 },
+	// Interpolation qualifiers have to match between the stages, a constant can not change them.
+	{ "FLAT_COLOR", ShaderFeatureTier::Define, 2, 0 },
+	// Where DrawData comes from, same order as DrawDataPath.
+	{ "DRAW_DATA", ShaderFeatureTier::Define, 3, 0 },
+};
 
-static const char *fragShaderText =
+// Counts fragments with additive blending, 1 / 255 is one step of an 8 bit UNORM channel.
+static const char *overdrawFragShaderText =
 "#version 400\n"
 "#extension GL_ARB_separate_shader_objects : enable\n"
-"#extension GL_ARB_shading_language_420pack : enable\n"
-"layout (location = 0) in vec4 color;\n"
 "layout (location = 0) out vec4 outColor;\n"
 "void main() {\n"
-"   outColor = color;\n"
+"   outColor = vec4(1.0 / 255.0);\n"
 "}\n";
 
 Renderer::Renderer()
@@ -46,26 +47,57 @@ Renderer::Renderer()
 
 	SurfaceSizeX = 1920;
 	SurfaceSizeY = 1080;
+	InitRenderer();
+	InitShaderReload(vertShaderPath, fragShaderPath);
+}
+
+Renderer::Renderer(int Width, int Height)
+{
+	Headless = true;
+	SurfaceSizeX = Width;
+	SurfaceSizeY = Height;
+	InitRenderer();
+}
+
+void Renderer::InitRenderer()
+{
+	// Once for the renderer's lifetime: the render thread and the shader watcher
+	// both compile, and a per-compile Finalize would tear glslang down under the other.
+	glslang::InitializeProcess();
 	// Set up debug layers.
 	//SetupDebug();
 	// Init GLFW for WSI help.
-	InitGLFW();
+	if (!Headless)
+		InitGLFW();
 	// Get Vulkan Instance
 	InitInstance();
 	// Init Lunarg debug layers.
 	//InitDebug();
 	// Init and grab device and physical device.
 	InitDevice();
+	DeferredDeletion.Init(this);
 	// Create surface.
-	GLFWCreateSurface();
+	if (!Headless)
+		GLFWCreateSurface();
 	// Create commandpool.
 	InitCommandPool();
 	// Create command buffer.
 	InitCommandBuffer();
-	// Create swapchain for swapimages.
-	InitSwapchain();
-	// Create Images to swap.
-	InitSwapImages();
+	if (Headless)
+	{
+		// Offscreen images stand in for the swapchain.
+		InitHeadlessImages();
+	}
+	else
+	{
+		// Create swapchain for swapimages.
+		InitSwapchain();
+		// Create Images to swap.
+		InitSwapImages();
+		InitSemaphore();
+	}
+	RenderExtent.width = SurfaceSizeX;
+	RenderExtent.height = SurfaceSizeY;
 	// Begin accepting commands to the buffer.
 	BeginCommandBuffer();
 	// Create depth buffer.
@@ -73,10 +105,14 @@ Renderer::Renderer()
 
 	InitUniformBuffer();
 
+	if (DescriptorIndexingSupported)
+		InitBindless();
 	InitDescriptorPipelineLayout(false);
 
 	InitRenderpass(true, true);
-	InitShaders(vertShaderText, fragShaderText);
+	std::string VertSource, FragSource;
+	LoadCubeShaders(VertSource, FragSource);
+	InitShaders(VertSource.c_str(), FragSource.c_str());
 	InitFramebuffer(true);
 	InitVertexBuffer(g_vb_solid_face_colors_Data,
 		sizeof(g_vb_solid_face_colors_Data),
@@ -86,46 +122,107 @@ Renderer::Renderer()
 	InitPipelineCache();
 	InitGraphicsPipeline(true, true);
 	//ExecuteQueueCommandBuffer();
-	//InitSemaphore();
-	//CreateFence();
 	FlushCommandBuffer();
-	while (true)
-	{
-		DrawCube();
-	}
 }
 
 
 Renderer::~Renderer()
 {
+	GraphicsTimeline.WaitIdle();
+	DeleteJobs();
+	DeleteShaderReload();
+	DeleteShaderPermutations();
+	DeleteReadback();
+	DeleteCommandCache();
+	DeleteScenePipelines();
+	DeleteOverdraw();
 	DeleteGraphcisPipeline();
 	DeletePipelineCache();
+	DeleteObjectBuffer();
+	DeleteMeshlets();
+	DeleteParticles();
+	DeleteLighting();
+	DeleteShadows();
+	// What the deletes above retired, before the pool its sets came from goes.
+	DeferredDeletion.Flush();
 	DeleteDescriptorPool();
+	DeleteLodMesh();
 	DeleteVertexBuffer();
 	DeleteFramebuffer();
+	DeleteDynamicResolution();
 	DeleteShaders();
 	DeleteRenderpass();
 	DeleteDescriptorPipelineLayout();
+	DeleteBindless();
 	DeleteUniformBuffer();
 	DeleteDepthBuffer();
-	DeleteSwapImages();
-	DeleteSwapchain();
+	if (Headless)
+	{
+		DeleteHeadlessImages();
+	}
+	else
+	{
+		DeleteSwapImages();
+		DeleteSwapchain();
+	}
 	DeleteCommandBuffer();
 	DeleteCommandPool();
-	GLFWDeleteSurface();
+	if (!Headless)
+	{
+		DeleteSemaphore();
+		GLFWDeleteSurface();
+	}
+	GraphicsTimeline.Destroy();
 	DeleteDevice();
 	DeleteDebug();
 	DeleteInstance();
-	DeleteGLFW();
+	if (!Headless)
+		DeleteGLFW();
+	glslang::FinalizeProcess();
+}
+
+static bool HasExtension(const std::vector<VkExtensionProperties>& Extensions, const char* Name)
+{
+	for (auto& Extension : Extensions)
+	{
+		if (strcmp(Extension.extensionName, Name) == 0)
+			return true;
+	}
+	return false;
 }
 
 void Renderer::InitInstance()
 {
+	if (!LoadVulkan())
+	{
+		std::cout << "Could not load the Vulkan loader." << std::endl;
+		std::exit(-1);
+	}
+
+	uint32_t ExtensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &ExtensionCount, nullptr);
+	std::vector<VkExtensionProperties> Extensions(ExtensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &ExtensionCount, Extensions.data());
+
+	// Needed to query VK_EXT_memory_budget.
+	Properties2Supported = HasExtension(Extensions, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	if (Properties2Supported)
+		InstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
 	// Welcome to Vulkan descriptor galore!
 	VkApplicationInfo ApplicationInfo{};
 	ApplicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	ApplicationInfo.apiVersion = VK_MAKE_VERSION(1, 0, 13);
+	// Vulkan 1.1 when the loader has it, for subgroup operations in compute shaders.
+	InstanceVersion = VK_MAKE_VERSION(1, 0, 13);
+#ifdef VK_VERSION_1_1
+	auto fvkEnumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)
+		vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+	uint32_t LoaderVersion = 0;
+	if (fvkEnumerateInstanceVersion && fvkEnumerateInstanceVersion(&LoaderVersion) == VK_SUCCESS &&
+		LoaderVersion >= VK_API_VERSION_1_1)
+		InstanceVersion = VK_API_VERSION_1_1;
+#endif
+	ApplicationInfo.apiVersion = InstanceVersion;
 	ApplicationInfo.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
 	ApplicationInfo.pApplicationName = "Learning Vulkan";
 
@@ -136,13 +233,16 @@ void Renderer::InitInstance()
 	InstanceCreateInfo.ppEnabledLayerNames = InstanceLayers.data();
 	InstanceCreateInfo.enabledExtensionCount = InstanceExtensions.size();
 	InstanceCreateInfo.ppEnabledExtensionNames = InstanceExtensions.data();
-	InstanceCreateInfo.pNext = &DebugReportInfo;
+	// Only chain the debug report info when SetupDebug filled it in.
+	InstanceCreateInfo.pNext = DebugReportInfo.sType ? &DebugReportInfo : nullptr;
 
 	auto error = vkCreateInstance(&InstanceCreateInfo, nullptr, &Instance);
 
 	if (error != VK_SUCCESS)
 		std::exit(-1); // Could not create instance.
 
+	LoadVulkanInstance(Instance);
+
 }
 
 void Renderer::DeleteInstance()
@@ -195,6 +295,135 @@ void Renderer::InitDevice()
 	}
 	std::cout << "[END]" << std::endl;
 	
+	uint32_t DeviceExtensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &DeviceExtensionCount, nullptr);
+	std::vector<VkExtensionProperties> AvailableDeviceExtensions(DeviceExtensionCount);
+	vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &DeviceExtensionCount, AvailableDeviceExtensions.data());
+
+#ifdef VK_EXT_memory_budget
+	MemoryBudgetSupported = Properties2Supported &&
+		HasExtension(AvailableDeviceExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (MemoryBudgetSupported)
+		DeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+#endif
+
+#ifdef VK_EXT_descriptor_indexing
+	// Everything the bindless table needs, otherwise we stay on bound descriptor sets.
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT IndexingFeatures = {};
+	IndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	DescriptorIndexingSupported = Properties2Supported &&
+		HasExtension(AvailableDeviceExtensions, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+		HasExtension(AvailableDeviceExtensions, VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+	if (DescriptorIndexingSupported)
+	{
+		auto fvkGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)
+			vkGetInstanceProcAddr(Instance, "vkGetPhysicalDeviceFeatures2KHR");
+		auto fvkGetPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)
+			vkGetInstanceProcAddr(Instance, "vkGetPhysicalDeviceProperties2KHR");
+
+		VkPhysicalDeviceFeatures2KHR Features2 = {};
+		Features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		Features2.pNext = &IndexingFeatures;
+		fvkGetPhysicalDeviceFeatures2(PhysicalDevice, &Features2);
+		// The shaders pick the table with a push constant, dynamically uniform indexing.
+		DescriptorIndexingSupported = Features2.features.shaderStorageBufferArrayDynamicIndexing &&
+			IndexingFeatures.runtimeDescriptorArray &&
+			IndexingFeatures.descriptorBindingPartiallyBound &&
+			IndexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+			IndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+			IndexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT IndexingProperties = {};
+		IndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2KHR Properties2 = {};
+		Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		Properties2.pNext = &IndexingProperties;
+		fvkGetPhysicalDeviceProperties2(PhysicalDevice, &Properties2);
+		BindlessSlots.Buffers = std::min(BindlessSlots.Buffers, IndexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+		BindlessSlots.Images = std::min(BindlessSlots.Images, IndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+		BindlessSlots.Samplers = std::min(BindlessSlots.Samplers, IndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers);
+	}
+	if (DescriptorIndexingSupported)
+	{
+		DeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		DeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		// Only turn on what we use.
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT Query = IndexingFeatures;
+		IndexingFeatures = {};
+		IndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		IndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		IndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		IndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		IndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		IndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = Query.descriptorBindingSampledImageUpdateAfterBind;
+	}
+	else
+	{
+		std::cout << "Descriptor indexing not supported, bindless draws disabled." << std::endl;
+	}
+#endif
+
+	// Many indirect draws in one call, each carrying its object in firstInstance, for the meshlet pass.
+	VkPhysicalDeviceFeatures SupportedFeatures;
+	vkGetPhysicalDeviceFeatures(PhysicalDevice, &SupportedFeatures);
+	EnabledFeatures.multiDrawIndirect = SupportedFeatures.multiDrawIndirect;
+	EnabledFeatures.drawIndirectFirstInstance = SupportedFeatures.drawIndirectFirstInstance;
+	// Shadow casters in front of a cascade still land in it, see DepthOnlyState.
+	EnabledFeatures.depthClamp = SupportedFeatures.depthClamp;
+	// bindlessBuffers is indexed with drawRef.table.
+	EnabledFeatures.shaderStorageBufferArrayDynamicIndexing = DescriptorIndexingSupported;
+#ifdef VK_KHR_timeline_semaphore
+	// One counter per queue for every wait, see QueueTimeline.
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR TimelineFeatures = {};
+	TimelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	TimelineSemaphoreSupported = Properties2Supported &&
+		HasExtension(AvailableDeviceExtensions, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	if (TimelineSemaphoreSupported)
+	{
+		auto fvkGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)
+			vkGetInstanceProcAddr(Instance, "vkGetPhysicalDeviceFeatures2KHR");
+		VkPhysicalDeviceFeatures2KHR Features2 = {};
+		Features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		Features2.pNext = &TimelineFeatures;
+		fvkGetPhysicalDeviceFeatures2(PhysicalDevice, &Features2);
+		TimelineSemaphoreSupported = TimelineFeatures.timelineSemaphore;
+	}
+	if (TimelineSemaphoreSupported)
+		DeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	else
+		std::cout << "Timeline semaphores not supported, submits are tracked with fences." << std::endl;
+	TimelineFeatures.pNext = nullptr;
+#endif
+
+#ifdef VK_VERSION_1_1
+	// Lets a subgroup of the particle simulation reserve its survivors' room with one atomic.
+	if (InstanceVersion >= VK_API_VERSION_1_1 && DeviceProperties.apiVersion >= VK_API_VERSION_1_1)
+	{
+		auto fvkGetPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2)
+			vkGetInstanceProcAddr(Instance, "vkGetPhysicalDeviceProperties2");
+		VkPhysicalDeviceSubgroupProperties SubgroupProperties = {};
+		SubgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 Properties2 = {};
+		Properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		Properties2.pNext = &SubgroupProperties;
+		if (fvkGetPhysicalDeviceProperties2)
+		{
+			fvkGetPhysicalDeviceProperties2(PhysicalDevice, &Properties2);
+			const VkSubgroupFeatureFlags Needed = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+			SubgroupBallotSupported = (SubgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+				(SubgroupProperties.supportedOperations & Needed) == Needed;
+		}
+	}
+#endif
+	if (!SubgroupBallotSupported)
+		std::cout << "Subgroup ballots not supported, particles are compacted with one atomic each." << std::endl;
+
+#ifdef VK_KHR_draw_indirect_count
+	DrawIndirectCountSupported = HasExtension(AvailableDeviceExtensions, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (DrawIndirectCountSupported)
+		DeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+#endif
+
 	float QueuePriorities[] = { 1.0f };
 	VkDeviceQueueCreateInfo DeviceQueueCreateInfo{};
 	DeviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -208,14 +437,30 @@ void Renderer::InitDevice()
 	DeviceCreateInfo.pQueueCreateInfos = &DeviceQueueCreateInfo;
 	DeviceCreateInfo.enabledExtensionCount = DeviceExtensions.size();
 	DeviceCreateInfo.ppEnabledExtensionNames = DeviceExtensions.data();
+	DeviceCreateInfo.pEnabledFeatures = &EnabledFeatures;
+#ifdef VK_KHR_timeline_semaphore
+	if (TimelineSemaphoreSupported)
+		DeviceCreateInfo.pNext = &TimelineFeatures;
+#endif
+#ifdef VK_EXT_descriptor_indexing
+	if (DescriptorIndexingSupported)
+	{
+		IndexingFeatures.pNext = (void*)DeviceCreateInfo.pNext;
+		DeviceCreateInfo.pNext = &IndexingFeatures;
+	}
+#endif
 
 	auto error = vkCreateDevice(PhysicalDevice, &DeviceCreateInfo, nullptr, &Device);
 
 	if (error != VK_SUCCESS)
 		std::exit(-1); // Could not create device.
 
+	// Skips the loader's dispatch on every device call from here on.
+	LoadVulkanDevice(Device);
 	vkGetDeviceQueue(Device, GraphicsFamilyIndex, 0, &Queue);
+	GraphicsTimeline.Init(Device, Queue, TimelineSemaphoreSupported);
 
+	GpuMemory.Init(Instance, PhysicalDevice, MemoryBudgetSupported);
 }
 
 void Renderer::DeleteDevice()
@@ -316,6 +561,8 @@ void Renderer::InitDebug()
 
 void Renderer::DeleteDebug()
 {
+	if (fvkDestroyDebugReportCallbackEXT == nullptr)
+		return; // InitDebug was never called.
 	fvkDestroyDebugReportCallbackEXT(Instance, DebugReport, nullptr);
 }
 
@@ -430,6 +677,13 @@ void Renderer::InitSwapchain()
 	swapchain_create_info.imageExtent.height = SurfaceSizeY;
 	swapchain_create_info.imageArrayLayers = 1;
 	swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// Needed to copy frames out for readback.
+	if (SurfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+		swapchain_create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	// Needed to blit dynamic resolution frames in.
+	SwapchainTransferDst = (SurfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+	if (SwapchainTransferDst)
+		swapchain_create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swapchain_create_info.queueFamilyIndexCount = 0;
 	swapchain_create_info.pQueueFamilyIndices = nullptr;
@@ -494,6 +748,88 @@ void Renderer::DeleteSwapImages()
 	}
 }
 
+void Renderer::InitHeadlessImages()
+{
+	// No surface to ask, pick a format every driver can render to.
+	SurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
+	SurfaceFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+
+	SwapchainImages.resize(SwapchainImageCount);
+	SwapchainImageViews.resize(SwapchainImageCount);
+	HeadlessImageMemory.resize(SwapchainImageCount);
+	SwapchainTransferDst = true;
+
+	for (uint32_t i = 0; i < SwapchainImageCount; ++i) {
+		VkImageCreateInfo ImageInfo = {};
+		ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		ImageInfo.pNext = NULL;
+		ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+		ImageInfo.format = SurfaceFormat.format;
+		ImageInfo.extent.width = SurfaceSizeX;
+		ImageInfo.extent.height = SurfaceSizeY;
+		ImageInfo.extent.depth = 1;
+		ImageInfo.mipLevels = 1;
+		ImageInfo.arrayLayers = 1;
+		ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		ImageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		auto error = vkCreateImage(Device, &ImageInfo, nullptr, &SwapchainImages[i]);
+		if (error != VK_SUCCESS)
+			std::exit(-1);
+
+		VkMemoryRequirements mem_reqs;
+		vkGetImageMemoryRequirements(Device, SwapchainImages[i], &mem_reqs);
+
+		VkMemoryAllocateInfo mem_alloc = {};
+		mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		mem_alloc.allocationSize = mem_reqs.size;
+		if (!memory_type_from_properties(mem_reqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mem_alloc.memoryTypeIndex))
+			std::exit(-1);
+
+		error = AllocateMemory(&mem_alloc, MemoryCategory::RenderTarget, &HeadlessImageMemory[i]);
+		if (error != VK_SUCCESS)
+			std::exit(-1);
+
+		error = vkBindImageMemory(Device, SwapchainImages[i], HeadlessImageMemory[i], 0);
+		if (error != VK_SUCCESS)
+			std::exit(-1);
+
+		VkImageViewCreateInfo image_view_create_info{};
+		image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		image_view_create_info.image = SwapchainImages[i];
+		image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		image_view_create_info.format = SurfaceFormat.format;
+		image_view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		image_view_create_info.subresourceRange.baseMipLevel = 0;
+		image_view_create_info.subresourceRange.levelCount = 1;
+		image_view_create_info.subresourceRange.baseArrayLayer = 0;
+		image_view_create_info.subresourceRange.layerCount = 1;
+
+		error = vkCreateImageView(Device, &image_view_create_info, nullptr, &SwapchainImageViews[i]);
+		if (error != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+void Renderer::DeleteHeadlessImages()
+{
+	for (uint32_t i = 0; i < SwapchainImageCount; ++i) {
+		vkDestroyImageView(Device, SwapchainImageViews[i], nullptr);
+		vkDestroyImage(Device, SwapchainImages[i], nullptr);
+		FreeMemory(HeadlessImageMemory[i]);
+	}
+	HeadlessImageMemory.clear();
+}
+
 void Renderer::InitCommandPool()
 {
 	VkCommandPoolCreateInfo CmdPoolInfo = {};
@@ -585,6 +921,12 @@ void Renderer::CreateDepthBuffer()
 	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	ImageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	// Kept past the render pass for the depth pyramid, when the format allows it.
+	VkFormatFeatureFlags TilingFeatures = ImageInfo.tiling == VK_IMAGE_TILING_LINEAR ?
+		FormatProperties.linearTilingFeatures : FormatProperties.optimalTilingFeatures;
+	DepthSampled = (TilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+	if (DepthSampled)
+		ImageInfo.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
 	ImageInfo.queueFamilyIndexCount = 0;
 	ImageInfo.pQueueFamilyIndices = NULL;
 	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -634,7 +976,7 @@ void Renderer::CreateDepthBuffer()
 	if (!pass)
 		std::exit(-1);
 
-	error = vkAllocateMemory(Device, &mem_alloc, nullptr, &DepthMemory);
+	error = AllocateMemory(&mem_alloc, MemoryCategory::Depth, &DepthMemory);
 	if (error != VK_SUCCESS)
 		std::exit(-1);
 
@@ -656,7 +998,7 @@ void Renderer::DeleteDepthBuffer()
 {
 	vkDestroyImageView(Device, DepthImageView, NULL);
 	vkDestroyImage(Device, DepthImage, NULL);
-	vkFreeMemory(Device, DepthMemory, NULL);
+	FreeMemory(DepthMemory);
 }
 
 // From Lunarg samples.
@@ -680,6 +1022,20 @@ bool Renderer::memory_type_from_properties(uint32_t typeBits,
 	return false;
 }
 
+VkResult Renderer::AllocateMemory(const VkMemoryAllocateInfo* AllocateInfo, MemoryCategory Category, VkDeviceMemory* Memory)
+{
+	auto res = vkAllocateMemory(Device, AllocateInfo, nullptr, Memory);
+	if (res == VK_SUCCESS)
+		GpuMemory.TrackAllocation(*Memory, AllocateInfo->allocationSize, AllocateInfo->memoryTypeIndex, Category);
+	return res;
+}
+
+void Renderer::FreeMemory(VkDeviceMemory Memory)
+{
+	GpuMemory.TrackFree(Memory);
+	vkFreeMemory(Device, Memory, nullptr);
+}
+
 // Thank you lunarg.
 void Renderer::set_image_layout(VkImage image,
 	VkImageAspectFlags aspectMask,
@@ -766,70 +1122,36 @@ void Renderer::FlushCommandBuffer()
 	ExecuteQueueCommandBuffer();
 }
 
-/*
-* TODO Split into different functions.
-*/
 void Renderer::ExecuteQueueCommandBuffer()
 {
-
-	/* Queue the command buffer for execution */
-	const VkCommandBuffer cmd_bufs[] = { CommandBuffer };
-	VkFenceCreateInfo fenceInfo;
-	VkFence drawFence;
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.pNext = NULL;
-	fenceInfo.flags = 0;
-	vkCreateFence(Device, &fenceInfo, NULL, &drawFence);
-
-	VkPipelineStageFlags pipe_stage_flags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	VkSubmitInfo submit_info[1] = {};
-	submit_info[0].pNext = NULL;
-	submit_info[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info[0].waitSemaphoreCount = 0;
-	submit_info[0].pWaitSemaphores = NULL;
-	submit_info[0].pWaitDstStageMask = &pipe_stage_flags;
-	submit_info[0].commandBufferCount = 1;
-	submit_info[0].pCommandBuffers = cmd_bufs;
-	submit_info[0].signalSemaphoreCount = 0;
-	submit_info[0].pSignalSemaphores = NULL;
-
-	auto error = vkQueueSubmit(Queue, 1, submit_info, drawFence);
-	if (error != VK_SUCCESS)
-		std::exit(-1);
-
-	VkResult result;
-	do
-	{
-		result = vkWaitForFences(Device, 1, &drawFence, VK_TRUE, UINT64_MAX);
-	} while (result == VK_TIMEOUT);
-	
-	
-	//vkDestroyFence(Device, drawFence, NULL);
+	GraphicsTimeline.Wait(GraphicsTimeline.Submit(&CommandBuffer, 1));
 }
 
-void Renderer::InitUniformBuffer()
+void Renderer::DefaultCamera(int SizeX, int SizeY, glm::mat4& Projection, glm::mat4& View, glm::mat4& Model)
 {
-
-	glm::mat4 Projection = glm::perspective(glm::radians(45.0f), (float)SurfaceSizeY / (float)SurfaceSizeX, 0.1f, 100.0f);
-	glm::mat4 View = glm::lookAt(
+	Projection = glm::perspective(glm::radians(45.0f), (float)SizeY / (float)SizeX, 0.1f, 100.0f);
+	View = glm::lookAt(
 		glm::vec3(0, 20, 4), // Camera is at (0,3,10), in World Space
 		glm::vec3(0, 0, 0),  // and looks at the origin
 		glm::vec3(0, 1, 0)  // Head is up (set to 0,-1,0 to look upside-down)
 	);
-	glm::mat4 Model = glm::mat4
+	Model = glm::mat4
 	(1.0f, 0.0f, 0.0f, 0.0f,
 		0.0f, -1.0f, 0.0f, 0.0f,
 		0.0f, 0.0f, 1.0f, 0.0f,
 		0.0f, 0.0f, 0.0f, 1.0f);
 	Model = glm::translate(Model, glm::vec3(0, 5, 0));
+}
 
-	glm::mat4 MVP = Projection * View * Model;
+void Renderer::InitUniformBuffer()
+{
+	DefaultCamera(SurfaceSizeX, SurfaceSizeY, Projection, View, Model);
 
 	VkBufferCreateInfo buf_info = {};
 	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	buf_info.pNext = NULL;
 	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	buf_info.size = sizeof(MVP);
+	buf_info.size = sizeof(UniformData);
 	buf_info.queueFamilyIndexCount = 0;
 	buf_info.pQueueFamilyIndices = NULL;
 	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -855,30 +1177,58 @@ void Renderer::InitUniformBuffer()
 	if (!pass)
 		std::exit(-1);
 
-	res = vkAllocateMemory(Device, &alloc_info, NULL, &UniformMemory);
+	res = AllocateMemory(&alloc_info, MemoryCategory::Uniform, &UniformMemory);
 	if (res != VK_SUCCESS)
 		std::exit(-1);
 
-	uint8_t *pData;
-	res = vkMapMemory(Device, UniformMemory, 0, mem_reqs.size, 0, (void **)&pData);
-
-	memcpy(pData, &MVP, sizeof(MVP));
-
-	vkUnmapMemory(Device, UniformMemory);
-
 	res = vkBindBufferMemory(Device, UniformBuffer, UniformMemory, 0);
 	if (res != VK_SUCCESS)
 		std::exit(-1);
 
+	WriteUniformBuffer();
+
 	UniformDescriptor.buffer = UniformBuffer;
 	UniformDescriptor.offset = 0;
-	UniformDescriptor.range = sizeof(MVP);
+	UniformDescriptor.range = sizeof(UniformData);
+}
+
+void Renderer::UpdateUniformBuffer()
+{
+	// The frame in flight still reads it.
+	FinishFrame();
+	WriteUniformBuffer();
+}
+
+void Renderer::WriteUniformBuffer()
+{
+	UniformData Data;
+	Data.MVP = Projection * View * Model;
+
+	Data.InstanceGrid = InstanceGrid(InstanceCount);
+
+	uint8_t *pData;
+	auto res = vkMapMemory(Device, UniformMemory, 0, sizeof(Data), 0, (void **)&pData);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	memcpy(pData, &Data, sizeof(Data));
+
+	vkUnmapMemory(Device, UniformMemory);
+}
+
+glm::vec4 Renderer::InstanceGrid(uint32_t Count)
+{
+	// Spread the instances over a square grid that stays about 20 units wide,
+	// a single instance keeps the cube exactly where it was.
+	float Side = std::ceil(std::sqrt((float)Count));
+	float Spacing = Side > 1.0f ? 20.0f / Side : 0.0f;
+	return glm::vec4(Side, Spacing, Side > 1.0f ? Spacing * 0.4f : 1.0f, 0.0f);
 }
 
 void Renderer::DeleteUniformBuffer()
 {
 	vkDestroyBuffer(Device, UniformBuffer, NULL);
-	vkFreeMemory(Device, UniformMemory, NULL);
+	FreeMemory(UniformMemory);
 }
 
 void Renderer::InitDescriptorPipelineLayout(bool UseTexture)
@@ -907,18 +1257,43 @@ void Renderer::InitDescriptorPipelineLayout(bool UseTexture)
 	DescriptorLayout.bindingCount = UseTexture ? 2 : 1; // Change binding count if we use texture or not.
 	DescriptorLayout.pBindings = LayoutBindings;
 
-	DescriptorSetLayouts.resize(1);
+	DescriptorSetLayouts.resize(2);
 	auto res = vkCreateDescriptorSetLayout(Device, &DescriptorLayout, NULL, DescriptorSetLayouts.data());
 	if (res != VK_SUCCESS)
 		std::exit(-1);
 
+	// Set 1 holds DrawData for the descriptor path, one dynamic offset per draw.
+	VkDescriptorSetLayoutBinding ObjectBinding = {};
+	ObjectBinding.binding = 0;
+	ObjectBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	ObjectBinding.descriptorCount = 1;
+	ObjectBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	ObjectBinding.pImmutableSamplers = NULL;
+
+	DescriptorLayout.bindingCount = 1;
+	DescriptorLayout.pBindings = &ObjectBinding;
+	res = vkCreateDescriptorSetLayout(Device, &DescriptorLayout, NULL, &DescriptorSetLayouts[1]);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// DrawData for the push constant path.
+	static_assert(sizeof(DrawData) <= 128, "DrawData must fit the minimum maxPushConstantsSize");
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	PushRange.offset = 0;
+	PushRange.size = sizeof(DrawData);
+
 	VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {};
 	PipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	PipelineLayoutCreateInfo.pNext = NULL;
-	PipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-	PipelineLayoutCreateInfo.pPushConstantRanges = NULL;
-	PipelineLayoutCreateInfo.setLayoutCount = 1;
-	PipelineLayoutCreateInfo.pSetLayouts = DescriptorSetLayouts.data();
+	PipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	PipelineLayoutCreateInfo.pPushConstantRanges = &PushRange;
+	// The bindless table is set 2. It is not ours to destroy, so it stays out of DescriptorSetLayouts.
+	std::vector<VkDescriptorSetLayout> SetLayouts = DescriptorSetLayouts;
+	if (Bindless.IsEnabled())
+		SetLayouts.push_back(Bindless.GetLayout());
+	PipelineLayoutCreateInfo.setLayoutCount = (uint32_t)SetLayouts.size();
+	PipelineLayoutCreateInfo.pSetLayouts = SetLayouts.data();
 
 	res = vkCreatePipelineLayout(Device, &PipelineLayoutCreateInfo, NULL, &PipelineLayout);
 	if (res != VK_SUCCESS)
@@ -927,12 +1302,9 @@ void Renderer::InitDescriptorPipelineLayout(bool UseTexture)
 
 void Renderer::DeleteDescriptorPipelineLayout()
 {
-	// We have only one DescriptorSetLayout, but may have more in the future.
-	for (int i = 0; i < 1; i++)
-	{
+	for (size_t i = 0; i < DescriptorSetLayouts.size(); i++)
 		vkDestroyDescriptorSetLayout(Device, DescriptorSetLayouts[i], NULL);
-		vkDestroyPipelineLayout(Device, PipelineLayout, NULL);
-	}
+	vkDestroyPipelineLayout(Device, PipelineLayout, NULL);
 }
 
 void Renderer::InitRenderpass(bool clear, bool UseDepth)
@@ -995,10 +1367,18 @@ void Renderer::InitRenderpass(bool clear, bool UseDepth)
 
 	if (res != VK_SUCCESS)
 		std::exit(-1);
+
+	// Compatible with RenderPass, so it uses the same framebuffers and pipelines.
+	Attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	Attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	res = vkCreateRenderPass(Device, &rp_info, NULL, &ResumeRenderPass);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
 }
 
 void Renderer::DeleteRenderpass()
 {
+	vkDestroyRenderPass(Device, ResumeRenderPass, NULL);
 	vkDestroyRenderPass(Device, RenderPass, NULL);
 }
 
@@ -1008,7 +1388,6 @@ void Renderer::InitShaders(const char * VertShader, const char * FragShader)
 	if (!(VertShader || FragShader))
 		return;
 
-	glslang::InitializeProcess();
 	VkShaderModuleCreateInfo moduleCreateInfo;
 
 	if (VertShader) {
@@ -1057,8 +1436,74 @@ void Renderer::InitShaders(const char * VertShader, const char * FragShader)
 			&ShaderStages[1].module);
 		assert(res == VK_SUCCESS);
 	}
+}
+
+VkShaderModule Renderer::CreateShaderModule(const std::vector<unsigned int>& Spirv)
+{
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.pNext = NULL;
+	moduleCreateInfo.flags = 0;
+	moduleCreateInfo.codeSize = Spirv.size() * sizeof(unsigned int);
+	moduleCreateInfo.pCode = Spirv.data();
+
+	VkShaderModule Module;
+	auto res = vkCreateShaderModule(Device, &moduleCreateInfo, NULL, &Module);
+	return res == VK_SUCCESS ? Module : VK_NULL_HANDLE;
+}
+
+void Renderer::LoadCubeShaders(std::string& VertSource, std::string& FragSource)
+{
+	if (!LoadShaderFile(vertShaderPath, VertSource) || !LoadShaderFile(fragShaderPath, FragSource))
+	{
+		std::cout << "Could not read " << vertShaderPath << " and " << fragShaderPath
+			<< ", run from the directory that holds Shaders." << std::endl;
+		std::exit(-1);
+	}
+}
 
-	glslang::FinalizeProcess();
+void Renderer::InitShaderReload(const char* VertPath, const char* FragPath)
+{
+	ShaderReload = new ShaderReloader(this, VertPath, FragPath);
+}
+
+void Renderer::DeleteShaderReload()
+{
+	// Joins the watcher, a build it finished but we never used is destroyed.
+	delete ShaderReload;
+	ShaderReload = nullptr;
+}
+
+void Renderer::InitShaderPermutations()
+{
+	DeleteShaderPermutations();
+
+	std::string VertSource, FragSource;
+	LoadCubeShaders(VertSource, FragSource);
+	std::vector<ShaderFeature> Features = CubeShaderFeatures;
+	// Without the bindless table in the pipeline layout those pipelines can not be built.
+	if (!Bindless.IsEnabled())
+	{
+		for (auto& Feature : Features)
+		{
+			if (strcmp(Feature.Name, "DRAW_DATA") == 0)
+				Feature.ValueCount = (uint32_t)DrawDataPath::Bindless;
+		}
+	}
+	Permutations = new ShaderPermutations(this, VertSource, FragSource, Features);
+}
+
+void Renderer::UsePermutation(uint32_t Permutation)
+{
+	ActivePermutation = Permutation;
+	PermutationPipeline = Permutations->GetPipeline(Permutation);
+}
+
+void Renderer::DeleteShaderPermutations()
+{
+	PermutationPipeline = nullptr;
+	delete Permutations;
+	Permutations = nullptr;
 }
 
 void Renderer::DeleteShaders()
@@ -1106,6 +1551,202 @@ void Renderer::DeleteFramebuffer()
 	free(framebuffers);
 }
 
+bool Renderer::InitDynamicResolution(const DynamicResolutionSettings& Settings)
+{
+	VkFormatProperties FormatProperties;
+	vkGetPhysicalDeviceFormatProperties(PhysicalDevice, SurfaceFormat.format, &FormatProperties);
+	VkFormatFeatureFlags Blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	if ((FormatProperties.optimalTilingFeatures & Blit) != Blit || !SwapchainTransferDst)
+	{
+		std::cout << "Dynamic resolution needs blits to the swapchain images, staying at full size." << std::endl;
+		return false;
+	}
+	// The queue wait is no measure of GPU time, the controller would chase the CPU.
+	if (!DeviceProperties.limits.timestampComputeAndGraphics)
+	{
+		std::cout << "Dynamic resolution needs GPU timestamps, staying at full size." << std::endl;
+		return false;
+	}
+	UpscaleFilter = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ?
+		VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+	VkImageCreateInfo ImageInfo = {};
+	ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+	ImageInfo.format = SurfaceFormat.format;
+	ImageInfo.extent.width = SurfaceSizeX;
+	ImageInfo.extent.height = SurfaceSizeY;
+	ImageInfo.extent.depth = 1;
+	ImageInfo.mipLevels = 1;
+	ImageInfo.arrayLayers = 1;
+	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ImageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	auto error = vkCreateImage(Device, &ImageInfo, nullptr, &SceneColor);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(Device, SceneColor, &mem_reqs);
+
+	VkMemoryAllocateInfo mem_alloc = {};
+	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc.allocationSize = mem_reqs.size;
+	if (!memory_type_from_properties(mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mem_alloc.memoryTypeIndex))
+		std::exit(-1);
+
+	error = AllocateMemory(&mem_alloc, MemoryCategory::RenderTarget, &SceneColorMemory);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	error = vkBindImageMemory(Device, SceneColor, SceneColorMemory, 0);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	VkImageViewCreateInfo ViewInfo = {};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = SceneColor;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	ViewInfo.format = SurfaceFormat.format;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ViewInfo.subresourceRange.levelCount = 1;
+	ViewInfo.subresourceRange.layerCount = 1;
+
+	error = vkCreateImageView(Device, &ViewInfo, nullptr, &SceneColorView);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	// Same attachments as framebuffers, so RenderPass and the pipelines work with it.
+	VkImageView Attachments[2] = { SceneColorView, DepthImageView };
+	VkFramebufferCreateInfo FramebufferInfo = {};
+	FramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	FramebufferInfo.renderPass = RenderPass;
+	FramebufferInfo.attachmentCount = 2;
+	FramebufferInfo.pAttachments = Attachments;
+	FramebufferInfo.width = SurfaceSizeX;
+	FramebufferInfo.height = SurfaceSizeY;
+	FramebufferInfo.layers = 1;
+
+	error = vkCreateFramebuffer(Device, &FramebufferInfo, nullptr, &SceneFramebuffer);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	VkQueryPoolCreateInfo QueryInfo = {};
+	QueryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	QueryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	QueryInfo.queryCount = 2;
+	error = vkCreateQueryPool(Device, &QueryInfo, nullptr, &FrameTimestamps);
+	if (error != VK_SUCCESS)
+		std::exit(-1);
+
+	DynamicResolution = new DynamicResolutionController(Settings);
+	return true;
+}
+
+void Renderer::DeleteDynamicResolution()
+{
+	if (!DynamicResolution)
+		return;
+	if (FrameTimestamps != VK_NULL_HANDLE)
+		vkDestroyQueryPool(Device, FrameTimestamps, nullptr);
+	vkDestroyFramebuffer(Device, SceneFramebuffer, nullptr);
+	vkDestroyImageView(Device, SceneColorView, nullptr);
+	vkDestroyImage(Device, SceneColor, nullptr);
+	FreeMemory(SceneColorMemory);
+	FrameTimestamps = VK_NULL_HANDLE;
+	SceneFramebuffer = VK_NULL_HANDLE;
+	SceneColorView = VK_NULL_HANDLE;
+	SceneColor = VK_NULL_HANDLE;
+	SceneColorMemory = VK_NULL_HANDLE;
+	delete DynamicResolution;
+	DynamicResolution = nullptr;
+}
+
+double Renderer::GetGpuFrameTime() const
+{
+	return LastGpuFrameTime;
+}
+
+void Renderer::FinishFrame()
+{
+	if (LastFrameValue > FinishedFrameValue)
+	{
+		auto WaitStart = std::chrono::high_resolution_clock::now();
+		GraphicsTimeline.Wait(LastFrameValue);
+		LastQueueWaitTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - WaitStart).count();
+		FinishedFrameValue = LastFrameValue;
+
+		// The next frame resets the queries, read them while they still hold this one.
+		LastGpuFrameTime = LastQueueWaitTime * 1000.0;
+		uint64_t Ticks[2];
+		bool Measured = FrameTimestamps != VK_NULL_HANDLE && vkGetQueryPoolResults(Device, FrameTimestamps, 0, 2,
+			sizeof(Ticks), Ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+		if (Measured)
+			LastGpuFrameTime = (Ticks[1] - Ticks[0]) * DeviceProperties.limits.timestampPeriod * 1e-6;
+		// Only measured GPU time steers the scale, a frame without it keeps the last one.
+		if (Measured && FrameUpscaled && DynamicResolution)
+			DynamicResolution->Update(LastGpuFrameTime);
+		if (Meshlets && Meshlets->CountStats)
+			LastTriangleCount = Meshlets->GetStats().Triangles[(int)MeshletCull::Visible];
+	}
+
+	uint64_t Completed = GraphicsTimeline.GetCompleted();
+	DeferredDeletion.Collect(Completed);
+	Bindless.Collect(Completed);
+}
+
+void Renderer::RecordUpscale()
+{
+	VkImageMemoryBarrier Barriers[2] = {};
+	for (auto& Barrier : Barriers)
+	{
+		Barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		Barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		Barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		Barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		Barrier.subresourceRange.levelCount = 1;
+		Barrier.subresourceRange.layerCount = 1;
+	}
+	Barriers[0].image = SceneColor;
+	Barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	Barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	// Nothing was drawn to the swapchain image, its contents do not matter.
+	Barriers[1].image = SwapchainImages[CurrentBuffer];
+	Barriers[1].srcAccessMask = 0;
+	Barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 2, Barriers);
+
+	VkImageBlit Region = {};
+	Region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	Region.srcSubresource.layerCount = 1;
+	Region.srcOffsets[1].x = (int32_t)RenderExtent.width;
+	Region.srcOffsets[1].y = (int32_t)RenderExtent.height;
+	Region.srcOffsets[1].z = 1;
+	Region.dstSubresource = Region.srcSubresource;
+	Region.dstOffsets[1].x = SurfaceSizeX;
+	Region.dstOffsets[1].y = SurfaceSizeY;
+	Region.dstOffsets[1].z = 1;
+	vkCmdBlitImage(CommandBuffer, SceneColor, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		SwapchainImages[CurrentBuffer], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region, UpscaleFilter);
+
+	// Back to where a frame drawn at full size would be, for the readback and present barriers.
+	Barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	Barriers[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	Barriers[1].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, NULL, 0, NULL, 1, &Barriers[1]);
+}
+
 void Renderer::InitVertexBuffer(const void * vertexData, uint32_t dataSize, uint32_t dataStride, bool use_texture)
 {
 	VkBufferCreateInfo buf_info = {};
@@ -1138,7 +1779,7 @@ void Renderer::InitVertexBuffer(const void * vertexData, uint32_t dataSize, uint
 	if (!pass)
 		std::exit(-1);
 
-	res = vkAllocateMemory(Device, &alloc_info, NULL, &VertexBufferMemory);
+	res = AllocateMemory(&alloc_info, MemoryCategory::Vertex, &VertexBufferMemory);
 	if (res != VK_SUCCESS)
 		std::exit(-1);
 
@@ -1175,24 +1816,189 @@ void Renderer::InitVertexBuffer(const void * vertexData, uint32_t dataSize, uint
 void Renderer::DeleteVertexBuffer()
 {
 	vkDestroyBuffer(Device, VertexBuffer, NULL);
-	vkFreeMemory(Device, VertexBufferMemory, NULL);
+	FreeMemory(VertexBufferMemory);
 }
 
+void Renderer::InitHostBuffer(VkBufferUsageFlags Usage, const void* Data, VkDeviceSize Size, MemoryCategory Category,
+	VkBuffer* Buffer, VkDeviceMemory* Memory)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.usage = Usage;
+	buf_info.size = Size;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto res = vkCreateBuffer(Device, &buf_info, NULL, Buffer);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(Device, *Buffer, &mem_reqs);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!memory_type_from_properties(mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&alloc_info.memoryTypeIndex))
+		std::exit(-1);
+
+	res = AllocateMemory(&alloc_info, Category, Memory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	uint8_t *pData;
+	res = vkMapMemory(Device, *Memory, 0, mem_reqs.size, 0, (void **)&pData);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	memcpy(pData, Data, (size_t)Size);
+	vkUnmapMemory(Device, *Memory);
+
+	res = vkBindBufferMemory(Device, *Buffer, *Memory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+void Renderer::InitLodMesh(const Vertex* Vertices, uint32_t VertexCount, const MeshLodChain& Chain)
+{
+	if (MeshIndexBuffer)
+	{
+		DeferredDeletion.RetireBuffer(GraphicsTimeline.GetSubmitted(), MeshVertexBuffer);
+		DeferredDeletion.RetireMemory(GraphicsTimeline.GetSubmitted(), MeshVertexMemory);
+		DeferredDeletion.RetireBuffer(GraphicsTimeline.GetSubmitted(), MeshIndexBuffer);
+		DeferredDeletion.RetireMemory(GraphicsTimeline.GetSubmitted(), MeshIndexMemory);
+	}
+	MeshLods = Chain;
+	InitHostBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, Vertices, sizeof(Vertex) * VertexCount,
+		MemoryCategory::Vertex, &MeshVertexBuffer, &MeshVertexMemory);
+	InitHostBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, Chain.Indices.data(), sizeof(uint32_t) * Chain.Indices.size(),
+		MemoryCategory::Vertex, &MeshIndexBuffer, &MeshIndexMemory);
+}
+
+void Renderer::DeleteLodMesh()
+{
+	if (MeshIndexBuffer == nullptr)
+		return;
+	vkDestroyBuffer(Device, MeshVertexBuffer, NULL);
+	FreeMemory(MeshVertexMemory);
+	vkDestroyBuffer(Device, MeshIndexBuffer, NULL);
+	FreeMemory(MeshIndexMemory);
+	MeshVertexBuffer = nullptr;
+	MeshVertexMemory = nullptr;
+	MeshIndexBuffer = nullptr;
+	MeshIndexMemory = nullptr;
+	MeshLods = MeshLodChain();
+}
+
+bool Renderer::InitMeshlets(const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh, uint32_t MaxObjects,
+	bool Occlusion)
+{
+	if (!MeshletCuller::IsSupported(this))
+	{
+		std::cout << "Multi draw indirect not supported, meshlet culling disabled." << std::endl;
+		return false;
+	}
+	if (Occlusion && !DepthPyramid::IsSupported(this))
+	{
+		std::cout << "Depth buffer can not be sampled, occlusion culling disabled." << std::endl;
+		Occlusion = false;
+	}
+	// The previous mesh's culler retires its buffers, frames in flight may still draw with them.
+	DeleteMeshlets();
+	if (Occlusion)
+		HiZ = new DepthPyramid(this);
+	Meshlets = new MeshletCuller(this, Vertices, VertexCount, Mesh, MaxObjects, HiZ);
+	return true;
+}
+
+void Renderer::DeleteMeshlets()
+{
+	delete Meshlets;
+	Meshlets = nullptr;
+	delete HiZ;
+	HiZ = nullptr;
+}
+
+void Renderer::InitParticles(uint32_t Capacity)
+{
+	// The previous system retires its buffers, frames in flight may still draw with them.
+	DeleteParticles();
+	Particles = new ParticleSystem(this, Capacity);
+}
+
+void Renderer::DeleteParticles()
+{
+	delete Particles;
+	Particles = nullptr;
+}
+
+void Renderer::InitLighting(uint32_t MaxLights)
+{
+	// The previous pipeline and light set are retired, frames in flight may still use them.
+	DeleteLighting();
+	std::string VertSource, FragSource;
+	LoadCubeShaders(VertSource, FragSource);
+	Lighting = new ClusteredLighting(this, MaxLights, VertSource, FragSource);
+	MarkCommandsDirty();
+}
+
+void Renderer::DeleteLighting()
+{
+	if (!Lighting)
+		return;
+	delete Lighting;
+	Lighting = nullptr;
+	MarkCommandsDirty();
+}
+
+void Renderer::InitShadows(uint32_t Resolution, uint32_t Cascades)
+{
+	// The previous maps are retired, frames in flight may still sample them.
+	DeleteShadows();
+	Shadows = new ShadowCascades(this, Resolution, Cascades);
+}
+
+void Renderer::DeleteShadows()
+{
+	delete Shadows;
+	Shadows = nullptr;
+}
+
+MeshletCullView Renderer::GetCullView() const
+{
+	MeshletCullView Cull;
+	Cull.ViewProjection = Projection * View * Model;
+	Cull.Camera = glm::vec3(glm::inverse(View * Model)[3]);
+	Cull.PixelsPerUnit = std::abs(Projection[1][1]) * RenderExtent.height * 0.5f;
+	return Cull;
+}
+
+// Sets from DescriptorPool that can be replaced, the uniform set and ObjectSet.
+static const uint32_t ReplaceableSets = 2;
+
 void Renderer::InitDescriptorPool(bool UseTexture)
 {
-	VkDescriptorPoolSize type_count[2];
+	// Each set in use, and the one it replaced for every frame that may still read it,
+	// waiting in DeferredDeletion.
+	const uint32_t MaxSets = ReplaceableSets * (FramesInFlight + 1);
+	DescriptorPoolSets = MaxSets;
+
+	VkDescriptorPoolSize type_count[3];
 	type_count[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	type_count[0].descriptorCount = 1;
+	type_count[0].descriptorCount = MaxSets;
+	// ObjectSet.
+	type_count[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	type_count[1].descriptorCount = MaxSets;
 	if (UseTexture) {
-		type_count[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		type_count[1].descriptorCount = 1;
+		type_count[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		type_count[2].descriptorCount = MaxSets;
 	}
 
 	VkDescriptorPoolCreateInfo descriptor_pool = {};
 	descriptor_pool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptor_pool.pNext = NULL;
-	descriptor_pool.maxSets = 1;
-	descriptor_pool.poolSizeCount = UseTexture ? 2 : 1;
+	descriptor_pool.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	descriptor_pool.maxSets = MaxSets;
+	descriptor_pool.poolSizeCount = UseTexture ? 3 : 2;
 	descriptor_pool.pPoolSizes = type_count;
 
 	auto res = vkCreateDescriptorPool(Device, &descriptor_pool, NULL, &DescriptorPool);
@@ -1200,6 +2006,17 @@ void Renderer::InitDescriptorPool(bool UseTexture)
 		std::exit(-1);
 }
 
+void Renderer::ReserveDescriptorSet()
+{
+	uint32_t InUse = (uint32_t)DescriptorSet.size() + (ObjectSet ? 1 : 0);
+	if (InUse + DeferredDeletion.GetPendingDescriptorSets(DescriptorPool) < DescriptorPoolSets)
+		return;
+	// Only as long as the oldest retired set is in use, not until the queue is idle.
+	DescriptorPoolStalls++;
+	GraphicsTimeline.Wait(DeferredDeletion.GetOldestDescriptorSetValue(DescriptorPool));
+	DeferredDeletion.Collect(GraphicsTimeline.GetCompleted());
+}
+
 void Renderer::DeleteDescriptorPool()
 {
 	vkDestroyDescriptorPool(Device, DescriptorPool, NULL);
@@ -1245,6 +2062,173 @@ void Renderer::InitDescriptorSet(bool UseTexture)
 	vkUpdateDescriptorSets(Device, UseTexture ? 2 : 1, writes, 0, NULL);
 }
 
+// What DrawCube draws when Draws is empty, the cube where the uniform MVP puts it.
+static DrawData DefaultDraw()
+{
+	DrawData Draw = {};
+	Draw.Model = glm::mat4(1.0f);
+	return Draw;
+}
+
+void Renderer::InitObjectBuffer(uint32_t Count)
+{
+	// The bindless path reads a plain std430 array, dynamic offsets have to be aligned.
+	bool Storage = DrawPath == DrawDataPath::Bindless;
+	assert(!Storage || Bindless.IsEnabled());
+	VkDeviceSize Alignment = Storage ? 1 : DeviceProperties.limits.minUniformBufferOffsetAlignment;
+	ObjectStride = (uint32_t)((sizeof(DrawData) + Alignment - 1) / Alignment * Alignment);
+	ObjectCapacity = Count;
+
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.usage = Storage ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	buf_info.size = (VkDeviceSize)ObjectStride * Count;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto res = vkCreateBuffer(Device, &buf_info, NULL, &ObjectBuffer);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(Device, ObjectBuffer, &mem_reqs);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = mem_reqs.size;
+	if (!memory_type_from_properties(mem_reqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&alloc_info.memoryTypeIndex))
+		std::exit(-1);
+
+	res = AllocateMemory(&alloc_info, MemoryCategory::Uniform, &ObjectMemory);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	res = vkBindBufferMemory(Device, ObjectBuffer, ObjectMemory, 0);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+	res = vkMapMemory(Device, ObjectMemory, 0, VK_WHOLE_SIZE, 0, (void **)&ObjectData);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	if (Storage)
+	{
+		ObjectSlot = Bindless.RegisterBuffer(ObjectBuffer, 0, buf_info.size);
+		if (ObjectSlot == SlotAllocator::InvalidSlot)
+			std::exit(-1);
+		UpdateObjectBuffer();
+		return;
+	}
+
+	VkDescriptorSetAllocateInfo alloc_set = {};
+	alloc_set.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_set.descriptorPool = DescriptorPool;
+	alloc_set.descriptorSetCount = 1;
+	alloc_set.pSetLayouts = &DescriptorSetLayouts[1];
+	res = vkAllocateDescriptorSets(Device, &alloc_set, &ObjectSet);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	// The range is one DrawData, the dynamic offset picks which.
+	VkDescriptorBufferInfo ObjectDescriptor;
+	ObjectDescriptor.buffer = ObjectBuffer;
+	ObjectDescriptor.offset = 0;
+	ObjectDescriptor.range = sizeof(DrawData);
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = ObjectSet;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.pBufferInfo = &ObjectDescriptor;
+	vkUpdateDescriptorSets(Device, 1, &write, 0, NULL);
+
+	UpdateObjectBuffer();
+}
+
+void Renderer::UpdateObjectBuffer()
+{
+	FinishFrame();
+
+	DrawData Default = DefaultDraw();
+	const DrawData* Source = Draws.empty() ? &Default : Draws.data();
+	uint32_t Count = Draws.empty() ? 1 : (uint32_t)Draws.size();
+	assert(Count <= ObjectCapacity);
+
+	ParallelDraws(Count, [&](uint32_t Begin, uint32_t End)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+			memcpy(ObjectData + (size_t)i * ObjectStride, &Source[i], sizeof(DrawData));
+	});
+}
+
+void Renderer::SyncSceneDraws()
+{
+	Scene.Update();
+	assert(DrawNodes.size() == Draws.size());
+	ParallelDraws((uint32_t)DrawNodes.size(), [&](uint32_t Begin, uint32_t End)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+			Draws[i].Model = Scene.GetWorld(DrawNodes[i]);
+	});
+	if (ObjectData)
+		UpdateObjectBuffer();
+}
+
+void Renderer::InitJobs(uint32_t ThreadCount, JobAffinity Affinity)
+{
+	DeleteJobs();
+	Jobs = new JobSystem(ThreadCount, Affinity);
+	Scene.SetJobSystem(Jobs);
+}
+
+void Renderer::DeleteJobs()
+{
+	Scene.SetJobSystem(nullptr);
+	delete Jobs;
+	Jobs = nullptr;
+}
+
+void Renderer::ParallelDraws(uint32_t Count, const std::function<void(uint32_t Begin, uint32_t End)>& Fn)
+{
+	// Below this many draws a chunk costs more to hand out than to run.
+	const uint32_t MinChunk = 1024;
+	if (Jobs)
+		Jobs->ParallelFor(Count, MinChunk, Fn);
+	else if (Count > 0)
+		Fn(0, Count);
+}
+
+void Renderer::DeleteObjectBuffer()
+{
+	if (ObjectBuffer == nullptr)
+		return;
+	// Frames already submitted may still read them.
+	uint64_t Value = GraphicsTimeline.GetSubmitted();
+	if (ObjectSet)
+		DeferredDeletion.RetireDescriptorSet(Value, DescriptorPool, ObjectSet);
+	Bindless.Release(BindlessKind::Buffer, ObjectSlot, Value);
+	vkUnmapMemory(Device, ObjectMemory);
+	DeferredDeletion.RetireBuffer(Value, ObjectBuffer);
+	DeferredDeletion.RetireMemory(Value, ObjectMemory);
+	ObjectSet = nullptr;
+	ObjectSlot = SlotAllocator::InvalidSlot;
+	ObjectBuffer = nullptr;
+	ObjectMemory = nullptr;
+	ObjectData = nullptr;
+	ObjectCapacity = 0;
+}
+
+void Renderer::InitBindless()
+{
+	// Falls back to bound descriptor sets if the table can not be created.
+	Bindless.Init(this, BindlessSlots);
+}
+
+void Renderer::DeleteBindless()
+{
+	Bindless.Destroy();
+}
+
 void Renderer::InitPipelineCache()
 {
 	VkPipelineCacheCreateInfo pipelineCache;
@@ -1261,9 +2245,11 @@ void Renderer::DeletePipelineCache()
 	vkDestroyPipelineCache(Device, PipelineCache, NULL);
 }
 
-void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
+VkPipeline Renderer::CreateGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi, const VkPipelineShaderStageCreateInfo* Stages,
+	VkPipelineLayout Layout, const VkPipelineColorBlendAttachmentState* Blend, const DepthOnlyState* DepthOnly)
 {
-	VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
+	// Viewport and scissor are the only dynamic states we use.
+	VkDynamicState dynamicStateEnables[2];
 	VkPipelineDynamicStateCreateInfo dynamicState = {};
 	memset(dynamicStateEnables, 0, sizeof dynamicStateEnables);
 	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
@@ -1297,12 +2283,12 @@ void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
 	rs.polygonMode = VK_POLYGON_MODE_FILL;
 	rs.cullMode = VK_CULL_MODE_BACK_BIT;
 	rs.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rs.depthClampEnable = include_depth;
+	rs.depthClampEnable = DepthOnly && DepthOnly->DepthClamp && EnabledFeatures.depthClamp;
 	rs.rasterizerDiscardEnable = VK_FALSE;
-	rs.depthBiasEnable = VK_FALSE;
-	rs.depthBiasConstantFactor = 0;
+	rs.depthBiasEnable = DepthOnly ? VK_TRUE : VK_FALSE;
+	rs.depthBiasConstantFactor = DepthOnly ? DepthOnly->BiasConstant : 0;
 	rs.depthBiasClamp = 0;
-	rs.depthBiasSlopeFactor = 0;
+	rs.depthBiasSlopeFactor = DepthOnly ? DepthOnly->BiasSlope : 0;
 	rs.lineWidth = 1.0f;
 
 	VkPipelineColorBlendStateCreateInfo cb;
@@ -1319,8 +2305,8 @@ void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
 	att_state[0].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
 	att_state[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 	att_state[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	cb.attachmentCount = 1;
-	cb.pAttachments = att_state;
+	cb.attachmentCount = DepthOnly ? 0 : 1;
+	cb.pAttachments = Blend ? Blend : att_state;
 	cb.logicOpEnable = VK_FALSE;
 	cb.logicOp = VK_LOGIC_OP_NO_OP;
 	cb.blendConstants[0] = 1.0f;
@@ -1377,7 +2363,7 @@ void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
 	VkGraphicsPipelineCreateInfo pipeline;
 	pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipeline.pNext = NULL;
-	pipeline.layout = PipelineLayout;
+	pipeline.layout = Layout ? Layout : PipelineLayout;
 	pipeline.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline.basePipelineIndex = 0;
 	pipeline.flags = 0;
@@ -1390,15 +2376,23 @@ void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
 	pipeline.pDynamicState = &dynamicState;
 	pipeline.pViewportState = &vp;
 	pipeline.pDepthStencilState = &ds;
-	pipeline.pStages = ShaderStages;
-	pipeline.stageCount = 2;
-	pipeline.renderPass = RenderPass;
+	pipeline.pStages = Stages ? Stages : ShaderStages;
+	pipeline.stageCount = DepthOnly ? 1 : 2;
+	pipeline.renderPass = DepthOnly ? DepthOnly->RenderPass : RenderPass;
 	pipeline.subpass = 0;
 
-	auto res = vkCreateGraphicsPipelines(Device, PipelineCache, 1, &pipeline, NULL, &GraphicsPipeline);
+	VkPipeline Pipeline;
+	auto res = vkCreateGraphicsPipelines(Device, PipelineCache, 1, &pipeline, NULL, &Pipeline);
 
 	if (res != VK_SUCCESS)
 		std::exit(-1);
+
+	return Pipeline;
+}
+
+void Renderer::InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
+{
+	GraphicsPipeline = CreateGraphicsPipeline(include_depth, include_vi);
 }
 
 void Renderer::DeleteGraphcisPipeline()
@@ -1406,8 +2400,117 @@ void Renderer::DeleteGraphcisPipeline()
 	vkDestroyPipeline(Device, GraphicsPipeline, NULL);
 }
 
+void Renderer::InitOverdraw(bool DepthTest)
+{
+	DeleteOverdraw();
+
+	std::string VertSource, FragSource;
+	LoadCubeShaders(VertSource, FragSource);
+	std::string Preamble = "#define DRAW_DATA " + std::to_string((int)DrawPath) + "\n";
+
+	std::vector<unsigned int> Spirv;
+	if (GLSLtoSPV(VK_SHADER_STAGE_VERTEX_BIT, VertSource.c_str(), Spirv, Preamble.c_str()))
+		OverdrawModules[0] = CreateShaderModule(Spirv);
+	Spirv.clear();
+	if (GLSLtoSPV(VK_SHADER_STAGE_FRAGMENT_BIT, overdrawFragShaderText, Spirv))
+		OverdrawModules[1] = CreateShaderModule(Spirv);
+	if (!OverdrawModules[0] || !OverdrawModules[1])
+		std::exit(-1);
+
+	VkPipelineShaderStageCreateInfo Stages[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		Stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		Stages[i].stage = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		Stages[i].module = OverdrawModules[i];
+		Stages[i].pName = "main";
+	}
+
+	VkPipelineColorBlendAttachmentState Blend = {};
+	Blend.colorWriteMask = 0xf;
+	Blend.blendEnable = VK_TRUE;
+	Blend.colorBlendOp = VK_BLEND_OP_ADD;
+	Blend.alphaBlendOp = VK_BLEND_OP_ADD;
+	Blend.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	Blend.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	Blend.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	Blend.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	OverdrawPipeline = CreateGraphicsPipeline(DepthTest ? VK_TRUE : VK_FALSE, VK_TRUE, Stages, VK_NULL_HANDLE, &Blend);
+
+	if (ShaderReload)
+	{
+		ShaderReloadTarget Target;
+		Target.Preambles[0] = Preamble;
+		Target.FragSource = overdrawFragShaderText;
+		Target.IncludeDepth = DepthTest ? VK_TRUE : VK_FALSE;
+		Target.Blended = true;
+		Target.Blend = Blend;
+		Target.Pipeline = &OverdrawPipeline;
+		Target.Modules[0] = &OverdrawModules[0];
+		Target.Modules[1] = &OverdrawModules[1];
+		OverdrawReloadTarget = ShaderReload->AddTarget(Target);
+	}
+}
+
+void Renderer::DeleteOverdraw()
+{
+	if (!OverdrawPipeline)
+		return;
+	if (ShaderReload)
+		ShaderReload->RemoveTarget(OverdrawReloadTarget);
+	OverdrawReloadTarget = UINT32_MAX;
+	// The frame in flight may still draw with them.
+	uint64_t Value = GraphicsTimeline.GetSubmitted();
+	DeferredDeletion.RetirePipeline(Value, OverdrawPipeline);
+	DeferredDeletion.RetireShaderModule(Value, OverdrawModules[0]);
+	DeferredDeletion.RetireShaderModule(Value, OverdrawModules[1]);
+	OverdrawPipeline = nullptr;
+	OverdrawModules[0] = OverdrawModules[1] = VK_NULL_HANDLE;
+}
+
+void Renderer::InitScenePipelines(uint32_t Count)
+{
+	// Same state as GraphicsPipeline, but each one is its own object so
+	// binding them costs a real pipeline switch.
+	for (uint32_t i = 0; i < Count; i++)
+		ScenePipelines.push_back(CreateGraphicsPipeline(true, true));
+}
+
+void Renderer::DeleteScenePipelines()
+{
+	for (auto Pipeline : ScenePipelines)
+		vkDestroyPipeline(Device, Pipeline, NULL);
+	ScenePipelines.clear();
+}
+
+void Renderer::ReplaceVertexBuffer(const void * vertexData, uint32_t dataSize, uint32_t dataStride, bool use_texture)
+{
+	DeferredDeletion.RetireBuffer(GraphicsTimeline.GetSubmitted(), VertexBuffer);
+	DeferredDeletion.RetireMemory(GraphicsTimeline.GetSubmitted(), VertexBufferMemory);
+	InitVertexBuffer(vertexData, dataSize, dataStride, use_texture);
+}
+
+void Renderer::ReplaceUniformBuffer()
+{
+	// The set below comes from DescriptorPool while the old one still waits.
+	ReserveDescriptorSet();
+	DeferredDeletion.RetireBuffer(GraphicsTimeline.GetSubmitted(), UniformBuffer);
+	DeferredDeletion.RetireMemory(GraphicsTimeline.GetSubmitted(), UniformMemory);
+	InitUniformBuffer();
+
+	// The set points at the old buffer, so it needs replacing too.
+	DeferredDeletion.RetireDescriptorSet(GraphicsTimeline.GetSubmitted(), DescriptorPool, DescriptorSet[0]);
+	InitDescriptorSet(false);
+}
+
+void Renderer::ReplaceGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi)
+{
+	DeferredDeletion.RetirePipeline(GraphicsTimeline.GetSubmitted(), GraphicsPipeline);
+	InitGraphicsPipeline(include_depth, include_vi);
+}
+
 bool Renderer::GLSLtoSPV(const VkShaderStageFlagBits shader_type, const char *pshader,
-	std::vector<unsigned int> &spirv) {
+	std::vector<unsigned int> &spirv, const char *Preamble, bool Vulkan11) {
 
 	EShLanguage stage = FindLanguage(shader_type);
 	glslang::TShader shader(stage);
@@ -1421,6 +2524,14 @@ bool Renderer::GLSLtoSPV(const VkShaderStageFlagBits shader_type, const char *ps
 
 	shaderStrings[0] = pshader;
 	shader.setStrings(shaderStrings, 1);
+	if (Preamble)
+		shader.setPreamble(Preamble);
+	if (Vulkan11)
+	{
+		shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+		shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
+		shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
+	}
 
 	if (!shader.parse(&Resources, 100, false, messages)) {
 		puts(shader.getInfoLog());
@@ -1569,56 +2680,267 @@ void Renderer::init_resources(TBuiltInResource &Resources)
 
 void Renderer::DrawCube()
 {
-	vkDeviceWaitIdle(Device);
+	// The command buffer and uniforms are shared, the previous frame has to be done.
+	FinishFrame();
+
+	// Cheap enough to do once a frame, fires the pressure callbacks if a heap filled up.
+	GpuMemory.UpdateBudget();
 
-	InitSemaphore();
+	// Frame boundary, swap in pipelines rebuilt from changed shader files.
+	if (ShaderReload)
+		ShaderReload->ApplyPending();
 
+	// Picked before LOD selection, which looks at the size of a pixel.
+	bool Upscale = DynamicResolution && !(Meshlets && Meshlets->IsOccluding());
+	RenderExtent.width = SurfaceSizeX;
+	RenderExtent.height = SurfaceSizeY;
+	if (Upscale)
+	{
+		// Multiples of 8 pixels, so small scale changes do not move the image every frame.
+		float Scale = DynamicResolution->GetScale();
+		RenderExtent.width = std::min(std::max(((uint32_t)(SurfaceSizeX * Scale) + 4) & ~7u, 8u), (uint32_t)SurfaceSizeX);
+		RenderExtent.height = std::min(std::max(((uint32_t)(SurfaceSizeY * Scale) + 4) & ~7u, 8u), (uint32_t)SurfaceSizeY);
+	}
+
+	if (!DrawNodes.empty())
+		SyncSceneDraws();
+	// Camera and render size are final, the recorded binning reads them from here.
+	if (Lighting)
+		Lighting->Update();
+	// Packets only know the cube.
+	bool DrawMesh = MeshIndexBuffer && Packets.IsEmpty() && !Meshlets;
+	if (DrawMesh)
+		SelectLods();
+	LastTriangleCount = 0;
+
+	// Overdraw counts start at 0.
+	float Clear = OverdrawPipeline ? 0.0f : 0.2f;
 	VkClearValue clear_values[2];
-	clear_values[0].color.float32[0] = 0.2f;
-	clear_values[0].color.float32[1] = 0.2f;
-	clear_values[0].color.float32[2] = 0.2f;
-	clear_values[0].color.float32[3] = 0.2f;
+	clear_values[0].color.float32[0] = Clear;
+	clear_values[0].color.float32[1] = Clear;
+	clear_values[0].color.float32[2] = Clear;
+	clear_values[0].color.float32[3] = Clear;
 	clear_values[1].depthStencil.depth = 1.0f;
 	clear_values[1].depthStencil.stencil = 0;
 
 	
-	// Get the index of the next available swapchain image:
-	auto res = vkAcquireNextImageKHR(Device, Swapchain, UINT64_MAX,
-		presentCompleteSemaphore, VK_NULL_HANDLE,
-		&CurrentBuffer);
+	VkResult res;
+	if (Headless)
+	{
+		// No swapchain, just cycle through the offscreen images.
+		CurrentBuffer = (CurrentBuffer + 1) % SwapchainImageCount;
+	}
+	else
+	{
+		// Get the index of the next available swapchain image:
+		AcquireIndex = (AcquireIndex + 1) % (uint32_t)AcquireSemaphores.size();
+		res = vkAcquireNextImageKHR(Device, Swapchain, UINT64_MAX,
+			AcquireSemaphores[AcquireIndex], VK_NULL_HANDLE,
+			&CurrentBuffer);
+	}
+
+	auto RecordStart = std::chrono::high_resolution_clock::now();
+	VkCommandBuffer FrameCommands = CommandBuffer;
+	// Readback copies into a different slot every frame and meshlet culling, particles,
+	// shadows and packets record per frame data, those frames are always recorded.
+	if (!CommandCache.empty() && !Meshlets && !Particles && !Shadows && Packets.IsEmpty() && !Readback)
+	{
+		CachedCommands& Cached = CommandCache[CurrentBuffer];
+		CachedCommands Current = GetCommandState(Upscale, DrawMesh, Clear);
+		if (!CommandsMatch(Cached, Current))
+		{
+			std::swap(CommandBuffer, Cached.Buffer);
+			RecordFrame(Upscale, DrawMesh, clear_values);
+			std::swap(CommandBuffer, Cached.Buffer);
+			Current.Buffer = Cached.Buffer;
+			Current.ScenePipelines = ScenePipelines;
+			Current.Lods = DrawLods;
+			if (DrawPath == DrawDataPath::PushConstants)
+				Current.Pushed = Draws;
+			Current.Triangles = LastTriangleCount;
+			Cached = std::move(Current);
+			CommandCacheRecords++;
+		}
+		LastTriangleCount = Cached.Triangles;
+		FrameCommands = Cached.Buffer;
+	}
+	else
+	{
+		RecordFrame(Upscale, DrawMesh, clear_values);
+	}
+	LastRecordTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - RecordStart).count();
+
+	TimelineWait AcquireWait;
+	AcquireWait.Binary = Headless ? VK_NULL_HANDLE : AcquireSemaphores[AcquireIndex];
+	uint64_t FrameValue = GraphicsTimeline.Submit(&FrameCommands, 1, &AcquireWait, Headless ? 0 : 1,
+		Headless ? VK_NULL_HANDLE : PresentSemaphores[CurrentBuffer]);
+	if (Readback)
+		Readback->Submitted(FrameValue);
+	// Not waited for here, the next FinishFrame does.
+	LastFrameValue = FrameValue;
+	FrameUpscaled = Upscale;
+
+	// Free what was replaced before the frames that already finished.
+	uint64_t Completed = GraphicsTimeline.GetCompleted();
+	DeferredDeletion.Collect(Completed);
+	Bindless.Collect(Completed);
+
+	if (Headless)
+		return;
+
+	VkPresentInfoKHR present;
+	present.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present.pNext = NULL;
+	present.swapchainCount = 1;
+	present.pSwapchains = &Swapchain;
+	present.pImageIndices = &CurrentBuffer;
+	present.pWaitSemaphores = &PresentSemaphores[CurrentBuffer];
+	present.waitSemaphoreCount = 1;
+	present.pResults = NULL;
+
+	res = vkQueuePresentKHR(Queue, &present);
+
+	glfwPollEvents();
+}
+
+void Renderer::InitCommandCache()
+{
+	DeleteCommandCache();
+	CommandCache.resize(SwapchainImageCount);
+	for (auto& Cached : CommandCache)
+	{
+		VkCommandBufferAllocateInfo CmdBufferInfo = {};
+		CmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		CmdBufferInfo.commandPool = CommandPool;
+		CmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		CmdBufferInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(Device, &CmdBufferInfo, &Cached.Buffer) != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+void Renderer::DeleteCommandCache()
+{
+	for (auto& Cached : CommandCache)
+		vkFreeCommandBuffers(Device, CommandPool, 1, &Cached.Buffer);
+	CommandCache.clear();
+}
+
+void Renderer::MarkCommandsDirty()
+{
+	for (auto& Cached : CommandCache)
+		Cached.Valid = false;
+}
+
+CachedCommands Renderer::GetCommandState(bool Upscale, bool DrawMesh, float Clear) const
+{
+	CachedCommands State;
+	State.Valid = true;
+	State.Framebuffer = Upscale ? SceneFramebuffer : framebuffers[CurrentBuffer];
+	State.Extent = RenderExtent;
+	State.Upscale = Upscale;
+	State.Pipeline = OverdrawPipeline ? OverdrawPipeline : Lighting ? Lighting->GetPipeline() :
+		PermutationPipeline ? PermutationPipeline : GraphicsPipeline;
+	State.VertexBuffer = DrawMesh ? MeshVertexBuffer : VertexBuffer;
+	State.IndexBuffer = DrawMesh ? MeshIndexBuffer : VK_NULL_HANDLE;
+	State.Set = DescriptorSet[0];
+	State.ObjectSet = ObjectSet;
+	State.ObjectSlot = ObjectSlot;
+	State.Path = DrawPath;
+	State.InstanceCount = InstanceCount;
+	State.DrawCount = (uint32_t)Draws.size();
+	State.Clear = Clear;
+	State.Timestamps = FrameTimestamps != VK_NULL_HANDLE;
+	return State;
+}
+
+bool Renderer::CommandsMatch(const CachedCommands& Cached, const CachedCommands& Current) const
+{
+	if (!Cached.Valid || Cached.Framebuffer != Current.Framebuffer || Cached.Extent.width != Current.Extent.width ||
+		Cached.Extent.height != Current.Extent.height || Cached.Upscale != Current.Upscale ||
+		Cached.Pipeline != Current.Pipeline || Cached.VertexBuffer != Current.VertexBuffer ||
+		Cached.IndexBuffer != Current.IndexBuffer || Cached.Set != Current.Set ||
+		Cached.ObjectSet != Current.ObjectSet || Cached.ObjectSlot != Current.ObjectSlot ||
+		Cached.Path != Current.Path || Cached.InstanceCount != Current.InstanceCount ||
+		Cached.DrawCount != Current.DrawCount || Cached.Clear != Current.Clear ||
+		Cached.Timestamps != Current.Timestamps)
+		return false;
+	if (Cached.ScenePipelines != ScenePipelines || Cached.Lods != DrawLods)
+		return false;
+	// Push constants are the only draw data recorded into the commands.
+	return DrawPath != DrawDataPath::PushConstants || Draws.empty() ||
+		memcmp(Cached.Pushed.data(), Draws.data(), Draws.size() * sizeof(DrawData)) == 0;
+}
 
+void Renderer::RecordFrame(bool Upscale, bool DrawMesh, const VkClearValue* ClearValues)
+{
 	BeginCommandBuffer();
+	if (FrameTimestamps != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(CommandBuffer, FrameTimestamps, 0, 2);
+		vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, FrameTimestamps, 0);
+	}
 
 	set_image_layout(SwapchainImages[CurrentBuffer],
 		VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
 		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (Upscale)
+	{
+		set_image_layout(SceneColor, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+
+	// Compute has to run outside the render pass.
+	if (Meshlets)
+	{
+		DrawData Default = DefaultDraw();
+		Meshlets->RecordCull(CommandBuffer, Draws.empty() ? &Default : Draws.data(),
+			Draws.empty() ? 1 : (uint32_t)Draws.size(), GetCullView());
+	}
+	if (Particles)
+		Particles->RecordUpdate(CommandBuffer);
+	if (Lighting)
+		Lighting->RecordBinning(CommandBuffer);
+	if (Shadows)
+		Shadows->RecordShadows(CommandBuffer);
 
 	VkRenderPassBeginInfo rp_begin;
 	rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	rp_begin.pNext = NULL;
 	rp_begin.renderPass = RenderPass;
-	rp_begin.framebuffer = framebuffers[CurrentBuffer];
+	rp_begin.framebuffer = Upscale ? SceneFramebuffer : framebuffers[CurrentBuffer];
 	rp_begin.renderArea.offset.x = 0;
 	rp_begin.renderArea.offset.y = 0;
-	rp_begin.renderArea.extent.width = SurfaceSizeX;
-	rp_begin.renderArea.extent.height = SurfaceSizeY;
+	rp_begin.renderArea.extent = RenderExtent;
 	rp_begin.clearValueCount = 2;
-	rp_begin.pClearValues = clear_values;
+	rp_begin.pClearValues = ClearValues;
 
 
 	vkCmdBeginRenderPass(CommandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
+	// All our pipelines share PipelineLayout, so the set stays bound across pipeline switches.
 	vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		PipelineLayout, 0, 1,
 		DescriptorSet.data(), 0, NULL);
+	if (Bindless.IsEnabled())
+		Bindless.Bind(CommandBuffer, PipelineLayout, 2);
+	if (Lighting)
+		Lighting->BindSet(CommandBuffer);
 
 	const VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffer, offsets);
+	if (DrawMesh)
+	{
+		vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &MeshVertexBuffer, offsets);
+		vkCmdBindIndexBuffer(CommandBuffer, MeshIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+	else
+	{
+		vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffer, offsets);
+	}
 
 	VkViewport Viewport;
-	Viewport.height = (float)SurfaceSizeX;
-	Viewport.width = (float)SurfaceSizeY;
+	Viewport.height = (float)RenderExtent.height;
+	Viewport.width = (float)RenderExtent.width;
 	Viewport.minDepth = (float)0.0f;
 	Viewport.maxDepth = (float)1.0f;
 	Viewport.x = 0;
@@ -1626,23 +2948,75 @@ void Renderer::DrawCube()
 	vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
 
 	VkRect2D Scissor;
-	Scissor.extent.width = SurfaceSizeX;
-	Scissor.extent.height = SurfaceSizeY;
+	Scissor.extent = RenderExtent;
 	Scissor.offset.x = 0;
 	Scissor.offset.y = 0;
 	vkCmdSetScissor(CommandBuffer, 0, 1, &Scissor);
 
-	vkCmdDraw(CommandBuffer, 12 * 3, 1, 0, 0);
+	if (Meshlets)
+	{
+		Meshlets->RecordDraw(CommandBuffer);
+	}
+	else if (!Packets.IsEmpty())
+	{
+		// Packets carry their DrawData through push constants.
+		assert(DrawPath == DrawDataPath::PushConstants);
+		Packets.Record(CommandBuffer, PipelineLayout, PacketTables, Draws.data(),
+			12 * 3, InstanceCount, SkipRedundantBinds);
+	}
+	else if (ScenePipelines.empty())
+	{
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, OverdrawPipeline ? OverdrawPipeline :
+			Lighting ? Lighting->GetPipeline() : PermutationPipeline ? PermutationPipeline : GraphicsPipeline);
+		RecordDraws();
+	}
+	else
+	{
+		for (auto Pipeline : ScenePipelines)
+		{
+			vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, OverdrawPipeline ? OverdrawPipeline :
+				Lighting ? Lighting->GetPipeline() : Pipeline);
+			RecordDraws();
+		}
+	}
+
+	// Particles go last, and stay out of the depth the occlusion test uses.
+	bool Occluding = Meshlets && Meshlets->IsOccluding();
+	if (Particles && !Occluding)
+		Particles->RecordDraw(CommandBuffer);
 
 	vkCmdEndRenderPass(CommandBuffer);
 
+	// Occlusion culling's second phase, against the depth of what was drawn so far.
+	if (Occluding)
+	{
+		HiZ->RecordBuild(CommandBuffer);
+		Meshlets->RecordLateCull(CommandBuffer);
+		rp_begin.renderPass = ResumeRenderPass;
+		vkCmdBeginRenderPass(CommandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+		Meshlets->RecordLateDraw(CommandBuffer);
+		if (Particles)
+			Particles->RecordDraw(CommandBuffer);
+		vkCmdEndRenderPass(CommandBuffer);
+	}
+
+	if (Upscale)
+		RecordUpscale();
+	if (FrameTimestamps != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, FrameTimestamps, 1);
+
+	// The readback copy moves the image to TRANSFER_SRC.
+	if (Readback)
+		Readback->RecordCopy(CommandBuffer, SwapchainImages[CurrentBuffer]);
+
 	VkImageMemoryBarrier prePresentBarrier = {};
 	prePresentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	prePresentBarrier.pNext = NULL;
-	prePresentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	prePresentBarrier.srcAccessMask = Readback ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	prePresentBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	prePresentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	prePresentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	prePresentBarrier.oldLayout = Readback ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	// Offscreen images are left ready to be copied out.
+	prePresentBarrier.newLayout = Headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 	prePresentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	prePresentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	prePresentBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1656,74 +3030,131 @@ void Renderer::DrawCube()
 		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0,
 		NULL, 1, &prePresentBarrier);
 
-	res = vkEndCommandBuffer(CommandBuffer);
-
+	VkResult res = vkEndCommandBuffer(CommandBuffer);
 	if (res != VK_SUCCESS)
 		std::exit(-1);
+}
 
-	const VkCommandBuffer cmd_bufs[] = { CommandBuffer };
-
-	VkPipelineStageFlags pipe_stage_flags =
-		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	VkSubmitInfo submit_info[1] = {};
-	submit_info[0].pNext = NULL;
-	submit_info[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info[0].waitSemaphoreCount = 1;
-	submit_info[0].pWaitSemaphores = &presentCompleteSemaphore;
-	submit_info[0].pWaitDstStageMask = &pipe_stage_flags;
-	submit_info[0].commandBufferCount = 1;
-	submit_info[0].pCommandBuffers = cmd_bufs;
-	submit_info[0].signalSemaphoreCount = 0;
-	submit_info[0].pSignalSemaphores = NULL;
-
-	res = vkQueueSubmit(Queue, 1, submit_info, nullptr);
-	if (res != VK_SUCCESS)
-		std::exit(-1);
-	vkQueueWaitIdle(Queue);
-
-	VkPresentInfoKHR present;
-	present.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	present.pNext = NULL;
-	present.swapchainCount = 1;
-	present.pSwapchains = &Swapchain;
-	present.pImageIndices = &CurrentBuffer;
-	present.pWaitSemaphores = NULL;
-	present.waitSemaphoreCount = 0;
-	present.pResults = NULL;
+void Renderer::RecordDraws()
+{
+	DrawData Default = DefaultDraw();
+	const DrawData* Source = Draws.empty() ? &Default : Draws.data();
+	uint32_t Count = Draws.empty() ? 1 : (uint32_t)Draws.size();
 
-	//vkQueueWaitIdle(Queue);
+	if (DrawPath == DrawDataPath::PushConstants)
+	{
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			vkCmdPushConstants(CommandBuffer, PipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DrawData), &Source[i]);
+			RecordGeometry(i);
+		}
+	}
+	else if (DrawPath == DrawDataPath::Bindless)
+	{
+		// The table is already bound, only the index of the draw changes.
+		assert(ObjectSlot != SlotAllocator::InvalidSlot && Count <= ObjectCapacity);
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			uint32_t Ref[2] = { ObjectSlot, i };
+			vkCmdPushConstants(CommandBuffer, PipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Ref), Ref);
+			RecordGeometry(i);
+		}
+	}
+	else
+	{
+		// Needs InitObjectBuffer and a pipeline built with DRAW_DATA=1.
+		assert(ObjectSet != nullptr && Count <= ObjectCapacity);
+		// PipelineLayout has no light set, binding with it would disturb that one.
+		VkPipelineLayout Layout = Lighting ? Lighting->GetLayout() : PipelineLayout;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			uint32_t Offset = i * ObjectStride;
+			vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				Layout, 1, 1, &ObjectSet, 1, &Offset);
+			RecordGeometry(i);
+		}
+	}
+}
 
-	res = vkQueuePresentKHR(Queue, &present);
+void Renderer::SelectLods()
+{
+	uint32_t Count = Draws.empty() ? 1 : (uint32_t)Draws.size();
+	DrawLods.assign(Count, 0);
+	if (!UseLods)
+		return;
 
-	DeleteSemaphore();
+	DrawData Default = DefaultDraw();
+	const DrawData* Source = Draws.empty() ? &Default : Draws.data();
+	float PixelsPerUnit = std::abs(Projection[1][1]) * RenderExtent.height * 0.5f;
+	glm::mat4 ModelView = View * Model;
+	glm::vec4 Center(MeshLods.Center[0], MeshLods.Center[1], MeshLods.Center[2], 1.0f);
+	ParallelDraws(Count, [&](uint32_t Begin, uint32_t End)
+	{
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			glm::mat4 ToView = ModelView * Source[i].Model;
+			// The largest axis scale bounds how much the error and the radius grow.
+			float Scale = std::sqrt(std::max(glm::dot(glm::vec3(ToView[0]), glm::vec3(ToView[0])),
+				std::max(glm::dot(glm::vec3(ToView[1]), glm::vec3(ToView[1])), glm::dot(glm::vec3(ToView[2]), glm::vec3(ToView[2])))));
+			float Distance = glm::length(glm::vec3(ToView * Center)) - MeshLods.Radius * Scale;
+			DrawLods[i] = SelectMeshLod(MeshLods, Scale, Distance, PixelsPerUnit, LodErrorPixels);
+		}
+	});
+}
 
-	glfwPollEvents();
+void Renderer::RecordGeometry(uint32_t DrawIndex)
+{
+	if (MeshIndexBuffer == nullptr)
+	{
+		vkCmdDraw(CommandBuffer, 12 * 3, InstanceCount, 0, 0);
+		LastTriangleCount += 12 * InstanceCount;
+		return;
+	}
+	const MeshLodLevel& Level = MeshLods.Levels[DrawLods[DrawIndex]];
+	vkCmdDrawIndexed(CommandBuffer, Level.IndexCount, InstanceCount, Level.FirstIndex, 0, 0);
+	LastTriangleCount += (uint64_t)Level.IndexCount / 3 * InstanceCount;
 }
 
-void Renderer::CreateFence()
+void Renderer::InitReadback(uint32_t SlotCount, ReadbackCallback Callback)
 {
-	VkFenceCreateInfo fenceInfo;
+	if (!Headless && !(SurfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+	{
+		std::cout << "Swapchain images can not be copied from, readback disabled.\n";
+		return;
+	}
+	Readback = new FrameReadback(this, SlotCount, Callback);
+}
 
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.pNext = NULL;
-	fenceInfo.flags = 0;
-	vkCreateFence(Device, &fenceInfo, NULL, &drawFence);
+void Renderer::DeleteReadback()
+{
+	// Waits for the consumer to finish the frames still in the ring.
+	delete Readback;
+	Readback = nullptr;
 }
 
 void Renderer::InitSemaphore()
 {
-	VkSemaphoreCreateInfo presentCompleteSemaphoreCreateInfo;
-	presentCompleteSemaphoreCreateInfo.sType =
-		VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	presentCompleteSemaphoreCreateInfo.pNext = NULL;
-	presentCompleteSemaphoreCreateInfo.flags = 0;
-
-	auto res = vkCreateSemaphore(Device, &presentCompleteSemaphoreCreateInfo,
-		NULL, &presentCompleteSemaphore);
-	assert(res == VK_SUCCESS);
+	VkSemaphoreCreateInfo SemaphoreInfo = {};
+	SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	// One per image each, an acquire semaphore is free again once its frame finished.
+	AcquireSemaphores.resize(SwapchainImageCount);
+	PresentSemaphores.resize(SwapchainImageCount);
+	for (uint32_t i = 0; i < SwapchainImageCount; i++)
+	{
+		if (vkCreateSemaphore(Device, &SemaphoreInfo, NULL, &AcquireSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(Device, &SemaphoreInfo, NULL, &PresentSemaphores[i]) != VK_SUCCESS)
+			std::exit(-1);
+	}
 }
 
 void Renderer::DeleteSemaphore()
 {
-	vkDestroySemaphore(Device, presentCompleteSemaphore, NULL);
+	for (auto Semaphore : AcquireSemaphores)
+		vkDestroySemaphore(Device, Semaphore, NULL);
+	for (auto Semaphore : PresentSemaphores)
+		vkDestroySemaphore(Device, Semaphore, NULL);
+	AcquireSemaphores.clear();
+	PresentSemaphores.clear();
 }
@@ -1,20 +1,112 @@
 #pragma once
 
-#include <vulkan\vulkan.h>
+#include "VulkanDispatch.h"
 #include <vector>
 #include <cstdlib>
-#include <GLFW\glfw3.h>
-#include "SPIRV\GlslangToSpv.h"
+#include <GLFW/glfw3.h>
+#include <glm.hpp>
+#include "SPIRV/GlslangToSpv.h"
 #include "Cube.h"
+#include "FrameReadback.h"
+#include "MemoryTracker.h"
+#include "DeletionQueue.h"
+#include "QueueTimeline.h"
+#include "ShaderReloader.h"
+#include "ShaderPermutations.h"
+#include "BindlessTable.h"
+#include "DrawPackets.h"
+#include "TransformKernels.h"
+#include "SceneHierarchy.h"
+#include "JobSystem.h"
+#include "MeshLod.h"
+#include "MeshletCuller.h"
+#include "DepthPyramid.h"
+#include "ParticleSystem.h"
+#include "ClusteredLighting.h"
+#include "ShadowCascades.h"
+#include "DynamicResolution.h"
 #ifndef NOMINMAX
 #define NOMINMAX /* Don't let Windows define min() or max() */
 #endif
+
+// Layout of the vertex shader uniform block.
+struct UniformData
+{
+	glm::mat4 MVP;
+	// x = instances per grid row, y = grid spacing, z = instance scale.
+	glm::vec4 InstanceGrid;
+};
+
+// Per draw data, matches DrawData in the shaders. Goes through push constants, or
+// through ObjectBuffer on the descriptor path. 80 bytes, every device takes 128.
+struct DrawData
+{
+	glm::mat4 Model;
+	uint32_t ObjectId;
+	uint32_t MaterialIndex;
+	uint32_t Pad[2];
+};
+
+// Turns CreateGraphicsPipeline's state into a depth only one, for passes without color
+// attachments: only the vertex stage, no color blending, and a depth bias.
+struct DepthOnlyState
+{
+	VkRenderPass RenderPass = VK_NULL_HANDLE;
+	// In depth units and per unit of slope.
+	float BiasConstant = 0.0f;
+	float BiasSlope = 0.0f;
+	// Clamp depth instead of clipping it, when the device can. Every other pipeline clips.
+	bool DepthClamp = false;
+};
+
+enum class DrawDataPath
+{
+	PushConstants,
+	// One dynamic uniform buffer offset per draw, set 1 rebound between draws.
+	Descriptors,
+	// ObjectBuffer lives in the bindless table, bound once, draws only push their index.
+	Bindless
+};
+
+// A frame DrawCube recorded for one swapchain image and what went into its commands.
+struct CachedCommands
+{
+	VkCommandBuffer Buffer = VK_NULL_HANDLE;
+	// False until recorded and after MarkCommandsDirty.
+	bool Valid = false;
+	VkFramebuffer Framebuffer = VK_NULL_HANDLE;
+	VkExtent2D Extent = {};
+	bool Upscale = false;
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	std::vector<VkPipeline> ScenePipelines;
+	VkBuffer VertexBuffer = VK_NULL_HANDLE;
+	VkBuffer IndexBuffer = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+	VkDescriptorSet ObjectSet = VK_NULL_HANDLE;
+	uint32_t ObjectSlot = 0;
+	DrawDataPath Path = DrawDataPath::PushConstants;
+	uint32_t InstanceCount = 0;
+	uint32_t DrawCount = 0;
+	float Clear = 0.0f;
+	bool Timestamps = false;
+	std::vector<uint32_t> Lods;
+	// Draws as they were pushed, only on the push constant path.
+	std::vector<DrawData> Pushed;
+	uint64_t Triangles = 0;
+};
+
 class Renderer
 {
 public:
+	// Windowed renderer with shader reloading. The caller drives DrawCube(), Main.cpp
+	// through a FramePipeline until the window closes.
 	Renderer();
+	// Headless renderer, draws into offscreen images instead of a swapchain.
+	Renderer(int Width, int Height);
 	~Renderer();
 
+	void InitRenderer();
+
 	void InitInstance();
 	void DeleteInstance();
 
@@ -37,6 +129,9 @@ public:
 	void InitSwapImages();
 	void DeleteSwapImages();
 
+	void InitHeadlessImages();
+	void DeleteHeadlessImages();
+
 	void InitCommandPool();
 	void DeleteCommandPool();
 
@@ -49,9 +144,17 @@ public:
 
 	void CreateDepthBuffer();
 	void DeleteDepthBuffer();
+	// Submits CommandBuffer and waits for it on GraphicsTimeline.
 	void ExecuteQueueCommandBuffer();
 
 	void InitUniformBuffer();
+	void UpdateUniformBuffer();
+	// UpdateUniformBuffer without waiting, for a buffer no frame reads yet.
+	void WriteUniformBuffer();
+	// The camera InitUniformBuffer starts with on a SizeX x SizeY surface.
+	static void DefaultCamera(int SizeX, int SizeY, glm::mat4& Projection, glm::mat4& View, glm::mat4& Model);
+	// Side, spacing and scale of the grid the vertex shader lays Count instances out on.
+	static glm::vec4 InstanceGrid(uint32_t Count);
 	void DeleteUniformBuffer();
 
 	void InitDescriptorPipelineLayout(bool UseTexture);
@@ -62,43 +165,216 @@ public:
 
 	void InitShaders(const char* VertShader, const char* FragShader);
 	void DeleteShaders();
+	// Returns VK_NULL_HANDLE on failure.
+	VkShaderModule CreateShaderModule(const std::vector<unsigned int>& Spirv);
+
+	// Shaders/cube.vert and cube.frag, every pipeline of the cube is built from these.
+	// Exits when they can not be read.
+	void LoadCubeShaders(std::string& VertSource, std::string& FragSource);
+	// Rebuilds the pipelines whenever one of the shader files changes. Pipelines created
+	// after this, from permutations, lighting or overdraw, are rebuilt as well.
+	void InitShaderReload(const char* VertPath, const char* FragPath);
+	void DeleteShaderReload();
+
+	// Every feature combination of the cube shaders, see CubeShaderFeatures in Renderer.cpp.
+	void InitShaderPermutations();
+	// DrawCube draws with this permutation instead of GraphicsPipeline until DeleteShaderPermutations.
+	void UsePermutation(uint32_t Permutation);
+	void DeleteShaderPermutations();
 
 	void InitFramebuffer(bool UseDepth);
 	void DeleteFramebuffer();
 
+	// Draws the scene into SceneColor at a scale of the surface size that the controller
+	// picks from the GPU frame time, and blits it up to the swapchain image. SceneColor
+	// and the depth buffer stay surface sized, a new scale only changes the render area,
+	// viewport and scissor. Returns false when the images can not be blitted or the queue
+	// has no timestamps to measure the GPU frame time with.
+	// Frames with HiZ occlusion stay at full size, the pyramid covers the whole depth buffer.
+	bool InitDynamicResolution(const DynamicResolutionSettings& Settings);
+	void DeleteDynamicResolution();
+	// Blits RenderExtent of SceneColor over the current swapchain image, which is left
+	// as a color attachment again.
+	void RecordUpscale();
+	// GPU milliseconds of the last frame FinishFrame waited for. Measured with timestamps
+	// when the queue has them, otherwise the time spent waiting for the queue.
+	double GetGpuFrameTime() const;
+
 	void InitVertexBuffer(const void *vertexData, uint32_t dataSize, uint32_t dataStride, bool use_texture);
 	void DeleteVertexBuffer();
-
+	// Filled, host visible buffer.
+	void InitHostBuffer(VkBufferUsageFlags Usage, const void* Data, VkDeviceSize Size, MemoryCategory Category,
+		VkBuffer* Buffer, VkDeviceMemory* Memory);
+
+	// Indexed mesh DrawCube draws instead of the cube, in the cube's vertex format, with the
+	// levels of Chain in one index buffer. A previous mesh goes through DeferredDeletion.
+	void InitLodMesh(const Vertex* Vertices, uint32_t VertexCount, const MeshLodChain& Chain);
+	void DeleteLodMesh();
+	// Picks the level of every draw from its screen-space error, DrawCube calls it.
+	void SelectLods();
+
+	// Indexed mesh DrawCube draws meshlet by meshlet for every entry of Draws, culled on the GPU.
+	// Returns false and leaves the normal draws alone when the device can not draw it.
+	// Occlusion adds the two-phase cull against HiZ, when the depth buffer can be sampled.
+	bool InitMeshlets(const Vertex* Vertices, uint32_t VertexCount, const MeshletMesh& Mesh, uint32_t MaxObjects,
+		bool Occlusion = false);
+	void DeleteMeshlets();
+	// The camera as DrawCube sees it, in the space Draws' models map to.
+	MeshletCullView GetCullView() const;
+
+	// GPU particles, simulated and drawn by DrawCube after everything else, see ParticleSystem.
+	// Room for Capacity particles, a previous system is deleted.
+	void InitParticles(uint32_t Capacity);
+	void DeleteParticles();
+
+	// Clustered point lights for the cube's shaders, built for the current DrawPath. DrawCube
+	// bins Lighting's lights every frame and draws with its pipeline instead of GraphicsPipeline,
+	// the permutation and ScenePipelines. Overdraw still wins, meshlet and packet draws keep
+	// their own pipelines. A previous Lighting is deleted.
+	void InitLighting(uint32_t MaxLights);
+	void DeleteLighting();
+
+	// Cascaded shadow maps of Draws, rendered by DrawCube before the frame's render pass,
+	// see ShadowCascades. Off until called: the cube's shaders do not sample the maps yet,
+	// so only the shadows bench turns them on. A previous one is deleted.
+	void InitShadows(uint32_t Resolution = 2048, uint32_t Cascades = 4);
+	void DeleteShadows();
+
+	// Room for the sets in use and, per frame in flight, a replaced one of each.
 	void InitDescriptorPool(bool UseTexture);
+	// Before allocating a replacement set. Waits for the GPU and frees replaced sets
+	// when DescriptorPool would run out, which only happens with several replaces a frame.
+	void ReserveDescriptorSet();
 	void DeleteDescriptorPool();
 
 	void InitDescriptorSet(bool UseTexture);
 
+	// Set 2 of the pipeline layout, only when the device has descriptor indexing.
+	void InitBindless();
+	void DeleteBindless();
+
+	// Room for Count DrawData in ObjectBuffer, for the Descriptors and Bindless paths.
+	// Set DrawPath first, it decides the buffer type.
+	void InitObjectBuffer(uint32_t Count);
+	// Copies Draws into ObjectBuffer.
+	void UpdateObjectBuffer();
+	void DeleteObjectBuffer();
+	// Updates Scene and copies the world matrices of DrawNodes into Draws and ObjectBuffer.
+	void SyncSceneDraws();
+
+	// Worker threads for the per draw CPU work of a frame: scene updates, LOD selection
+	// and ObjectBuffer writes. Without them that work stays on the calling thread.
+	// ThreadCount includes the calling thread, 0 is one per core.
+	void InitJobs(uint32_t ThreadCount = 0, JobAffinity Affinity = JobAffinity::None);
+	void DeleteJobs();
+	// Fn on chunks of [0, Count), spread over Jobs when there is one.
+	void ParallelDraws(uint32_t Count, const std::function<void(uint32_t Begin, uint32_t End)>& Fn);
+
 	void InitPipelineCache();
 	void DeletePipelineCache();
 
+	// Uses ShaderStages and PipelineLayout unless Stages or Layout are given, and no
+	// blending unless Blend is. With DepthOnly Stages is the vertex stage alone and the
+	// pipeline is for DepthOnly's render pass. Safe to call from other threads.
+	VkPipeline CreateGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi, const VkPipelineShaderStageCreateInfo* Stages = nullptr,
+		VkPipelineLayout Layout = VK_NULL_HANDLE, const VkPipelineColorBlendAttachmentState* Blend = nullptr,
+		const DepthOnlyState* DepthOnly = nullptr);
 	void InitGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi);
 	void DeleteGraphcisPipeline();
 
+	void InitScenePipelines(uint32_t Count);
+	void DeleteScenePipelines();
+
+	// Overdraw diagnostics. DrawCube clears to 0 and draws with a pipeline that adds 1 to
+	// every channel per fragment, so each pixel of the frame and of its readback holds its
+	// fragment count, up to 255. See Overdraw.h for the statistics and the heatmap.
+	// With DepthTest only fragments passing it count, the ones the normal pipelines shade,
+	// without it every rasterized fragment does. Replaces GraphicsPipeline, the permutation
+	// and ScenePipelines, with the vertex shader for the current DrawPath. Meshlet and
+	// packet draws keep their own pipelines.
+	void InitOverdraw(bool DepthTest = true);
+	void DeleteOverdraw();
+
+	// Swap in new resources while frames in flight still use the old ones,
+	// the old objects go through DeferredDeletion instead of a device wait.
+	void ReplaceVertexBuffer(const void *vertexData, uint32_t dataSize, uint32_t dataStride, bool use_texture);
+	void ReplaceUniformBuffer();
+	void ReplaceGraphicsPipeline(VkBool32 include_depth, VkBool32 include_vi);
+
+	// Frames the GPU may still be running while the next one is prepared.
+	static const uint32_t FramesInFlight = 1;
+	// Submits and presents the frame without waiting for it, the next DrawCube does.
 	void DrawCube();
-
-	void CreateFence();
-	void DeleteFence();
-
+	// Waits for the frame DrawCube submitted last, if it is still running, and takes its
+	// results: GPU time, dynamic resolution and meshlet counts. Then frees what frames
+	// that finished no longer use. DrawCube, UpdateUniformBuffer and UpdateObjectBuffer
+	// call it before touching what the frame reads, callers that read what the GPU wrote
+	// call it after DrawCube.
+	void FinishFrame();
+	// Records the frame into CommandBuffer.
+	void RecordFrame(bool Upscale, bool DrawMesh, const VkClearValue* ClearValues);
+	// One draw per entry of Draws, or a single draw with an identity transform when it is empty.
+	void RecordDraws();
+	// The cube, or the selected level of the LOD mesh for draw DrawIndex.
+	void RecordGeometry(uint32_t DrawIndex);
+
+	// Command buffer caching. DrawCube keeps a recorded command buffer per swapchain image
+	// and submits it again while nothing recorded into it has changed, so per frame data
+	// has to come through buffers, e.g. UpdateUniformBuffer and UpdateObjectBuffer.
+	// Changed pipelines, buffers, draw counts, LOD levels and pushed draw data are noticed
+	// and the image's buffer is recorded again. MarkCommandsDirty forces that for
+	// everything else. Frames with Meshlets, Particles, Shadows, Packets or Readback are always recorded.
+	void InitCommandCache();
+	void DeleteCommandCache();
+	void MarkCommandsDirty();
+	CachedCommands GetCommandState(bool Upscale, bool DrawMesh, float Clear) const;
+	bool CommandsMatch(const CachedCommands& Cached, const CachedCommands& Current) const;
+
+	// Copies every frame into a ring of host buffers and hands them to Callback on a worker thread.
+	void InitReadback(uint32_t SlotCount, ReadbackCallback Callback);
+	void DeleteReadback();
+
+	// The swapchain's binary semaphores.
 	void InitSemaphore();
 	void DeleteSemaphore();
 	/*
 	Functions from lunarg samples.
 	*/
 	bool memory_type_from_properties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
+	// vkAllocateMemory/vkFreeMemory that also account the memory in GpuMemory.
+	VkResult AllocateMemory(const VkMemoryAllocateInfo* AllocateInfo, MemoryCategory Category, VkDeviceMemory* Memory);
+	void FreeMemory(VkDeviceMemory Memory);
 	void set_image_layout(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout);
-	bool GLSLtoSPV(const VkShaderStageFlagBits shader_type, const char *pshader, std::vector<unsigned int> &spirv);
+	// Preamble goes in after the #version line, e.g. "#define FOO 1\n".
+	// Vulkan11 targets SPIR-V 1.3, for subgroup operations, only when SubgroupBallotSupported.
+	bool GLSLtoSPV(const VkShaderStageFlagBits shader_type, const char *pshader, std::vector<unsigned int> &spirv, const char *Preamble = nullptr,
+		bool Vulkan11 = false);
 	EShLanguage FindLanguage(const VkShaderStageFlagBits shader_type);
 	void init_resources(TBuiltInResource &Resources);
 	///////////////////
 	VkPhysicalDeviceMemoryProperties MemoryProperties;
 	VkPhysicalDeviceProperties DeviceProperties;
 
+	// Per category and per heap memory usage.
+	MemoryTracker GpuMemory;
+	bool Properties2Supported = false;
+	bool MemoryBudgetSupported = false;
+	// Descriptor indexing with dynamically indexed storage buffer arrays.
+	bool DescriptorIndexingSupported = false;
+	bool DrawIndirectCountSupported = false;
+	// VK_KHR_timeline_semaphore, otherwise GraphicsTimeline falls back to fences.
+	bool TimelineSemaphoreSupported = false;
+	// Version the instance was created with, 1.1 when the loader has it.
+	uint32_t InstanceVersion = 0;
+	// Basic and ballot subgroup operations in compute shaders, Vulkan 1.1 on both sides.
+	bool SubgroupBallotSupported = false;
+	// Optional features turned on at device creation, the ones the device has.
+	VkPhysicalDeviceFeatures EnabledFeatures = {};
+
+	// Every buffer, image and sampler in one set, when DescriptorIndexingSupported.
+	BindlessTable Bindless;
+	BindlessCapacity BindlessSlots;
+
 	// VkInstance is where everything in Vulkan happens.
 	VkInstance Instance = nullptr;
 	// VkDevice handles the GPU and its queues.
@@ -117,6 +393,10 @@ public:
 	int SurfaceSizeX = 1920;
 	int SurfaceSizeY = 1080;
 
+	// No window, surface or swapchain. SwapchainImages are plain offscreen images.
+	bool Headless = false;
+	std::vector<VkDeviceMemory> HeadlessImageMemory;
+
 	VkSwapchainKHR Swapchain = nullptr;
 	uint32_t SwapchainImageCount = 2;
 	std::vector<VkImage> SwapchainImages;
@@ -139,8 +419,13 @@ public:
 	VkImage DepthImage;
 	VkDeviceMemory DepthMemory;
 	VkImageView DepthImageView;
+	// The depth buffer can also be read by shaders, for HiZ.
+	bool DepthSampled = false;
 
 	// Uniform Buffer
+	glm::mat4 Projection;
+	glm::mat4 View;
+	glm::mat4 Model;
 	VkBuffer UniformBuffer;
 	VkDeviceMemory UniformMemory;
 	VkDescriptorBufferInfo UniformDescriptor;
@@ -151,9 +436,16 @@ public:
 
 	//Renderpass
 	VkRenderPass RenderPass;
+	// Same attachments but loaded, to draw on after compute work in the middle of a frame.
+	VkRenderPass ResumeRenderPass;
 
 	//Shader stuff
 	VkPipelineShaderStageCreateInfo ShaderStages[2];
+	ShaderReloader* ShaderReload = nullptr;
+	ShaderPermutations* Permutations = nullptr;
+	// Owned by Permutations.
+	VkPipeline PermutationPipeline = nullptr;
+	uint32_t ActivePermutation = 0;
 
 	//Framebuffer
 	VkFramebuffer *framebuffers;
@@ -167,6 +459,9 @@ public:
 
 	//
 	VkDescriptorPool DescriptorPool = nullptr;
+	uint32_t DescriptorPoolSets = 0;
+	// Times ReserveDescriptorSet had to wait for the GPU.
+	uint64_t DescriptorPoolStalls = 0;
 
 	//
 	std::vector<VkDescriptorSet> DescriptorSet;
@@ -174,13 +469,107 @@ public:
 	//
 	VkPipelineCache PipelineCache = nullptr;
 	VkPipeline GraphicsPipeline = nullptr;
-
-	uint32_t CurrentBuffer;
-
-	//
-	VkSemaphore presentCompleteSemaphore;
-	//
-	VkFence drawFence;
+	// When not empty DrawCube draws once with each of these instead of GraphicsPipeline.
+	std::vector<VkPipeline> ScenePipelines;
+	// Set by InitOverdraw, DrawCube draws with it instead of the pipelines above.
+	VkPipeline OverdrawPipeline = nullptr;
+	VkShaderModule OverdrawModules[2] = {};
+	uint32_t OverdrawReloadTarget = UINT32_MAX;
+
+	// Number of cube instances DrawCube draws, laid out on a grid by the vertex shader.
+	uint32_t InstanceCount = 1;
+
+	// Objects DrawCube draws, each with InstanceCount instances.
+	std::vector<DrawData> Draws;
+	// Bindless only when Bindless.IsEnabled(), push constants work everywhere.
+	DrawDataPath DrawPath = DrawDataPath::PushConstants;
+
+	VkBuffer MeshVertexBuffer = nullptr;
+	VkDeviceMemory MeshVertexMemory = nullptr;
+	VkBuffer MeshIndexBuffer = nullptr;
+	VkDeviceMemory MeshIndexMemory = nullptr;
+	MeshLodChain MeshLods;
+	// Off always draws level 0.
+	bool UseLods = true;
+	// Largest error a level may show on screen, in pixels.
+	float LodErrorPixels = 1.0f;
+	// Level each draw was recorded with last frame.
+	std::vector<uint32_t> DrawLods;
+	// Triangles recorded last frame, instances included. With Meshlets counting, the ones
+	// the GPU drew, after FinishFrame.
+	uint64_t LastTriangleCount = 0;
+
+	// When set DrawCube draws its mesh instead of the cube, see InitMeshlets.
+	MeshletCuller* Meshlets = nullptr;
+	// Built from the depth of what Meshlets drew first, when it culls occluded objects.
+	DepthPyramid* HiZ = nullptr;
+	// Set by InitParticles.
+	ParticleSystem* Particles = nullptr;
+	// Set by InitLighting, fill its Lights before DrawCube.
+	ClusteredLighting* Lighting = nullptr;
+	// Set by InitShadows.
+	ShadowCascades* Shadows = nullptr;
+
+	JobSystem* Jobs = nullptr;
+	SceneHierarchy Scene;
+	// Scene node of each entry in Draws. When set, DrawCube updates Scene and takes the models from it.
+	std::vector<SceneNode> DrawNodes;
+
+	// When not empty DrawCube records these instead, payloads index Draws. Sorting is up to the caller.
+	DrawPacketQueue Packets;
+	DrawPacketTables PacketTables;
+	bool SkipRedundantBinds = true;
+	VkBuffer ObjectBuffer = nullptr;
+	VkDeviceMemory ObjectMemory = nullptr;
+	// Persistently mapped.
+	uint8_t* ObjectData = nullptr;
+	VkDescriptorSet ObjectSet = nullptr;
+	// Table entry of ObjectBuffer on the bindless path.
+	uint32_t ObjectSlot = SlotAllocator::InvalidSlot;
+	// sizeof(DrawData) rounded up to minUniformBufferOffsetAlignment.
+	uint32_t ObjectStride = 0;
+	uint32_t ObjectCapacity = 0;
+
+	uint32_t CurrentBuffer = 0;
+
+	// CPU time spent recording the last frame's command buffer, in seconds.
+	double LastRecordTime = 0.0;
+	// One per swapchain image while caching, see InitCommandCache.
+	std::vector<CachedCommands> CommandCache;
+	// Times a cached command buffer was recorded.
+	uint64_t CommandCacheRecords = 0;
+
+	// Area the last frame was drawn in, the surface size unless DynamicResolution scaled it.
+	VkExtent2D RenderExtent = {};
+	DynamicResolutionController* DynamicResolution = nullptr;
+	VkImage SceneColor = VK_NULL_HANDLE;
+	VkDeviceMemory SceneColorMemory = VK_NULL_HANDLE;
+	VkImageView SceneColorView = VK_NULL_HANDLE;
+	VkFramebuffer SceneFramebuffer = VK_NULL_HANDLE;
+	VkFilter UpscaleFilter = VK_FILTER_LINEAR;
+	// Swapchain images can be blitted to.
+	bool SwapchainTransferDst = false;
+	// Start and end of the last frame, while dynamic resolution is on.
+	VkQueryPool FrameTimestamps = VK_NULL_HANDLE;
+	double LastQueueWaitTime = 0.0;
+	double LastGpuFrameTime = 0.0;
+	// Timeline value of the last frame DrawCube submitted and of the last FinishFrame waited for.
+	uint64_t LastFrameValue = 0;
+	uint64_t FinishedFrameValue = 0;
+	bool FrameUpscaled = false;
+
+	// Binary semaphores at the swapchain, the only place timelines can not go. Acquires
+	// take the next of AcquireSemaphores, presents wait on the image's PresentSemaphores.
+	std::vector<VkSemaphore> AcquireSemaphores;
+	std::vector<VkSemaphore> PresentSemaphores;
+	uint32_t AcquireIndex = 0;
+
+	FrameReadback* Readback = nullptr;
+
+	// Every submit to Queue goes through it. Objects retired at GetSubmitted() are freed
+	// once GetCompleted() reaches that value.
+	QueueTimeline GraphicsTimeline;
+	DeletionQueue DeferredDeletion;
 
 	std::vector<const char*> InstanceLayers;
 	std::vector<const char*> InstanceExtensions;
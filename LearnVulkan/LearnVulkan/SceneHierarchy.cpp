@@ -0,0 +1,419 @@
+#include "SceneHierarchy.h"
+#include "TransformKernels.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+
+// Below this many nodes a level is not worth waking the workers for.
+static const uint32_t SceneLevelChunk = 2048;
+static const uint32_t SceneRangeChunk = 64;
+
+SceneHierarchy::SceneHierarchy(uint32_t WorkerCount)
+	: WorkerCount(WorkerCount), NextChunk(0)
+{
+	if (this->WorkerCount == 0)
+	{
+		uint32_t Cores = std::thread::hardware_concurrency();
+		this->WorkerCount = Cores > 1 ? Cores - 1 : 0;
+	}
+}
+
+SceneHierarchy::~SceneHierarchy()
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Quit = true;
+	}
+	WorkReady.notify_all();
+	for (auto& Worker : Workers)
+		Worker.join();
+}
+
+void SceneHierarchy::Reserve(uint32_t Count)
+{
+	for (auto* Array : { &PositionX, &PositionY, &PositionZ, &RotationX, &RotationY, &RotationZ, &RotationW,
+		&ScaleX, &ScaleY, &ScaleZ })
+		Array->reserve(Count);
+	for (auto* Array : { &Parent, &FirstChild, &ChildCount, &UpdateStamp, &HandleToIndex, &IndexToHandle })
+		Array->reserve(Count);
+	World.reserve(Count);
+	Dirty.reserve(Count);
+}
+
+void SceneHierarchy::Clear()
+{
+	for (auto* Array : { &PositionX, &PositionY, &PositionZ, &RotationX, &RotationY, &RotationZ, &RotationW,
+		&ScaleX, &ScaleY, &ScaleZ })
+		Array->clear();
+	for (auto* Array : { &Parent, &FirstChild, &ChildCount, &UpdateStamp, &HandleToIndex, &IndexToHandle,
+		&LevelStart, &DirtyNodes })
+		Array->clear();
+	World.clear();
+	Dirty.clear();
+	NeedsRebuild = false;
+}
+
+SceneNode SceneHierarchy::AddNode(SceneNode ParentNode, const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale)
+{
+	assert(ParentNode == SceneNoParent || ParentNode < HandleToIndex.size());
+	uint32_t Index = GetNodeCount();
+	SceneNode Handle = (SceneNode)HandleToIndex.size();
+
+	PositionX.push_back(Position.x);
+	PositionY.push_back(Position.y);
+	PositionZ.push_back(Position.z);
+	RotationX.push_back(Rotation.x);
+	RotationY.push_back(Rotation.y);
+	RotationZ.push_back(Rotation.z);
+	RotationW.push_back(Rotation.w);
+	ScaleX.push_back(Scale.x);
+	ScaleY.push_back(Scale.y);
+	ScaleZ.push_back(Scale.z);
+	// Parents always exist before their children, so the parent index is lower until the next Rebuild too.
+	Parent.push_back(ParentNode == SceneNoParent ? SceneNoParent : HandleToIndex[ParentNode]);
+	FirstChild.push_back(0);
+	ChildCount.push_back(0);
+	World.push_back(glm::mat4(1.0f));
+	Dirty.push_back(0);
+	UpdateStamp.push_back(0);
+	HandleToIndex.push_back(Index);
+	IndexToHandle.push_back(Handle);
+	NeedsRebuild = true;
+	return Handle;
+}
+
+void SceneHierarchy::SetLocal(SceneNode Node, const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale)
+{
+	uint32_t Index = HandleToIndex[Node];
+	PositionX[Index] = Position.x;
+	PositionY[Index] = Position.y;
+	PositionZ[Index] = Position.z;
+	RotationX[Index] = Rotation.x;
+	RotationY[Index] = Rotation.y;
+	RotationZ[Index] = Rotation.z;
+	RotationW[Index] = Rotation.w;
+	ScaleX[Index] = Scale.x;
+	ScaleY[Index] = Scale.y;
+	ScaleZ[Index] = Scale.z;
+	MarkDirty(Index);
+}
+
+void SceneHierarchy::SetPosition(SceneNode Node, const glm::vec3& Position)
+{
+	uint32_t Index = HandleToIndex[Node];
+	PositionX[Index] = Position.x;
+	PositionY[Index] = Position.y;
+	PositionZ[Index] = Position.z;
+	MarkDirty(Index);
+}
+
+void SceneHierarchy::SetRotation(SceneNode Node, const glm::quat& Rotation)
+{
+	uint32_t Index = HandleToIndex[Node];
+	RotationX[Index] = Rotation.x;
+	RotationY[Index] = Rotation.y;
+	RotationZ[Index] = Rotation.z;
+	RotationW[Index] = Rotation.w;
+	MarkDirty(Index);
+}
+
+SceneNode SceneHierarchy::GetParent(SceneNode Node) const
+{
+	uint32_t ParentIndex = Parent[HandleToIndex[Node]];
+	return ParentIndex == SceneNoParent ? SceneNoParent : IndexToHandle[ParentIndex];
+}
+
+void SceneHierarchy::MarkDirty(uint32_t Index)
+{
+	// The rebuild recomputes everything anyway.
+	if (NeedsRebuild || Dirty[Index])
+		return;
+	Dirty[Index] = 1;
+	DirtyNodes.push_back(Index);
+}
+
+template <class T>
+static void PermuteArray(std::vector<T>& Array, const std::vector<uint32_t>& Order)
+{
+	std::vector<T> Sorted(Array.size());
+	for (size_t i = 0; i < Order.size(); i++)
+		Sorted[i] = Array[Order[i]];
+	Array.swap(Sorted);
+}
+
+void SceneHierarchy::Rebuild()
+{
+	uint32_t Count = GetNodeCount();
+	NeedsRebuild = false;
+	LevelStart.clear();
+	if (Count == 0)
+		return;
+
+	// Children of every node, in the current order.
+	std::vector<uint32_t> ChildOffsets(Count + 1, 0);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		if (Parent[i] != SceneNoParent)
+			ChildOffsets[Parent[i] + 1]++;
+	}
+	for (uint32_t i = 0; i < Count; i++)
+		ChildOffsets[i + 1] += ChildOffsets[i];
+	std::vector<uint32_t> Children(Count);
+	std::vector<uint32_t> Fill(ChildOffsets.begin(), ChildOffsets.end() - 1);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		if (Parent[i] != SceneNoParent)
+			Children[Fill[Parent[i]]++] = i;
+	}
+
+	// Breadth-first: the roots, then the children of each placed node in turn, which
+	// keeps levels and siblings contiguous.
+	std::vector<uint32_t> Order;
+	Order.reserve(Count);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		if (Parent[i] == SceneNoParent)
+			Order.push_back(i);
+	}
+	LevelStart.assign(1, 0);
+	size_t LevelEnd = Order.size();
+	for (size_t Position = 0; Position < Order.size(); Position++)
+	{
+		if (Position == LevelEnd)
+		{
+			LevelStart.push_back((uint32_t)Position);
+			LevelEnd = Order.size();
+		}
+		uint32_t Old = Order[Position];
+		FirstChild[Position] = (uint32_t)Order.size();
+		ChildCount[Position] = ChildOffsets[Old + 1] - ChildOffsets[Old];
+		Order.insert(Order.end(), Children.begin() + ChildOffsets[Old], Children.begin() + ChildOffsets[Old + 1]);
+	}
+	LevelStart.push_back(Count);
+	assert(Order.size() == Count);
+
+	std::vector<uint32_t> NewIndex(Count);
+	for (uint32_t i = 0; i < Count; i++)
+		NewIndex[Order[i]] = i;
+	std::vector<uint32_t> NewParent(Count);
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		uint32_t OldParent = Parent[Order[i]];
+		NewParent[i] = OldParent == SceneNoParent ? SceneNoParent : NewIndex[OldParent];
+	}
+	Parent.swap(NewParent);
+
+	for (auto* Array : { &PositionX, &PositionY, &PositionZ, &RotationX, &RotationY, &RotationZ, &RotationW,
+		&ScaleX, &ScaleY, &ScaleZ })
+		PermuteArray(*Array, Order);
+	PermuteArray(IndexToHandle, Order);
+	for (uint32_t i = 0; i < Count; i++)
+		HandleToIndex[IndexToHandle[i]] = i;
+
+	// World matrices are recomputed from scratch by the full update that follows.
+	std::fill(Dirty.begin(), Dirty.end(), 0);
+	std::fill(UpdateStamp.begin(), UpdateStamp.end(), 0);
+	DirtyNodes.clear();
+}
+
+void SceneHierarchy::Update()
+{
+	Stats = SceneUpdateStats();
+	bool Full = NeedsRebuild;
+	if (NeedsRebuild)
+		Rebuild();
+	uint32_t Levels = GetLevelCount();
+	Stats.Levels = Levels;
+	if (Levels == 0)
+		return;
+	CurrentStamp++;
+
+	// Index order is level order, so the changed nodes come out grouped by level.
+	std::sort(DirtyNodes.begin(), DirtyNodes.end());
+	size_t NextDirty = 0;
+	Frontier.clear();
+	size_t FrontierNodes = 0;
+	for (uint32_t L = 0; L < Levels; L++)
+	{
+		uint32_t Begin = LevelStart[L];
+		uint32_t End = LevelStart[L + 1];
+		// Nodes changed on this level, unless their parent was recomputed and already queued them.
+		for (; NextDirty < DirtyNodes.size() && DirtyNodes[NextDirty] < End; NextDirty++)
+		{
+			uint32_t Index = DirtyNodes[NextDirty];
+			Dirty[Index] = 0;
+			uint32_t ParentIndex = Parent[Index];
+			if (!Full && (ParentIndex == SceneNoParent || UpdateStamp[ParentIndex] != CurrentStamp))
+			{
+				Frontier.push_back({ Index, 1 });
+				FrontierNodes++;
+			}
+		}
+
+		// Once most of a level is dirty, walking it whole is cheaper, and everything below is dirty too.
+		if (!Full && FrontierNodes * 4 > End - Begin)
+			Full = true;
+		if (Full)
+		{
+			UpdateLevel(L);
+			Stats.FullLevels++;
+			Stats.NodesUpdated += End - Begin;
+			continue;
+		}
+		if (Frontier.empty())
+		{
+			if (NextDirty == DirtyNodes.size())
+				break;
+			continue;
+		}
+
+		UpdateRanges(Frontier.data(), Frontier.size());
+		Stats.NodesUpdated += (uint32_t)FrontierNodes;
+
+		NextFrontier.clear();
+		FrontierNodes = 0;
+		for (auto& Range : Frontier)
+		{
+			for (uint32_t i = Range.Begin; i < Range.Begin + Range.Count; i++)
+			{
+				if (ChildCount[i] == 0)
+					continue;
+				NextFrontier.push_back({ FirstChild[i], ChildCount[i] });
+				FrontierNodes += ChildCount[i];
+			}
+		}
+		Frontier.swap(NextFrontier);
+	}
+	DirtyNodes.clear();
+}
+
+void SceneHierarchy::UpdateRanges(const NodeRange* Ranges, size_t Count)
+{
+	ParallelFor((uint32_t)Count, SceneRangeChunk, [&](uint32_t First, uint32_t Last)
+	{
+		for (uint32_t r = First; r < Last; r++)
+		{
+			const NodeRange& Range = Ranges[r];
+			ComposeLocal(Range.Begin, Range.Count);
+			// A range is a single node or siblings, one parent either way.
+			uint32_t ParentIndex = Parent[Range.Begin];
+			if (ParentIndex != SceneNoParent)
+			{
+				TransformOutput Out;
+				Out.Data = &World[Range.Begin];
+				MultiplyMat4(&World[ParentIndex][0][0], 0, &World[Range.Begin][0][0], Range.Count, Out);
+			}
+			for (uint32_t i = Range.Begin; i < Range.Begin + Range.Count; i++)
+				UpdateStamp[i] = CurrentStamp;
+		}
+	});
+}
+
+void SceneHierarchy::UpdateLevel(uint32_t L)
+{
+	uint32_t LevelBegin = LevelStart[L];
+	uint32_t LevelCount = LevelStart[L + 1] - LevelBegin;
+	ParallelFor(LevelCount, SceneLevelChunk, [&](uint32_t First, uint32_t Last)
+	{
+		uint32_t Begin = LevelBegin + First;
+		uint32_t End = LevelBegin + Last;
+		ComposeLocal(Begin, End - Begin);
+		// Siblings are contiguous, so the chunk splits into runs that share a parent.
+		for (uint32_t i = Begin; i < End;)
+		{
+			uint32_t ParentIndex = Parent[i];
+			uint32_t RunEnd = i + 1;
+			while (RunEnd < End && Parent[RunEnd] == ParentIndex)
+				RunEnd++;
+			if (ParentIndex != SceneNoParent)
+			{
+				TransformOutput Out;
+				Out.Data = &World[i];
+				MultiplyMat4(&World[ParentIndex][0][0], 0, &World[i][0][0], RunEnd - i, Out);
+			}
+			i = RunEnd;
+		}
+	});
+}
+
+void SceneHierarchy::ComposeLocal(uint32_t Begin, uint32_t Count)
+{
+	TransformSoA In = { &PositionX[Begin], &PositionY[Begin], &PositionZ[Begin],
+		&RotationX[Begin], &RotationY[Begin], &RotationZ[Begin], &RotationW[Begin],
+		&ScaleX[Begin], &ScaleY[Begin], &ScaleZ[Begin] };
+	TransformOutput Out;
+	Out.Data = &World[Begin];
+	ComposeTRS(In, Count, Out);
+}
+
+void SceneHierarchy::ParallelFor(uint32_t Count, uint32_t MinChunk, const std::function<void(uint32_t Begin, uint32_t End)>& Fn)
+{
+	if (Jobs)
+	{
+		Jobs->ParallelFor(Count, MinChunk, Fn);
+		return;
+	}
+	if (WorkerCount == 0 || Count <= MinChunk)
+	{
+		if (Count > 0)
+			Fn(0, Count);
+		return;
+	}
+	if (Workers.empty())
+		StartWorkers();
+
+	// A few chunks per thread so uneven ranges even out.
+	uint32_t Threads = WorkerCount + 1;
+	uint32_t Chunk = std::max(MinChunk, (Count + Threads * 4 - 1) / (Threads * 4));
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Job = &Fn;
+		JobCount = Count;
+		JobChunk = Chunk;
+		NextChunk = 0;
+		BusyWorkers = (uint32_t)Workers.size();
+		JobGeneration++;
+	}
+	WorkReady.notify_all();
+	RunChunks();
+
+	std::unique_lock<std::mutex> Lock(Mutex);
+	WorkDone.wait(Lock, [this] { return BusyWorkers == 0; });
+	Job = nullptr;
+}
+
+void SceneHierarchy::StartWorkers()
+{
+	for (uint32_t i = 0; i < WorkerCount; i++)
+		Workers.emplace_back(&SceneHierarchy::WorkerLoop, this);
+}
+
+void SceneHierarchy::WorkerLoop()
+{
+	uint64_t Seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> Lock(Mutex);
+			WorkReady.wait(Lock, [&] { return Quit || JobGeneration != Seen; });
+			if (Quit)
+				return;
+			Seen = JobGeneration;
+		}
+		RunChunks();
+		std::lock_guard<std::mutex> Lock(Mutex);
+		if (--BusyWorkers == 0)
+			WorkDone.notify_one();
+	}
+}
+
+void SceneHierarchy::RunChunks()
+{
+	for (;;)
+	{
+		uint32_t Begin = NextChunk.fetch_add(JobChunk);
+		if (Begin >= JobCount)
+			return;
+		(*Job)(Begin, std::min(Begin + JobChunk, JobCount));
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Stable handle of a node, returned by AddNode.
+typedef uint32_t SceneNode;
+const SceneNode SceneNoParent = UINT32_MAX;
+
+struct SceneUpdateStats
+{
+	// Nodes whose world matrix was recomputed by the last Update.
+	uint32_t NodesUpdated = 0;
+	// Levels that were recomputed whole instead of node by node.
+	uint32_t FullLevels = 0;
+	uint32_t Levels = 0;
+};
+
+/*
+* Transform hierarchy in structure-of-arrays form. Nodes are kept in breadth-first
+* order: every level is a contiguous range, parents come before their children and
+* the children of a node are contiguous. Update walks the levels top down and only
+* recomputes the subtrees below nodes whose local transform changed, spreading each
+* level over worker threads when it is big enough to pay for the wake up.
+*/
+class SceneHierarchy
+{
+public:
+	// WorkerCount 0 uses one thread per core besides the caller. Workers start on first use.
+	explicit SceneHierarchy(uint32_t WorkerCount = 0);
+	~SceneHierarchy();
+
+	// Spreads levels over Jobs instead of the hierarchy's own workers, nullptr goes back to them.
+	void SetJobSystem(JobSystem* System) { Jobs = System; }
+
+	void Reserve(uint32_t Count);
+	void Clear();
+	// Parent has to exist already. Reorders the arrays on the next Update.
+	SceneNode AddNode(SceneNode Parent, const glm::vec3& Position,
+		const glm::quat& Rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& Scale = glm::vec3(1.0f));
+
+	void SetLocal(SceneNode Node, const glm::vec3& Position, const glm::quat& Rotation, const glm::vec3& Scale);
+	void SetPosition(SceneNode Node, const glm::vec3& Position);
+	void SetRotation(SceneNode Node, const glm::quat& Rotation);
+
+	// Brings the world matrices of every changed node and its descendants up to date.
+	void Update();
+
+	// As of the last Update.
+	const glm::mat4& GetWorld(SceneNode Node) const { return World[HandleToIndex[Node]]; }
+	SceneNode GetParent(SceneNode Node) const;
+	uint32_t GetNodeCount() const { return (uint32_t)Parent.size(); }
+	uint32_t GetLevelCount() const { return LevelStart.empty() ? 0 : (uint32_t)LevelStart.size() - 1; }
+	const SceneUpdateStats& GetStats() const { return Stats; }
+
+private:
+	// A run of nodes with the same parent, or a single node.
+	struct NodeRange
+	{
+		uint32_t Begin;
+		uint32_t Count;
+	};
+
+	void MarkDirty(uint32_t Index);
+	void Rebuild();
+	// Local TRS matrices of [Begin, Begin + Count) straight into World.
+	void ComposeLocal(uint32_t Begin, uint32_t Count);
+	// World = parent world * local for each range. Ranges only depend on the level above.
+	void UpdateRanges(const NodeRange* Ranges, size_t Count);
+	void UpdateLevel(uint32_t Level);
+	// Calls Fn on chunks of [0, Count), on the workers as well when Count is large.
+	void ParallelFor(uint32_t Count, uint32_t MinChunk, const std::function<void(uint32_t Begin, uint32_t End)>& Fn);
+	void StartWorkers();
+	void WorkerLoop();
+	void RunChunks();
+
+	// Local transforms, indexed by position in breadth-first order.
+	std::vector<float> PositionX, PositionY, PositionZ;
+	std::vector<float> RotationX, RotationY, RotationZ, RotationW;
+	std::vector<float> ScaleX, ScaleY, ScaleZ;
+	std::vector<uint32_t> Parent;
+	std::vector<uint32_t> FirstChild;
+	std::vector<uint32_t> ChildCount;
+	std::vector<glm::mat4> World;
+	// Set for nodes in DirtyNodes, so each is queued once.
+	std::vector<uint8_t> Dirty;
+	// Update a node's world matrix was last recomputed by the sparse path in.
+	std::vector<uint32_t> UpdateStamp;
+	std::vector<uint32_t> LevelStart;
+	std::vector<SceneNode> HandleToIndex;
+	std::vector<SceneNode> IndexToHandle;
+
+	// Nodes given new local transforms since the last Update, by index.
+	std::vector<uint32_t> DirtyNodes;
+	// Ranges to recompute on the current and the next level, kept to avoid allocating every Update.
+	std::vector<NodeRange> Frontier;
+	std::vector<NodeRange> NextFrontier;
+	bool NeedsRebuild = false;
+	uint32_t CurrentStamp = 0;
+	SceneUpdateStats Stats;
+
+	JobSystem* Jobs = nullptr;
+	uint32_t WorkerCount;
+	std::vector<std::thread> Workers;
+	std::mutex Mutex;
+	std::condition_variable WorkReady;
+	std::condition_variable WorkDone;
+	const std::function<void(uint32_t, uint32_t)>* Job = nullptr;
+	uint32_t JobCount = 0;
+	uint32_t JobChunk = 0;
+	std::atomic<uint32_t> NextChunk;
+	uint32_t BusyWorkers = 0;
+	uint64_t JobGeneration = 0;
+	bool Quit = false;
+};
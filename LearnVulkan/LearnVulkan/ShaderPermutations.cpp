@@ -0,0 +1,236 @@
+#include "ShaderPermutations.h"
+#include "Renderer.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+ShaderPermutations::ShaderPermutations(Renderer* Rend, const std::string& VertSource, const std::string& FragSource, const std::vector<ShaderFeature>& Features)
+	: Rend(Rend), Features(Features)
+{
+	Sources[0] = VertSource;
+	Sources[1] = FragSource;
+	for (auto& Feature : Features)
+	{
+		assert(Feature.ValueCount > 0);
+		Strides.push_back(PermutationCount);
+		PermutationCount *= Feature.ValueCount;
+	}
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	if (Rend->ShaderReload)
+	{
+		for (uint32_t Id : ReloadTargets)
+			Rend->ShaderReload->RemoveTarget(Id);
+	}
+	// The frame in flight may still draw with them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	for (auto& Entry : Pipelines)
+	{
+		if (Entry.second)
+			Rend->DeferredDeletion.RetirePipeline(Value, Entry.second);
+	}
+	for (auto& Entry : Variants)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (Entry.second.Modules[i])
+				Rend->DeferredDeletion.RetireShaderModule(Value, Entry.second.Modules[i]);
+		}
+	}
+}
+
+uint32_t ShaderPermutations::GetVariantCount() const
+{
+	uint32_t Count = 1;
+	for (auto& Feature : Features)
+	{
+		if (Feature.Tier == ShaderFeatureTier::Define)
+			Count *= Feature.ValueCount;
+	}
+	return Count;
+}
+
+uint32_t ShaderPermutations::FindFeature(const char* Name) const
+{
+	for (uint32_t i = 0; i < Features.size(); i++)
+	{
+		if (strcmp(Features[i].Name, Name) == 0)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+uint32_t ShaderPermutations::MakePermutation(const std::vector<uint32_t>& Values) const
+{
+	assert(Values.size() == Features.size());
+	uint32_t Permutation = 0;
+	for (size_t i = 0; i < Features.size(); i++)
+	{
+		assert(Values[i] < Features[i].ValueCount);
+		Permutation += Values[i] * Strides[i];
+	}
+	return Permutation;
+}
+
+uint32_t ShaderPermutations::GetFeatureValue(uint32_t Permutation, uint32_t Feature) const
+{
+	return Permutation / Strides[Feature] % Features[Feature].ValueCount;
+}
+
+std::string ShaderPermutations::GetPermutationName(uint32_t Permutation) const
+{
+	std::ostringstream Name;
+	for (uint32_t i = 0; i < Features.size(); i++)
+		Name << (i ? " " : "") << Features[i].Name << "=" << GetFeatureValue(Permutation, i);
+	return Name.str();
+}
+
+uint32_t ShaderPermutations::VariantOf(uint32_t Permutation) const
+{
+	uint32_t Key = Permutation;
+	for (uint32_t i = 0; i < Features.size(); i++)
+	{
+		if (Features[i].Tier == ShaderFeatureTier::Specialization)
+			Key -= GetFeatureValue(Permutation, i) * Strides[i];
+	}
+	return Key;
+}
+
+std::string ShaderPermutations::GetPreamble(uint32_t Key) const
+{
+	std::ostringstream Preamble;
+	for (uint32_t i = 0; i < Features.size(); i++)
+	{
+		uint32_t Value = GetFeatureValue(Key, i);
+		if (Features[i].Tier == ShaderFeatureTier::Define && Value != 0)
+			Preamble << "#define " << Features[i].Name << " " << Value << "\n";
+	}
+	return Preamble.str();
+}
+
+ShaderPermutations::Variant& ShaderPermutations::GetVariant(uint32_t Key)
+{
+	auto Found = Variants.find(Key);
+	if (Found != Variants.end())
+		return Found->second;
+
+	std::string PreambleText = GetPreamble(Key);
+
+	static const VkShaderStageFlagBits Stages[2] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	Variant& V = Variants[Key];
+	for (int i = 0; i < 2 && !V.Failed; i++)
+	{
+		std::vector<unsigned int> Spirv;
+		CompileCount++;
+		if (Rend->GLSLtoSPV(Stages[i], Sources[i].c_str(), Spirv, PreambleText.c_str()))
+			V.Modules[i] = Rend->CreateShaderModule(Spirv);
+		V.Failed = V.Modules[i] == VK_NULL_HANDLE;
+	}
+
+	if (V.Failed)
+		std::cout << "Shader variant failed to build: " << GetPermutationName(Key) << "\n";
+	return V;
+}
+
+VkPipeline ShaderPermutations::GetPipeline(uint32_t Permutation)
+{
+	assert(Permutation < PermutationCount);
+	auto Found = Pipelines.find(Permutation);
+	if (Found != Pipelines.end())
+		return Found->second;
+
+	Variant& V = GetVariant(VariantOf(Permutation));
+	if (V.Failed)
+	{
+		Pipelines[Permutation] = VK_NULL_HANDLE;
+		return VK_NULL_HANDLE;
+	}
+
+	// Every stage gets all the constants, ids a stage does not declare are ignored.
+	std::vector<VkSpecializationMapEntry> Entries;
+	std::vector<uint32_t> Data;
+	for (uint32_t i = 0; i < Features.size(); i++)
+	{
+		if (Features[i].Tier != ShaderFeatureTier::Specialization)
+			continue;
+		VkSpecializationMapEntry Entry;
+		Entry.constantID = Features[i].ConstantId;
+		Entry.offset = (uint32_t)(Data.size() * sizeof(uint32_t));
+		// Bools are VkBool32, so every value fits in 32 bits.
+		Entry.size = sizeof(uint32_t);
+		Entries.push_back(Entry);
+		Data.push_back(GetFeatureValue(Permutation, i));
+	}
+
+	VkSpecializationInfo Specialization = {};
+	Specialization.mapEntryCount = (uint32_t)Entries.size();
+	Specialization.pMapEntries = Entries.data();
+	Specialization.dataSize = Data.size() * sizeof(uint32_t);
+	Specialization.pData = Data.data();
+
+	VkPipelineShaderStageCreateInfo StageInfo[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		StageInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		StageInfo[i].stage = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		StageInfo[i].module = V.Modules[i];
+		StageInfo[i].pName = "main";
+		StageInfo[i].pSpecializationInfo = Entries.empty() ? NULL : &Specialization;
+	}
+
+	VkPipeline Pipeline = Rend->CreateGraphicsPipeline(true, true, StageInfo);
+	Pipelines[Permutation] = Pipeline;
+	if (Rend->ShaderReload && Pipeline)
+	{
+		ShaderReloadTarget Target;
+		Target.Preambles[0] = Target.Preambles[1] = GetPreamble(VariantOf(Permutation));
+		Target.SpecEntries = Entries;
+		Target.SpecData.assign((const uint8_t*)Data.data(), (const uint8_t*)Data.data() + Data.size() * sizeof(uint32_t));
+		// Map nodes do not move.
+		Target.Pipeline = &Pipelines[Permutation];
+		ReloadTargets.push_back(Rend->ShaderReload->AddTarget(Target));
+	}
+	return Pipeline;
+}
+
+VkPipeline ShaderPermutations::FindPipeline(uint32_t Permutation) const
+{
+	auto Found = Pipelines.find(Permutation);
+	return Found != Pipelines.end() ? Found->second : VK_NULL_HANDLE;
+}
+
+bool ShaderPermutations::Precompile()
+{
+	bool Succeeded = true;
+	for (uint32_t i = 0; i < PermutationCount; i++)
+		Succeeded = GetPipeline(i) != VK_NULL_HANDLE && Succeeded;
+	return Succeeded;
+}
+
+void ShaderPermutations::SetSources(const std::string& VertSource, const std::string& FragSource)
+{
+	Sources[0] = VertSource;
+	Sources[1] = FragSource;
+
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	for (auto& Entry : Variants)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (Entry.second.Modules[i])
+				Rend->DeferredDeletion.RetireShaderModule(Value, Entry.second.Modules[i]);
+		}
+	}
+	Variants.clear();
+
+	for (auto It = Pipelines.begin(); It != Pipelines.end();)
+	{
+		if (It->second == VK_NULL_HANDLE)
+			It = Pipelines.erase(It);
+		else
+			++It;
+	}
+}
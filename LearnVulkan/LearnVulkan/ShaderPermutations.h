@@ -0,0 +1,101 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+enum class ShaderFeatureTier
+{
+	// A specialization constant, every value shares one SPIR-V module and the
+	// driver folds the branches away when it builds the pipeline.
+	Specialization,
+	// A preprocessor define, for anything that changes the shader interface.
+	// Every value is a separate glslang compile.
+	Define
+};
+
+struct ShaderFeature
+{
+	const char* Name;
+	ShaderFeatureTier Tier;
+	// Values run from 0 to ValueCount - 1, 2 for an on/off feature.
+	uint32_t ValueCount;
+	// constant_id in the shaders, unused for defines.
+	uint32_t ConstantId;
+};
+
+/*
+* Every combination of feature values of a vertex/fragment shader pair. Permutations
+* are numbered 0 to GetPermutationCount() - 1, so the whole space can be walked and
+* precompiled. Permutations that only differ in specialization features share their
+* SPIR-V, only the define features pick a different source variant.
+*
+* Defines are passed as "#define NAME VALUE", an off define feature is not defined at all.
+* Pipelines and modules live until the object is destroyed, which retires them through
+* the renderer's DeferredDeletion.
+* With shader reloading on, every pipeline is a ShaderReloadTarget and rebuilt with its
+* defines and constants when the files change.
+*/
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(Renderer* Rend, const std::string& VertSource, const std::string& FragSource, const std::vector<ShaderFeature>& Features);
+	~ShaderPermutations();
+
+	uint32_t GetPermutationCount() const { return PermutationCount; }
+	// Number of different SPIR-V module pairs the permutations need.
+	uint32_t GetVariantCount() const;
+	uint32_t GetFeatureCount() const { return (uint32_t)Features.size(); }
+	const ShaderFeature& GetFeature(uint32_t Feature) const { return Features[Feature]; }
+	// Index of the feature called Name, UINT32_MAX if there is none.
+	uint32_t FindFeature(const char* Name) const;
+
+	// Values holds one value per feature, in the order they were given.
+	uint32_t MakePermutation(const std::vector<uint32_t>& Values) const;
+	uint32_t GetFeatureValue(uint32_t Permutation, uint32_t Feature) const;
+	// "COLOR_MODE=1 GAMMA=0 ..." for logs and bench output.
+	std::string GetPermutationName(uint32_t Permutation) const;
+
+	// Compiles the variant and creates the pipeline on first use. VK_NULL_HANDLE if the shaders do not compile.
+	VkPipeline GetPipeline(uint32_t Permutation);
+	// The pipeline GetPipeline built, VK_NULL_HANDLE if there is none yet. Never compiles.
+	VkPipeline FindPipeline(uint32_t Permutation) const;
+	// Builds every permutation, returns false if any of them failed.
+	bool Precompile();
+	// Render thread, after the shader files were reloaded. Variants of the old sources are
+	// retired, permutations that failed to build are tried again on next use.
+	void SetSources(const std::string& VertSource, const std::string& FragSource);
+
+	// glslang compiles done so far, one per stage.
+	uint32_t GetCompileCount() const { return CompileCount; }
+	uint32_t GetPipelineCount() const { return (uint32_t)Pipelines.size(); }
+
+private:
+	struct Variant
+	{
+		VkShaderModule Modules[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		bool Failed = false;
+	};
+
+	// Permutation with every specialization feature set to 0, the key of its variant.
+	uint32_t VariantOf(uint32_t Permutation) const;
+	// The defines of the variant's features.
+	std::string GetPreamble(uint32_t Key) const;
+	Variant& GetVariant(uint32_t Key);
+
+	Renderer* Rend;
+	std::string Sources[2];
+	std::vector<ShaderFeature> Features;
+	// Mixed radix place value of each feature.
+	std::vector<uint32_t> Strides;
+	uint32_t PermutationCount = 1;
+	uint32_t CompileCount = 0;
+
+	std::map<uint32_t, Variant> Variants;
+	std::map<uint32_t, VkPipeline> Pipelines;
+	// Ids of the pipelines at the renderer's ShaderReload.
+	std::vector<uint32_t> ReloadTargets;
+};
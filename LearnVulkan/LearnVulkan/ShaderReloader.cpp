@@ -0,0 +1,392 @@
+#include "ShaderReloader.h"
+#include "Renderer.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+bool LoadShaderFile(const std::string& Path, std::string& Source)
+{
+	std::ifstream File(Path, std::ios::binary);
+	if (!File)
+		return false;
+	std::stringstream Contents;
+	Contents << File.rdbuf();
+	Source = Contents.str();
+	return true;
+}
+
+static std::string DirectoryOf(const std::string& Path)
+{
+	size_t Slash = Path.find_last_of("/\\");
+	return Slash == std::string::npos ? std::string(".") : Path.substr(0, Slash);
+}
+
+static std::string FileNameOf(const std::string& Path)
+{
+	size_t Slash = Path.find_last_of("/\\");
+	return Slash == std::string::npos ? Path : Path.substr(Slash + 1);
+}
+
+#ifndef __linux__
+static long long FileWriteTime(const std::string& Path)
+{
+	struct stat Status;
+	if (stat(Path.c_str(), &Status) != 0)
+		return 0;
+	return (long long)Status.st_mtime;
+}
+#endif
+
+ShaderReloader::ShaderReloader(Renderer* Rend, const std::string& VertPath, const std::string& FragPath)
+	: Rend(Rend), ScenePipelineCount(0), ReloadCount(0), FailedCount(0), Quit(false)
+{
+	Paths[0] = VertPath;
+	Paths[1] = FragPath;
+	ScenePipelineCount = (uint32_t)Rend->ScenePipelines.size();
+
+#ifdef __linux__
+	InotifyFd = inotify_init1(IN_NONBLOCK);
+	if (InotifyFd < 0)
+	{
+		std::cout << "inotify unavailable, shader hot reload disabled.\n";
+		return;
+	}
+	// Watch the directories, editors often save by writing a new file and renaming it.
+	const uint32_t Mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+	inotify_add_watch(InotifyFd, DirectoryOf(Paths[0]).c_str(), Mask);
+	if (DirectoryOf(Paths[1]) != DirectoryOf(Paths[0]))
+		inotify_add_watch(InotifyFd, DirectoryOf(Paths[1]).c_str(), Mask);
+#else
+	for (int i = 0; i < 2; i++)
+		LastWriteTimes[i] = FileWriteTime(Paths[i]);
+#endif
+
+	Watcher = std::thread(&ShaderReloader::WatchLoop, this);
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	Quit = true;
+	if (Watcher.joinable())
+		Watcher.join();
+#ifdef __linux__
+	if (InotifyFd >= 0)
+		close(InotifyFd);
+#endif
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	if (HasPending)
+		DestroyBuild(Pending);
+	HasPending = false;
+}
+
+void ShaderReloader::WatchLoop()
+{
+	while (WaitForChange())
+		Rebuild();
+}
+
+#ifdef __linux__
+bool ShaderReloader::WaitForChange()
+{
+	alignas(struct inotify_event) char Buffer[4096];
+	std::string Names[2] = { FileNameOf(Paths[0]), FileNameOf(Paths[1]) };
+
+	while (!Quit)
+	{
+		// Short timeout so the destructor does not wait long for us.
+		pollfd Poll = { InotifyFd, POLLIN, 0 };
+		if (poll(&Poll, 1, 100) <= 0)
+			continue;
+
+		ssize_t Length = read(InotifyFd, Buffer, sizeof(Buffer));
+		bool Changed = false;
+		for (char* Ptr = Buffer; Ptr < Buffer + Length;)
+		{
+			const struct inotify_event* Event = (const struct inotify_event*)Ptr;
+			if (Event->len > 0 && (Names[0] == Event->name || Names[1] == Event->name))
+				Changed = true;
+			Ptr += sizeof(struct inotify_event) + Event->len;
+		}
+
+		if (Changed)
+		{
+			// Let the editor finish writing, then drop the events that piled up meanwhile.
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			while (read(InotifyFd, Buffer, sizeof(Buffer)) > 0) {}
+			return true;
+		}
+	}
+	return false;
+}
+#else
+bool ShaderReloader::WaitForChange()
+{
+	while (!Quit)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		bool Changed = false;
+		for (int i = 0; i < 2; i++)
+		{
+			long long WriteTime = FileWriteTime(Paths[i]);
+			if (WriteTime != 0 && WriteTime != LastWriteTimes[i])
+			{
+				LastWriteTimes[i] = WriteTime;
+				Changed = true;
+			}
+		}
+		if (Changed)
+			return true;
+	}
+	return false;
+}
+#endif
+
+// Builds that share a stage, preamble and source compile once.
+typedef std::map<std::string, std::vector<unsigned int>> SpirvCache;
+
+static VkShaderModule BuildModule(Renderer* Rend, SpirvCache& Cache, int Stage, const std::string& Source,
+	const char* Override, const std::string& Preamble)
+{
+	static const VkShaderStageFlagBits Stages[2] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+	std::string Key = std::to_string(Stage) + " " + std::to_string((uintptr_t)Override) + "\n" + Preamble;
+	auto Found = Cache.find(Key);
+	if (Found == Cache.end())
+	{
+		std::vector<unsigned int> Spirv;
+		if (!Rend->GLSLtoSPV(Stages[Stage], Override ? Override : Source.c_str(), Spirv,
+			Preamble.empty() ? nullptr : Preamble.c_str()))
+			Spirv.clear();
+		Found = Cache.emplace(Key, std::move(Spirv)).first;
+	}
+	return Found->second.empty() ? VK_NULL_HANDLE : Rend->CreateShaderModule(Found->second);
+}
+
+void ShaderReloader::Rebuild()
+{
+	static const VkShaderStageFlagBits Stages[2] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+
+	// Held until the build is published, so no target goes away while it is built.
+	std::lock_guard<std::mutex> BuildLock(BuildMutex);
+	std::map<uint32_t, ShaderReloadTarget> Current;
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Current = Targets;
+	}
+
+	Build B;
+	for (int i = 0; i < 2; i++)
+	{
+		if (!LoadShaderFile(Paths[i], B.Sources[i]))
+		{
+			std::cout << "Could not read " << Paths[i] << "\n";
+			FailedCount++;
+			return;
+		}
+	}
+
+	// GraphicsPipeline and ScenePipelines are built like InitShaders builds them, without a preamble.
+	SpirvCache Cache;
+	bool Succeeded = true;
+	for (int i = 0; i < 2; i++)
+	{
+		B.Modules[i] = BuildModule(Rend, Cache, i, B.Sources[i], nullptr, "");
+		Succeeded = Succeeded && B.Modules[i] != VK_NULL_HANDLE;
+	}
+	for (auto& Entry : Current)
+	{
+		const ShaderReloadTarget& T = Entry.second;
+		Build::TargetBuild& TB = B.Targets[Entry.first];
+		for (int i = 0; i < 2; i++)
+		{
+			TB.Modules[i] = BuildModule(Rend, Cache, i, B.Sources[i], i == 1 ? T.FragSource : nullptr, T.Preambles[i]);
+			Succeeded = Succeeded && TB.Modules[i] != VK_NULL_HANDLE;
+		}
+	}
+
+	if (!Succeeded)
+	{
+		std::cout << "Shader reload failed, keeping the previous version.\n";
+		DestroyBuild(B);
+		FailedCount++;
+		return;
+	}
+
+	VkPipelineShaderStageCreateInfo StageInfo[2] = {};
+	for (int i = 0; i < 2; i++)
+	{
+		StageInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		StageInfo[i].stage = Stages[i];
+		StageInfo[i].pName = "main";
+		StageInfo[i].module = B.Modules[i];
+	}
+
+	// Goes through the PipelineCache, so most of the work is shared between these.
+	B.Pipeline = Rend->CreateGraphicsPipeline(true, true, StageInfo);
+	uint32_t SceneCount = ScenePipelineCount;
+	for (uint32_t i = 0; i < SceneCount; i++)
+		B.ScenePipelines.push_back(Rend->CreateGraphicsPipeline(true, true, StageInfo));
+
+	for (auto& Entry : Current)
+	{
+		const ShaderReloadTarget& T = Entry.second;
+		Build::TargetBuild& TB = B.Targets[Entry.first];
+		VkSpecializationInfo Specialization = {};
+		Specialization.mapEntryCount = (uint32_t)T.SpecEntries.size();
+		Specialization.pMapEntries = T.SpecEntries.data();
+		Specialization.dataSize = T.SpecData.size();
+		Specialization.pData = T.SpecData.data();
+		for (int i = 0; i < 2; i++)
+		{
+			StageInfo[i].module = TB.Modules[i];
+			StageInfo[i].pSpecializationInfo = T.SpecEntries.empty() ? NULL : &Specialization;
+		}
+		TB.Pipeline = Rend->CreateGraphicsPipeline(T.IncludeDepth, T.IncludeVi, StageInfo, T.Layout,
+			T.Blended ? &T.Blend : nullptr);
+
+		// The pipeline does not need them, only owners that build more from them keep theirs.
+		for (int i = 0; i < 2; i++)
+		{
+			if (!T.Modules[i])
+			{
+				vkDestroyShaderModule(Rend->Device, TB.Modules[i], NULL);
+				TB.Modules[i] = VK_NULL_HANDLE;
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	// A newer build replaces one that was never picked up.
+	if (HasPending)
+		DestroyBuild(Pending);
+	Pending = B;
+	HasPending = true;
+}
+
+void ShaderReloader::ApplyPending()
+{
+	ScenePipelineCount = (uint32_t)Rend->ScenePipelines.size();
+
+	Build B;
+	{
+		// If the watcher holds the lock it is just publishing a build, take it next frame.
+		std::unique_lock<std::mutex> Lock(Mutex, std::try_to_lock);
+		if (!Lock.owns_lock() || !HasPending)
+			return;
+		B = Pending;
+		Pending = Build();
+		HasPending = false;
+	}
+
+	// Frames already submitted may still use the old objects.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	for (int i = 0; i < 2; i++)
+	{
+		Retired.RetireShaderModule(Value, Rend->ShaderStages[i].module);
+		Rend->ShaderStages[i].module = B.Modules[i];
+	}
+	Retired.RetirePipeline(Value, Rend->GraphicsPipeline);
+	Rend->GraphicsPipeline = B.Pipeline;
+
+	if (B.ScenePipelines.size() == Rend->ScenePipelines.size())
+	{
+		for (auto Pipeline : Rend->ScenePipelines)
+			Retired.RetirePipeline(Value, Pipeline);
+		Rend->ScenePipelines = B.ScenePipelines;
+	}
+	else
+	{
+		// The scene changed while we were building, these are stale.
+		for (auto Pipeline : B.ScenePipelines)
+			Retired.RetirePipeline(Value, Pipeline);
+	}
+
+	// Only the render thread changes Targets, it can read them without the lock.
+	for (auto& Entry : B.Targets)
+	{
+		Build::TargetBuild& TB = Entry.second;
+		auto Found = Targets.find(Entry.first);
+		if (Found == Targets.end())
+		{
+			// Removed while we were building, the GPU never saw these.
+			vkDestroyPipeline(Rend->Device, TB.Pipeline, NULL);
+			for (int i = 0; i < 2; i++)
+			{
+				if (TB.Modules[i])
+					vkDestroyShaderModule(Rend->Device, TB.Modules[i], NULL);
+			}
+			continue;
+		}
+		ShaderReloadTarget& T = Found->second;
+		Retired.RetirePipeline(Value, *T.Pipeline);
+		*T.Pipeline = TB.Pipeline;
+		for (int i = 0; i < 2; i++)
+		{
+			if (T.Modules[i])
+			{
+				Retired.RetireShaderModule(Value, *T.Modules[i]);
+				*T.Modules[i] = TB.Modules[i];
+			}
+		}
+	}
+
+	// Permutations built from now on use the new sources. The one in use is a target, the
+	// watcher already built it again and it was swapped above, so only pick up the new handle.
+	if (Rend->Permutations)
+	{
+		Rend->Permutations->SetSources(B.Sources[0], B.Sources[1]);
+		if (Rend->PermutationPipeline)
+			Rend->PermutationPipeline = Rend->Permutations->FindPipeline(Rend->ActivePermutation);
+	}
+
+	ReloadCount++;
+	std::cout << "Shaders reloaded.\n";
+}
+
+uint32_t ShaderReloader::AddTarget(const ShaderReloadTarget& Target)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	uint32_t Id = NextTargetId++;
+	Targets[Id] = Target;
+	return Id;
+}
+
+void ShaderReloader::RemoveTarget(uint32_t Id)
+{
+	std::lock_guard<std::mutex> BuildLock(BuildMutex);
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Targets.erase(Id);
+}
+
+void ShaderReloader::DestroyBuild(Build& B)
+{
+	VkDevice Device = Rend->Device;
+	for (auto Pipeline : B.ScenePipelines)
+		vkDestroyPipeline(Device, Pipeline, NULL);
+	if (B.Pipeline)
+		vkDestroyPipeline(Device, B.Pipeline, NULL);
+	for (int i = 0; i < 2; i++)
+	{
+		if (B.Modules[i])
+			vkDestroyShaderModule(Device, B.Modules[i], NULL);
+	}
+	for (auto& Entry : B.Targets)
+	{
+		if (Entry.second.Pipeline)
+			vkDestroyPipeline(Device, Entry.second.Pipeline, NULL);
+		for (int i = 0; i < 2; i++)
+		{
+			if (Entry.second.Modules[i])
+				vkDestroyShaderModule(Device, Entry.second.Modules[i], NULL);
+		}
+	}
+	B = Build();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Renderer;
+
+// Reads a whole text file, returns false if it can not be opened.
+bool LoadShaderFile(const std::string& Path, std::string& Source);
+
+// A pipeline built from the watched files besides GraphicsPipeline and ScenePipelines,
+// with everything needed to build it again the way it was first built.
+struct ShaderReloadTarget
+{
+	// Put in front of the vertex and fragment source, the defines it was compiled with.
+	std::string Preambles[2];
+	// Used instead of the fragment file when set, for pipelines that only take the vertex shader from it.
+	const char* FragSource = nullptr;
+	// Given to both stages, ids a stage does not declare are ignored.
+	std::vector<VkSpecializationMapEntry> SpecEntries;
+	std::vector<uint8_t> SpecData;
+	// Arguments of Renderer::CreateGraphicsPipeline.
+	VkBool32 IncludeDepth = VK_TRUE;
+	VkBool32 IncludeVi = VK_TRUE;
+	VkPipelineLayout Layout = VK_NULL_HANDLE;
+	bool Blended = false;
+	VkPipelineColorBlendAttachmentState Blend = {};
+	// Where the owner keeps the pipeline, and its modules when it keeps them. The render
+	// thread swaps the new ones in and retires the old.
+	VkPipeline* Pipeline = nullptr;
+	VkShaderModule* Modules[2] = { nullptr, nullptr };
+};
+
+/*
+* Watches the vertex and fragment shader files and rebuilds the pipelines that use
+* them when either changes: GraphicsPipeline and ScenePipelines, and every target
+* added with AddTarget. Compiling and pipeline creation happen on the watcher
+* thread against the renderer's PipelineCache, the render thread only swaps the
+* finished objects in at a frame boundary and retires the old ones through
+* DeferredDeletion. A shader that fails to compile leaves the previous version in use.
+*
+* Uses inotify on Linux and polls the file times everywhere else.
+*/
+class ShaderReloader
+{
+public:
+	ShaderReloader(Renderer* Rend, const std::string& VertPath, const std::string& FragPath);
+	~ShaderReloader();
+
+	// Render thread, between frames. Never waits on a compile.
+	void ApplyPending();
+
+	// Render thread. The owner removes the target before it destroys anything the target
+	// points at, which waits for a rebuild that is still using it.
+	uint32_t AddTarget(const ShaderReloadTarget& Target);
+	void RemoveTarget(uint32_t Id);
+
+	uint32_t GetReloadCount() const { return ReloadCount; }
+	uint32_t GetFailedCount() const { return FailedCount; }
+
+private:
+	struct Build
+	{
+		VkShaderModule Modules[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		VkPipeline Pipeline = VK_NULL_HANDLE;
+		std::vector<VkPipeline> ScenePipelines;
+		// The new sources, and per target id its pipeline and kept modules.
+		std::string Sources[2];
+		struct TargetBuild
+		{
+			VkPipeline Pipeline = VK_NULL_HANDLE;
+			VkShaderModule Modules[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		};
+		std::map<uint32_t, TargetBuild> Targets;
+	};
+
+	void WatchLoop();
+	// Blocks until one of the files changed, returns false when asked to quit.
+	bool WaitForChange();
+	void Rebuild();
+	// Only for builds the GPU never saw.
+	void DestroyBuild(Build& B);
+
+	Renderer* Rend;
+	std::string Paths[2];
+
+	std::mutex Mutex;
+	bool HasPending = false;
+	Build Pending;
+	// Guarded by Mutex. A rebuild holds BuildMutex from start to end.
+	std::map<uint32_t, ShaderReloadTarget> Targets;
+	uint32_t NextTargetId = 0;
+	std::mutex BuildMutex;
+
+	// Published by the render thread so the watcher knows how many scene pipelines to build.
+	std::atomic<uint32_t> ScenePipelineCount;
+	std::atomic<uint32_t> ReloadCount;
+	std::atomic<uint32_t> FailedCount;
+	std::atomic<bool> Quit;
+	std::thread Watcher;
+
+#ifdef __linux__
+	int InotifyFd = -1;
+#else
+	long long LastWriteTimes[2] = { 0, 0 };
+#endif
+};
@@ -0,0 +1,118 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+// Where DrawData comes from: 0 = push constants, 1 = dynamic uniform buffer, 2 = bindless table.
+#ifndef DRAW_DATA
+#define DRAW_DATA 0
+#endif
+#if DRAW_DATA == 2
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+#ifdef CLUSTERED_LIGHTING
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
+// 0 = vertex color, 1 = luminance, 2 = depth, 3 = object id.
+layout (constant_id = 1) const int COLOR_MODE = 0;
+layout (constant_id = 2) const bool GAMMA = false;
+struct DrawData {
+    mat4 model;
+    uint objectId;
+    uint material;
+};
+#if DRAW_DATA == 2
+layout (std430, set = 2, binding = 0) readonly buffer drawBuffers {
+    DrawData draws[];
+} bindlessBuffers[];
+layout (push_constant) uniform pushVals {
+    uint table;
+    uint index;
+} drawRef;
+DrawData loadDraw() { return bindlessBuffers[drawRef.table].draws[drawRef.index]; }
+#elif DRAW_DATA == 1
+layout (std140, set = 1, binding = 0) uniform objectVals {
+    DrawData object;
+};
+DrawData loadDraw() { return object; }
+#else
+layout (push_constant) uniform pushVals {
+    DrawData pushed;
+};
+DrawData loadDraw() { return pushed; }
+#endif
+#ifdef FLAT_COLOR
+layout (location = 0) flat in vec4 color;
+#else
+layout (location = 0) in vec4 color;
+#endif
+layout (location = 0) out vec4 outColor;
+#ifdef CLUSTERED_LIGHTING
+// Point lights binned by ClusteredLighting, positions in the space of the model.
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+layout (std140, set = LIGHT_SET, binding = 0) uniform clusterVals {
+    mat4 view;
+    mat4 inverseProjection;
+    uvec4 clusterCount;
+    uvec4 config;
+    vec4 screen;
+    vec4 ambient;
+} cluster;
+layout (std430, set = LIGHT_SET, binding = 1) readonly buffer lightBuffer { Light lights[]; };
+layout (std430, set = LIGHT_SET, binding = 2) readonly buffer countBuffer { uint clusterLightCounts[]; };
+layout (std430, set = LIGHT_SET, binding = 3) readonly buffer indexBuffer { uint clusterLights[]; };
+vec3 shadeLight(uint i, vec3 position, vec3 normal) {
+   Light l = lights[i];
+   vec3 toLight = (cluster.view * vec4(l.position.xyz, 1.0)).xyz - position;
+   float d = length(toLight);
+   float falloff = max(1.0 - d / l.position.w, 0.0);
+   return l.color.rgb * falloff * falloff * max(dot(normal, toLight / max(d, 1e-4)), 0.0);
+}
+vec3 clusteredLighting(vec3 albedo) {
+   // View space position from the depth, and the face normal from its derivatives.
+   vec2 ndc = gl_FragCoord.xy / cluster.screen.xy * 2.0 - 1.0;
+   vec4 p = cluster.inverseProjection * vec4(ndc, gl_FragCoord.z, 1.0);
+   vec3 position = p.xyz / p.w;
+   vec3 normal = normalize(cross(dFdx(position), dFdy(position)));
+   if (dot(normal, position) > 0.0)
+      normal = -normal;
+   vec3 lit = cluster.ambient.rgb;
+   if (cluster.config.w != 0u) {
+      for (uint i = 0u; i < cluster.config.x; i++)
+         lit += shadeLight(i, position, normal);
+   } else {
+      uvec2 tile = min(uvec2(gl_FragCoord.xy) / cluster.config.z, cluster.clusterCount.xy - 1u);
+      float slice = floor(log(-position.z / cluster.screen.z) * cluster.screen.w);
+      uint z = uint(clamp(slice, 0.0, float(cluster.clusterCount.z - 1u)));
+      uint index = tile.x + cluster.clusterCount.x * (tile.y + cluster.clusterCount.y * z);
+      uint count = min(clusterLightCounts[index], cluster.config.y);
+      for (uint i = 0u; i < count; i++)
+         lit += shadeLight(clusterLights[index * cluster.config.y + i], position, normal);
+   }
+   return albedo * lit;
+}
+#endif
+vec3 idColor(uint id) {
+   uint h = id * 2654435761u;
+   return vec3((h >> 16) & 255u, (h >> 8) & 255u, h & 255u) / 255.0;
+}
+void main() {
+   DrawData draw = loadDraw();
+   vec4 c = color;
+   if (draw.material != 0u)
+      c.rgb *= mix(vec3(1.0), idColor(draw.material), 0.5);
+#ifdef CLUSTERED_LIGHTING
+   c.rgb = clusteredLighting(c.rgb);
+#endif
+   if (COLOR_MODE == 1)
+      c.rgb = vec3(dot(c.rgb, vec3(0.299, 0.587, 0.114)));
+   else if (COLOR_MODE == 2)
+      c.rgb = vec3(gl_FragCoord.z);
+   else if (COLOR_MODE == 3)
+      c.rgb = idColor(draw.objectId);
+   if (GAMMA)
+      c.rgb = pow(c.rgb, vec3(1.0 / 2.2));
+   outColor = c;
+}
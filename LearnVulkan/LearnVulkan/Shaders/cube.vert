@@ -0,0 +1,63 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+// Where DrawData comes from: 0 = push constants, 1 = dynamic uniform buffer, 2 = bindless table.
+#ifndef DRAW_DATA
+#define DRAW_DATA 0
+#endif
+#if DRAW_DATA == 2
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+layout (constant_id = 0) const bool INSTANCE_GRID = true;
+layout (std140, binding = 0) uniform bufferVals {
+    mat4 mvp;
+    vec4 grid;
+} myBufferVals;
+struct DrawData {
+    mat4 model;
+    uint objectId;
+    uint material;
+};
+#if DRAW_DATA == 2
+layout (std430, set = 2, binding = 0) readonly buffer drawBuffers {
+    DrawData draws[];
+} bindlessBuffers[];
+layout (push_constant) uniform pushVals {
+    uint table;
+    uint index;
+} drawRef;
+DrawData loadDraw() { return bindlessBuffers[drawRef.table].draws[drawRef.index]; }
+#elif DRAW_DATA == 1
+layout (std140, set = 1, binding = 0) uniform objectVals {
+    DrawData object;
+};
+DrawData loadDraw() { return object; }
+#else
+layout (push_constant) uniform pushVals {
+    DrawData pushed;
+};
+DrawData loadDraw() { return pushed; }
+#endif
+layout (location = 0) in vec4 pos;
+layout (location = 1) in vec4 inColor;
+#ifdef FLAT_COLOR
+layout (location = 0) flat out vec4 outColor;
+#else
+layout (location = 0) out vec4 outColor;
+#endif
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+void main() {
+   DrawData draw = loadDraw();
+   vec3 p = pos.xyz;
+   if (INSTANCE_GRID) {
+      int side = int(myBufferVals.grid.x);
+      vec3 cell = vec3(gl_InstanceIndex % side, 0, gl_InstanceIndex / side);
+      cell -= vec3(side - 1, 0, side - 1) * 0.5;
+      p = pos.xyz * myBufferVals.grid.z + cell * myBufferVals.grid.y;
+   }
+   outColor = inColor;
+   gl_Position = myBufferVals.mvp * draw.model * vec4(p, 1.0);
+}
@@ -0,0 +1,473 @@
+#include "ShadowCascades.h"
+#include "Renderer.h"
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// The cube's instance grid, placed by the cascade instead of the camera.
+static const char* casterVertShaderText =
+"#version 400\n"
+"#extension GL_ARB_separate_shader_objects : enable\n"
+"#extension GL_ARB_shading_language_420pack : enable\n"
+"layout (std140, binding = 0) uniform bufferVals {\n"
+"    mat4 mvp;\n"
+"    vec4 grid;\n"
+"} myBufferVals;\n"
+"layout (push_constant) uniform pushVals {\n"
+"    // The cascade's view projection times the draw's model.\n"
+"    mat4 casterMvp;\n"
+"};\n"
+"layout (location = 0) in vec4 pos;\n"
+"void main() {\n"
+"   // One instance gets a grid of one, which leaves the cube alone.\n"
+"   int side = int(myBufferVals.grid.x);\n"
+"   vec3 cell = vec3(gl_InstanceIndex % side, 0, gl_InstanceIndex / side);\n"
+"   cell -= vec3(side - 1, 0, side - 1) * 0.5;\n"
+"   vec3 p = pos.xyz * myBufferVals.grid.z + cell * myBufferVals.grid.y;\n"
+"   gl_Position = casterMvp * vec4(p, 1.0);\n"
+"}\n";
+
+// Every device can render to and sample it.
+static const VkFormat ShadowFormat = VK_FORMAT_D16_UNORM;
+// Depth bias against acne, in depth units and per unit of slope.
+static const float ShadowBiasConstant = 1.25f;
+static const float ShadowBiasSlope = 1.75f;
+
+static bool SameCascades(const std::vector<ShadowCascade>& A, const std::vector<ShadowCascade>& B)
+{
+	if (A.size() != B.size())
+		return false;
+	for (size_t i = 0; i < A.size(); i++)
+	{
+		if (A[i].ViewProjection != B[i].ViewProjection)
+			return false;
+	}
+	return true;
+}
+
+ShadowCascades::ShadowCascades(Renderer* Rend, uint32_t Resolution, uint32_t Cascades)
+	: Rend(Rend), Resolution(std::max(Resolution, 1u)), Cascades(std::max(Cascades, 1u))
+{
+	InitImages();
+	InitRenderPasses();
+	InitPipeline();
+
+	if (Rend->DeviceProperties.limits.timestampComputeAndGraphics)
+	{
+		VkQueryPoolCreateInfo QueryInfo = {};
+		QueryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		QueryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		QueryInfo.queryCount = 2;
+		auto res = vkCreateQueryPool(Rend->Device, &QueryInfo, NULL, &Timestamps);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+ShadowCascades::~ShadowCascades()
+{
+	// Frames already submitted may still use them.
+	uint64_t Value = Rend->GraphicsTimeline.GetSubmitted();
+	DeletionQueue& Retired = Rend->DeferredDeletion;
+	Retired.RetireQueryPool(Value, Timestamps);
+	Retired.RetirePipeline(Value, Pipeline);
+	Retired.RetireShaderModule(Value, Module);
+	Retired.RetirePipelineLayout(Value, Layout);
+	for (auto Framebuffer : Framebuffers)
+		Retired.RetireFramebuffer(Value, Framebuffer);
+	Retired.RetireRenderPass(Value, CachePass);
+	Retired.RetireRenderPass(Value, OverlayPass);
+	Retired.RetireSampler(Value, Sampler);
+	for (auto LayerView : LayerViews)
+		Retired.RetireImageView(Value, LayerView);
+	Retired.RetireImageView(Value, ArrayView);
+	Retired.RetireImage(Value, CacheImage);
+	Retired.RetireImage(Value, Image);
+	Retired.RetireMemory(Value, CacheMemory);
+	Retired.RetireMemory(Value, Memory);
+}
+
+void ShadowCascades::InitImages()
+{
+	uint32_t Count = (uint32_t)Cascades.size();
+	VkImage* Images[2] = { &CacheImage, &Image };
+	VkDeviceMemory* Memories[2] = { &CacheMemory, &Memory };
+	for (int i = 0; i < 2; i++)
+	{
+		VkImageCreateInfo ImageInfo = {};
+		ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+		ImageInfo.format = ShadowFormat;
+		ImageInfo.extent.width = Resolution;
+		ImageInfo.extent.height = Resolution;
+		ImageInfo.extent.depth = 1;
+		ImageInfo.mipLevels = 1;
+		ImageInfo.arrayLayers = Count;
+		ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// The cache is only copied from, the map is copied to and sampled.
+		ImageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+			(i == 0 ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		auto res = vkCreateImage(Rend->Device, &ImageInfo, NULL, Images[i]);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+
+		VkMemoryRequirements mem_reqs;
+		vkGetImageMemoryRequirements(Rend->Device, *Images[i], &mem_reqs);
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = mem_reqs.size;
+		if (!Rend->memory_type_from_properties(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &alloc_info.memoryTypeIndex))
+			std::exit(-1);
+		res = Rend->AllocateMemory(&alloc_info, MemoryCategory::Depth, Memories[i]);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+		res = vkBindImageMemory(Rend->Device, *Images[i], *Memories[i], 0);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+
+	VkImageViewCreateInfo ViewInfo = {};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = Image;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	ViewInfo.format = ShadowFormat;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	ViewInfo.subresourceRange.levelCount = 1;
+	ViewInfo.subresourceRange.layerCount = Count;
+	auto res = vkCreateImageView(Rend->Device, &ViewInfo, NULL, &ArrayView);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	LayerViews.resize(Count * 2);
+	for (uint32_t i = 0; i < Count * 2; i++)
+	{
+		ViewInfo.image = i < Count ? CacheImage : Image;
+		ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		ViewInfo.subresourceRange.baseArrayLayer = i % Count;
+		ViewInfo.subresourceRange.layerCount = 1;
+		res = vkCreateImageView(Rend->Device, &ViewInfo, NULL, &LayerViews[i]);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+
+	VkSamplerCreateInfo SamplerInfo = {};
+	SamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	SamplerInfo.magFilter = VK_FILTER_LINEAR;
+	SamplerInfo.minFilter = VK_FILTER_LINEAR;
+	SamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	SamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	SamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	SamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	SamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	SamplerInfo.compareEnable = VK_TRUE;
+	SamplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	SamplerInfo.maxLod = 0.0f;
+	res = vkCreateSampler(Rend->Device, &SamplerInfo, NULL, &Sampler);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+}
+
+void ShadowCascades::InitRenderPasses()
+{
+	for (int Pass = 0; Pass < 2; Pass++)
+	{
+		bool Overlay = Pass == 1;
+		VkAttachmentDescription Attachment = {};
+		Attachment.format = ShadowFormat;
+		Attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		Attachment.loadOp = Overlay ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		Attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		Attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		Attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		Attachment.initialLayout = Overlay ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		Attachment.finalLayout = Overlay ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		VkAttachmentReference DepthReference = {};
+		DepthReference.attachment = 0;
+		DepthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription Subpass = {};
+		Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		Subpass.pDepthStencilAttachment = &DepthReference;
+
+		// The cache waits for last frame's copy out of it and is copied next. The map
+		// waits for the copy into it and is sampled next.
+		const VkPipelineStageFlags DepthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		const VkAccessFlags DepthAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		VkSubpassDependency Dependencies[2] = {};
+		Dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		Dependencies[0].dstSubpass = 0;
+		Dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		Dependencies[0].srcAccessMask = Overlay ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+		Dependencies[0].dstStageMask = DepthStages;
+		Dependencies[0].dstAccessMask = DepthAccess;
+		Dependencies[1].srcSubpass = 0;
+		Dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		Dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		Dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		Dependencies[1].dstStageMask = Overlay ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+		Dependencies[1].dstAccessMask = Overlay ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+
+		VkRenderPassCreateInfo PassInfo = {};
+		PassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		PassInfo.attachmentCount = 1;
+		PassInfo.pAttachments = &Attachment;
+		PassInfo.subpassCount = 1;
+		PassInfo.pSubpasses = &Subpass;
+		PassInfo.dependencyCount = 2;
+		PassInfo.pDependencies = Dependencies;
+		auto res = vkCreateRenderPass(Rend->Device, &PassInfo, NULL, Overlay ? &OverlayPass : &CachePass);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+
+	uint32_t Count = (uint32_t)Cascades.size();
+	Framebuffers.resize(Count * 2);
+	for (uint32_t i = 0; i < Count * 2; i++)
+	{
+		VkFramebufferCreateInfo FramebufferInfo = {};
+		FramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		FramebufferInfo.renderPass = i < Count ? CachePass : OverlayPass;
+		FramebufferInfo.attachmentCount = 1;
+		FramebufferInfo.pAttachments = &LayerViews[i];
+		FramebufferInfo.width = Resolution;
+		FramebufferInfo.height = Resolution;
+		FramebufferInfo.layers = 1;
+		auto res = vkCreateFramebuffer(Rend->Device, &FramebufferInfo, NULL, &Framebuffers[i]);
+		if (res != VK_SUCCESS)
+			std::exit(-1);
+	}
+}
+
+void ShadowCascades::InitPipeline()
+{
+	std::vector<unsigned int> Spirv;
+	if (!Rend->GLSLtoSPV(VK_SHADER_STAGE_VERTEX_BIT, casterVertShaderText, Spirv))
+		std::exit(-1);
+	Module = Rend->CreateShaderModule(Spirv);
+	if (Module == VK_NULL_HANDLE)
+		std::exit(-1);
+
+	// The renderer's set 0 for the instance grid, the caster's matrix pushed per draw.
+	VkPushConstantRange PushRange = {};
+	PushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	PushRange.size = sizeof(glm::mat4);
+	VkPipelineLayoutCreateInfo LayoutInfo = {};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	LayoutInfo.setLayoutCount = 1;
+	LayoutInfo.pSetLayouts = &Rend->DescriptorSetLayouts[0];
+	LayoutInfo.pushConstantRangeCount = 1;
+	LayoutInfo.pPushConstantRanges = &PushRange;
+	auto res = vkCreatePipelineLayout(Rend->Device, &LayoutInfo, NULL, &Layout);
+	if (res != VK_SUCCESS)
+		std::exit(-1);
+
+	VkPipelineShaderStageCreateInfo Stage = {};
+	Stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	Stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	Stage.module = Module;
+	Stage.pName = "main";
+	DepthOnlyState DepthOnly;
+	DepthOnly.RenderPass = CachePass;
+	DepthOnly.BiasConstant = ShadowBiasConstant;
+	DepthOnly.BiasSlope = ShadowBiasSlope;
+	DepthOnly.DepthClamp = true;
+	Pipeline = Rend->CreateGraphicsPipeline(VK_TRUE, VK_TRUE, &Stage, Layout, nullptr, &DepthOnly);
+}
+
+void ShadowCascades::FitCascades()
+{
+	// Planes of glm::perspective: [2][2] = -(f + n) / (f - n), [3][2] = -2fn / (f - n).
+	const glm::mat4& Projection = Rend->Projection;
+	float Near = Projection[3][2] / (Projection[2][2] - 1.0f);
+	float Far = std::min(Projection[3][2] / (Projection[2][2] + 1.0f), std::max(ShadowDistance, Near * 2.0f));
+	glm::mat4 InverseProjection = glm::inverse(Projection);
+	glm::mat4 InverseCamera = glm::inverse(Rend->View * Rend->Model);
+
+	glm::vec3 Direction = glm::normalize(LightDirection);
+	glm::vec3 Up = std::abs(Direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 LightView = glm::lookAt(glm::vec3(0.0f), Direction, Up);
+	// glm::ortho's z goes to [-1, 1], Vulkan clips to [0, 1].
+	glm::mat4 ClipDepth(1.0f);
+	ClipDepth[2][2] = 0.5f;
+	ClipDepth[3][2] = 0.5f;
+
+	uint32_t Count = (uint32_t)Cascades.size();
+	float SplitNear = Near;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		float t = (float)(i + 1) / Count;
+		float SplitFar = SplitLambda * Near * std::pow(Far / Near, t) + (1.0f - SplitLambda) * (Near + (Far - Near) * t);
+
+		// The slice's corners in the space Draws' models map to, and a sphere around them.
+		// The sphere does not turn with the camera, and its radius only depends on the projection.
+		glm::vec3 Corners[8];
+		glm::vec3 Center(0.0f);
+		for (int c = 0; c < 8; c++)
+		{
+			glm::vec4 Ray = InverseProjection * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, 1.0f, 1.0f);
+			glm::vec3 View = glm::vec3(Ray) / Ray.w;
+			float Depth = (c & 4) ? SplitFar : SplitNear;
+			Corners[c] = glm::vec3(InverseCamera * glm::vec4(View * (Depth / -View.z), 1.0f));
+			Center += Corners[c] / 8.0f;
+		}
+		float Radius = 0.0f;
+		for (auto& Corner : Corners)
+			Radius = std::max(Radius, glm::length(Corner - Center));
+		// Rounded up so rounding errors of the camera's matrices do not change it.
+		Radius = std::ceil(Radius * 16.0f) / 16.0f;
+
+		// Snapped to half the radius, the sphere moves at most a quarter of it inside the
+		// half radius margin, and the cascade only moves when it crosses a step.
+		float Step = Radius * 0.5f;
+		float Extent = Radius + Step;
+		glm::vec3 Snapped = glm::floor(glm::vec3(LightView * glm::vec4(Center, 1.0f)) / Step + 0.5f) * Step;
+		// Light view looks down -z, casters up to CasterReach in front of the sphere count.
+		glm::mat4 Ortho = glm::ortho(Snapped.x - Extent, Snapped.x + Extent, Snapped.y - Extent, Snapped.y + Extent,
+			-Snapped.z - Extent - CasterReach, -Snapped.z + Extent);
+
+		Cascades[i].ViewProjection = ClipDepth * Ortho * LightView;
+		Cascades[i].Near = SplitNear;
+		Cascades[i].Far = SplitFar;
+		SplitNear = SplitFar;
+	}
+}
+
+void ShadowCascades::RecordCasters(VkCommandBuffer Cmd, uint32_t Cascade, uint32_t First, uint32_t End)
+{
+	const std::vector<DrawData>& Draws = Rend->Draws;
+	for (uint32_t i = First; i < End; i++)
+	{
+		glm::mat4 CasterMvp = Cascades[Cascade].ViewProjection * (Draws.empty() ? glm::mat4(1.0f) : Draws[i].Model);
+		vkCmdPushConstants(Cmd, Layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(CasterMvp), &CasterMvp);
+		// The full detail mesh, LODs are picked for the camera.
+		if (Rend->MeshIndexBuffer)
+		{
+			const MeshLodLevel& Level = Rend->MeshLods.Levels[0];
+			vkCmdDrawIndexed(Cmd, Level.IndexCount, Rend->InstanceCount, Level.FirstIndex, 0, 0);
+		}
+		else
+		{
+			vkCmdDraw(Cmd, 12 * 3, Rend->InstanceCount, 0, 0);
+		}
+	}
+}
+
+void ShadowCascades::RecordShadows(VkCommandBuffer Cmd)
+{
+	if (Timestamps != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(Cmd, Timestamps, 0, 2);
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 0);
+	}
+
+	FitCascades();
+	uint32_t Count = (uint32_t)Cascades.size();
+	uint32_t DrawCount = Rend->Draws.empty() ? 1 : (uint32_t)Rend->Draws.size();
+	uint32_t StaticEnd = std::min(StaticCasters, DrawCount);
+
+	// Bound once, both passes are compatible with the pipeline.
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, 0, 1, Rend->DescriptorSet.data(), 0, NULL);
+	const VkDeviceSize Offsets[1] = { 0 };
+	if (Rend->MeshIndexBuffer)
+	{
+		vkCmdBindVertexBuffers(Cmd, 0, 1, &Rend->MeshVertexBuffer, Offsets);
+		vkCmdBindIndexBuffer(Cmd, Rend->MeshIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+	else
+	{
+		vkCmdBindVertexBuffers(Cmd, 0, 1, &Rend->VertexBuffer, Offsets);
+	}
+	VkViewport Viewport = {};
+	Viewport.width = (float)Resolution;
+	Viewport.height = (float)Resolution;
+	Viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(Cmd, 0, 1, &Viewport);
+	VkRect2D Scissor = {};
+	Scissor.extent.width = Resolution;
+	Scissor.extent.height = Resolution;
+	vkCmdSetScissor(Cmd, 0, 1, &Scissor);
+
+	VkClearValue Clear = {};
+	Clear.depthStencil.depth = 1.0f;
+	VkRenderPassBeginInfo PassBegin = {};
+	PassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	PassBegin.renderArea.extent.width = Resolution;
+	PassBegin.renderArea.extent.height = Resolution;
+	PassBegin.clearValueCount = 1;
+	PassBegin.pClearValues = &Clear;
+
+	CacheRendered = !CacheValid || !SameCascades(Cascades, CachedCascades);
+	if (CacheRendered)
+	{
+		PassBegin.renderPass = CachePass;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			PassBegin.framebuffer = Framebuffers[i];
+			vkCmdBeginRenderPass(Cmd, &PassBegin, VK_SUBPASS_CONTENTS_INLINE);
+			RecordCasters(Cmd, i, 0, StaticEnd);
+			vkCmdEndRenderPass(Cmd);
+		}
+		CachedCascades = Cascades;
+		CacheValid = true;
+		CacheRenders++;
+	}
+
+	// Last frame's map is done being sampled, all of it is overwritten.
+	VkImageMemoryBarrier Barrier = {};
+	Barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = 0;
+	Barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.oldLayout = Rendered ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	Barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barrier.image = Image;
+	Barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	Barrier.subresourceRange.levelCount = 1;
+	Barrier.subresourceRange.layerCount = Count;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, NULL, 0, NULL, 1, &Barrier);
+
+	VkImageCopy Region = {};
+	Region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	Region.srcSubresource.layerCount = Count;
+	Region.dstSubresource = Region.srcSubresource;
+	Region.extent.width = Resolution;
+	Region.extent.height = Resolution;
+	Region.extent.depth = 1;
+	vkCmdCopyImage(Cmd, CacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region);
+
+	// Every layer goes through its pass even without dynamic casters, the pass moves it
+	// to the layout it is sampled in.
+	PassBegin.renderPass = OverlayPass;
+	PassBegin.clearValueCount = 0;
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		PassBegin.framebuffer = Framebuffers[Count + i];
+		vkCmdBeginRenderPass(Cmd, &PassBegin, VK_SUBPASS_CONTENTS_INLINE);
+		RecordCasters(Cmd, i, StaticEnd, DrawCount);
+		vkCmdEndRenderPass(Cmd);
+	}
+	Rendered = true;
+
+	if (Timestamps != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 1);
+}
+
+double ShadowCascades::GetShadowTime() const
+{
+	if (Timestamps == VK_NULL_HANDLE || !Rendered)
+		return 0.0;
+	uint64_t Ticks[2];
+	auto res = vkGetQueryPoolResults(Rend->Device, Timestamps, 0, 2, sizeof(Ticks), Ticks, sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS)
+		return 0.0;
+	return (Ticks[1] - Ticks[0]) * Rend->DeviceProperties.limits.timestampPeriod * 1e-6;
+}
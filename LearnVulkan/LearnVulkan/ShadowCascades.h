@@ -0,0 +1,114 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+#include <glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class Renderer;
+
+// One slice of the camera frustum and the light's view of it.
+struct ShadowCascade
+{
+	// From the space Draws' models map to into the cascade's clip space, z in [0, 1].
+	glm::mat4 ViewProjection = glm::mat4(1.0f);
+	// View space distances the cascade covers.
+	float Near = 0.0f;
+	float Far = 0.0f;
+};
+
+/*
+* Cascaded shadow maps of the renderer's Draws for a directional light. The camera
+* frustum, taken from Renderer::View and Projection, is split into Cascades slices up to
+* ShadowDistance and each slice gets an orthographic view from the light, one layer of
+* a depth array, with depth only pipelines derived from the cube's.
+*
+* The first StaticCasters draws are assumed never to move. Their depth is rendered once
+* into a cache, then every frame the cache is copied into the shadow map and only the
+* other draws are rendered over it. The cascades are fit to bounding spheres and snapped
+* to half their radius in light space, so camera rotation never moves them and
+* translation only does every few units. The cache is rendered again when a cascade moves,
+* when LightDirection changes, or after Invalidate.
+*
+* Recorded by DrawCube before the frame's render pass, with the instance grid of the
+* cube. Draws go through push constants whatever the DrawPath.
+*/
+class ShadowCascades
+{
+public:
+	ShadowCascades(Renderer* Rend, uint32_t Resolution = 2048, uint32_t Cascades = 4);
+	~ShadowCascades();
+
+	// Outside a render pass. Leaves the map in DEPTH_STENCIL_READ_ONLY_OPTIMAL, visible to
+	// fragment shaders.
+	void RecordShadows(VkCommandBuffer Cmd);
+	// Renders the static casters again next frame, after they changed.
+	void Invalidate() { CacheValid = false; }
+
+	// Every cascade, one layer each. The sampler compares, LESS_OR_EQUAL against the
+	// reference, and clamps to the border, lit.
+	VkImageView GetView() const { return ArrayView; }
+	VkSampler GetSampler() const { return Sampler; }
+	// Of the last RecordShadows.
+	const ShadowCascade& GetCascade(uint32_t Index) const { return Cascades[Index]; }
+	uint32_t GetCascadeCount() const { return (uint32_t)Cascades.size(); }
+	uint32_t GetResolution() const { return Resolution; }
+
+	// GPU time of the last shadow pass in milliseconds, copy included, once its frame
+	// finished. 0 when the queue has no timestamps.
+	double GetShadowTime() const;
+	// Whether the last RecordShadows rendered the static casters, and how many times it has.
+	bool WasCacheRendered() const { return CacheRendered; }
+	uint32_t GetCacheRenders() const { return CacheRenders; }
+
+	// Direction the light travels in, in the space Draws' models map to.
+	glm::vec3 LightDirection = glm::vec3(-0.3f, -1.0f, -0.2f);
+	// Draws before this index are static casters.
+	uint32_t StaticCasters = 0;
+	// View space distance the last cascade ends at, the camera's far plane when closer.
+	float ShadowDistance = 40.0f;
+	// 0 splits the distance evenly, 1 logarithmically.
+	float SplitLambda = 0.75f;
+	// How far toward the light casters outside a cascade's sphere still shadow it.
+	float CasterReach = 20.0f;
+
+private:
+	void InitImages();
+	void InitRenderPasses();
+	void InitPipeline();
+	void FitCascades();
+	void RecordCasters(VkCommandBuffer Cmd, uint32_t Cascade, uint32_t First, uint32_t End);
+
+	Renderer* Rend;
+	uint32_t Resolution;
+	std::vector<ShadowCascade> Cascades;
+	// Cascades the cache holds, it is stale when they differ from Cascades.
+	std::vector<ShadowCascade> CachedCascades;
+	bool CacheValid = false;
+	bool CacheRendered = false;
+	uint32_t CacheRenders = 0;
+	// The map is still UNDEFINED before the first frame.
+	bool Rendered = false;
+
+	// Static casters only, left in TRANSFER_SRC_OPTIMAL.
+	VkImage CacheImage = VK_NULL_HANDLE;
+	VkDeviceMemory CacheMemory = VK_NULL_HANDLE;
+	VkImage Image = VK_NULL_HANDLE;
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	VkImageView ArrayView = VK_NULL_HANDLE;
+	// One layer each, Cascades of the cache then Cascades of the map.
+	std::vector<VkImageView> LayerViews;
+	std::vector<VkFramebuffer> Framebuffers;
+	VkSampler Sampler = VK_NULL_HANDLE;
+
+	// Clears the cache. Loads the copied cache and draws the dynamic casters over it.
+	VkRenderPass CachePass = VK_NULL_HANDLE;
+	VkRenderPass OverlayPass = VK_NULL_HANDLE;
+	VkPipelineLayout Layout = VK_NULL_HANDLE;
+	// Compatible with both passes.
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	VkShaderModule Module = VK_NULL_HANDLE;
+
+	// Before and after the shadow pass.
+	VkQueryPool Timestamps = VK_NULL_HANDLE;
+};
@@ -0,0 +1,385 @@
+#include "SoftRasterImpl.h"
+#include "Cube.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+
+// Triangles per setup job. Every chunk keeps a bin per tile, so fewer and larger
+// chunks mean less for each tile to walk.
+static const uint32_t ChunkTriangles = 4096;
+// Clip space w below this is behind the eye.
+static const float MinClipW = 1e-5f;
+// Triangles are clipped to this many pixels either side of the target's center, which
+// keeps fixed point edge values within 32 bits across a tile, see SoftTriangle.
+static const float GuardBand = 4096.0f;
+
+struct SoftRasterizer::Chunk
+{
+	std::vector<SoftTriangle> Triangles;
+	// Indices into Triangles, one list per tile, in draw order.
+	std::vector<std::vector<uint32_t>> Bins;
+};
+
+namespace
+{
+	// One lane, the reference for the vector kernels.
+	struct Lanes1
+	{
+		static const int Lanes = 1;
+		typedef int32_t I;
+		typedef float F;
+		typedef bool M;
+
+		static I LoadI(const int32_t* P) { return *P; }
+		static I SetI(int32_t V) { return V; }
+		static I AddI(I A, I B) { return A + B; }
+		static F LoadF(const float* P) { return *P; }
+		static F SetF(float V) { return V; }
+		static F AddF(F A, F B) { return A + B; }
+		static F MulF(F A, F B) { return A * B; }
+		static F DivF(F A, F B) { return A / B; }
+		static F ClampF(F A) { return A < 0.0f ? 0.0f : (A > 1.0f ? 1.0f : A); }
+		static M Covered(I E0, I E1, I E2) { return (E0 | E1 | E2) >= 0; }
+		static M LessEqual(F A, F B) { return A <= B; }
+		static M And(M A, M B) { return A && B; }
+		static uint32_t Bits(M A) { return A ? 1 : 0; }
+		static void StoreF(float* Dst, M Mask, F V) { if (Mask) *Dst = V; }
+		static void StoreColor(uint32_t* Dst, M Mask, F R, F G, F B, F A)
+		{
+			// Rounds to nearest even like the vector conversions.
+			if (Mask)
+				*Dst = (uint32_t)std::nearbyint(R * 255.0f) | ((uint32_t)std::nearbyint(G * 255.0f) << 8) |
+					((uint32_t)std::nearbyint(B * 255.0f) << 16) | ((uint32_t)std::nearbyint(A * 255.0f) << 24);
+		}
+	};
+
+	struct ClipVertex
+	{
+		glm::vec4 Position;
+		glm::vec4 Color;
+	};
+
+	uint32_t PackColor(const glm::vec4& Color)
+	{
+		glm::vec4 C = glm::clamp(Color, 0.0f, 1.0f) * 255.0f;
+		return (uint32_t)std::nearbyint(C.x) | ((uint32_t)std::nearbyint(C.y) << 8) |
+			((uint32_t)std::nearbyint(C.z) << 16) | ((uint32_t)std::nearbyint(C.w) << 24);
+	}
+
+	// Body(i) for i in [0, Count), spread over Threads threads including the caller.
+	void ParallelFor(uint32_t Threads, uint32_t Count, const std::function<void(uint32_t)>& Body)
+	{
+		std::atomic<uint32_t> Next(0);
+		auto Worker = [&]()
+		{
+			for (uint32_t i = Next.fetch_add(1); i < Count; i = Next.fetch_add(1))
+				Body(i);
+		};
+		std::vector<std::thread> Pool;
+		for (uint32_t t = 1; t < Threads && t < Count; t++)
+			Pool.emplace_back(Worker);
+		Worker();
+		for (auto& Thread : Pool)
+			Thread.join();
+	}
+
+	// Sutherland-Hodgman against Plane . Position + Offset >= 0. Returns the new vertex count.
+	uint32_t ClipPolygon(const ClipVertex* In, uint32_t Count, const glm::vec4& Plane, float Offset, ClipVertex* Out)
+	{
+		uint32_t OutCount = 0;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			const ClipVertex& A = In[i];
+			const ClipVertex& B = In[(i + 1) % Count];
+			float Da = glm::dot(Plane, A.Position) + Offset;
+			float Db = glm::dot(Plane, B.Position) + Offset;
+			if (Da >= 0.0f)
+				Out[OutCount++] = A;
+			if ((Da >= 0.0f) != (Db >= 0.0f))
+			{
+				float t = Da / (Da - Db);
+				Out[OutCount].Position = A.Position + (B.Position - A.Position) * t;
+				Out[OutCount].Color = A.Color + (B.Color - A.Color) * t;
+				OutCount++;
+			}
+		}
+		return OutCount;
+	}
+
+	// P[0] * x + P[1] * y + P[2] through the three values at the vertices, in double
+	// so large triangles keep their precision.
+	void SetupPlane(const double* X, const double* Y, double Det, float V0, float V1, float V2, float* P)
+	{
+		double Dv1 = (double)V1 - V0, Dv2 = (double)V2 - V0;
+		double Px = (Dv1 * (Y[2] - Y[0]) - Dv2 * (Y[1] - Y[0])) / Det;
+		double Py = (Dv2 * (X[1] - X[0]) - Dv1 * (X[2] - X[0])) / Det;
+		P[0] = (float)Px;
+		P[1] = (float)Py;
+		P[2] = (float)(V0 - Px * X[0] - Py * Y[0]);
+	}
+}
+
+SoftRasterizer::SoftRasterizer(uint32_t Width, uint32_t Height, uint32_t Threads)
+	: Width(Width), Height(Height)
+{
+	TilesX = (Width + TileSize - 1) / TileSize;
+	TilesY = (Height + TileSize - 1) / TileSize;
+	Stride = TilesX * TileSize;
+	ThreadCount = Threads ? Threads : std::max(1u, std::thread::hardware_concurrency());
+	Color.resize((size_t)Stride * TilesY * TileSize);
+	Depth.resize(Color.size());
+	Clear(glm::vec4(0.0f));
+}
+
+SoftRasterizer::~SoftRasterizer()
+{
+}
+
+void SoftRasterizer::Clear(const glm::vec4& ClearColor, float ClearDepth)
+{
+	std::fill(Color.begin(), Color.end(), PackColor(ClearColor));
+	std::fill(Depth.begin(), Depth.end(), ClearDepth);
+}
+
+void SoftRasterizer::Draw(const Vertex* Vertices, uint32_t VertexCount, const glm::mat4& MVP)
+{
+	if (VertexCount < 3)
+		return;
+	DrawCall Call;
+	Call.Vertices = Vertices;
+	Call.TriangleCount = VertexCount / 3;
+	Call.FirstTriangle = TriangleCount;
+	Call.MVP = MVP;
+	Draws.push_back(Call);
+	TriangleCount += Call.TriangleCount;
+}
+
+void SoftRasterizer::Flush()
+{
+	switch (GetSimdLevel())
+	{
+#if TRANSFORM_KERNELS_X86
+	case SimdLevel::AVX512:
+	case SimdLevel::AVX2: Kernel = RasterizeTriangleAVX2; break;
+	case SimdLevel::SSE4: Kernel = RasterizeTriangleSSE4; break;
+#endif
+	default: Kernel = RasterizeTriangleScalar; break;
+	}
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	ChunkCount = (uint32_t)((TriangleCount + ChunkTriangles - 1) / ChunkTriangles);
+	while (Chunks.size() < ChunkCount)
+	{
+		Chunks.emplace_back(new Chunk());
+		Chunks.back()->Bins.resize(TilesX * TilesY);
+	}
+	ParallelFor(ThreadCount, ChunkCount, [this](uint32_t i) { SetupChunk(i); });
+	auto Binned = std::chrono::high_resolution_clock::now();
+
+	// Busiest tiles first, so a crowded one is not left to a single thread at the end.
+	uint32_t TileCount = TilesX * TilesY;
+	std::vector<uint32_t> Order(TileCount);
+	std::vector<size_t> Load(TileCount, 0);
+	for (uint32_t t = 0; t < TileCount; t++)
+	{
+		Order[t] = t;
+		for (uint32_t c = 0; c < ChunkCount; c++)
+			Load[t] += Chunks[c]->Bins[t].size();
+	}
+	std::stable_sort(Order.begin(), Order.end(), [&Load](uint32_t A, uint32_t B) { return Load[A] > Load[B]; });
+
+	std::atomic<uint64_t> Pixels(0);
+	ParallelFor(ThreadCount, TileCount, [&](uint32_t i) { Pixels += RasterizeTile(Order[i]); });
+	auto End = std::chrono::high_resolution_clock::now();
+
+	Stats = SoftRasterStats();
+	Stats.Triangles = TriangleCount;
+	for (uint32_t c = 0; c < ChunkCount; c++)
+		Stats.Rasterized += Chunks[c]->Triangles.size();
+	Stats.Pixels = Pixels;
+	Stats.SetupTime = std::chrono::duration<double>(Binned - Start).count();
+	Stats.RasterTime = std::chrono::duration<double>(End - Binned).count();
+
+	Draws.clear();
+	TriangleCount = 0;
+}
+
+void SoftRasterizer::SetupChunk(uint32_t Index)
+{
+	Chunk& Out = *Chunks[Index];
+	Out.Triangles.clear();
+	for (auto& Bin : Out.Bins)
+		Bin.clear();
+
+	uint64_t Begin = (uint64_t)Index * ChunkTriangles;
+	uint64_t End = std::min(Begin + ChunkTriangles, TriangleCount);
+	size_t d = std::upper_bound(Draws.begin(), Draws.end(), Begin,
+		[](uint64_t T, const DrawCall& Call) { return T < Call.FirstTriangle; }) - Draws.begin() - 1;
+
+	// Screen coordinates stay inside the guard band around the center of the target, and
+	// depth inside [0, w].
+	const float GuardX = GuardBand / (Width * 0.5f);
+	const float GuardY = GuardBand / (Height * 0.5f);
+	const glm::vec4 Planes[6] = { glm::vec4(1, 0, 0, GuardX), glm::vec4(-1, 0, 0, GuardX), glm::vec4(0, 1, 0, GuardY),
+		glm::vec4(0, -1, 0, GuardY), glm::vec4(0, 0, 1, 0), glm::vec4(0, 0, -1, 1) };
+	const float One = (float)(1 << SOFT_RASTER_SUBPIXEL_BITS);
+
+	for (uint64_t t = Begin; t < End; t++)
+	{
+		while (t >= Draws[d].FirstTriangle + Draws[d].TriangleCount)
+			d++;
+		const DrawCall& Call = Draws[d];
+		const Vertex* In = Call.Vertices + (t - Call.FirstTriangle) * 3;
+
+		// The vertex shader ignores posW, see cube.vert.
+		ClipVertex Polygon[2][10];
+		uint32_t Outside = ~0u, Clipped = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			glm::vec4 P = Call.MVP * glm::vec4(In[i].posX, In[i].posY, In[i].posZ, 1.0f);
+			Polygon[0][i].Position = P;
+			Polygon[0][i].Color = glm::vec4(In[i].r, In[i].g, In[i].b, In[i].a);
+			// Past the target, or past the guard band or the depth range and in need of clipping.
+			uint32_t Code = (P.x < -P.w ? 1 : 0) | (P.x > P.w ? 2 : 0) | (P.y < -P.w ? 4 : 0) | (P.y > P.w ? 8 : 0) |
+				(P.w < MinClipW ? 16 : 0) | (P.z < 0.0f ? 32 : 0) | (P.z > P.w ? 64 : 0);
+			Outside &= Code;
+			if (P.w < MinClipW || std::fabs(P.x) > GuardX * P.w || std::fabs(P.y) > GuardY * P.w || P.z < 0.0f || P.z > P.w)
+				Clipped = 1;
+		}
+		if (Outside)
+			continue;
+
+		uint32_t Count = 3, Current = 0;
+		if (Clipped)
+		{
+			Count = ClipPolygon(Polygon[0], Count, glm::vec4(0, 0, 0, 1), -MinClipW, Polygon[1]);
+			Current = 1;
+			for (int p = 0; p < 6 && Count >= 3; p++)
+			{
+				Count = ClipPolygon(Polygon[Current], Count, Planes[p], 0.0f, Polygon[Current ^ 1]);
+				Current ^= 1;
+			}
+		}
+
+		// A fan over what is left.
+		const ClipVertex* Poly = Polygon[Current];
+		for (uint32_t v = 1; v + 1 < Count; v++)
+		{
+			const ClipVertex* Corners[3] = { &Poly[0], &Poly[v], &Poly[v + 1] };
+			int64_t X[3], Y[3];
+			double Xf[3], Yf[3];
+			float Z[3], InvW[3];
+			for (int i = 0; i < 3; i++)
+			{
+				const glm::vec4& P = Corners[i]->Position;
+				InvW[i] = 1.0f / P.w;
+				X[i] = (int64_t)std::nearbyint((P.x * InvW[i] + 1.0f) * Width * 0.5f * One);
+				Y[i] = (int64_t)std::nearbyint((P.y * InvW[i] + 1.0f) * Height * 0.5f * One);
+				Xf[i] = X[i] / (double)One;
+				Yf[i] = Y[i] / (double)One;
+				Z[i] = P.z * InvW[i];
+			}
+
+			// Clockwise is front facing, and in framebuffer space with y down that makes
+			// the area positive. Back faces and slivers that snapped to nothing are dropped.
+			int64_t Area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+			if (Area <= 0)
+				continue;
+
+			SoftTriangle Tri;
+			int64_t MinX = std::min(X[0], std::min(X[1], X[2])), MaxX = std::max(X[0], std::max(X[1], X[2]));
+			int64_t MinY = std::min(Y[0], std::min(Y[1], Y[2])), MaxY = std::max(Y[0], std::max(Y[1], Y[2]));
+			Tri.MinX = (int32_t)std::max<int64_t>(0, (int64_t)std::floor(MinX / One));
+			Tri.MinY = (int32_t)std::max<int64_t>(0, (int64_t)std::floor(MinY / One));
+			Tri.MaxX = (int32_t)std::min<int64_t>(Width - 1, (int64_t)std::floor(MaxX / One));
+			Tri.MaxY = (int32_t)std::min<int64_t>(Height - 1, (int64_t)std::floor(MaxY / One));
+			if (Tri.MinX > Tri.MaxX || Tri.MinY > Tri.MaxY)
+				continue;
+
+			for (int e = 0; e < 3; e++)
+			{
+				int n = (e + 1) % 3;
+				Tri.A[e] = (int32_t)(Y[e] - Y[n]);
+				Tri.B[e] = (int32_t)(X[n] - X[e]);
+				Tri.C[e] = -((int64_t)Tri.A[e] * X[e] + (int64_t)Tri.B[e] * Y[e]);
+				// Top-left rule: samples exactly on an edge belong to it only if it is a
+				// top or a left edge, so triangles sharing an edge never both cover one.
+				bool TopLeft = Tri.A[e] > 0 || (Tri.A[e] == 0 && Tri.B[e] > 0);
+				if (!TopLeft)
+					Tri.C[e] -= 1;
+			}
+
+			double Det = Area / (double)(One * One);
+			SetupPlane(Xf, Yf, Det, Z[0], Z[1], Z[2], Tri.Z);
+			SetupPlane(Xf, Yf, Det, InvW[0], InvW[1], InvW[2], Tri.InvW);
+			for (int c = 0; c < 4; c++)
+				SetupPlane(Xf, Yf, Det, Corners[0]->Color[c] * InvW[0], Corners[1]->Color[c] * InvW[1],
+					Corners[2]->Color[c] * InvW[2], Tri.Color[c]);
+
+			uint32_t TriIndex = (uint32_t)Out.Triangles.size();
+			Out.Triangles.push_back(Tri);
+			for (int32_t ty = Tri.MinY / (int32_t)TileSize; ty <= Tri.MaxY / (int32_t)TileSize; ty++)
+				for (int32_t tx = Tri.MinX / (int32_t)TileSize; tx <= Tri.MaxX / (int32_t)TileSize; tx++)
+					Out.Bins[ty * TilesX + tx].push_back(TriIndex);
+		}
+	}
+}
+
+uint32_t SoftRasterizer::RasterizeTile(uint32_t Index)
+{
+	SoftTile Tile;
+	Tile.X0 = (Index % TilesX) * TileSize;
+	Tile.Y0 = (Index / TilesX) * TileSize;
+	Tile.X1 = Tile.X0 + TileSize;
+	Tile.Y1 = Tile.Y0 + TileSize;
+	Tile.Width = Width;
+	Tile.Stride = Stride;
+	Tile.Color = Color.data();
+	Tile.Depth = Depth.data();
+
+	uint32_t Written = 0;
+	for (uint32_t c = 0; c < ChunkCount; c++)
+	{
+		const Chunk& In = *Chunks[c];
+		for (uint32_t Tri : In.Bins[Index])
+			Written += Kernel(In.Triangles[Tri], Tile);
+	}
+	return Written;
+}
+
+double SoftRasterizer::Compare(const uint8_t* Pixels, uint32_t RowPitch, bool Bgra, uint32_t Tolerance, uint32_t* MaxError) const
+{
+	uint64_t Different = 0;
+	uint32_t Largest = 0;
+	for (uint32_t y = 0; y < Height; y++)
+	{
+		const uint8_t* Row = Pixels + (size_t)y * RowPitch;
+		for (uint32_t x = 0; x < Width; x++)
+		{
+			const uint8_t* Other = Row + x * 4;
+			uint32_t Mine = GetPixel(x, y);
+			uint32_t Error = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				int Theirs = Other[Bgra && c < 3 ? 2 - c : c];
+				int Diff = std::abs((int)((Mine >> (c * 8)) & 0xFF) - Theirs);
+				Error = std::max(Error, (uint32_t)Diff);
+			}
+			Largest = std::max(Largest, Error);
+			if (Error > Tolerance)
+				Different++;
+		}
+	}
+	if (MaxError)
+		*MaxError = Largest;
+	return (double)Different / ((double)Width * Height);
+}
+
+uint32_t RasterizeTriangleScalar(const SoftTriangle& Tri, const SoftTile& Tile)
+{
+	return RasterizeTriangleLanes<Lanes1>(Tri, Tile);
+}
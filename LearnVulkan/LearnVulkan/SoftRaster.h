@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TransformKernels.h"
+
+struct Vertex;
+struct SoftTriangle;
+struct SoftTile;
+
+struct SoftRasterStats
+{
+	// Triangles drawn, and what was left of them after culling and clipping.
+	uint64_t Triangles = 0;
+	uint64_t Rasterized = 0;
+	// Pixels that passed the depth test and were written.
+	uint64_t Pixels = 0;
+	// Seconds spent transforming and binning, then rasterizing tiles.
+	double SetupTime = 0.0;
+	double RasterTime = 0.0;
+};
+
+/*
+* CPU version of the cube pipeline, for checking and timing the geometry path without
+* a Vulkan driver. Draws the same Vertex triangle lists with an MVP and follows what
+* InitGraphicsPipeline sets up: clockwise front faces with back faces culled, depth
+* clipped to [0, w], LESS_OR_EQUAL depth test and write, no blending, the
+* vertex color interpolated with perspective. Samples at pixel centers with 4 bits of
+* subpixel precision, Vulkan's minimum, so edges can differ from a GPU by a pixel.
+*
+* Draws are only recorded, Flush transforms and bins them into 64x64 tiles and then
+* rasterizes the tiles on a pool of threads, each tile with the widest edge function
+* kernel GetSimdLevel() allows. Draw order is kept inside every tile.
+*/
+class SoftRasterizer
+{
+public:
+	static const uint32_t TileSize = 64;
+
+	// Threads 0 uses every hardware thread.
+	SoftRasterizer(uint32_t Width, uint32_t Height, uint32_t Threads = 0);
+	~SoftRasterizer();
+
+	void Clear(const glm::vec4& Color, float Depth = 1.0f);
+	// A triangle list. The vertices are read by Flush, they have to stay valid until then.
+	void Draw(const Vertex* Vertices, uint32_t VertexCount, const glm::mat4& MVP);
+	void Flush();
+
+	uint32_t GetWidth() const { return Width; }
+	uint32_t GetHeight() const { return Height; }
+	uint32_t GetThreadCount() const { return ThreadCount; }
+	// Of the last Flush.
+	const SoftRasterStats& GetStats() const { return Stats; }
+
+	// R8G8B8A8, R in the lowest byte.
+	uint32_t GetPixel(uint32_t X, uint32_t Y) const { return Color[Y * Stride + X]; }
+	float GetDepth(uint32_t X, uint32_t Y) const { return Depth[Y * Stride + X]; }
+
+	// Fraction of pixels where some channel of an 8 bit RGBA or BGRA image differs from
+	// this one by more than Tolerance. MaxError receives the largest difference.
+	double Compare(const uint8_t* Pixels, uint32_t RowPitch, bool Bgra, uint32_t Tolerance,
+		uint32_t* MaxError = nullptr) const;
+
+private:
+	struct DrawCall
+	{
+		const Vertex* Vertices;
+		uint32_t TriangleCount;
+		// Of the first triangle, counted over every draw since the last Flush.
+		uint64_t FirstTriangle;
+		glm::mat4 MVP;
+	};
+	struct Chunk;
+
+	void SetupChunk(uint32_t Index);
+	uint32_t RasterizeTile(uint32_t Tile);
+
+	uint32_t Width;
+	uint32_t Height;
+	// Rows are padded to whole tiles so kernels never run off the end of one.
+	uint32_t Stride;
+	uint32_t TilesX;
+	uint32_t TilesY;
+	uint32_t ThreadCount;
+	std::vector<uint32_t> Color;
+	std::vector<float> Depth;
+
+	std::vector<DrawCall> Draws;
+	uint64_t TriangleCount = 0;
+	// A fixed run of triangles each, set up by one thread into its own bins so tiles
+	// can replay them in order. Kept between frames for their capacity.
+	std::vector<std::unique_ptr<Chunk>> Chunks;
+	uint32_t ChunkCount = 0;
+	// Picked by Flush from GetSimdLevel().
+	uint32_t (*Kernel)(const SoftTriangle& Tri, const SoftTile& Tile) = nullptr;
+	SoftRasterStats Stats;
+};
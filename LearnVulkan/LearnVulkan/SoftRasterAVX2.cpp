@@ -0,0 +1,51 @@
+// Built with AVX2 and FMA enabled, only called when DetectSimdLevel() allows it.
+
+#include "SoftRasterImpl.h"
+
+#if TRANSFORM_KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	struct Lanes8
+	{
+		static const int Lanes = 8;
+		typedef __m256i I;
+		typedef __m256 F;
+		typedef __m256 M;
+
+		static I LoadI(const int32_t* P) { return _mm256_loadu_si256((const __m256i*)P); }
+		static I SetI(int32_t V) { return _mm256_set1_epi32(V); }
+		static I AddI(I A, I B) { return _mm256_add_epi32(A, B); }
+		static F LoadF(const float* P) { return _mm256_loadu_ps(P); }
+		static F SetF(float V) { return _mm256_set1_ps(V); }
+		static F AddF(F A, F B) { return _mm256_add_ps(A, B); }
+		static F MulF(F A, F B) { return _mm256_mul_ps(A, B); }
+		static F DivF(F A, F B) { return _mm256_div_ps(A, B); }
+		static F ClampF(F A) { return _mm256_min_ps(_mm256_max_ps(A, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)); }
+		// The sign bits of the three edges together.
+		static M Covered(I E0, I E1, I E2)
+		{
+			return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_or_si256(E0, _mm256_or_si256(E1, E2)), _mm256_set1_epi32(-1)));
+		}
+		static M LessEqual(F A, F B) { return _mm256_cmp_ps(A, B, _CMP_LE_OQ); }
+		static M And(M A, M B) { return _mm256_and_ps(A, B); }
+		static uint32_t Bits(M A) { return (uint32_t)_mm256_movemask_ps(A); }
+		static void StoreF(float* Dst, M Mask, F V) { _mm256_storeu_ps(Dst, _mm256_blendv_ps(_mm256_loadu_ps(Dst), V, Mask)); }
+		static void StoreColor(uint32_t* Dst, M Mask, F R, F G, F B, F A)
+		{
+			__m256 Scale = _mm256_set1_ps(255.0f);
+			__m256i Packed = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cvtps_epi32(_mm256_mul_ps(R, Scale)), _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(G, Scale)), 8)),
+				_mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(B, Scale)), 16), _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(A, Scale)), 24)));
+			__m256 Old = _mm256_loadu_ps((const float*)Dst);
+			_mm256_storeu_ps((float*)Dst, _mm256_blendv_ps(Old, _mm256_castsi256_ps(Packed), Mask));
+		}
+	};
+}
+
+uint32_t RasterizeTriangleAVX2(const SoftTriangle& Tri, const SoftTile& Tile)
+{
+	return RasterizeTriangleLanes<Lanes8>(Tri, Tile);
+}
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+
+// Shared by the SoftRaster*.cpp files only.
+
+#include "SoftRaster.h"
+#include "TransformKernelsImpl.h"
+
+// Screen positions are fixed point with this many fractional bits.
+#define SOFT_RASTER_SUBPIXEL_BITS 4
+
+/*
+* A triangle after setup, in pixels of the target. Edge i is A * x + B * y + C in
+* fixed point with x and y at the sample, it is >= 0 inside, top-left ties already
+* folded into C. Its magnitude stays below 2^29 across a tile, the clipping guard
+* band keeps the coordinates small enough for that.
+*
+* The planes are P[0] * x + P[1] * y + P[2] at pixel centers: z, 1 / w and the
+* color divided by w.
+*/
+struct SoftTriangle
+{
+	int32_t A[3];
+	int32_t B[3];
+	int64_t C[3];
+	// Inclusive pixel bounds, inside the target.
+	int32_t MinX, MinY, MaxX, MaxY;
+	float Z[3];
+	float InvW[3];
+	float Color[4][3];
+};
+
+// One tile of the color and depth buffers, X1 and Y1 exclusive.
+struct SoftTile
+{
+	int32_t X0, Y0, X1, Y1;
+	// Pixels past the target's width are padding, they are written but not counted.
+	int32_t Width;
+	uint32_t Stride;
+	uint32_t* Color;
+	float* Depth;
+};
+
+// Every kernel returns the pixels it wrote.
+#define DECLARE_SOFT_RASTER_KERNELS(Suffix) \
+	uint32_t RasterizeTriangle##Suffix(const SoftTriangle& Tri, const SoftTile& Tile);
+
+DECLARE_SOFT_RASTER_KERNELS(Scalar)
+#if TRANSFORM_KERNELS_X86
+DECLARE_SOFT_RASTER_KERNELS(SSE4)
+DECLARE_SOFT_RASTER_KERNELS(AVX2)
+#endif
+
+static inline int32_t SoftRasterPopCount(uint32_t Bits)
+{
+	int32_t Count = 0;
+	for (; Bits; Bits &= Bits - 1)
+		Count++;
+	return Count;
+}
+
+/*
+* The scanline loop written once for any lane type V. V has an int vector I, a float
+* vector F and a mask M, with:
+*   Lanes, LoadI, SetI, AddI, LoadF, SetF, AddF, MulF, DivF, ClampF(x) to [0, 1],
+*   Covered(e0, e1, e2) where all three are >= 0, LessEqual, And, Bits(M) one bit per lane,
+*   StoreF(dst, M, value) and StoreColor(dst, M, r, g, b, a) writing only the masked lanes.
+* Spans start at a multiple of Lanes and tiles are whole multiples of it, so a span never
+* leaves the tile.
+*/
+template <class V>
+inline uint32_t RasterizeTriangleLanes(const SoftTriangle& Tri, const SoftTile& Tile)
+{
+	typedef typename V::I I;
+	typedef typename V::F F;
+	typedef typename V::M M;
+	const int32_t One = 1 << SOFT_RASTER_SUBPIXEL_BITS;
+	const int64_t Limit = (int64_t)1 << 30;
+
+	int32_t MinX = Tri.MinX > Tile.X0 ? Tri.MinX : Tile.X0;
+	int32_t MinY = Tri.MinY > Tile.Y0 ? Tri.MinY : Tile.Y0;
+	int32_t MaxX = Tri.MaxX < Tile.X1 - 1 ? Tri.MaxX : Tile.X1 - 1;
+	int32_t MaxY = Tri.MaxY < Tile.Y1 - 1 ? Tri.MaxY : Tile.Y1 - 1;
+	if (MinX > MaxX || MinY > MaxY)
+		return 0;
+	MinX -= (MinX - Tile.X0) % V::Lanes;
+
+	// Edges at the first pixel's center. Far outside means outside the whole tile, far
+	// inside is clamped so the steps can be taken in 32 bits.
+	int32_t Row[3];
+	I LaneOffset[3], SpanStep[3];
+	int32_t LaneSteps[V::Lanes];
+	for (int e = 0; e < 3; e++)
+	{
+		int64_t E = (int64_t)Tri.A[e] * (MinX * One + One / 2) + (int64_t)Tri.B[e] * (MinY * One + One / 2) + Tri.C[e];
+		if (E <= -Limit)
+			return 0;
+		Row[e] = (int32_t)(E < Limit ? E : Limit);
+		for (int l = 0; l < V::Lanes; l++)
+			LaneSteps[l] = Tri.A[e] * One * l;
+		LaneOffset[e] = V::LoadI(LaneSteps);
+		SpanStep[e] = V::SetI(Tri.A[e] * One * V::Lanes);
+	}
+
+	// Planes at the first pixel's center, z, 1 / w and the four color channels.
+	const float* Planes[6] = { Tri.Z, Tri.InvW, Tri.Color[0], Tri.Color[1], Tri.Color[2], Tri.Color[3] };
+	float PlaneRow[6];
+	F PlaneOffset[6], PlaneStep[6];
+	float Ramp[V::Lanes];
+	for (int l = 0; l < V::Lanes; l++)
+		Ramp[l] = (float)l;
+	F LaneRamp = V::LoadF(Ramp);
+	for (int p = 0; p < 6; p++)
+	{
+		PlaneRow[p] = Planes[p][0] * (MinX + 0.5f) + Planes[p][1] * (MinY + 0.5f) + Planes[p][2];
+		PlaneOffset[p] = V::MulF(LaneRamp, V::SetF(Planes[p][0]));
+		PlaneStep[p] = V::SetF(Planes[p][0] * V::Lanes);
+	}
+
+	uint32_t Written = 0;
+	for (int32_t y = MinY; y <= MaxY; y++)
+	{
+		I E0 = V::AddI(V::SetI(Row[0]), LaneOffset[0]);
+		I E1 = V::AddI(V::SetI(Row[1]), LaneOffset[1]);
+		I E2 = V::AddI(V::SetI(Row[2]), LaneOffset[2]);
+		F Plane[6];
+		for (int p = 0; p < 6; p++)
+			Plane[p] = V::AddF(V::SetF(PlaneRow[p]), PlaneOffset[p]);
+
+		uint32_t* ColorRow = Tile.Color + (size_t)y * Tile.Stride;
+		float* DepthRow = Tile.Depth + (size_t)y * Tile.Stride;
+		for (int32_t x = MinX; x <= MaxX; x += V::Lanes)
+		{
+			M Inside = V::Covered(E0, E1, E2);
+			if (V::Bits(Inside))
+			{
+				F Z = V::ClampF(Plane[0]);
+				M Pass = V::And(Inside, V::LessEqual(Z, V::LoadF(DepthRow + x)));
+				if (uint32_t Bits = V::Bits(Pass))
+				{
+					V::StoreF(DepthRow + x, Pass, Z);
+					F W = V::DivF(V::SetF(1.0f), Plane[1]);
+					V::StoreColor(ColorRow + x, Pass,
+						V::ClampF(V::MulF(Plane[2], W)), V::ClampF(V::MulF(Plane[3], W)),
+						V::ClampF(V::MulF(Plane[4], W)), V::ClampF(V::MulF(Plane[5], W)));
+					if (x + V::Lanes > Tile.Width)
+						Bits &= (1u << (Tile.Width > x ? Tile.Width - x : 0)) - 1;
+					Written += SoftRasterPopCount(Bits);
+				}
+			}
+			E0 = V::AddI(E0, SpanStep[0]);
+			E1 = V::AddI(E1, SpanStep[1]);
+			E2 = V::AddI(E2, SpanStep[2]);
+			for (int p = 0; p < 6; p++)
+				Plane[p] = V::AddF(Plane[p], PlaneStep[p]);
+		}
+		for (int e = 0; e < 3; e++)
+			Row[e] += Tri.B[e] * One;
+		for (int p = 0; p < 6; p++)
+			PlaneRow[p] += Planes[p][1];
+	}
+	return Written;
+}
@@ -0,0 +1,51 @@
+// Built with SSE4.1 enabled, only called when DetectSimdLevel() allows it.
+
+#include "SoftRasterImpl.h"
+
+#if TRANSFORM_KERNELS_X86
+#include <smmintrin.h>
+
+namespace
+{
+	struct Lanes4
+	{
+		static const int Lanes = 4;
+		typedef __m128i I;
+		typedef __m128 F;
+		typedef __m128 M;
+
+		static I LoadI(const int32_t* P) { return _mm_loadu_si128((const __m128i*)P); }
+		static I SetI(int32_t V) { return _mm_set1_epi32(V); }
+		static I AddI(I A, I B) { return _mm_add_epi32(A, B); }
+		static F LoadF(const float* P) { return _mm_loadu_ps(P); }
+		static F SetF(float V) { return _mm_set1_ps(V); }
+		static F AddF(F A, F B) { return _mm_add_ps(A, B); }
+		static F MulF(F A, F B) { return _mm_mul_ps(A, B); }
+		static F DivF(F A, F B) { return _mm_div_ps(A, B); }
+		static F ClampF(F A) { return _mm_min_ps(_mm_max_ps(A, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+		// The sign bits of the three edges together.
+		static M Covered(I E0, I E1, I E2)
+		{
+			return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(E0, _mm_or_si128(E1, E2)), _mm_set1_epi32(-1)));
+		}
+		static M LessEqual(F A, F B) { return _mm_cmple_ps(A, B); }
+		static M And(M A, M B) { return _mm_and_ps(A, B); }
+		static uint32_t Bits(M A) { return (uint32_t)_mm_movemask_ps(A); }
+		static void StoreF(float* Dst, M Mask, F V) { _mm_storeu_ps(Dst, _mm_blendv_ps(_mm_loadu_ps(Dst), V, Mask)); }
+		static void StoreColor(uint32_t* Dst, M Mask, F R, F G, F B, F A)
+		{
+			__m128 Scale = _mm_set1_ps(255.0f);
+			__m128i Packed = _mm_or_si128(
+				_mm_or_si128(_mm_cvtps_epi32(_mm_mul_ps(R, Scale)), _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(G, Scale)), 8)),
+				_mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(B, Scale)), 16), _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(A, Scale)), 24)));
+			__m128 Old = _mm_loadu_ps((const float*)Dst);
+			_mm_storeu_ps((float*)Dst, _mm_blendv_ps(Old, _mm_castsi128_ps(Packed), Mask));
+		}
+	};
+}
+
+uint32_t RasterizeTriangleSSE4(const SoftTriangle& Tri, const SoftTile& Tile)
+{
+	return RasterizeTriangleLanes<Lanes4>(Tri, Tile);
+}
+#endif
@@ -0,0 +1,564 @@
+/*
+* Unit tests for the CPU side of the renderer, no GPU needed. ctest runs them all,
+* a single test runs with
+*   ./LearnVulkanTests <name>
+*/
+
+#include "Cube.h"
+#include "DrawPackets.h"
+#include "JobSystem.h"
+#include "MeshLod.h"
+#include "Meshlets.h"
+#include "SceneHierarchy.h"
+#include "SoftRaster.h"
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+static int Failures = 0;
+
+#define TEST_CHECK(Condition) \
+	do { \
+		if (!(Condition)) \
+		{ \
+			std::cout << __FILE__ << ":" << __LINE__ << ": failed: " << #Condition << "\n"; \
+			Failures++; \
+		} \
+	} while (0)
+
+/*
+* A V shaped trough, y = |x| / 2, with its front faces up into the valley. Every
+* meshlet the cone test rejects must only hold triangles facing away from the camera,
+* a camera down in the valley sees all of them.
+*/
+static void TestMeshletConcaveCone()
+{
+	const int Cells = 6;
+	std::vector<glm::vec3> Positions;
+	for (int z = 0; z <= Cells; z++)
+	{
+		for (int x = 0; x <= Cells; x++)
+		{
+			float X = -1.0f + 2.0f * x / Cells;
+			Positions.push_back(glm::vec3(X, std::fabs(X) * 0.5f, -1.0f + 2.0f * z / Cells));
+		}
+	}
+	std::vector<uint32_t> Indices;
+	auto AddTriangle = [&](uint32_t A, uint32_t B, uint32_t C)
+	{
+		// Front faces wind so that cross(C - A, B - A) points out of them, make that up.
+		if (glm::cross(Positions[C] - Positions[A], Positions[B] - Positions[A]).y < 0.0f)
+			std::swap(B, C);
+		Indices.insert(Indices.end(), { A, B, C });
+	};
+	for (int z = 0; z < Cells; z++)
+	{
+		for (int x = 0; x < Cells; x++)
+		{
+			uint32_t V = z * (Cells + 1) + x;
+			AddTriangle(V, V + 1, V + Cells + 1);
+			AddTriangle(V + 1, V + Cells + 2, V + Cells + 1);
+		}
+	}
+
+	MeshletMesh Mesh = BuildMeshlets(&Positions[0].x, Positions.size(), sizeof(glm::vec3), Indices.data(), Indices.size());
+	TEST_CHECK(!Mesh.Meshlets.empty());
+	TEST_CHECK(Mesh.Indices.size() == Indices.size());
+
+	const glm::vec3 Cameras[] = {
+		glm::vec3(0.0f, 0.15f, 0.0f),
+		glm::vec3(0.5f, 0.3f, 0.5f),
+		glm::vec3(0.0f, 3.0f, 0.0f),
+		glm::vec3(0.0f, -3.0f, 0.0f),
+	};
+	for (auto& Camera : Cameras)
+	{
+		MeshletCullView View;
+		View.ViewProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.01f, 100.0f) *
+			glm::lookAt(Camera, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		View.Camera = Camera;
+		View.PixelsPerUnit = 540.0f;
+		View.MinPixels = 0.0f;
+
+		bool AnyFront = false;
+		for (auto& Cluster : Mesh.Meshlets)
+		{
+			bool Front = false;
+			for (uint32_t i = Cluster.FirstIndex; i < Cluster.FirstIndex + Cluster.TriangleCount * 3; i += 3)
+			{
+				glm::vec3 A = Positions[Mesh.Indices[i]];
+				glm::vec3 N = glm::cross(Positions[Mesh.Indices[i + 2]] - A, Positions[Mesh.Indices[i + 1]] - A);
+				Front = Front || glm::dot(N, Camera - A) > 0.0f;
+			}
+			AnyFront = AnyFront || Front;
+			if (Front)
+				TEST_CHECK(CullMeshlet(Cluster, glm::mat4(1.0f), View) != MeshletCull::Backface);
+		}
+		// From below every triangle faces away, the cone has to catch that too.
+		if (!AnyFront)
+		{
+			for (auto& Cluster : Mesh.Meshlets)
+				TEST_CHECK(CullMeshlet(Cluster, glm::mat4(1.0f), View) == MeshletCull::Backface);
+		}
+	}
+}
+
+/*
+* Keys hold their fields, and sorting orders packets exactly as a stable sort on the
+* key would, including the skipped passes and packets with equal keys.
+*/
+static void TestDrawPacketSort()
+{
+	uint64_t Key = MakeDrawKey(3, 4095, 1234, 255, 77);
+	TEST_CHECK(DrawKeyPipeline(Key) == 4095);
+	TEST_CHECK(DrawKeyMaterial(Key) == 1234);
+	TEST_CHECK(DrawKeyVertexBuffer(Key) == 255);
+	TEST_CHECK(MakeDrawKey(1, 0, 0, 0, 0) > MakeDrawKey(0, 4095, 65535, 255, (1u << DrawKeyDepthBits) - 1));
+
+	TEST_CHECK(QuantizeDrawDepth(-1.0f, 0.1f, 100.0f) == 0);
+	TEST_CHECK(QuantizeDrawDepth(1000.0f, 0.1f, 100.0f) == (1u << DrawKeyDepthBits) - 1);
+	TEST_CHECK(QuantizeDrawDepth(10.0f, 0.1f, 100.0f) < QuantizeDrawDepth(10.5f, 0.1f, 100.0f));
+
+	std::mt19937 Random(7);
+	DrawPacketQueue Queue;
+	std::vector<DrawPacket> Expected;
+	for (uint32_t i = 0; i < 5000; i++)
+	{
+		// Few pipelines and materials so many keys repeat, the top bytes stay the same.
+		uint64_t PacketKey = MakeDrawKey(0, Random() % 3, Random() % 5, Random() % 2, Random() % 64);
+		Queue.Submit(PacketKey, i);
+		Expected.push_back({ PacketKey, i });
+	}
+	std::stable_sort(Expected.begin(), Expected.end(),
+		[](const DrawPacket& A, const DrawPacket& B) { return A.Key < B.Key; });
+	Queue.Sort();
+
+	const std::vector<DrawPacket>& Sorted = Queue.GetPackets();
+	TEST_CHECK(Sorted.size() == Expected.size());
+	bool Same = Sorted.size() == Expected.size();
+	for (size_t i = 0; Same && i < Sorted.size(); i++)
+		Same = Sorted[i].Key == Expected[i].Key && Sorted[i].Payload == Expected[i].Payload;
+	TEST_CHECK(Same);
+}
+
+// Largest difference between two matrices, relative to the size of the entries.
+static float MatrixError(const glm::mat4& A, const glm::mat4& B)
+{
+	float Error = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+			Error = std::max(Error, std::fabs(A[c][r] - B[c][r]) / (1.0f + std::fabs(B[c][r])));
+	}
+	return Error;
+}
+
+/*
+* World matrices match parent world * T * R * S computed node by node, after the
+* first Update, after sparse edits and after nodes are added. Levels are bigger
+* than SceneLevelChunk, so the workers take part.
+*/
+static void TestSceneHierarchyUpdate()
+{
+	struct Local
+	{
+		glm::vec3 Position;
+		glm::quat Rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 Scale;
+	};
+	std::mt19937 Random(11);
+	std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+	auto RandomLocal = [&]()
+	{
+		Local L;
+		L.Position = glm::vec3(Unit(Random), Unit(Random), Unit(Random));
+		L.Rotation = glm::normalize(glm::quat(Unit(Random), Unit(Random), Unit(Random), Unit(Random)));
+		L.Scale = glm::vec3(1.0f + 0.1f * Unit(Random));
+		return L;
+	};
+
+	SceneHierarchy Scene(2);
+	std::vector<Local> Locals;
+	std::vector<SceneNode> Parents;
+	auto AddNode = [&](SceneNode Parent)
+	{
+		Local L = RandomLocal();
+		SceneNode Node = Scene.AddNode(Parent, L.Position, L.Rotation, L.Scale);
+		TEST_CHECK(Node == Locals.size());
+		Locals.push_back(L);
+		Parents.push_back(Parent);
+	};
+	for (uint32_t i = 0; i < 6000; i++)
+		AddNode(i < 4 ? SceneNoParent : (SceneNode)(Random() % std::min<uint32_t>(i, 1000)));
+
+	auto Check = [&]()
+	{
+		// Handles are in creation order, so parents come first.
+		std::vector<glm::mat4> Expected(Locals.size());
+		float Error = 0.0f;
+		bool ParentsMatch = true;
+		for (size_t i = 0; i < Locals.size(); i++)
+		{
+			glm::mat4 M = glm::translate(glm::mat4(1.0f), Locals[i].Position) * glm::mat4_cast(Locals[i].Rotation) *
+				glm::scale(glm::mat4(1.0f), Locals[i].Scale);
+			Expected[i] = Parents[i] == SceneNoParent ? M : Expected[Parents[i]] * M;
+			Error = std::max(Error, MatrixError(Scene.GetWorld((SceneNode)i), Expected[i]));
+			ParentsMatch = ParentsMatch && Scene.GetParent((SceneNode)i) == Parents[i];
+		}
+		TEST_CHECK(Error < 1e-4f);
+		TEST_CHECK(ParentsMatch);
+	};
+
+	Scene.Update();
+	TEST_CHECK(Scene.GetNodeCount() == Locals.size());
+	TEST_CHECK(Scene.GetStats().NodesUpdated == Locals.size());
+	Check();
+
+	// A few leaves and inner nodes, only their subtrees are recomputed.
+	for (uint32_t i = 0; i < 20; i++)
+	{
+		SceneNode Node = (SceneNode)(Random() % Locals.size());
+		Local L = RandomLocal();
+		if (i % 3 == 0)
+		{
+			Locals[Node].Position = L.Position;
+			Scene.SetPosition(Node, L.Position);
+		}
+		else if (i % 3 == 1)
+		{
+			Locals[Node].Rotation = L.Rotation;
+			Scene.SetRotation(Node, L.Rotation);
+		}
+		else
+		{
+			Locals[Node] = L;
+			Scene.SetLocal(Node, L.Position, L.Rotation, L.Scale);
+		}
+	}
+	Scene.Update();
+	TEST_CHECK(Scene.GetStats().NodesUpdated < Locals.size());
+	Check();
+
+	Scene.Update();
+	TEST_CHECK(Scene.GetStats().NodesUpdated == 0);
+
+	// Adding reorders the arrays, handles have to stay put.
+	for (uint32_t i = 0; i < 50; i++)
+		AddNode((SceneNode)(Random() % Locals.size()));
+	Scene.Update();
+	Check();
+}
+
+/*
+* A bumpy square grid with every triangle facing up. Every level has fewer triangles and at least
+* as much error as the one before, keeps the square's outline (its border vertices
+* never move) and flips no triangle over. Selection only gets coarser with distance
+* and never picks a level whose error shows by more than the allowed pixels.
+*/
+static void TestMeshLodChain()
+{
+	const int Cells = 32;
+	std::vector<glm::vec3> Positions;
+	for (int z = 0; z <= Cells; z++)
+	{
+		for (int x = 0; x <= Cells; x++)
+		{
+			float X = -1.0f + 2.0f * x / Cells;
+			float Z = -1.0f + 2.0f * z / Cells;
+			Positions.push_back(glm::vec3(X, 0.1f * std::cos(X * 3.0f) * std::cos(Z * 3.0f), Z));
+		}
+	}
+	std::vector<uint32_t> Indices;
+	for (int z = 0; z < Cells; z++)
+	{
+		for (int x = 0; x < Cells; x++)
+		{
+			uint32_t V = z * (Cells + 1) + x;
+			Indices.insert(Indices.end(), { V, V + Cells + 1, V + 1, V + 1, V + Cells + 1, V + Cells + 2 });
+		}
+	}
+
+	MeshLodChain Chain = BuildMeshLods(&Positions[0].x, Positions.size(), sizeof(glm::vec3), Indices.data(), Indices.size());
+	TEST_CHECK(Chain.Levels.size() >= 3);
+	if (Chain.Levels.empty())
+		return;
+	TEST_CHECK(Chain.Levels[0].IndexCount == Indices.size() && Chain.Levels[0].Error == 0.0f);
+
+	glm::vec3 Center(Chain.Center[0], Chain.Center[1], Chain.Center[2]);
+	float Outside = 0.0f;
+	for (auto& P : Positions)
+		Outside = std::max(Outside, glm::length(P - Center) - Chain.Radius);
+	TEST_CHECK(Outside <= 1e-5f);
+
+	for (size_t l = 0; l < Chain.Levels.size(); l++)
+	{
+		const MeshLodLevel& Level = Chain.Levels[l];
+		TEST_CHECK(Level.IndexCount % 3 == 0 && Level.FirstIndex + Level.IndexCount <= Chain.Indices.size());
+		if (l > 0)
+		{
+			TEST_CHECK(Level.IndexCount < Chain.Levels[l - 1].IndexCount);
+			TEST_CHECK(Level.Error >= Chain.Levels[l - 1].Error);
+		}
+		// The grid winds so that cross(B - A, C - A) points up.
+		float Area = 0.0f;
+		bool Valid = true;
+		for (uint32_t i = Level.FirstIndex; i < Level.FirstIndex + Level.IndexCount; i += 3)
+		{
+			const uint32_t* T = &Chain.Indices[i];
+			Valid = Valid && T[0] < Positions.size() && T[1] < Positions.size() && T[2] < Positions.size();
+			if (!Valid)
+				break;
+			float Up = glm::cross(Positions[T[1]] - Positions[T[0]], Positions[T[2]] - Positions[T[0]]).y;
+			// Collapses may stand a sliver on its edge, but none may fold over.
+			Valid = Up > -1e-6f;
+			Area += Up * 0.5f;
+		}
+		TEST_CHECK(Valid);
+		TEST_CHECK(std::fabs(Area - 4.0f) < 1e-3f);
+	}
+
+	const float PixelsPerUnit = 540.0f;
+	TEST_CHECK(SelectMeshLod(Chain, 1.0f, 0.0f, PixelsPerUnit, 1.0f) == 0);
+	TEST_CHECK(SelectMeshLod(Chain, 1.0f, 1e6f, PixelsPerUnit, 1.0f) == Chain.Levels.size() - 1);
+	uint32_t Previous = 0;
+	bool Monotonic = true;
+	bool WithinError = true;
+	for (float Distance = 0.5f; Distance < 1000.0f; Distance *= 1.5f)
+	{
+		uint32_t Level = SelectMeshLod(Chain, 2.0f, Distance, PixelsPerUnit, 1.0f);
+		Monotonic = Monotonic && Level >= Previous;
+		WithinError = WithinError && Chain.Levels[Level].Error * 2.0f * PixelsPerUnit / Distance <= 1.0f;
+		Previous = Level;
+	}
+	TEST_CHECK(Monotonic);
+	TEST_CHECK(WithinError);
+
+	std::vector<float> Floats(&Positions[0].x, &Positions[0].x + Positions.size() * 3);
+	MeshLodChain Async = BuildMeshLodsAsync(Floats, sizeof(float) * 3, Indices).get();
+	TEST_CHECK(Async.Indices == Chain.Indices && Async.Levels.size() == Chain.Levels.size());
+}
+
+/*
+* Pixel rules of the CPU rasterizer: a quad whose edges run through pixel centers
+* covers exactly its area, shared and outer edges included, back faces are culled,
+* depth outside [0, 1] is clipped, and LESS_OR_EQUAL keeps the nearest of overlapping draws. Then a row of cubes comes
+* out the same on any number of threads, and with every SIMD level as with the scalar
+* kernels.
+*/
+static void TestSoftRasterRules()
+{
+	const uint32_t Width = 256, Height = 192;
+	// Pixel coordinates to a vertex, z is the depth written.
+	auto Corner = [&](float X, float Y, float Z, const glm::vec4& C)
+	{
+		Vertex V = { 2.0f * X / Width - 1.0f, 2.0f * Y / Height - 1.0f, Z, 1.0f, C.x, C.y, C.z, C.w };
+		return V;
+	};
+	// Clockwise on screen, y down, so front facing.
+	auto Quad = [&](float X0, float Y0, float X1, float Y1, float Z, const glm::vec4& C)
+	{
+		Vertex TL = Corner(X0, Y0, Z, C), TR = Corner(X1, Y0, Z, C), BR = Corner(X1, Y1, Z, C), BL = Corner(X0, Y1, Z, C);
+		return std::vector<Vertex>{ TL, TR, BR, TL, BR, BL };
+	};
+	const glm::vec4 Red(1, 0, 0, 1), Green(0, 1, 0, 1), Blue(0, 0, 1, 1);
+	const uint32_t RedPixel = 0xFF0000FF, GreenPixel = 0xFF00FF00, Cleared = 0xFF000000;
+
+	SoftRasterizer Raster(Width, Height, 2);
+	Raster.Clear(glm::vec4(0, 0, 0, 1));
+	std::vector<Vertex> Centers = Quad(10.5f, 20.5f, 74.5f, 84.5f, 0.5f, Red);
+	Raster.Draw(Centers.data(), (uint32_t)Centers.size(), glm::mat4(1.0f));
+	Raster.Flush();
+	TEST_CHECK(Raster.GetStats().Pixels == 64 * 64);
+	// Centers on the left and top edges are in, on the right and bottom ones out.
+	TEST_CHECK(Raster.GetPixel(10, 20) == RedPixel && Raster.GetPixel(73, 83) == RedPixel);
+	TEST_CHECK(Raster.GetPixel(9, 20) == Cleared && Raster.GetPixel(10, 19) == Cleared &&
+		Raster.GetPixel(74, 83) == Cleared && Raster.GetPixel(73, 84) == Cleared);
+	TEST_CHECK(std::fabs(Raster.GetDepth(40, 50) - 0.5f) < 1e-6f);
+
+	std::vector<Vertex> Back = Quad(100.0f, 20.0f, 164.0f, 84.0f, 0.5f, Red);
+	std::reverse(Back.begin(), Back.end());
+	Raster.Draw(Back.data(), (uint32_t)Back.size(), glm::mat4(1.0f));
+	Raster.Flush();
+	TEST_CHECK(Raster.GetStats().Pixels == 0 && Raster.GetPixel(130, 50) == Cleared);
+
+	// Depth is clipped to [0, 1] like the GPU pipelines, not clamped.
+	std::vector<Vertex> TooNear = Quad(100.0f, 20.0f, 164.0f, 84.0f, -0.5f, Red);
+	std::vector<Vertex> TooFar = Quad(100.0f, 20.0f, 164.0f, 84.0f, 1.5f, Red);
+	Raster.Draw(TooNear.data(), (uint32_t)TooNear.size(), glm::mat4(1.0f));
+	Raster.Draw(TooFar.data(), (uint32_t)TooFar.size(), glm::mat4(1.0f));
+	Raster.Flush();
+	TEST_CHECK(Raster.GetStats().Pixels == 0 && Raster.GetPixel(130, 50) == Cleared);
+
+	std::vector<Vertex> Far = Quad(0.0f, 100.0f, 128.0f, 192.0f, 0.8f, Red);
+	std::vector<Vertex> Near = Quad(64.0f, 100.0f, 192.0f, 192.0f, 0.2f, Green);
+	std::vector<Vertex> Behind = Quad(0.0f, 100.0f, 256.0f, 192.0f, 0.8f, Blue);
+	Raster.Draw(Far.data(), (uint32_t)Far.size(), glm::mat4(1.0f));
+	Raster.Draw(Near.data(), (uint32_t)Near.size(), glm::mat4(1.0f));
+	Raster.Draw(Behind.data(), (uint32_t)Behind.size(), glm::mat4(1.0f));
+	Raster.Flush();
+	TEST_CHECK(Raster.GetPixel(100, 150) == GreenPixel);
+	// Equal depth passes, the later draw wins.
+	TEST_CHECK(Raster.GetPixel(30, 150) == 0xFFFF0000);
+
+	glm::mat4 MVP = glm::perspective(glm::radians(45.0f), (float)Width / Height, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(-5.0f, 3.0f, -10.0f), glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	const uint32_t VertexCount = sizeof(g_vb_solid_face_colors_Data) / sizeof(g_vb_solid_face_colors_Data[0]);
+	auto DrawCube = [&](SoftRasterizer& Target)
+	{
+		Target.Clear(glm::vec4(0.2f));
+		for (int i = -2; i <= 2; i++)
+			Target.Draw(g_vb_solid_face_colors_Data, VertexCount, MVP * glm::translate(glm::mat4(1.0f), glm::vec3(i * 1.5f, 0.0f, i * 2.0f)));
+		Target.Flush();
+	};
+
+	SimdLevel Detected = DetectSimdLevel();
+	SetSimdLevel(SimdLevel::Scalar);
+	SoftRasterizer Reference(Width, Height, 1);
+	DrawCube(Reference);
+	TEST_CHECK(Reference.GetStats().Pixels > 0);
+	for (int Level = (int)SimdLevel::Scalar; Level <= (int)Detected; Level++)
+	{
+		SetSimdLevel((SimdLevel)Level);
+		SoftRasterizer Single(Width, Height, 1);
+		SoftRasterizer Threaded(Width, Height, 4);
+		DrawCube(Single);
+		DrawCube(Threaded);
+		// Threads never change a pixel. Kernels round depth their own way, but cover the same samples.
+		bool Same = Threaded.GetStats().Pixels == Reference.GetStats().Pixels;
+		bool Close = true;
+		for (uint32_t y = 0; y < Height; y++)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				Same = Same && Threaded.GetPixel(x, y) == Single.GetPixel(x, y) && Threaded.GetDepth(x, y) == Single.GetDepth(x, y);
+				Close = Close && Threaded.GetPixel(x, y) == Reference.GetPixel(x, y) &&
+					std::fabs(Threaded.GetDepth(x, y) - Reference.GetDepth(x, y)) < 1e-5f;
+			}
+		}
+		TEST_CHECK(Same);
+		TEST_CHECK(Close);
+	}
+	SetSimdLevel(Detected);
+}
+
+/*
+* Every job runs once, a job started after a counter only sees that counter's jobs
+* finished, jobs may start more jobs on the counter they run under, jobs from a thread
+* outside the system run too, and ParallelFor hands out every index exactly once.
+* With one thread as well as several, where stealing has to happen.
+*/
+static void TestJobSystem()
+{
+	for (uint32_t Threads : { 1u, 4u })
+	{
+		JobSystem Jobs(Threads);
+
+		const uint32_t First = 2000;
+		std::atomic<uint32_t> FirstDone(0);
+		std::atomic<uint32_t> EarlySecond(0);
+		std::atomic<uint32_t> SecondDone(0);
+		JobCounter FirstCounter, SecondCounter;
+		for (uint32_t i = 0; i < First; i++)
+			Jobs.Run([&] { FirstDone.fetch_add(1); }, &FirstCounter);
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			Jobs.Run([&]
+			{
+				if (FirstDone.load() != First)
+					EarlySecond.fetch_add(1);
+				SecondDone.fetch_add(1);
+			}, &SecondCounter, &FirstCounter);
+		}
+		Jobs.Wait(SecondCounter);
+		TEST_CHECK(FirstDone.load() == First);
+		TEST_CHECK(SecondDone.load() == 100);
+		TEST_CHECK(EarlySecond.load() == 0);
+
+		// Children counted on the counter of the job that starts them.
+		std::atomic<uint32_t> Children(0);
+		JobCounter Nested;
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			Jobs.Run([&]
+			{
+				for (uint32_t c = 0; c < 16; c++)
+					Jobs.Run([&] { Children.fetch_add(1); }, &Nested);
+			}, &Nested);
+		}
+		Jobs.Wait(Nested);
+		TEST_CHECK(Children.load() == 64 * 16);
+
+		std::atomic<uint32_t> External(0);
+		JobCounter ExternalCounter;
+		std::thread Outside([&]
+		{
+			for (uint32_t i = 0; i < 500; i++)
+				Jobs.Run([&] { External.fetch_add(1); }, &ExternalCounter);
+		});
+		Outside.join();
+		Jobs.Wait(ExternalCounter);
+		TEST_CHECK(External.load() == 500);
+
+		const uint32_t Count = 100003;
+		std::vector<std::atomic<uint32_t>> Visits(Count);
+		for (auto& Visit : Visits)
+			Visit.store(0);
+		std::atomic<uint32_t> ShortChunks(0);
+		Jobs.ParallelFor(Count, 256, [&](uint32_t Begin, uint32_t End)
+		{
+			if (End - Begin < 256 && End != Count)
+				ShortChunks.fetch_add(1);
+			for (uint32_t i = Begin; i < End; i++)
+				Visits[i].fetch_add(1);
+		});
+		bool Once = true;
+		for (auto& Visit : Visits)
+			Once = Once && Visit.load() == 1;
+		TEST_CHECK(Once);
+		TEST_CHECK(ShortChunks.load() == 0);
+
+		JobSystemStats Stats = Jobs.GetStats();
+		TEST_CHECK(Stats.Executed >= First + 100 + 64 * 17 + 500);
+	}
+}
+
+struct TestCase
+{
+	const char* Name;
+	void(*Run)();
+};
+
+static const TestCase TestCases[] = {
+	{ "draw_packet_sort", TestDrawPacketSort },
+	{ "job_system", TestJobSystem },
+	{ "mesh_lod_chain", TestMeshLodChain },
+	{ "meshlet_concave_cone", TestMeshletConcaveCone },
+	{ "scene_hierarchy_update", TestSceneHierarchyUpdate },
+	{ "soft_raster_rules", TestSoftRasterRules },
+};
+
+int main(int argc, char** argv)
+{
+	int Ran = 0;
+	for (auto& Test : TestCases)
+	{
+		if (argc > 1 && std::strcmp(argv[1], Test.Name) != 0)
+			continue;
+		int Before = Failures;
+		Test.Run();
+		std::cout << (Failures == Before ? "pass " : "FAIL ") << Test.Name << "\n";
+		Ran++;
+	}
+	if (Ran == 0)
+	{
+		std::cerr << "No test named " << argv[1] << "\n";
+		return 1;
+	}
+	return Failures == 0 ? 0 : 1;
+}
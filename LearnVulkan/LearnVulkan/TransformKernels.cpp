@@ -0,0 +1,173 @@
+#include "TransformKernelsImpl.h"
+#include <atomic>
+#if TRANSFORM_KERNELS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// One lane, so the templated math doubles as the reference and tail path.
+	struct ScalarVec
+	{
+		float V;
+		static ScalarVec Load(const float* P) { return { *P }; }
+		static ScalarVec Set1(float F) { return { F }; }
+		ScalarVec operator+(ScalarVec B) const { return { V + B.V }; }
+		ScalarVec operator-(ScalarVec B) const { return { V - B.V }; }
+		ScalarVec operator*(ScalarVec B) const { return { V * B.V }; }
+	};
+
+	void StoreScalar(const ScalarVec* M, const TransformOutput& Out, size_t Index)
+	{
+		float* Dst = TransformOutputAt(Out, Index);
+		for (int i = 0; i < 16; i++)
+			Dst[i] = M[i].V;
+	}
+}
+
+void ComposeTRSScalar(const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	for (size_t i = Begin; i < End; i++)
+	{
+		ScalarVec M[16];
+		ComposeTRSColumns(In, i, M);
+		StoreScalar(M, Out, i);
+	}
+}
+
+void ComposeMVPScalar(const float* ViewProjection, const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	for (size_t i = Begin; i < End; i++)
+	{
+		ScalarVec M[16];
+		ComposeMVPColumns(ViewProjection, In, i, M);
+		StoreScalar(M, Out, i);
+	}
+}
+
+void MultiplyMat4Scalar(const float* A, size_t AStride, const float* B, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	for (size_t i = Begin; i < End; i++)
+	{
+		const float* Left = A + i * AStride;
+		const float* Right = B + i * 16;
+		float M[16];
+		for (int Column = 0; Column < 4; Column++)
+			for (int Row = 0; Row < 4; Row++)
+				M[Column * 4 + Row] = Left[0 * 4 + Row] * Right[Column * 4 + 0] +
+					Left[1 * 4 + Row] * Right[Column * 4 + 1] +
+					Left[2 * 4 + Row] * Right[Column * 4 + 2] +
+					Left[3 * 4 + Row] * Right[Column * 4 + 3];
+		float* Dst = TransformOutputAt(Out, i);
+		for (int j = 0; j < 16; j++)
+			Dst[j] = M[j];
+	}
+}
+
+const char* SimdLevelName(SimdLevel Level)
+{
+	switch (Level)
+	{
+	case SimdLevel::SSE4: return "sse4";
+	case SimdLevel::AVX2: return "avx2";
+	case SimdLevel::AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
+
+SimdLevel DetectSimdLevel()
+{
+#if TRANSFORM_KERNELS_X86 && defined(_MSC_VER)
+	int Info[4];
+	__cpuid(Info, 0);
+	int MaxLeaf = Info[0];
+	__cpuid(Info, 1);
+	bool Sse41 = (Info[2] & (1 << 19)) != 0;
+	bool Fma = (Info[2] & (1 << 12)) != 0;
+	bool OsSave = (Info[2] & (1 << 27)) != 0;
+	// The OS has to save the wider registers too, not just the CPU support them.
+	unsigned long long Xcr0 = OsSave ? _xgetbv(0) : 0;
+	bool Avx2 = false, Avx512 = false;
+	if (MaxLeaf >= 7)
+	{
+		__cpuidex(Info, 7, 0);
+		Avx2 = (Info[1] & (1 << 5)) != 0 && Fma && (Xcr0 & 0x06) == 0x06;
+		Avx512 = (Info[1] & (1 << 16)) != 0 && (Xcr0 & 0xE6) == 0xE6;
+	}
+	if (Avx512)
+		return SimdLevel::AVX512;
+	if (Avx2)
+		return SimdLevel::AVX2;
+	if (Sse41)
+		return SimdLevel::SSE4;
+	return SimdLevel::Scalar;
+#elif TRANSFORM_KERNELS_X86
+	// Checks the OS register state as well.
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SimdLevel::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return SimdLevel::SSE4;
+	return SimdLevel::Scalar;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+static std::atomic<int>& ActiveLevel()
+{
+	static std::atomic<int> Level((int)DetectSimdLevel());
+	return Level;
+}
+
+SimdLevel GetSimdLevel()
+{
+	return (SimdLevel)ActiveLevel().load(std::memory_order_relaxed);
+}
+
+void SetSimdLevel(SimdLevel Level)
+{
+	SimdLevel Supported = DetectSimdLevel();
+	ActiveLevel().store((int)(Level < Supported ? Level : Supported), std::memory_order_relaxed);
+}
+
+void ComposeTRS(const TransformSoA& In, size_t Count, const TransformOutput& Out)
+{
+	switch (GetSimdLevel())
+	{
+#if TRANSFORM_KERNELS_X86
+	case SimdLevel::AVX512: ComposeTRSAVX512(In, 0, Count, Out); break;
+	case SimdLevel::AVX2: ComposeTRSAVX2(In, 0, Count, Out); break;
+	case SimdLevel::SSE4: ComposeTRSSSE4(In, 0, Count, Out); break;
+#endif
+	default: ComposeTRSScalar(In, 0, Count, Out); break;
+	}
+}
+
+void ComposeMVP(const float* ViewProjection, const TransformSoA& In, size_t Count, const TransformOutput& Out)
+{
+	switch (GetSimdLevel())
+	{
+#if TRANSFORM_KERNELS_X86
+	case SimdLevel::AVX512: ComposeMVPAVX512(ViewProjection, In, 0, Count, Out); break;
+	case SimdLevel::AVX2: ComposeMVPAVX2(ViewProjection, In, 0, Count, Out); break;
+	case SimdLevel::SSE4: ComposeMVPSSE4(ViewProjection, In, 0, Count, Out); break;
+#endif
+	default: ComposeMVPScalar(ViewProjection, In, 0, Count, Out); break;
+	}
+}
+
+void MultiplyMat4(const float* A, size_t AStride, const float* B, size_t Count, const TransformOutput& Out)
+{
+	switch (GetSimdLevel())
+	{
+#if TRANSFORM_KERNELS_X86
+	case SimdLevel::AVX512: MultiplyMat4AVX512(A, AStride, B, 0, Count, Out); break;
+	case SimdLevel::AVX2: MultiplyMat4AVX2(A, AStride, B, 0, Count, Out); break;
+	case SimdLevel::SSE4: MultiplyMat4SSE4(A, AStride, B, 0, Count, Out); break;
+#endif
+	default: MultiplyMat4Scalar(A, AStride, B, 0, Count, Out); break;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+* Batched matrix kernels with SSE4.1, AVX2 and AVX-512 versions picked at runtime.
+* Matrices are 16 column-major floats, the same layout as glm::mat4, and can be
+* written with a stride so they land straight in an array of larger structs, e.g.
+* the Model field of DrawData in a mapped buffer.
+*/
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE4,
+	AVX2,
+	AVX512
+};
+
+const char* SimdLevelName(SimdLevel Level);
+// What this CPU and OS support.
+SimdLevel DetectSimdLevel();
+// Level the kernels use, DetectSimdLevel() unless lowered with SetSimdLevel.
+SimdLevel GetSimdLevel();
+// Clamped to DetectSimdLevel(). For benchmarks and for checking the kernels against each other.
+void SetSimdLevel(SimdLevel Level);
+
+// Structure of arrays, one entry per transform. Rotations are unit quaternions.
+struct TransformSoA
+{
+	const float* PositionX;
+	const float* PositionY;
+	const float* PositionZ;
+	const float* RotationX;
+	const float* RotationY;
+	const float* RotationZ;
+	const float* RotationW;
+	const float* ScaleX;
+	const float* ScaleY;
+	const float* ScaleZ;
+};
+
+struct TransformOutput
+{
+	void* Data;
+	// Bytes from one matrix to the next.
+	size_t Stride = sizeof(float) * 16;
+	// Non-temporal stores where the alignment allows, for write-combined mapped
+	// memory that the CPU does not read back.
+	bool Stream = false;
+};
+
+// Out[i] = Translate * Rotate * Scale.
+void ComposeTRS(const TransformSoA& In, size_t Count, const TransformOutput& Out);
+// Out[i] = ViewProjection * Translate * Rotate * Scale, without going through memory in between.
+void ComposeMVP(const float* ViewProjection, const TransformSoA& In, size_t Count, const TransformOutput& Out);
+// Out[i] = A[i] * B[i]. AStride is in floats, 0 uses the same A for every B. B is tightly packed
+// and may be Out itself, each B is read before its result is stored.
+void MultiplyMat4(const float* A, size_t AStride, const float* B, size_t Count, const TransformOutput& Out);
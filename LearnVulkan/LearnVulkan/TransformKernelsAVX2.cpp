@@ -0,0 +1,121 @@
+// Built with AVX2 and FMA enabled, only called when DetectSimdLevel() allows it.
+
+#include "TransformKernelsImpl.h"
+
+#if TRANSFORM_KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	struct Vec8
+	{
+		__m256 V;
+		static Vec8 Load(const float* P) { return { _mm256_loadu_ps(P) }; }
+		static Vec8 Set1(float F) { return { _mm256_set1_ps(F) }; }
+		Vec8 operator+(Vec8 B) const { return { _mm256_add_ps(V, B.V) }; }
+		Vec8 operator-(Vec8 B) const { return { _mm256_sub_ps(V, B.V) }; }
+		Vec8 operator*(Vec8 B) const { return { _mm256_mul_ps(V, B.V) }; }
+	};
+
+	void StoreColumns(float* Dst, __m256 Columns, bool Stream)
+	{
+		if (Stream && ((uintptr_t)Dst & 31) == 0)
+			_mm256_stream_ps(Dst, Columns);
+		else
+			_mm256_storeu_ps(Dst, Columns);
+	}
+
+	/*
+	* M holds 8 transforms per element. The in-lane 4x4 transposes leave column c
+	* of transforms k and k + 4 in the two halves of Columns[c][k], then pairs of
+	* columns are recombined into 32 byte stores.
+	*/
+	void StoreMatrices(Vec8* M, const TransformOutput& Out, size_t Index)
+	{
+		__m256 Columns[4][4];
+		for (int Column = 0; Column < 4; Column++)
+		{
+			__m256 T0 = _mm256_unpacklo_ps(M[Column * 4 + 0].V, M[Column * 4 + 1].V);
+			__m256 T1 = _mm256_unpackhi_ps(M[Column * 4 + 0].V, M[Column * 4 + 1].V);
+			__m256 T2 = _mm256_unpacklo_ps(M[Column * 4 + 2].V, M[Column * 4 + 3].V);
+			__m256 T3 = _mm256_unpackhi_ps(M[Column * 4 + 2].V, M[Column * 4 + 3].V);
+			Columns[Column][0] = _mm256_shuffle_ps(T0, T2, _MM_SHUFFLE(1, 0, 1, 0));
+			Columns[Column][1] = _mm256_shuffle_ps(T0, T2, _MM_SHUFFLE(3, 2, 3, 2));
+			Columns[Column][2] = _mm256_shuffle_ps(T1, T3, _MM_SHUFFLE(1, 0, 1, 0));
+			Columns[Column][3] = _mm256_shuffle_ps(T1, T3, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			float* Low = TransformOutputAt(Out, Index + k);
+			float* High = TransformOutputAt(Out, Index + k + 4);
+			StoreColumns(Low, _mm256_permute2f128_ps(Columns[0][k], Columns[1][k], 0x20), Out.Stream);
+			StoreColumns(Low + 8, _mm256_permute2f128_ps(Columns[2][k], Columns[3][k], 0x20), Out.Stream);
+			StoreColumns(High, _mm256_permute2f128_ps(Columns[0][k], Columns[1][k], 0x31), Out.Stream);
+			StoreColumns(High + 8, _mm256_permute2f128_ps(Columns[2][k], Columns[3][k], 0x31), Out.Stream);
+		}
+	}
+}
+
+void ComposeTRSAVX2(const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 8 <= End; i += 8)
+	{
+		Vec8 M[16];
+		ComposeTRSColumns(In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeTRSScalar(In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+void ComposeMVPAVX2(const float* ViewProjection, const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 8 <= End; i += 8)
+	{
+		Vec8 M[16];
+		ComposeMVPColumns(ViewProjection, In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeMVPScalar(ViewProjection, In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+// Two result columns per register, A's columns repeated in both halves.
+void MultiplyMat4AVX2(const float* A, size_t AStride, const float* B, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	if (Begin == End)
+		return;
+	const float* Left = A + Begin * AStride;
+	__m256 A0 = _mm256_broadcast_ps((const __m128*)(Left + 0));
+	__m256 A1 = _mm256_broadcast_ps((const __m128*)(Left + 4));
+	__m256 A2 = _mm256_broadcast_ps((const __m128*)(Left + 8));
+	__m256 A3 = _mm256_broadcast_ps((const __m128*)(Left + 12));
+	for (size_t i = Begin; i < End; i++)
+	{
+		if (AStride != 0)
+		{
+			Left = A + i * AStride;
+			A0 = _mm256_broadcast_ps((const __m128*)(Left + 0));
+			A1 = _mm256_broadcast_ps((const __m128*)(Left + 4));
+			A2 = _mm256_broadcast_ps((const __m128*)(Left + 8));
+			A3 = _mm256_broadcast_ps((const __m128*)(Left + 12));
+		}
+		float* Dst = TransformOutputAt(Out, i);
+		for (int Half = 0; Half < 2; Half++)
+		{
+			__m256 Right = _mm256_loadu_ps(B + i * 16 + Half * 8);
+			__m256 Result = _mm256_mul_ps(A0, _mm256_permute_ps(Right, 0x00));
+			Result = _mm256_fmadd_ps(A1, _mm256_permute_ps(Right, 0x55), Result);
+			Result = _mm256_fmadd_ps(A2, _mm256_permute_ps(Right, 0xAA), Result);
+			Result = _mm256_fmadd_ps(A3, _mm256_permute_ps(Right, 0xFF), Result);
+			StoreColumns(Dst + Half * 8, Result, Out.Stream);
+		}
+	}
+	if (Out.Stream)
+		_mm_sfence();
+}
+#endif
@@ -0,0 +1,120 @@
+// Built with AVX-512F enabled, only called when DetectSimdLevel() allows it.
+
+#include "TransformKernelsImpl.h"
+
+#if TRANSFORM_KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	struct Vec16
+	{
+		__m512 V;
+		static Vec16 Load(const float* P) { return { _mm512_loadu_ps(P) }; }
+		static Vec16 Set1(float F) { return { _mm512_set1_ps(F) }; }
+		Vec16 operator+(Vec16 B) const { return { _mm512_add_ps(V, B.V) }; }
+		Vec16 operator-(Vec16 B) const { return { _mm512_sub_ps(V, B.V) }; }
+		Vec16 operator*(Vec16 B) const { return { _mm512_mul_ps(V, B.V) }; }
+	};
+
+	// A whole matrix per store.
+	void StoreMatrix(float* Dst, __m512 Matrix, bool Stream)
+	{
+		if (Stream && ((uintptr_t)Dst & 63) == 0)
+			_mm512_stream_ps(Dst, Matrix);
+		else
+			_mm512_storeu_ps(Dst, Matrix);
+	}
+
+	/*
+	* M holds 16 transforms per element. The in-lane 4x4 transposes leave column c
+	* of transforms k, k + 4, k + 8 and k + 12 in the four 128 bit lanes of
+	* Columns[c][k], two rounds of lane shuffles then gather each transform's columns.
+	*/
+	void StoreMatrices(Vec16* M, const TransformOutput& Out, size_t Index)
+	{
+		__m512 Columns[4][4];
+		for (int Column = 0; Column < 4; Column++)
+		{
+			__m512 T0 = _mm512_unpacklo_ps(M[Column * 4 + 0].V, M[Column * 4 + 1].V);
+			__m512 T1 = _mm512_unpackhi_ps(M[Column * 4 + 0].V, M[Column * 4 + 1].V);
+			__m512 T2 = _mm512_unpacklo_ps(M[Column * 4 + 2].V, M[Column * 4 + 3].V);
+			__m512 T3 = _mm512_unpackhi_ps(M[Column * 4 + 2].V, M[Column * 4 + 3].V);
+			Columns[Column][0] = _mm512_shuffle_ps(T0, T2, _MM_SHUFFLE(1, 0, 1, 0));
+			Columns[Column][1] = _mm512_shuffle_ps(T0, T2, _MM_SHUFFLE(3, 2, 3, 2));
+			Columns[Column][2] = _mm512_shuffle_ps(T1, T3, _MM_SHUFFLE(1, 0, 1, 0));
+			Columns[Column][3] = _mm512_shuffle_ps(T1, T3, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+		for (int k = 0; k < 4; k++)
+		{
+			__m512 Low01 = _mm512_shuffle_f32x4(Columns[0][k], Columns[1][k], _MM_SHUFFLE(1, 0, 1, 0));
+			__m512 Low23 = _mm512_shuffle_f32x4(Columns[2][k], Columns[3][k], _MM_SHUFFLE(1, 0, 1, 0));
+			__m512 High01 = _mm512_shuffle_f32x4(Columns[0][k], Columns[1][k], _MM_SHUFFLE(3, 2, 3, 2));
+			__m512 High23 = _mm512_shuffle_f32x4(Columns[2][k], Columns[3][k], _MM_SHUFFLE(3, 2, 3, 2));
+			StoreMatrix(TransformOutputAt(Out, Index + k), _mm512_shuffle_f32x4(Low01, Low23, _MM_SHUFFLE(2, 0, 2, 0)), Out.Stream);
+			StoreMatrix(TransformOutputAt(Out, Index + k + 4), _mm512_shuffle_f32x4(Low01, Low23, _MM_SHUFFLE(3, 1, 3, 1)), Out.Stream);
+			StoreMatrix(TransformOutputAt(Out, Index + k + 8), _mm512_shuffle_f32x4(High01, High23, _MM_SHUFFLE(2, 0, 2, 0)), Out.Stream);
+			StoreMatrix(TransformOutputAt(Out, Index + k + 12), _mm512_shuffle_f32x4(High01, High23, _MM_SHUFFLE(3, 1, 3, 1)), Out.Stream);
+		}
+	}
+}
+
+void ComposeTRSAVX512(const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 16 <= End; i += 16)
+	{
+		Vec16 M[16];
+		ComposeTRSColumns(In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeTRSScalar(In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+void ComposeMVPAVX512(const float* ViewProjection, const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 16 <= End; i += 16)
+	{
+		Vec16 M[16];
+		ComposeMVPColumns(ViewProjection, In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeMVPScalar(ViewProjection, In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+// The whole result in one register, A's columns repeated in all four lanes.
+void MultiplyMat4AVX512(const float* A, size_t AStride, const float* B, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	if (Begin == End)
+		return;
+	const float* Left = A + Begin * AStride;
+	__m512 A0 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 0));
+	__m512 A1 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 4));
+	__m512 A2 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 8));
+	__m512 A3 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 12));
+	for (size_t i = Begin; i < End; i++)
+	{
+		if (AStride != 0)
+		{
+			Left = A + i * AStride;
+			A0 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 0));
+			A1 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 4));
+			A2 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 8));
+			A3 = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 12));
+		}
+		__m512 Right = _mm512_loadu_ps(B + i * 16);
+		__m512 Result = _mm512_mul_ps(A0, _mm512_permute_ps(Right, 0x00));
+		Result = _mm512_fmadd_ps(A1, _mm512_permute_ps(Right, 0x55), Result);
+		Result = _mm512_fmadd_ps(A2, _mm512_permute_ps(Right, 0xAA), Result);
+		Result = _mm512_fmadd_ps(A3, _mm512_permute_ps(Right, 0xFF), Result);
+		StoreMatrix(TransformOutputAt(Out, i), Result, Out.Stream);
+	}
+	if (Out.Stream)
+		_mm_sfence();
+}
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+// Shared by the TransformKernels*.cpp files only.
+
+#include "TransformKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TRANSFORM_KERNELS_X86 1
+#else
+#define TRANSFORM_KERNELS_X86 0
+#endif
+
+// Every kernel handles [Begin, End), the vector ones hand their tail to the scalar one.
+#define DECLARE_TRANSFORM_KERNELS(Suffix) \
+	void ComposeTRS##Suffix(const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out); \
+	void ComposeMVP##Suffix(const float* ViewProjection, const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out); \
+	void MultiplyMat4##Suffix(const float* A, size_t AStride, const float* B, size_t Begin, size_t End, const TransformOutput& Out);
+
+DECLARE_TRANSFORM_KERNELS(Scalar)
+#if TRANSFORM_KERNELS_X86
+DECLARE_TRANSFORM_KERNELS(SSE4)
+DECLARE_TRANSFORM_KERNELS(AVX2)
+DECLARE_TRANSFORM_KERNELS(AVX512)
+#endif
+
+// Static so no copy built with wider instructions can be picked for the scalar code.
+static inline float* TransformOutputAt(const TransformOutput& Out, size_t Index)
+{
+	return (float*)((char*)Out.Data + Index * Out.Stride);
+}
+
+/*
+* The TRS math written once for any vector type V with Load, Set1, +, - and *.
+* M receives the 16 matrix elements column-major, each holding V's lane count
+* of transforms starting at index i.
+*/
+template <class V>
+inline void ComposeTRSColumns(const TransformSoA& In, size_t i, V* M)
+{
+	V qx = V::Load(In.RotationX + i);
+	V qy = V::Load(In.RotationY + i);
+	V qz = V::Load(In.RotationZ + i);
+	V qw = V::Load(In.RotationW + i);
+	V x2 = qx + qx, y2 = qy + qy, z2 = qz + qz;
+	V xx = qx * x2, yy = qy * y2, zz = qz * z2;
+	V xy = qx * y2, xz = qx * z2, yz = qy * z2;
+	V wx = qw * x2, wy = qw * y2, wz = qw * z2;
+
+	V sx = V::Load(In.ScaleX + i);
+	V sy = V::Load(In.ScaleY + i);
+	V sz = V::Load(In.ScaleZ + i);
+	V One = V::Set1(1.0f);
+	V Zero = V::Set1(0.0f);
+
+	M[0] = (One - (yy + zz)) * sx;
+	M[1] = (xy + wz) * sx;
+	M[2] = (xz - wy) * sx;
+	M[3] = Zero;
+	M[4] = (xy - wz) * sy;
+	M[5] = (One - (xx + zz)) * sy;
+	M[6] = (yz + wx) * sy;
+	M[7] = Zero;
+	M[8] = (xz + wy) * sz;
+	M[9] = (yz - wx) * sz;
+	M[10] = (One - (xx + yy)) * sz;
+	M[11] = Zero;
+	M[12] = V::Load(In.PositionX + i);
+	M[13] = V::Load(In.PositionY + i);
+	M[14] = V::Load(In.PositionZ + i);
+	M[15] = One;
+}
+
+// ViewProjection * TRS. The bottom row of the TRS matrix is known, so those terms are left out.
+template <class V>
+inline void ComposeMVPColumns(const float* ViewProjection, const TransformSoA& In, size_t i, V* M)
+{
+	V Local[16];
+	ComposeTRSColumns(In, i, Local);
+	for (int Column = 0; Column < 4; Column++)
+	{
+		const V* L = Local + Column * 4;
+		for (int Row = 0; Row < 4; Row++)
+		{
+			V Sum = V::Set1(ViewProjection[0 * 4 + Row]) * L[0] +
+				V::Set1(ViewProjection[1 * 4 + Row]) * L[1] +
+				V::Set1(ViewProjection[2 * 4 + Row]) * L[2];
+			if (Column == 3)
+				Sum = Sum + V::Set1(ViewProjection[3 * 4 + Row]);
+			M[Column * 4 + Row] = Sum;
+		}
+	}
+}
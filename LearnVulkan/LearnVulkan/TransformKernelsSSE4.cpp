@@ -0,0 +1,107 @@
+// Built with SSE4.1 enabled, only called when DetectSimdLevel() allows it.
+
+#include "TransformKernelsImpl.h"
+
+#if TRANSFORM_KERNELS_X86
+#include <smmintrin.h>
+
+namespace
+{
+	struct Vec4
+	{
+		__m128 V;
+		static Vec4 Load(const float* P) { return { _mm_loadu_ps(P) }; }
+		static Vec4 Set1(float F) { return { _mm_set1_ps(F) }; }
+		Vec4 operator+(Vec4 B) const { return { _mm_add_ps(V, B.V) }; }
+		Vec4 operator-(Vec4 B) const { return { _mm_sub_ps(V, B.V) }; }
+		Vec4 operator*(Vec4 B) const { return { _mm_mul_ps(V, B.V) }; }
+	};
+
+	void StoreColumn(float* Dst, __m128 Column, bool Stream)
+	{
+		if (Stream && ((uintptr_t)Dst & 15) == 0)
+			_mm_stream_ps(Dst, Column);
+		else
+			_mm_storeu_ps(Dst, Column);
+	}
+
+	// M holds 4 transforms per element, a 4x4 transpose per column gives each transform's column.
+	void StoreMatrices(Vec4* M, const TransformOutput& Out, size_t Index)
+	{
+		for (int Column = 0; Column < 4; Column++)
+		{
+			__m128 R0 = M[Column * 4 + 0].V;
+			__m128 R1 = M[Column * 4 + 1].V;
+			__m128 R2 = M[Column * 4 + 2].V;
+			__m128 R3 = M[Column * 4 + 3].V;
+			_MM_TRANSPOSE4_PS(R0, R1, R2, R3);
+			StoreColumn(TransformOutputAt(Out, Index + 0) + Column * 4, R0, Out.Stream);
+			StoreColumn(TransformOutputAt(Out, Index + 1) + Column * 4, R1, Out.Stream);
+			StoreColumn(TransformOutputAt(Out, Index + 2) + Column * 4, R2, Out.Stream);
+			StoreColumn(TransformOutputAt(Out, Index + 3) + Column * 4, R3, Out.Stream);
+		}
+	}
+}
+
+void ComposeTRSSSE4(const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 4 <= End; i += 4)
+	{
+		Vec4 M[16];
+		ComposeTRSColumns(In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeTRSScalar(In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+void ComposeMVPSSE4(const float* ViewProjection, const TransformSoA& In, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	size_t i = Begin;
+	for (; i + 4 <= End; i += 4)
+	{
+		Vec4 M[16];
+		ComposeMVPColumns(ViewProjection, In, i, M);
+		StoreMatrices(M, Out, i);
+	}
+	ComposeMVPScalar(ViewProjection, In, i, End, Out);
+	if (Out.Stream)
+		_mm_sfence();
+}
+
+// A column at a time, each result column is A's columns weighted by the elements of B's column.
+void MultiplyMat4SSE4(const float* A, size_t AStride, const float* B, size_t Begin, size_t End, const TransformOutput& Out)
+{
+	if (Begin == End)
+		return;
+	__m128 A0 = _mm_loadu_ps(A + Begin * AStride + 0);
+	__m128 A1 = _mm_loadu_ps(A + Begin * AStride + 4);
+	__m128 A2 = _mm_loadu_ps(A + Begin * AStride + 8);
+	__m128 A3 = _mm_loadu_ps(A + Begin * AStride + 12);
+	for (size_t i = Begin; i < End; i++)
+	{
+		if (AStride != 0)
+		{
+			const float* Left = A + i * AStride;
+			A0 = _mm_loadu_ps(Left + 0);
+			A1 = _mm_loadu_ps(Left + 4);
+			A2 = _mm_loadu_ps(Left + 8);
+			A3 = _mm_loadu_ps(Left + 12);
+		}
+		float* Dst = TransformOutputAt(Out, i);
+		for (int Column = 0; Column < 4; Column++)
+		{
+			__m128 Right = _mm_loadu_ps(B + i * 16 + Column * 4);
+			__m128 Result = _mm_mul_ps(A0, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(0, 0, 0, 0)));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A1, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(1, 1, 1, 1))));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A2, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(2, 2, 2, 2))));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A3, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(3, 3, 3, 3))));
+			StoreColumn(Dst + Column * 4, Result, Out.Stream);
+		}
+	}
+	if (Out.Stream)
+		_mm_sfence();
+}
+#endif
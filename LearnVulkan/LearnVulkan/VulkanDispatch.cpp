@@ -0,0 +1,81 @@
+#include "VulkanDispatch.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define VULKAN_DEFINE_FUNCTION(Name) PFN_##Name Name = nullptr;
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+#undef VULKAN_DEFINE_FUNCTION
+
+// Device functions in Loader mode come from here.
+static VkInstance LoadedInstance = VK_NULL_HANDLE;
+
+bool LoadVulkan()
+{
+	if (vkGetInstanceProcAddr)
+		return true;
+
+	// The library stays loaded for the rest of the process.
+#ifdef _WIN32
+	HMODULE Library = LoadLibraryA("vulkan-1.dll");
+	if (Library)
+		vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)(void(*)(void))GetProcAddress(Library, "vkGetInstanceProcAddr");
+#else
+#ifdef __APPLE__
+	const char* Names[] = { "libvulkan.dylib", "libvulkan.1.dylib", "libMoltenVK.dylib" };
+#else
+	const char* Names[] = { "libvulkan.so.1", "libvulkan.so" };
+#endif
+	for (const char* Name : Names)
+	{
+		if (void* Library = dlopen(Name, RTLD_NOW | RTLD_LOCAL))
+		{
+			vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)dlsym(Library, "vkGetInstanceProcAddr");
+			break;
+		}
+	}
+#endif
+	if (!vkGetInstanceProcAddr)
+		return false;
+
+#define VULKAN_LOAD_FUNCTION(Name) Name = (PFN_##Name)vkGetInstanceProcAddr(VK_NULL_HANDLE, #Name);
+	VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+	return vkCreateInstance != nullptr;
+}
+
+void LoadVulkanInstance(VkInstance Instance)
+{
+	LoadedInstance = Instance;
+#define VULKAN_LOAD_FUNCTION(Name) Name = (PFN_##Name)vkGetInstanceProcAddr(Instance, #Name);
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+}
+
+void LoadVulkanDevice(VkDevice Device, VulkanDispatchMode Mode)
+{
+	if (Mode == VulkanDispatchMode::Loader)
+	{
+#define VULKAN_LOAD_FUNCTION(Name) Name = (PFN_##Name)vkGetInstanceProcAddr(LoadedInstance, #Name);
+		VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+		return;
+	}
+	// Swapchain functions stay null when the extension is not enabled, nothing calls them then.
+#define VULKAN_LOAD_FUNCTION(Name) Name = (PFN_##Name)vkGetDeviceProcAddr(Device, #Name);
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// Include this instead of <vulkan/vulkan.h>. The loader is opened at runtime and
+// every Vulkan function the renderer calls is a pointer declared here under its
+// usual name, so call sites look the same but nothing links against the loader.
+#ifndef VK_NO_PROTOTYPES
+#define VK_NO_PROTOTYPES
+#endif
+#include <vulkan/vulkan.h>
+
+// Functions vkGetInstanceProcAddr returns without an instance.
+#define VULKAN_GLOBAL_FUNCTIONS(X) \
+	X(vkCreateInstance) \
+	X(vkEnumerateInstanceExtensionProperties) \
+	X(vkEnumerateInstanceLayerProperties)
+
+// Functions taking a VkInstance or VkPhysicalDevice.
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceFormatProperties) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkCreateDevice) \
+	X(vkGetDeviceProcAddr) \
+	X(vkDestroySurfaceKHR) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR)
+
+// Functions taking a VkDevice, VkQueue or VkCommandBuffer.
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkGetDeviceQueue) \
+	X(vkDeviceWaitIdle) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkInvalidateMappedMemoryRanges) \
+	X(vkBindBufferMemory) \
+	X(vkBindImageMemory) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkResetFences) \
+	X(vkWaitForFences) \
+	X(vkGetFenceStatus) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreatePipelineCache) \
+	X(vkDestroyPipelineCache) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateSampler) \
+	X(vkDestroySampler) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkFreeDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkResetCommandBuffer) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdDraw) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndirect) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDispatch) \
+	X(vkCmdCopyImage) \
+	X(vkCmdCopyImageToBuffer) \
+	X(vkCmdBlitImage) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdWriteTimestamp) \
+	X(vkCmdPushConstants) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR)
+
+#define VULKAN_DECLARE_FUNCTION(Name) extern PFN_##Name Name;
+extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+#undef VULKAN_DECLARE_FUNCTION
+
+enum class VulkanDispatchMode
+{
+	// Straight from the driver through vkGetDeviceProcAddr.
+	Device,
+	// The loader's trampolines, which look up the device's table on every call.
+	// What linking against the loader gives, kept to measure the difference.
+	Loader,
+};
+
+// Opens the loader library and fetches the global functions. False when there is none.
+bool LoadVulkan();
+// Instance functions. Device functions are fetched too, as trampolines, until
+// LoadVulkanDevice replaces them.
+void LoadVulkanInstance(VkInstance Instance);
+// The pointers are process wide: they belong to one device at a time, and no other
+// thread may call Vulkan while they are reloaded.
+void LoadVulkanDevice(VkDevice Device, VulkanDispatchMode Mode = VulkanDispatchMode::Device);